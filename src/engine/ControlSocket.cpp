@@ -1,12 +1,15 @@
 #include <filezilla.h>
 #include "ControlSocket.h"
+#include "checksum.h"
 #include "directorycache.h"
 #include "engineprivate.h"
 #include "local_path.h"
 #include "logging_private.h"
+#include "metrics.h"
 #include "proxy.h"
 #include "servercapabilities.h"
 #include "sizeformatting_base.h"
+#include "socket_tuning.h"
 
 #include <libfilezilla/event_loop.hpp>
 #include <libfilezilla/iputils.hpp>
@@ -34,6 +37,12 @@ CControlSocket::CControlSocket(CFileZillaEnginePrivate & engine)
 	, opLockManager_(engine.opLockManager_)
 	, logger_(engine.GetLogger())
 {
+	auto & metrics = engine_.GetMetrics();
+	transferBytes_[0] = &metrics.GetCounter("fz_transfer_bytes_total", "direction=\"upload\"");
+	transferBytes_[1] = &metrics.GetCounter("fz_transfer_bytes_total", "direction=\"download\"");
+	verifications_[static_cast<int>(verification_result::match)] = &metrics.GetCounter("fz_transfer_verifications_total", "result=\"match\"");
+	verifications_[static_cast<int>(verification_result::mismatch)] = &metrics.GetCounter("fz_transfer_verifications_total", "result=\"mismatch\"");
+	verifications_[static_cast<int>(verification_result::unavailable)] = &metrics.GetCounter("fz_transfer_verifications_total", "result=\"unavailable\"");
 }
 
 CControlSocket::~CControlSocket()
@@ -133,6 +142,8 @@ int CControlSocket::ResetOperation(int nErrorCode)
 
 		log(logmsg::debug_verbose, L"%s::Reset(%d) in state %d", oldOperation->name_, nErrorCode, oldOperation->opState);
 		nErrorCode = oldOperation->Reset(nErrorCode);
+
+		RecordOperationMetrics(*oldOperation, nErrorCode);
 	}
 	if (!operations_.empty()) {
 		int ret;
@@ -200,6 +211,12 @@ int CControlSocket::ResetOperation(int nErrorCode)
 					}
 				}
 				LogTransferResultMessage(nErrorCode, &data);
+
+				bool tmp{};
+				CTransferStatus const status = engine_.transfer_status_.Get(tmp);
+				if (!status.empty()) {
+					transferBytes_[data.download_ ? 1 : 0]->add(status.currentOffset - status.startOffset);
+				}
 			}
 			break;
 		default:
@@ -222,6 +239,43 @@ int CControlSocket::ResetOperation(int nErrorCode)
 	return engine_.ResetOperation(nErrorCode);
 }
 
+void CControlSocket::RecordOperationMetrics(COpData const& op, int result)
+{
+	auto const now = fz::monotonic_clock::now();
+
+	auto & metrics = engine_.GetMetrics();
+
+	auto & m = opMetrics_[op.name_];
+	if (!m.duration_) {
+		std::string const labels = "op=\"" + fz::to_utf8(op.name_) + "\"";
+		m.duration_ = &metrics.GetHistogram("fz_operation_duration_microseconds", labels);
+		m.ok_ = &metrics.GetCounter("fz_operations_total", labels + ",result=\"ok\"");
+		m.canceled_ = &metrics.GetCounter("fz_operations_total", labels + ",result=\"canceled\"");
+		m.error_ = &metrics.GetCounter("fz_operations_total", labels + ",result=\"error\"");
+	}
+
+	m.duration_->observe((now - op.startTime_).get_microseconds());
+
+	if (result == FZ_REPLY_OK) {
+		m.ok_->add();
+	}
+	else if ((result & FZ_REPLY_CANCELED) == FZ_REPLY_CANCELED) {
+		m.canceled_->add();
+	}
+	else {
+		m.error_->add();
+	}
+
+	if (metrics.Tracing()) {
+		metrics.AddSpan("operation", fz::to_utf8(op.name_), engine_.GetEngineId(), op.startTime_, now, result);
+	}
+}
+
+void CControlSocket::ReportVerification(verification_result result)
+{
+	verifications_[static_cast<int>(result)]->add();
+}
+
 void CControlSocket::UpdateCache(COpData const &, CServerPath const& serverPath, std::wstring const& remoteFile, int64_t fileSize)
 {
 	bool updated = engine_.GetDirectoryCache().UpdateFile(currentServer_, serverPath, remoteFile, true, CDirectoryCache::file, fileSize);
@@ -506,7 +560,7 @@ void CControlSocket::OnTimer(fz::timer_id)
 	if (timeout > 0) {
 		fz::duration elapsed = fz::monotonic_clock::now() - m_lastActivity;
 
-		if ((operations_.empty() || !operations_.back()->waitForAsyncRequest) && !opLockManager_.Waiting(this)) {
+		if ((operations_.empty() || !operations_.back()->waitForAsyncRequest) && !opLockManager_.Waiting(this, currentServer_)) {
 			if (elapsed > fz::duration::from_seconds(timeout)) {
 				log(logmsg::error, fztranslate("Connection timed out after %d second of inactivity", "Connection timed out after %d seconds of inactivity", timeout), timeout);
 				DoClose(FZ_REPLY_TIMEOUT);
@@ -618,12 +672,12 @@ int CControlSocket::ParseSubcommandResult(int prevResult, COpData const& opData)
 
 OpLock CControlSocket::Lock(locking_reason reason, CServerPath const& path, bool inclusive)
 {
-	return opLockManager_.Lock(this, reason, path, inclusive);
+	return opLockManager_.Lock(this, currentServer_, reason, path, inclusive);
 }
 
 void CControlSocket::OnObtainLock()
 {
-	if (opLockManager_.ObtainWaiting(this)) {
+	if (opLockManager_.ObtainWaiting(this, currentServer_)) {
 		SendNextCommand();
 	}
 }
@@ -754,6 +808,18 @@ void CRealControlSocket::OnSocketEvent(fz::socket_event_source*, fz::socket_even
 			OnSocketError(error);
 		}
 		else {
+			if (connectStart_) {
+				auto const now = fz::monotonic_clock::now();
+				if (!connectDuration_) {
+					connectDuration_ = &engine_.GetMetrics().GetHistogram("fz_socket_connect_duration_microseconds");
+				}
+				connectDuration_->observe((now - connectStart_).get_microseconds());
+				engine_.GetMetrics().AddSpan("socket", "connect", engine_.GetEngineId(), connectStart_, now);
+				connectStart_ = fz::monotonic_clock();
+			}
+			if (socket_ && tuning_) {
+				tuning_->Apply(*socket_, *this, -1);
+			}
 			OnConnect();
 		}
 		break;
@@ -762,6 +828,9 @@ void CRealControlSocket::OnSocketEvent(fz::socket_event_source*, fz::socket_even
 			OnSocketError(error);
 		}
 		else {
+			if (socket_ && tuning_) {
+				tuning_->Rearm(*socket_);
+			}
 			OnReceive();
 		}
 		break;
@@ -845,7 +914,13 @@ int CRealControlSocket::DoConnect(std::wstring const& host, unsigned int port)
 
 	ResetSocket();
 	socket_ = std::make_unique<fz::socket>(engine_.GetThreadPool(), nullptr);
-	ratelimit_layer_ = std::make_unique<CRatelimitLayer>(this, *socket_, engine_.GetRateLimiter());
+	tuning_ = std::make_unique<CTcpTuning>(currentServer_, engine_.GetOptions());
+	if (tuning_->GetBuffers() != CTcpTuning::buffers::options) {
+		// The global buffer size options are meant for FTP data connections,
+		// leave the buffers alone unless the site asks for something else.
+		tuning_->Prepare(*socket_, -1);
+	}
+	ratelimit_layer_ = std::make_unique<CRatelimitLayer>(this, *socket_, engine_.GetRateLimiter(), &engine_.GetMetrics(), "control");
 	active_layer_ = ratelimit_layer_.get();
 
 	const int proxy_type = engine_.GetOptions().GetOptionVal(OPTION_PROXY_TYPE);
@@ -872,6 +947,7 @@ int CRealControlSocket::DoConnect(std::wstring const& host, unsigned int port)
 
 	m_closed = false;
 
+	connectStart_ = fz::monotonic_clock::now();
 	int res = active_layer_->connect(fz::to_native(ConvertDomainName(host)), port);
 
 	if (res) {
@@ -982,6 +1058,53 @@ bool CControlSocket::SetFileExistsAction(CFileExistsNotification *pFileExistsNot
 			ResetOperation(FZ_REPLY_OK);
 		}
 		break;
+	case CFileExistsNotification::overwriteChanged:
+		if (pFileExistsNotification->localSize < 0 || pFileExistsNotification->localSize != pFileExistsNotification->remoteSize) {
+			SendNextCommand();
+			break;
+		}
+
+		if (pFileExistsNotification->localTime.empty() || pFileExistsNotification->remoteTime.empty()) {
+			data.sourceNewer_ = true;
+		}
+		else if (!pFileExistsNotification->localTime.compare(pFileExistsNotification->remoteTime)) {
+			// Same size and time, no need to look at the content
+			if (data.download_) {
+				auto const filename = data.remotePath_.FormatFilename(data.remoteFile_);
+				log(logmsg::status, _("Skipping download of %s"), filename);
+			}
+			else {
+				log(logmsg::status, _("Skipping upload of %s"), data.localFile_);
+			}
+			ResetOperation(FZ_REPLY_OK);
+			break;
+		}
+		else if (pFileExistsNotification->download) {
+			data.sourceNewer_ = pFileExistsNotification->localTime.earlier_than(pFileExistsNotification->remoteTime);
+		}
+		else {
+			data.sourceNewer_ = pFileExistsNotification->localTime.later_than(pFileExistsNotification->remoteTime);
+		}
+
+		if (CServer::ProtocolHasFeature(currentServer_.GetProtocol(), ProtocolFeature::Checksums)) {
+			// Checked by the protocol right before transferring
+			data.compareContent_ = true;
+			SendNextCommand();
+		}
+		else if (data.sourceNewer_) {
+			SendNextCommand();
+		}
+		else {
+			if (data.download_) {
+				auto const filename = data.remotePath_.FormatFilename(data.remoteFile_);
+				log(logmsg::status, _("Skipping download of %s"), filename);
+			}
+			else {
+				log(logmsg::status, _("Skipping upload of %s"), data.localFile_);
+			}
+			ResetOperation(FZ_REPLY_OK);
+		}
+		break;
 	case CFileExistsNotification::resume:
 		if (data.download_ && data.localFileSize_ >= 0) {
 			data.resume_ = true;
@@ -6,10 +6,15 @@
 #include <libfilezilla/buffer.hpp>
 #include <libfilezilla/socket.hpp>
 
+#include "metrics.h"
 #include "oplock_manager.h"
 #include "server.h"
 #include "serverpath.h"
 
+#include <map>
+
+enum class verification_result;
+
 class COpData
 {
 public:
@@ -46,6 +51,9 @@ public:
 	wchar_t const* const name_;
 
 	logmsg::type sendLogLevel_{logmsg::debug_verbose};
+
+	// For instrumentation, see CMetrics
+	fz::monotonic_clock const startTime_{fz::monotonic_clock::now()};
 };
 
 template<typename T>
@@ -103,9 +111,20 @@ public:
 
 	CFileTransferCommand::t_transferSettings transferSettings_;
 
+	// Set instead of localFile_ if not transferring a local file
+	std::shared_ptr<transfer_reader> reader_;
+	std::shared_ptr<transfer_writer> writer_;
+
 	// Set to true when sending the command which
 	// starts the actual transfer
 	bool transferInitiated_{};
+
+	// Set by the overwriteChanged file exists action if both files have the same size
+	// but different or unknown times. The protocol then compares checksums of the
+	// files before transferring. If it cannot, the file only gets transferred if
+	// sourceNewer_ is set.
+	bool compareContent_{};
+	bool sourceNewer_{};
 };
 
 class CMkdirOpData : public COpData
@@ -174,9 +193,7 @@ public:
 	virtual void Connect(CServer const& server, Credentials const& credentials) = 0;
 	virtual void List(CServerPath const& path = CServerPath(), std::wstring const& subDir = std::wstring(), int flags = 0);
 
-	virtual void FileTransfer(std::wstring const& localFile, CServerPath const& remotePath,
-							 std::wstring const& remoteFile, bool download,
-							 CFileTransferCommand::t_transferSettings const& transferSettings) = 0;
+	virtual void FileTransfer(CFileTransferCommand const& cmd) = 0;
 	virtual void RawCommand(std::wstring const& command = std::wstring());
 	virtual void Delete(CServerPath const& path, std::deque<std::wstring>&& files);
 	virtual void RemoveDir(CServerPath const& path = CServerPath(), std::wstring const& subDir = std::wstring());
@@ -231,6 +248,9 @@ public:
 	void log_raw(Args&& ... args) {
 		logger_.log_raw(std::forward<Args>(args)...);
 	}
+
+	void ReportVerification(verification_result result);
+
 protected:
 	virtual bool SetAsyncRequestReply(CAsyncRequestNotification *pNotification) = 0;
 	void SendDirectoryListingNotification(CServerPath const& path, bool failed);
@@ -283,10 +303,25 @@ protected:
 
 	void OnTimer(fz::timer_id id);
 	void OnObtainLock();
+
+	void RecordOperationMetrics(COpData const& op, int result);
+
+	// Looked up once, see CMetrics. Operations are keyed by their name.
+	struct op_metrics final
+	{
+		CMetrics::histogram* duration_{};
+		CMetrics::counter* ok_{};
+		CMetrics::counter* canceled_{};
+		CMetrics::counter* error_{};
+	};
+	std::map<wchar_t const*, op_metrics> opMetrics_;
+	CMetrics::counter* transferBytes_[2]{};
+	CMetrics::counter* verifications_[3]{};
 };
 
 class CProxySocket;
 class CRatelimitLayer;
+class CTcpTuning;
 
 class CRealControlSocket : public CControlSocket
 {
@@ -321,7 +356,12 @@ protected:
 	std::unique_ptr<CProxySocket> proxy_layer_;
 	fz::socket_layer* active_layer_{};
 
+	std::unique_ptr<CTcpTuning> tuning_;
+
 	fz::buffer send_buffer_;
+
+	fz::monotonic_clock connectStart_;
+	CMetrics::histogram* connectDuration_{};
 };
 
 #endif
@@ -2,10 +2,18 @@
 
 #include "backend.h"
 
-CRatelimitLayer::CRatelimitLayer(fz::event_handler* pEvtHandler, fz::socket_interface& next_layer, CRateLimiter& rateLimiter)
+CRatelimitLayer::CRatelimitLayer(fz::event_handler* pEvtHandler, fz::socket_interface& next_layer, CRateLimiter& rateLimiter, CMetrics* metrics, char const* kind)
 	: fz::socket_layer(pEvtHandler, next_layer, true)
 	, m_rateLimiter(rateLimiter)
 {
+	if (metrics) {
+		std::string const labels = std::string("socket=\"") + kind + "\"";
+		received_ = &metrics->GetCounter("fz_socket_received_bytes_total", labels);
+		sent_ = &metrics->GetCounter("fz_socket_sent_bytes_total", labels);
+		throttled_[CRateLimiter::inbound] = &metrics->GetCounter("fz_socket_throttled_total", labels + ",direction=\"inbound\"");
+		throttled_[CRateLimiter::outbound] = &metrics->GetCounter("fz_socket_throttled_total", labels + ",direction=\"outbound\"");
+	}
+
 	next_layer_.set_event_handler(pEvtHandler);
 	m_rateLimiter.AddObject(this);
 }
@@ -20,6 +28,9 @@ int CRatelimitLayer::write(const void *buffer, unsigned int len, int& error)
 {
 	int64_t max = GetAvailableBytes(CRateLimiter::outbound);
 	if (max == 0) {
+		if (throttled_[CRateLimiter::outbound]) {
+			throttled_[CRateLimiter::outbound]->add();
+		}
 		Wait(CRateLimiter::outbound);
 		error = EAGAIN;
 		return -1;
@@ -30,8 +41,13 @@ int CRatelimitLayer::write(const void *buffer, unsigned int len, int& error)
 
 	int written = next_layer_.write(buffer, len, error);
 
-	if (written > 0 && max != -1) {
-		UpdateUsage(CRateLimiter::outbound, written);
+	if (written > 0) {
+		if (max != -1) {
+			UpdateUsage(CRateLimiter::outbound, written);
+		}
+		if (sent_) {
+			sent_->add(written);
+		}
 	}
 
 	return written;
@@ -41,6 +57,9 @@ int CRatelimitLayer::read(void *buffer, unsigned int len, int& error)
 {
 	int64_t max = GetAvailableBytes(CRateLimiter::inbound);
 	if (max == 0) {
+		if (throttled_[CRateLimiter::inbound]) {
+			throttled_[CRateLimiter::inbound]->add();
+		}
 		Wait(CRateLimiter::inbound);
 		error = EAGAIN;
 		return -1;
@@ -51,8 +70,13 @@ int CRatelimitLayer::read(void *buffer, unsigned int len, int& error)
 
 	int read = next_layer_.read(buffer, len, error);
 
-	if (read > 0 && max != -1) {
-		UpdateUsage(CRateLimiter::inbound, read);
+	if (read > 0) {
+		if (max != -1) {
+			UpdateUsage(CRateLimiter::inbound, read);
+		}
+		if (received_) {
+			received_->add(read);
+		}
 	}
 
 	return read;
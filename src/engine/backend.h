@@ -3,12 +3,14 @@
 
 #include <libfilezilla/socket.hpp>
 
+#include "metrics.h"
 #include "ratelimiter.h"
 
 class CRatelimitLayer final : public fz::socket_layer, public CRateLimiterObject
 {
 public:
-	CRatelimitLayer(fz::event_handler* pEvtHandler, fz::socket_interface& next_layer, CRateLimiter& rateLimiter);
+	// kind is used as label on the socket metrics, e.g. "control" or "data"
+	CRatelimitLayer(fz::event_handler* pEvtHandler, fz::socket_interface& next_layer, CRateLimiter& rateLimiter, CMetrics* metrics = nullptr, char const* kind = "");
 	virtual ~CRatelimitLayer();
 
 	virtual int read(void *buffer, unsigned int size, int& error) override;
@@ -30,6 +32,10 @@ protected:
 	virtual void OnRateAvailable(CRateLimiter::rate_direction direction) override;
 
 	CRateLimiter& m_rateLimiter;
+
+	CMetrics::counter* received_{};
+	CMetrics::counter* sent_{};
+	CMetrics::counter* throttled_[2]{};
 };
 
 #endif
@@ -0,0 +1,140 @@
+#include <filezilla.h>
+
+#include "checksum.h"
+
+#include <libfilezilla/encode.hpp>
+
+bool ParseHashAlgorithm(std::wstring const& name, fz::hash_algorithm & algorithm)
+{
+	std::wstring normalized;
+	for (auto const& c : name) {
+		if (c != '-' && c != '_') {
+			normalized += c;
+		}
+	}
+	normalized = fz::str_toupper_ascii(normalized);
+
+	if (normalized == L"SHA512") {
+		algorithm = fz::hash_algorithm::sha512;
+	}
+	else if (normalized == L"SHA256") {
+		algorithm = fz::hash_algorithm::sha256;
+	}
+	else if (normalized == L"SHA1" || normalized == L"SHA") {
+		algorithm = fz::hash_algorithm::sha1;
+	}
+	else if (normalized == L"MD5") {
+		algorithm = fz::hash_algorithm::md5;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+std::wstring GetHashAlgorithmName(fz::hash_algorithm algorithm)
+{
+	switch (algorithm) {
+	case fz::hash_algorithm::md5:
+		return L"MD5";
+	case fz::hash_algorithm::sha1:
+		return L"SHA-1";
+	case fz::hash_algorithm::sha256:
+		return L"SHA-256";
+	case fz::hash_algorithm::sha512:
+		return L"SHA-512";
+	}
+
+	return std::wstring();
+}
+
+size_t GetDigestSize(fz::hash_algorithm algorithm)
+{
+	switch (algorithm) {
+	case fz::hash_algorithm::md5:
+		return 16;
+	case fz::hash_algorithm::sha1:
+		return 20;
+	case fz::hash_algorithm::sha256:
+		return 32;
+	case fz::hash_algorithm::sha512:
+		return 64;
+	}
+
+	return 0;
+}
+
+size_t GetDigestSize(file_hash hash)
+{
+	switch (hash) {
+	case file_hash::md5:
+		return 16;
+	case file_hash::sha1:
+		return 20;
+	case file_hash::sha256:
+		return 32;
+	case file_hash::sha512:
+		return 64;
+	case file_hash::crc32:
+		return 4;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+int GetHashStrength(fz::hash_algorithm algorithm)
+{
+	switch (algorithm) {
+	case fz::hash_algorithm::md5:
+		return 0;
+	case fz::hash_algorithm::sha1:
+		return 1;
+	case fz::hash_algorithm::sha256:
+		return 2;
+	case fz::hash_algorithm::sha512:
+		return 3;
+	}
+
+	return -1;
+}
+
+file_hash ToFileHash(fz::hash_algorithm algorithm)
+{
+	switch (algorithm) {
+	case fz::hash_algorithm::md5:
+		return file_hash::md5;
+	case fz::hash_algorithm::sha1:
+		return file_hash::sha1;
+	case fz::hash_algorithm::sha256:
+		return file_hash::sha256;
+	default:
+		return file_hash::sha512;
+	}
+}
+
+std::vector<uint8_t> FindHexDigest(std::wstring const& reply, fz::hash_algorithm algorithm)
+{
+	return FindHexDigest(reply, GetDigestSize(algorithm));
+}
+
+std::vector<uint8_t> FindHexDigest(std::wstring const& reply, size_t size)
+{
+	if (!size) {
+		return std::vector<uint8_t>();
+	}
+
+	for (auto const& token : fz::strtok(reply, L" \t")) {
+		if (token.size() != size * 2) {
+			continue;
+		}
+		auto digest = fz::hex_decode(token);
+		if (digest.size() == size) {
+			return digest;
+		}
+	}
+
+	return std::vector<uint8_t>();
+}
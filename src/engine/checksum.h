@@ -0,0 +1,40 @@
+#ifndef FILEZILLA_ENGINE_CHECKSUM_HEADER
+#define FILEZILLA_ENGINE_CHECKSUM_HEADER
+
+#include "hash_service.h"
+
+#include <libfilezilla/hash.hpp>
+
+#include <vector>
+
+// Helpers for verifying transferred files against the checksums reported by servers
+
+// Accepts names like "SHA-256", "sha256", "SHA" or "MD5". Returns false if the algorithm isn't supported.
+bool ParseHashAlgorithm(std::wstring const& name, fz::hash_algorithm & algorithm);
+
+std::wstring GetHashAlgorithmName(fz::hash_algorithm algorithm);
+
+size_t GetDigestSize(fz::hash_algorithm algorithm);
+size_t GetDigestSize(file_hash hash);
+
+// Higher is stronger
+int GetHashStrength(fz::hash_algorithm algorithm);
+
+// For hashing local files using CHashService
+file_hash ToFileHash(fz::hash_algorithm algorithm);
+
+// Returns the first token of the reply that is a hex-encoded digest of the given algorithm,
+// or an empty vector if there is none.
+std::vector<uint8_t> FindHexDigest(std::wstring const& reply, fz::hash_algorithm algorithm);
+
+// Same as above, for a digest of the given size in bytes
+std::vector<uint8_t> FindHexDigest(std::wstring const& reply, size_t size);
+
+enum class verification_result
+{
+	match,
+	mismatch,
+	unavailable
+};
+
+#endif
@@ -64,6 +64,26 @@ CFileTransferCommand::CFileTransferCommand(std::wstring const& localFile, CServe
 {
 }
 
+CFileTransferCommand::CFileTransferCommand(std::shared_ptr<transfer_reader> const& reader, CServerPath const& remotePath,
+										   std::wstring const& remoteFile,
+										   CFileTransferCommand::t_transferSettings const& transferSettings)
+	: m_remotePath(remotePath), m_remoteFile(remoteFile)
+	, m_download(false)
+	, m_transferSettings(transferSettings)
+	, reader_(reader)
+{
+}
+
+CFileTransferCommand::CFileTransferCommand(std::shared_ptr<transfer_writer> const& writer, CServerPath const& remotePath,
+										   std::wstring const& remoteFile,
+										   CFileTransferCommand::t_transferSettings const& transferSettings)
+	: m_remotePath(remotePath), m_remoteFile(remoteFile)
+	, m_download(true)
+	, m_transferSettings(transferSettings)
+	, writer_(writer)
+{
+}
+
 std::wstring CFileTransferCommand::GetLocalFile() const
 {
 	return m_localFile;
@@ -424,10 +424,9 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 					UpdateFile(server, pathFrom, fileTo, true, dir);
 				}
 				else {
-					listing.get(i).name = fileTo;
+					listing.RenameEntry(i, fileTo);
 					listing.get(i).flags |= CDirentry::flag_unsure;
 					listing.m_flags |= CDirectoryListing::unsure_unknown;
-					listing.ClearFindMap();
 				}
 			}
 			return;
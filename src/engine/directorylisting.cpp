@@ -50,36 +50,78 @@ bool CDirentry::operator==(const CDirentry &op) const
 	return true;
 }
 
+fz::shared_value<std::wstring> const& CDirentry::empty_string()
+{
+	static fz::shared_value<std::wstring> const empty;
+	return empty;
+}
+
+size_t CDirectoryListing::size() const
+{
+	if (!m_entries || m_entries->blocks.empty()) {
+		return 0;
+	}
+	return m_entries->starts.back() + m_entries->blocks.back()->size();
+}
+
+size_t CDirectoryListing::find_block(size_t index) const
+{
+	// No block holds more than block_size entries, so the block cannot come
+	// before this one. Unless entries got removed it is this very block.
+	auto const& starts = m_entries->starts;
+	size_t b = std::min(index / block_size, starts.size() - 1);
+	if (b + 1 < starts.size() && starts[b + 1] <= index) {
+		b = std::upper_bound(starts.cbegin() + b + 1, starts.cend(), index) - starts.cbegin() - 1;
+	}
+	return b;
+}
+
 const CDirentry& CDirectoryListing::operator[](size_t index) const
 {
-	return *(*m_entries)[index];
+	size_t const b = find_block(index);
+	return (*m_entries->blocks[b])[index - m_entries->starts[b]];
 }
 
 CDirentry& CDirectoryListing::get(size_t index)
 {
 	// Commented out, too heavy speed penalty
-	// assert(index < m_entryCount);
-	return m_entries.get()[index].get();
+	// assert(index < size());
+	size_t const b = find_block(index);
+	auto & own_entries = m_entries.get();
+	return own_entries.blocks[b].get()[index - own_entries.starts[b]];
 }
 
-void CDirectoryListing::Assign(std::vector<fz::shared_value<CDirentry>> && entries)
+void CDirectoryListing::Assign(std::vector<CDirentry> && entries)
 {
-	std::vector<fz::shared_value<CDirentry>> & own_entries = m_entries.get();
-	own_entries = std::move(entries);
+	auto & own_entries = m_entries.get();
+	auto & blocks = own_entries.blocks;
+	blocks.clear();
+	blocks.reserve((entries.size() + block_size - 1) / block_size);
+	own_entries.starts.clear();
+	own_entries.starts.reserve(blocks.capacity());
 
 	m_flags &= ~(listing_has_dirs | listing_has_perms | listing_has_usergroup);
 
-	for (auto const& entry : own_entries) {
-		if (entry->is_dir()) {
-			m_flags |= listing_has_dirs;
-		}
-		if (!entry->permissions->empty()) {
-			m_flags |= listing_has_perms;
-		}
-		if (!entry->ownerGroup->empty()) {
-			m_flags |= listing_has_usergroup;
+	for (size_t i = 0; i < entries.size(); i += block_size) {
+		blocks.emplace_back();
+		own_entries.starts.push_back(i);
+		auto & b = blocks.back().get();
+		b.reserve(std::min(block_size, entries.size() - i));
+		for (size_t j = i; j < entries.size() && j < i + block_size; ++j) {
+			auto & entry = entries[j];
+			if (entry.is_dir()) {
+				m_flags |= listing_has_dirs;
+			}
+			if (!entry.permissions->empty()) {
+				m_flags |= listing_has_perms;
+			}
+			if (!entry.ownerGroup->empty()) {
+				m_flags |= listing_has_usergroup;
+			}
+			b.emplace_back(std::move(entry));
 		}
 	}
+	entries.clear();
 
 	m_searchmap_case.clear();
 	m_searchmap_nocase.clear();
@@ -91,12 +133,20 @@ bool CDirectoryListing::RemoveEntry(size_t index)
 		return false;
 	}
 
-	m_searchmap_case.clear();
-	m_searchmap_nocase.clear();
+	// Keep the search maps, only the indexes after the removed entry change
+	std::wstring const& name = (*this)[index].name;
+	if (m_searchmap_case && index < m_searchmap_case->count()) {
+		m_searchmap_case.get().remove(name_hash(name), index);
+	}
+	if (m_searchmap_nocase && index < m_searchmap_nocase->count()) {
+		m_searchmap_nocase.get().remove(name_hash(fz::str_tolower(name)), index);
+	}
 
-	std::vector<fz::shared_value<CDirentry> >& entries = m_entries.get();
-	std::vector<fz::shared_value<CDirentry> >::iterator iter = entries.begin() + index;
-	if ((*iter)->is_dir()) {
+	size_t const b = find_block(index);
+	auto & own_entries = m_entries.get();
+	auto & entries = own_entries.blocks[b].get();
+	auto iter = entries.begin() + (index - own_entries.starts[b]);
+	if (iter->is_dir()) {
 		m_flags |= CDirectoryListing::unsure_dir_removed;
 	}
 	else {
@@ -104,48 +154,105 @@ bool CDirectoryListing::RemoveEntry(size_t index)
 	}
 	entries.erase(iter);
 
+	// Following blocks stay shared, only their offsets change
+	for (size_t i = b + 1; i < own_entries.starts.size(); ++i) {
+		--own_entries.starts[i];
+	}
+	if (entries.empty()) {
+		own_entries.blocks.erase(own_entries.blocks.begin() + b);
+		own_entries.starts.erase(own_entries.starts.begin() + b);
+	}
+
 	return true;
 }
 
 void CDirectoryListing::GetFilenames(std::vector<std::wstring> &names) const
 {
 	names.reserve(size());
-	for (size_t i = 0; i < size(); ++i) {
-		names.push_back((*m_entries)[i]->name);
+	if (m_entries) {
+		for (auto const& b : m_entries->blocks) {
+			for (auto const& entry : *b) {
+				names.push_back(entry.name);
+			}
+		}
+	}
+}
+
+void CDirectoryListing::RenameEntry(size_t index, std::wstring const& name)
+{
+	std::wstring & own_name = get(index).name;
+
+	if (m_searchmap_case && index < m_searchmap_case->count()) {
+		auto & searchmap_case = m_searchmap_case.get();
+		searchmap_case.erase(name_hash(own_name), index);
+		searchmap_case.insert(name_hash(name), index);
+	}
+	if (m_searchmap_nocase && index < m_searchmap_nocase->count()) {
+		auto & searchmap_nocase = m_searchmap_nocase.get();
+		searchmap_nocase.erase(name_hash(fz::str_tolower(own_name)), index);
+		searchmap_nocase.insert(name_hash(fz::str_tolower(name)), index);
 	}
+
+	own_name = name;
+}
+
+uint32_t CDirectoryListing::name_hash(std::wstring const& name)
+{
+	size_t const h = std::hash<std::wstring>()(name);
+	return static_cast<uint32_t>(h ^ (static_cast<uint64_t>(h) >> 32));
 }
 
 size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
 {
-	if (!m_entries || m_entries->empty()) {
+	return FindFile(m_searchmap_case, name, false);
+}
+
+size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
+{
+	return FindFile(m_searchmap_nocase, fz::str_tolower(name), true);
+}
+
+size_t CDirectoryListing::FindFile(fz::shared_optional<name_index> & index, std::wstring const& name, bool nocase) const
+{
+	size_t const count = size();
+	if (!count) {
 		return std::string::npos;
 	}
 
-	if (!m_searchmap_case) {
-		m_searchmap_case.get();
-	}
+	uint32_t const hash = name_hash(name);
 
 	// Search map
-	auto iter = m_searchmap_case->find(name);
-	if (iter != m_searchmap_case->end()) {
-		return iter->second;
+	if (index) {
+		size_t const found = index->find(hash, [&](size_t i) {
+			return nocase ? fz::str_tolower((*this)[i].name) == name : (*this)[i].name == name;
+		});
+		if (found != std::string::npos) {
+			return found;
+		}
 	}
 
-	size_t i = m_searchmap_case->size();
-	if (i == m_entries->size()) {
+	size_t i = index ? index->count() : 0;
+	if (i == count) {
 		return std::string::npos;
 	}
 
-	auto & searchmap_case = m_searchmap_case.get();
+	auto & own_index = index.get();
 
 	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring const& entry_name = (*entry_iter)->name;
-		searchmap_case.emplace(entry_name, i);
-
-		if (entry_name == name) {
-			return i;
+	for (; i < count; ++i) {
+		if (nocase) {
+			std::wstring const entry_lwr = fz::str_tolower((*this)[i].name);
+			own_index.insert(name_hash(entry_lwr), i);
+			if (entry_lwr == name) {
+				return i;
+			}
+		}
+		else {
+			std::wstring const& entry_name = (*this)[i].name;
+			own_index.insert(name_hash(entry_name), i);
+			if (entry_name == name) {
+				return i;
+			}
 		}
 	}
 
@@ -153,59 +260,143 @@ size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
 	return std::string::npos;
 }
 
-size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
+void CDirectoryListing::name_index::insert(uint32_t hash, size_t index)
 {
-	if (!m_entries || m_entries->empty()) {
-		return std::string::npos;
+	if ((count_ + 1) * 4 > slots_.size() * 3) {
+		grow();
 	}
 
-	if (!m_searchmap_nocase) {
-		m_searchmap_nocase.get();
+	size_t const mask = slots_.size() - 1;
+	size_t pos = hash & mask;
+	while (slots_[pos].index != empty) {
+		pos = (pos + 1) & mask;
 	}
+	slots_[pos] = slot{hash, stored(index)};
+	++count_;
+}
 
-	std::wstring lwr = fz::str_tolower(name);
+void CDirectoryListing::name_index::erase(uint32_t hash, size_t index)
+{
+	erase_stored(hash, stored(index));
+}
 
-	// Search map
-	auto iter = m_searchmap_nocase->find(lwr);
-	if (iter != m_searchmap_nocase->end()) {
-		return iter->second;
+void CDirectoryListing::name_index::erase_stored(uint32_t hash, uint32_t value)
+{
+	if (slots_.empty()) {
+		return;
 	}
 
-	size_t i = m_searchmap_nocase->size();
-	if (i == m_entries->size()) {
-		return std::string::npos;
+	size_t const mask = slots_.size() - 1;
+	size_t pos = hash & mask;
+	while (slots_[pos].index != value) {
+		if (slots_[pos].index == empty) {
+			return;
+		}
+		pos = (pos + 1) & mask;
 	}
+	--count_;
+
+	// Backward shift deletion, moves later entries of the probe sequence
+	// into the hole so that lookups never need tombstones.
+	size_t next = pos;
+	for (;;) {
+		slots_[pos].index = empty;
+		for (;;) {
+			next = (next + 1) & mask;
+			if (slots_[next].index == empty) {
+				return;
+			}
+			size_t const home = slots_[next].hash & mask;
+			// Stop at entries whose home lies cyclically in (pos, next]
+			if (pos <= next ? (pos < home && home <= next) : (pos < home || home <= next)) {
+				continue;
+			}
+			break;
+		}
+		slots_[pos] = slots_[next];
+		pos = next;
+	}
+}
 
-	auto& searchmap_nocase = m_searchmap_nocase.get();
+void CDirectoryListing::name_index::remove(uint32_t hash, size_t index)
+{
+	uint32_t const s = stored(index);
+	erase_stored(hash, s);
+	removed_.insert(std::upper_bound(removed_.begin(), removed_.end(), s), s);
+
+	// Recording a removal only moves the few recorded ones, rewriting the
+	// slots happens once every n/16 removals.
+	if (removed_.size() * 16 > slots_.size()) {
+		compact();
+	}
+}
 
-	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring entry_lrw = fz::str_tolower((*entry_iter)->name);
-		searchmap_nocase.emplace(entry_lrw, i);
+size_t CDirectoryListing::name_index::current(uint32_t stored) const
+{
+	return stored - (std::lower_bound(removed_.begin(), removed_.end(), stored) - removed_.begin());
+}
 
-		if (entry_lrw == lwr) {
-			return i;
+uint32_t CDirectoryListing::name_index::stored(size_t index) const
+{
+	// removed_[i] - i is the index the entry following the i-th removed
+	// one has now, it never decreases. Count the removals at or before
+	// the wanted entry.
+	size_t low = 0;
+	size_t high = removed_.size();
+	while (low < high) {
+		size_t const mid = low + (high - low) / 2;
+		if (removed_[mid] - mid <= index) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
 		}
 	}
+	return static_cast<uint32_t>(index + low);
+}
 
-	// Map is complete, item not in it
-	return std::string::npos;
+void CDirectoryListing::name_index::compact()
+{
+	for (auto & s : slots_) {
+		if (s.index != empty) {
+			s.index = static_cast<uint32_t>(current(s.index));
+		}
+	}
+	removed_.clear();
 }
 
-void CDirectoryListing::ClearFindMap()
+void CDirectoryListing::name_index::grow()
 {
-	if (!m_searchmap_case) {
-		return;
+	std::vector<slot> old(slots_.empty() ? 16 : slots_.size() * 2, slot{0, empty});
+	old.swap(slots_);
+
+	size_t const mask = slots_.size() - 1;
+	for (auto const& s : old) {
+		if (s.index != empty) {
+			size_t pos = s.hash & mask;
+			while (slots_[pos].index != empty) {
+				pos = (pos + 1) & mask;
+			}
+			slots_[pos] = s;
+		}
 	}
+}
 
+void CDirectoryListing::ClearFindMap()
+{
 	m_searchmap_case.clear();
 	m_searchmap_nocase.clear();
 }
 
 void CDirectoryListing::Append(CDirentry&& entry)
 {
-	m_entries.get().emplace_back(entry);
+	size_t const count = size();
+	auto & own_entries = m_entries.get();
+	if (own_entries.blocks.empty() || own_entries.blocks.back()->size() >= block_size) {
+		own_entries.blocks.emplace_back();
+		own_entries.starts.push_back(count);
+	}
+	own_entries.blocks.back().get().emplace_back(std::move(entry));
 }
 
 bool CheckInclusion(const CDirectoryListing& listing1, const CDirectoryListing& listing2)
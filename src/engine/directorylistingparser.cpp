@@ -747,8 +747,7 @@ CDirectoryListing CDirectoryListingParser::Parse(const CServerPath &path)
 
 bool CDirectoryListingParser::ParseLine(CLine &line, ServerType const serverType, bool concatenated, CDirentry const* override)
 {
-	fz::shared_value<CDirentry> refEntry;
-	CDirentry & entry = refEntry.get();
+	CDirentry entry;
 
 	bool res;
 	int ires;
@@ -897,7 +896,7 @@ done:
 		}
 	}
 
-	entries_.emplace_back(std::move(refEntry));
+	entries_.emplace_back(std::move(entry));
 
 skip:
 	m_maybeMultilineVms = false;
@@ -130,7 +130,7 @@ protected:
 	int m_currentOffset{};
 
 	std::deque<t_list> m_DataList;
-	std::vector<fz::shared_value<CDirentry>> entries_;
+	std::vector<CDirentry> entries_;
 	int64_t m_totalData{};
 
 	CLine *m_prevLine{};
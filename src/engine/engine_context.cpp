@@ -2,7 +2,9 @@
 #include "engine_context.h"
 
 #include "directorycache.h"
+#include "hash_service.h"
 #include "logging_private.h"
+#include "metrics.h"
 #include "oplock_manager.h"
 #include "pathcache.h"
 #include "ratelimiter.h"
@@ -19,17 +21,35 @@ public:
 		, tlsSystemTrustStore_(pool_)
 	{
 		directory_cache_.SetTtl(fz::duration::from_seconds(options.GetOptionVal(OPTION_CACHE_TTL)));
+
+		metrics_file_ = options.GetOption(OPTION_METRICS_FILE);
+		trace_file_ = options.GetOption(OPTION_TRACE_FILE);
+		if (!trace_file_.empty()) {
+			metrics_.EnableTracing(262144);
+		}
 	}
 
 	~Impl()
 	{
+		if (!metrics_file_.empty()) {
+			metrics_.WritePrometheus(metrics_file_);
+		}
+		if (!trace_file_.empty()) {
+			metrics_.WriteChromeTrace(trace_file_);
+		}
 	}
 
+	// Constructed first, destroyed last, everything else may report into it
+	CMetrics metrics_;
+	std::wstring metrics_file_;
+	std::wstring trace_file_;
+
 	fz::thread_pool pool_;
 	fz::event_loop loop_{pool_};
 	CRateLimiter limiter_;
 	CDirectoryCache directory_cache_;
-	CPathCache path_cache_;
+	CPathCache path_cache_{&metrics_};
+	CHashService hash_service_{pool_};
 	OpLockManager opLockManager_;
 	fz::tls_system_trust_store tlsSystemTrustStore_;
 };
@@ -70,11 +90,21 @@ CPathCache& CFileZillaEngineContext::GetPathCache()
 	return impl_->path_cache_;
 }
 
+CHashService& CFileZillaEngineContext::GetHashService()
+{
+	return impl_->hash_service_;
+}
+
 OpLockManager& CFileZillaEngineContext::GetOpLockManager()
 {
 	return impl_->opLockManager_;
 }
 
+CMetrics& CFileZillaEngineContext::GetMetrics()
+{
+	return impl_->metrics_;
+}
+
 fz::tls_system_trust_store& CFileZillaEngineContext::GetTlsSystemTrustStore()
 {
 	return impl_->tlsSystemTrustStore_;
@@ -71,6 +71,10 @@ int CFtpChangeDirOpData::Send()
 		cmd = L"PWD";
 		break;
 	case cwd_cwd:
+		if (!tryMkdOnFail_ && engine_.GetPathCache().LookupFailure(currentServer_, path_)) {
+			log(logmsg::debug_info, L"Changing into '%s' failed recently, not trying again.", path_.GetPath());
+			return FZ_REPLY_ERROR;
+		}
 		if (tryMkdOnFail_ && !opLock_) {
 			opLock_ = controlSocket_.Lock(locking_reason::mkdir, path_);
 		}
@@ -87,6 +91,10 @@ int CFtpChangeDirOpData::Send()
 		if (subDir_.empty()) {
 			return FZ_REPLY_INTERNALERROR;
 		}
+		else if (!link_discovery_ && engine_.GetPathCache().LookupFailure(currentServer_, path_, subDir_)) {
+			log(logmsg::debug_info, L"Changing into '%s' failed recently, not trying again.", path_.FormatFilename(subDir_));
+			return FZ_REPLY_ERROR;
+		}
 		else if (subDir_ == L".." && !tried_cdup_) {
 			cmd = L"CDUP";
 		}
@@ -134,6 +142,10 @@ int CFtpChangeDirOpData::ParseResponse()
 				return FZ_REPLY_CONTINUE;
 			}
 			else {
+				// Only permanent failures are worth remembering
+				if (code == 5) {
+					engine_.GetPathCache().StoreFailure(currentServer_, path_);
+				}
 				error = true;
 			}
 		}
@@ -194,6 +206,9 @@ int CFtpChangeDirOpData::ParseResponse()
 				return FZ_REPLY_LINKNOTDIR;
 			}
 			else {
+				if (code == 5) {
+					engine_.GetPathCache().StoreFailure(currentServer_, path_, subDir_);
+				}
 				error = true;
 			}
 		}
@@ -0,0 +1,114 @@
+#include <filezilla.h>
+
+#include "dataprefetch.h"
+#include "engineprivate.h"
+#include "ftpcontrolsocket.h"
+#include "socket_tuning.h"
+
+namespace {
+// Servers may close idle data connections
+auto const max_idle = fz::duration::from_seconds(10);
+}
+
+CFtpDataPrefetch::CFtpDataPrefetch(CFtpControlSocket & controlSocket)
+	: fz::event_handler(controlSocket.event_loop_)
+	, controlSocket_(controlSocket)
+{
+}
+
+CFtpDataPrefetch::~CFtpDataPrefetch()
+{
+	remove_handler();
+	socket_.reset();
+}
+
+bool CFtpDataPrefetch::Connect(std::wstring const& host, int port)
+{
+	Drop();
+
+	socket_ = std::make_unique<fz::socket>(controlSocket_.engine_.GetThreadPool(), this);
+
+	CTcpTuning tuning(controlSocket_.currentServer_, controlSocket_.engine_.GetOptions());
+	tuning.Prepare(*socket_, controlSocket_.m_rtt.GetLatency());
+
+	// Same as in CTransferSocket::SetupPassiveTransfer
+	std::string const ip = fz::to_utf8(host);
+	if (controlSocket_.socket_->peer_ip(true) == ip || controlSocket_.socket_->peer_ip(false) == ip) {
+		socket_->bind(controlSocket_.socket_->local_ip());
+	}
+
+	int const res = socket_->connect(fz::to_native(host), port, fz::address_type::unknown);
+	if (res) {
+		controlSocket_.log(logmsg::debug_info, L"Could not open data connection in advance: %s", fz::socket_error_description(res));
+		socket_.reset();
+		return false;
+	}
+
+	timer_ = add_timer(max_idle, true);
+
+	return true;
+}
+
+std::unique_ptr<fz::socket> CFtpDataPrefetch::Take()
+{
+	stop_timer(timer_);
+	timer_ = 0;
+
+	if (socket_) {
+		// Discards pending events, the new owner checks the state instead
+		socket_->set_event_handler(nullptr);
+	}
+
+	return std::move(socket_);
+}
+
+void CFtpDataPrefetch::Drop()
+{
+	stop_timer(timer_);
+	timer_ = 0;
+
+	socket_.reset();
+}
+
+void CFtpDataPrefetch::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event, fz::timer_event>(ev, this,
+		&CFtpDataPrefetch::OnSocketEvent,
+		&CFtpDataPrefetch::OnTimer);
+}
+
+void CFtpDataPrefetch::OnSocketEvent(fz::socket_event_source*, fz::socket_event_flag t, int error)
+{
+	if (!socket_) {
+		return;
+	}
+
+	switch (t)
+	{
+	case fz::socket_event_flag::connection:
+		if (error) {
+			controlSocket_.log(logmsg::debug_info, L"Could not open data connection in advance: %s", fz::socket_error_description(error));
+			Drop();
+		}
+		else {
+			controlSocket_.log(logmsg::debug_verbose, L"Opened data connection in advance");
+		}
+		break;
+	case fz::socket_event_flag::read:
+		// Nothing is to be received before the transfer command, so the
+		// connection either got closed or is in some unknown state.
+		controlSocket_.log(logmsg::debug_info, L"Server closed data connection opened in advance");
+		Drop();
+		break;
+	default:
+		break;
+	}
+}
+
+void CFtpDataPrefetch::OnTimer(fz::timer_id)
+{
+	if (socket_) {
+		controlSocket_.log(logmsg::debug_verbose, L"Data connection opened in advance has not been used, closing it");
+	}
+	Drop();
+}
@@ -0,0 +1,47 @@
+#ifndef FILEZILLA_ENGINE_FTP_DATAPREFETCH_HEADER
+#define FILEZILLA_ENGINE_FTP_DATAPREFETCH_HEADER
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/socket.hpp>
+
+#include <memory>
+
+class CFtpControlSocket;
+
+// Passive mode data connection opened ahead of the next transfer.
+//
+// As soon as a file transfer is done on the data connection, the control
+// socket sends the next PASV or EPSV while the final reply to the transfer
+// command is still outstanding, and connects to the address from the reply
+// right away. The next transfer picks up this connection and goes straight
+// to its transfer command, which takes two round trips off each file.
+//
+// Holds on to the connection only for a few seconds. It is dropped if the
+// server closes it or sends anything, as nothing is expected before the
+// transfer command.
+class CFtpDataPrefetch final : public fz::event_handler
+{
+public:
+	explicit CFtpDataPrefetch(CFtpControlSocket & controlSocket);
+	virtual ~CFtpDataPrefetch();
+
+	bool Connect(std::wstring const& host, int port);
+
+	// Returns nullptr if the connection failed, got closed or expired. The
+	// returned socket may still be connecting.
+	std::unique_ptr<fz::socket> Take();
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+	void OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+	void OnTimer(fz::timer_id);
+
+	void Drop();
+
+	CFtpControlSocket & controlSocket_;
+
+	std::unique_ptr<fz::socket> socket_;
+	fz::timer_id timer_{};
+};
+
+#endif
@@ -1,10 +1,13 @@
 #include <filezilla.h>
 
+#include "checksum.h"
 #include "directorycache.h"
 #include "filetransfer.h"
+#include "preallocate.h"
 #include "servercapabilities.h"
 #include "transfersocket.h"
 
+#include <libfilezilla/encode.hpp>
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/local_filesys.hpp>
 
@@ -14,13 +17,19 @@ CFtpFileTransferOpData::CFtpFileTransferOpData(CFtpControlSocket& controlSocket,
 {
 }
 
+CFtpFileTransferOpData::~CFtpFileTransferOpData()
+{
+	// Stop hashing the local file, localHashTask_ gets joined afterwards
+	cancelHash_ = true;
+}
+
 int CFtpFileTransferOpData::Send()
 {
 	std::wstring cmd;
 	switch (opState)
 	{
 	case filetransfer_init:
-		if (localFile_.empty()) {
+		if (localFile_.empty() && !reader_ && !writer_) {
 			if (!download_) {
 				return FZ_REPLY_CRITICALERROR | FZ_REPLY_NOTSUPPORTED;
 			}
@@ -34,13 +43,18 @@ int CFtpFileTransferOpData::Send()
 			log(logmsg::status, _("Starting download of %s"), filename);
 		}
 		else {
-			log(logmsg::status, _("Starting upload of %s"), localFile_);
+			log(logmsg::status, _("Starting upload of %s"), reader_ ? reader_->name() : localFile_);
 		}
 
-		int64_t size;
-		bool isLink;
-		if (fz::local_filesys::get_file_info(fz::to_native(localFile_), isLink, &size, nullptr, nullptr) == fz::local_filesys::file) {
-			localFileSize_ = size;
+		if (reader_) {
+			localFileSize_ = reader_->size();
+		}
+		else if (!writer_) {
+			int64_t size;
+			bool isLink;
+			if (fz::local_filesys::get_file_info(fz::to_native(localFile_), isLink, &size, nullptr, nullptr) == fz::local_filesys::file) {
+				localFileSize_ = size;
+			}
 		}
 
 		opState = filetransfer_waitcwd;
@@ -61,6 +75,11 @@ int CFtpFileTransferOpData::Send()
 		break;
 	case filetransfer_resumetest:
 	case filetransfer_transfer:
+		if (compareContent_) {
+			compareContent_ = false;
+			return StartComparison();
+		}
+
 		if (controlSocket_.m_pTransferSocket) {
 			log(logmsg::debug_verbose, L"m_pTransferSocket != 0");
 			controlSocket_.m_pTransferSocket.reset();
@@ -74,7 +93,12 @@ int CFtpFileTransferOpData::Send()
 				// Potentially racy
 				bool didExist = fz::local_filesys::get_file_type(fz::to_native(localFile_)) != fz::local_filesys::unknown;
 
-				if (resume_) {
+				if (writer_) {
+					// Writers always receive the whole file
+					resume_ = false;
+					localFileSize_ = 0;
+				}
+				else if (resume_) {
 					if (!pFile->open(fz::to_native(localFile_), fz::file::writing, fz::file::existing)) {
 						log(logmsg::error, _("Failed to open \"%s\" for appending/writing"), localFile_);
 						return FZ_REPLY_ERROR;
@@ -113,29 +137,26 @@ int CFtpFileTransferOpData::Send()
 				resumeOffset = resume_ ? localFileSize_ : 0;
 
 				engine_.transfer_status_.Init(remoteFileSize_, startOffset, false);
+				PrepareVerification(startOffset);
 
-				if (engine_.GetOptions().GetOptionVal(OPTION_PREALLOCATE_SPACE)) {
+				if (!writer_ && engine_.GetOptions().GetOptionVal(OPTION_PREALLOCATE_SPACE)) {
 					// Try to preallocate the file in order to reduce fragmentation
 					int64_t sizeToPreallocate = remoteFileSize_ - startOffset;
 					if (sizeToPreallocate > 0) {
 						log(logmsg::debug_info, L"Preallocating %d bytes for the file \"%s\"", sizeToPreallocate, localFile_);
-						auto oldPos = pFile->seek(0, fz::file::current);
-						if (oldPos >= 0) {
-							if (pFile->seek(sizeToPreallocate, fz::file::end) == remoteFileSize_) {
-								if (!pFile->truncate()) {
-									log(logmsg::debug_warning, L"Could not preallocate the file");
-								}
-							}
-							if (pFile->seek(oldPos, fz::file::begin) != oldPos) {
-								log(logmsg::error, _("Could not seek to offset %d within file"), oldPos);
-								return FZ_REPLY_ERROR;
-							}
+						auto const res = PreallocateFile(*pFile, localFile_, startOffset, sizeToPreallocate);
+						if (res == preallocation::error) {
+							log(logmsg::error, _("Could not seek to offset %d within file"), startOffset);
+							return FZ_REPLY_ERROR;
+						}
+						else if (res == preallocation::failed) {
+							log(logmsg::debug_warning, L"Could not preallocate the file");
 						}
 					}
 				}
 			}
 			else {
-				if (!pFile->open(fz::to_native(localFile_), fz::file::reading)) {
+				if (!reader_ && !pFile->open(fz::to_native(localFile_), fz::file::reading)) {
 					log(logmsg::error, _("Failed to open \"%s\" for reading"), localFile_);
 					return FZ_REPLY_ERROR;
 				}
@@ -146,7 +167,7 @@ int CFtpFileTransferOpData::Send()
 						startOffset = remoteFileSize_;
 
 						if (localFileSize_ < 0) {
-							auto s = pFile->size();
+							auto s = reader_ ? reader_->size() : pFile->size();
 							if (s >= 0) {
 								localFileSize_ = s;
 							}
@@ -155,7 +176,7 @@ int CFtpFileTransferOpData::Send()
 						if (startOffset == localFileSize_ && binary) {
 							log(logmsg::debug_info, L"No need to resume, remote file size matches local file size.");
 
-							if (engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS) &&
+							if (!reader_ && engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS) &&
 								CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
 							{
 								fz::datetime mtime = fz::local_filesys::get_modification_time(fz::to_native(localFile_));
@@ -168,7 +189,8 @@ int CFtpFileTransferOpData::Send()
 							return FZ_REPLY_OK;
 						}
 
-						if (pFile->seek(startOffset, fz::file::begin) == -1) {
+						bool const seeked = reader_ ? reader_->seek(startOffset) : pFile->seek(startOffset, fz::file::begin) != -1;
+						if (!seeked) {
 							log(logmsg::error, _("Could not seek to offset %d within file"), startOffset);
 							return FZ_REPLY_ERROR;
 						}
@@ -190,12 +212,29 @@ int CFtpFileTransferOpData::Send()
 					resumeOffset = 0;
 				}
 
-				auto len = pFile->size();
+				auto len = reader_ ? reader_->size() : pFile->size();
 				engine_.transfer_status_.Init(len, startOffset, false);
+				PrepareVerification(startOffset);
 			}
 			ioThread_ = std::make_unique<CIOThread>();
-			if (!ioThread_->Create(engine_.GetThreadPool(), std::move(pFile), !download_, binary)) {
+			if (!verifyCommand_.empty()) {
+				ioThread_->EnableHashing(verifyAlgorithm_);
+			}
+			if (transferSettings_.streaming || engine_.GetOptions().GetOptionVal(OPTION_STREAMING_IO)) {
+				ioThread_->EnableStreaming(localFile_);
+			}
+			bool created;
+			if (reader_) {
+				created = ioThread_->Create(engine_.GetThreadPool(), reader_, binary, &engine_.GetMetrics());
+			}
+			else if (writer_) {
+				created = ioThread_->Create(engine_.GetThreadPool(), writer_, binary, &engine_.GetMetrics());
+			}
+			else {
 				// CIOThread will delete pFile
+				created = ioThread_->Create(engine_.GetThreadPool(), std::move(pFile), !download_, binary, &engine_.GetMetrics());
+			}
+			if (!created) {
 				ioThread_.reset();
 				log(logmsg::error, _("Could not spawn IO thread"));
 				return FZ_REPLY_ERROR;
@@ -236,6 +275,18 @@ int CFtpFileTransferOpData::Send()
 
 		break;
 	}
+	case filetransfer_opts_hash:
+		cmd = L"OPTS HASH " + GetHashAlgorithmName(verifyAlgorithm_);
+		break;
+	case filetransfer_hash:
+		cmd = verifyCommand_ + L" " + remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_);
+		break;
+	case filetransfer_compare_opts_hash:
+		cmd = L"OPTS HASH " + compareAlgorithmName_;
+		break;
+	case filetransfer_compare_hash:
+		cmd = compareCommand_ + L" " + remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_);
+		break;
 	default:
 		log(logmsg::debug_warning, L"Unhandled opState: %d", opState);
 		return FZ_REPLY_ERROR;
@@ -366,6 +417,57 @@ int CFtpFileTransferOpData::ParseResponse()
 		break;
 	case filetransfer_mfmt:
 		return FZ_REPLY_OK;
+	case filetransfer_opts_hash:
+		if (code != 2) {
+			log(logmsg::debug_warning, L"Server refused to select %s, not verifying the transfer", GetHashAlgorithmName(verifyAlgorithm_));
+			controlSocket_.ReportVerification(verification_result::unavailable);
+			return TransferFinished(FZ_REPLY_OK);
+		}
+		controlSocket_.m_selectedHashAlgorithm = GetHashAlgorithmName(verifyAlgorithm_);
+		opState = filetransfer_hash;
+		break;
+	case filetransfer_hash:
+		{
+			int res = VerifyChecksum();
+			if (res != FZ_REPLY_OK) {
+				return res;
+			}
+		}
+		return TransferFinished(FZ_REPLY_OK);
+	case filetransfer_compare_opts_hash:
+		if (code != 2) {
+			log(logmsg::debug_warning, L"Server refused to select %s", compareAlgorithmName_);
+			return ComparisonUnavailable();
+		}
+		controlSocket_.m_selectedHashAlgorithm = compareAlgorithmName_;
+		opState = filetransfer_compare_hash;
+		break;
+	case filetransfer_compare_hash:
+		remoteDigest_ = FindHexDigest(response.size() > 4 ? response.substr(4) : std::wstring(), GetDigestSize(compareHash_));
+		if (code != 2 || remoteDigest_.empty()) {
+			log(logmsg::debug_warning, L"Could not obtain %s checksum of the remote file", compareAlgorithmName_);
+			return ComparisonUnavailable();
+		}
+
+		{
+			// Hashing the local file can take a while, do not block the event loop.
+			// The server is not involved, so there is nothing to time out meanwhile.
+			opState = filetransfer_compare_local;
+			controlSocket_.SetWait(false);
+			auto & hashService = engine_.GetContext().GetHashService();
+			auto & handler = controlSocket_;
+			auto const* cancel = &cancelHash_;
+			std::wstring const file = localFile_;
+			unsigned int const hashes = hash_bit(compareHash_);
+			localHashTask_ = engine_.GetThreadPool().spawn([&hashService, &handler, cancel, file, hashes]() {
+				handler.send_event<LocalHashEvent>(hashService.Hash(file, hashes, cancel));
+			});
+			if (!localHashTask_) {
+				log(logmsg::debug_warning, L"Could not spawn thread to hash the local file");
+				return ComparisonUnavailable();
+			}
+		}
+		return FZ_REPLY_WOULDBLOCK;
 	default:
 		log(logmsg::debug_warning, L"Unknown op state");
 		return FZ_REPLY_INTERNALERROR;
@@ -491,25 +593,24 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		}
 	}
 	else if (opState == filetransfer_waittransfer) {
-		if (prevResult == FZ_REPLY_OK && engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS)) {
-			if (!download_ &&
-				CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
-			{
-				fz::datetime mtime = fz::local_filesys::get_modification_time(fz::to_native(localFile_));
-				if (!mtime.empty()) {
-					fileTime_ = mtime;
-					opState = filetransfer_mfmt;
-					return FZ_REPLY_CONTINUE;
-				}
-			}
-			else if (download_ && !fileTime_.empty()) {
+		if (prevResult != FZ_REPLY_OK && prefetchRejected) {
+			prefetchRejected = false;
+
+			// Readers and writers cannot be rewound, local files just get opened again
+			if (!reader_ && !writer_) {
+				log(logmsg::debug_info, L"Retrying transfer with a new data connection");
+				transferEndReason = TransferEndReason::successful;
+				tranferCommandSent = false;
 				ioThread_.reset();
-				if (!fz::local_filesys::set_modification_time(fz::to_native(localFile_), fileTime_)) {
-					log(logmsg::debug_warning, L"Could not set modification time");
-				}
+				opState = filetransfer_transfer;
+				return FZ_REPLY_CONTINUE;
 			}
 		}
-		return prevResult;
+		if (prevResult == FZ_REPLY_OK && !verifyCommand_.empty()) {
+			opState = selectHashAlgorithm_ ? filetransfer_opts_hash : filetransfer_hash;
+			return FZ_REPLY_CONTINUE;
+		}
+		return TransferFinished(prevResult);
 	}
 	else if (opState == filetransfer_waitresumetest) {
 		if (prevResult != FZ_REPLY_OK) {
@@ -539,3 +640,244 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 
 	return FZ_REPLY_CONTINUE;
 }
+
+int CFtpFileTransferOpData::TransferFinished(int prevResult)
+{
+	if (prevResult == FZ_REPLY_OK && !reader_ && !writer_ && engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (!download_ &&
+			CServerCapabilities::GetCapability(currentServer_, mfmt_command) == yes)
+		{
+			fz::datetime mtime = fz::local_filesys::get_modification_time(fz::to_native(localFile_));
+			if (!mtime.empty()) {
+				fileTime_ = mtime;
+				opState = filetransfer_mfmt;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+		else if (download_ && !fileTime_.empty()) {
+			ioThread_.reset();
+			if (!fz::local_filesys::set_modification_time(fz::to_native(localFile_), fileTime_)) {
+				log(logmsg::debug_warning, L"Could not set modification time");
+			}
+		}
+	}
+	return prevResult;
+}
+
+void CFtpFileTransferOpData::PrepareVerification(int64_t startOffset)
+{
+	verifyCommand_.clear();
+	selectHashAlgorithm_ = false;
+
+	// Only complete binary transfers can be compared with the server's checksum
+	if (!engine_.GetOptions().GetOptionVal(OPTION_VERIFY_TRANSFERS) || !binary || startOffset) {
+		return;
+	}
+
+	std::wstring algorithms;
+	if (CServerCapabilities::GetCapability(currentServer_, hash_command, &algorithms) == yes) {
+		// E.g. "SHA-1;SHA-256*;SHA-512;MD5", the asterisk marks the default algorithm
+		std::wstring const& current = controlSocket_.m_selectedHashAlgorithm;
+		bool found{};
+		for (auto token : fz::strtok(algorithms, L";")) {
+			fz::trim(token);
+			bool const selected = !token.empty() && token.back() == '*';
+			if (selected) {
+				token.pop_back();
+			}
+
+			fz::hash_algorithm algorithm;
+			if (!ParseHashAlgorithm(token, algorithm)) {
+				continue;
+			}
+			if (!found || GetHashStrength(algorithm) > GetHashStrength(verifyAlgorithm_)) {
+				found = true;
+				verifyAlgorithm_ = algorithm;
+				selectHashAlgorithm_ = current.empty() ? !selected : current != GetHashAlgorithmName(algorithm);
+			}
+		}
+		if (found) {
+			verifyCommand_ = L"HASH";
+			return;
+		}
+	}
+
+	struct xhash_command
+	{
+		capabilityNames capability;
+		fz::hash_algorithm algorithm;
+		wchar_t const* command;
+	};
+	xhash_command const commands[] = {
+		{xsha512_command, fz::hash_algorithm::sha512, L"XSHA512"},
+		{xsha256_command, fz::hash_algorithm::sha256, L"XSHA256"},
+		{xsha1_command, fz::hash_algorithm::sha1, L"XSHA1"},
+		{xmd5_command, fz::hash_algorithm::md5, L"XMD5"}
+	};
+	for (auto const& command : commands) {
+		if (CServerCapabilities::GetCapability(currentServer_, command.capability) == yes) {
+			verifyAlgorithm_ = command.algorithm;
+			verifyCommand_ = command.command;
+			return;
+		}
+	}
+
+	log(logmsg::debug_info, L"Server does not support any checksum commands, transfer will not be verified");
+	controlSocket_.ReportVerification(verification_result::unavailable);
+}
+
+int CFtpFileTransferOpData::VerifyChecksum()
+{
+	std::wstring const name = GetHashAlgorithmName(verifyAlgorithm_);
+
+	int const code = controlSocket_.GetReplyCode();
+	auto const& response = controlSocket_.m_Response;
+	auto const remote = FindHexDigest(response.size() > 4 ? response.substr(4) : std::wstring(), verifyAlgorithm_);
+	if (code != 2 || remote.empty()) {
+		// Not being able to get the checksum isn't worth failing an otherwise successful transfer over
+		log(logmsg::debug_warning, L"Could not obtain %s checksum of the remote file, not verifying the transfer", name);
+		controlSocket_.ReportVerification(verification_result::unavailable);
+		return FZ_REPLY_OK;
+	}
+
+	auto const local = ioThread_->GetDigest();
+	if (local != remote) {
+		log(logmsg::error, _("%s checksum mismatch, local file has %s, remote file has %s"), name, fz::hex_encode<std::wstring>(local), fz::hex_encode<std::wstring>(remote));
+		controlSocket_.ReportVerification(verification_result::mismatch);
+		return FZ_REPLY_VERIFYFAILED;
+	}
+
+	log(logmsg::status, _("%s checksum of transferred file matches"), name);
+	controlSocket_.ReportVerification(verification_result::match);
+	return FZ_REPLY_OK;
+}
+
+int CFtpFileTransferOpData::StartComparison()
+{
+	compareNextState_ = opState;
+
+	// Readers and writers cannot be hashed up front
+	if (reader_ || writer_ || !SelectCompareCommand()) {
+		log(logmsg::debug_info, L"Server does not support any checksum commands, cannot compare the content of the files");
+		return ComparisonUnavailable();
+	}
+
+	opState = selectCompareHash_ ? filetransfer_compare_opts_hash : filetransfer_compare_hash;
+	return FZ_REPLY_CONTINUE;
+}
+
+bool CFtpFileTransferOpData::SelectCompareCommand()
+{
+	std::wstring algorithms;
+	if (CServerCapabilities::GetCapability(currentServer_, hash_command, &algorithms) == yes) {
+		std::wstring const& current = controlSocket_.m_selectedHashAlgorithm;
+		int strength = -2;
+		for (auto token : fz::strtok(algorithms, L";")) {
+			fz::trim(token);
+			bool const selected = !token.empty() && token.back() == '*';
+			if (selected) {
+				token.pop_back();
+			}
+
+			// CRC32 is weaker than any of the other algorithms, but still good enough to detect changes
+			int tokenStrength;
+			fz::hash_algorithm algorithm{};
+			if (fz::str_toupper_ascii(token) == L"CRC32") {
+				tokenStrength = -1;
+			}
+			else if (ParseHashAlgorithm(token, algorithm)) {
+				tokenStrength = GetHashStrength(algorithm);
+			}
+			else {
+				continue;
+			}
+			if (tokenStrength > strength) {
+				strength = tokenStrength;
+				if (tokenStrength < 0) {
+					compareHash_ = file_hash::crc32;
+					compareAlgorithmName_ = L"CRC32";
+				}
+				else {
+					compareHash_ = ToFileHash(algorithm);
+					compareAlgorithmName_ = GetHashAlgorithmName(algorithm);
+				}
+				selectCompareHash_ = current.empty() ? !selected : current != compareAlgorithmName_;
+			}
+		}
+		if (strength > -2) {
+			compareCommand_ = L"HASH";
+			return true;
+		}
+	}
+
+	struct xhash_command
+	{
+		capabilityNames capability;
+		file_hash hash;
+		wchar_t const* command;
+		wchar_t const* name;
+	};
+	xhash_command const commands[] = {
+		{xsha512_command, file_hash::sha512, L"XSHA512", L"SHA-512"},
+		{xsha256_command, file_hash::sha256, L"XSHA256", L"SHA-256"},
+		{xsha1_command, file_hash::sha1, L"XSHA1", L"SHA-1"},
+		{xmd5_command, file_hash::md5, L"XMD5", L"MD5"},
+		{xcrc_command, file_hash::crc32, L"XCRC", L"CRC32"}
+	};
+	for (auto const& command : commands) {
+		if (CServerCapabilities::GetCapability(currentServer_, command.capability) == yes) {
+			compareHash_ = command.hash;
+			compareCommand_ = command.command;
+			compareAlgorithmName_ = command.name;
+			selectCompareHash_ = false;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int CFtpFileTransferOpData::OnLocalHash(CHashService::result const& result)
+{
+	if (opState != filetransfer_compare_local || result.file != localFile_) {
+		log(logmsg::debug_info, L"Ignoring stale local hash result");
+		return FZ_REPLY_WOULDBLOCK;
+	}
+
+	auto const& local = result.digest(compareHash_);
+	if (!result.success || local.empty()) {
+		log(logmsg::debug_warning, L"Could not hash the local file \"%s\"", localFile_);
+		return ComparisonUnavailable();
+	}
+
+	if (local == remoteDigest_) {
+		log(logmsg::status, _("%s checksums of both files match"), compareAlgorithmName_);
+		return SkipTransfer();
+	}
+
+	log(logmsg::debug_info, L"%s checksums differ, transferring the file", compareAlgorithmName_);
+	opState = compareNextState_;
+	return FZ_REPLY_CONTINUE;
+}
+
+int CFtpFileTransferOpData::ComparisonUnavailable()
+{
+	// Same as overwriteSizeOrNewer for files of equal size
+	if (!sourceNewer_) {
+		return SkipTransfer();
+	}
+
+	opState = compareNextState_;
+	return FZ_REPLY_CONTINUE;
+}
+
+int CFtpFileTransferOpData::SkipTransfer()
+{
+	if (download_) {
+		log(logmsg::status, _("Skipping download of %s"), remotePath_.FormatFilename(remoteFile_));
+	}
+	else {
+		log(logmsg::status, _("Skipping upload of %s"), localFile_);
+	}
+	return FZ_REPLY_OK;
+}
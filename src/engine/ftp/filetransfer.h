@@ -5,6 +5,10 @@
 
 #include "iothread.h"
 
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
+
 enum filetransferStates
 {
 	filetransfer_init = 0,
@@ -16,13 +20,19 @@ enum filetransferStates
 	filetransfer_transfer,
 	filetransfer_waittransfer,
 	filetransfer_waitresumetest,
-	filetransfer_mfmt
+	filetransfer_mfmt,
+	filetransfer_opts_hash,
+	filetransfer_hash,
+	filetransfer_compare_opts_hash,
+	filetransfer_compare_hash,
+	filetransfer_compare_local
 };
 
 class CFtpFileTransferOpData final : public CFileTransferOpData, public CFtpTransferOpData, public CFtpOpData
 {
 public:
 	CFtpFileTransferOpData(CFtpControlSocket& controlSocket, bool is_download, std::wstring const& local_file, std::wstring const& remote_file, CServerPath const& remote_path, CFileTransferCommand::t_transferSettings const& settings);
+	virtual ~CFtpFileTransferOpData();
 
 	virtual int Send() override;
 	virtual int ParseResponse() override;
@@ -30,8 +40,38 @@ public:
 
 	int TestResumeCapability();
 
+	int OnLocalHash(CHashService::result const& result);
+
 	std::unique_ptr<CIOThread> ioThread_;
 	bool fileDidExist_{true};
+
+private:
+	void PrepareVerification(int64_t startOffset);
+	int VerifyChecksum();
+	int TransferFinished(int prevResult);
+
+	// Empty if the transfer does not get verified
+	std::wstring verifyCommand_;
+	fz::hash_algorithm verifyAlgorithm_{};
+	bool selectHashAlgorithm_{};
+
+	// Comparing the content of existing files, see compareContent_
+	int StartComparison();
+	bool SelectCompareCommand();
+	int ComparisonUnavailable();
+	int SkipTransfer();
+
+	std::wstring compareCommand_;
+	std::wstring compareAlgorithmName_;
+	file_hash compareHash_{};
+	bool selectCompareHash_{};
+	int compareNextState_{};
+	std::vector<uint8_t> remoteDigest_;
+
+	// The local file is hashed by CHashService. The destructor sets cancelHash_
+	// so that joining the task does not wait for the whole file to be read.
+	std::atomic<bool> cancelHash_{};
+	fz::async_task localHashTask_;
 };
 
 #endif
@@ -2,6 +2,7 @@
 
 #include "cwd.h"
 #include "chmod.h"
+#include "dataprefetch.h"
 #include "delete.h"
 #include "directorycache.h"
 #include "directorylistingparser.h"
@@ -12,6 +13,7 @@
 #include "iothread.h"
 #include "list.h"
 #include "logon.h"
+#include "metrics.h"
 #include "mkd.h"
 #include "pathcache.h"
 #include "proxy.h"
@@ -33,6 +35,7 @@
 CFtpControlSocket::CFtpControlSocket(CFileZillaEnginePrivate & engine)
 	: CRealControlSocket(engine)
 {
+	m_rtt.SetHistogram(&engine_.GetMetrics().GetHistogram("fz_rtt_microseconds", "protocol=\"ftp\""));
 }
 
 CFtpControlSocket::~CFtpControlSocket()
@@ -168,6 +171,7 @@ void CFtpControlSocket::ParseLine(std::wstring line)
 void CFtpControlSocket::OnConnect()
 {
 	m_lastTypeBinary = -1;
+	m_selectedHashAlgorithm.clear();
 
 	SetAlive();
 
@@ -215,6 +219,15 @@ void CFtpControlSocket::ParseResponse()
 			log(logmsg::debug_warning, L"Unexpected reply, no reply was pending.");
 			return;
 		}
+
+		if (prefetchReplyPosition_ != -1) {
+			if (!prefetchReplyPosition_) {
+				prefetchReplyPosition_ = -1;
+				OnPrefetchReply();
+				return;
+			}
+			--prefetchReplyPosition_;
+		}
 	}
 
 	if (m_repliesToSkip) {
@@ -276,6 +289,120 @@ int CFtpControlSocket::GetReplyCode() const
 	}
 }
 
+bool CFtpControlSocket::ParseEpsvResponse(std::wstring & host, int & port)
+{
+	size_t pos = m_Response.find(L"(|||");
+	if (pos == std::wstring::npos) {
+		return false;
+	}
+
+	size_t pos2 = m_Response.find(L"|)", pos + 4);
+	if (pos2 == std::wstring::npos || pos2 == pos + 4) {
+		return false;
+	}
+
+	std::wstring number = m_Response.substr(pos + 4, pos2 - pos - 4);
+	auto const value = fz::to_integral<unsigned int>(number);
+	if (value == 0 || value > 65535) {
+		return false;
+	}
+
+	port = static_cast<int>(value);
+
+	if (proxy_layer_) {
+		host = currentServer_.GetHost();
+	}
+	else {
+		host = fz::to_wstring(socket_->peer_ip());
+	}
+	return true;
+}
+
+bool CFtpControlSocket::ParsePasvResponse(std::wstring & host, int & port, bool triedActive)
+{
+	// Validate ip address
+	if (!m_pasvReplyRegex) {
+		std::wstring digit = L"0*[0-9]{1,3}";
+		wchar_t const* const  dot = L",";
+		std::wstring exp = L"( |\\()(" + digit + dot + digit + dot + digit + dot + digit + dot + digit + dot + digit + L")( |\\)|$)";
+		m_pasvReplyRegex = std::make_unique<std::wregex>(exp);
+	}
+
+	std::wsmatch m;
+	if (!std::regex_search(m_Response, m, *m_pasvReplyRegex)) {
+		return false;
+	}
+
+	host = m[2].str();
+
+	size_t i = host.rfind(',');
+	if (i == std::wstring::npos) {
+		return false;
+	}
+	auto number = fz::to_integral<unsigned int>(host.substr(i + 1));
+	if (number > 255) {
+		return false;
+	}
+
+	port = static_cast<int>(number); //get ls byte of server socket
+	host = host.substr(0, i);
+	i = host.rfind(',');
+	if (i == std::string::npos) {
+		return false;
+	}
+	number = fz::to_integral<unsigned int>(host.substr(i + 1));
+	if (number > 255) {
+		return false;
+	}
+
+	port += 256 * static_cast<int>(number); //add ms byte of server socket
+	host = host.substr(0, i);
+	fz::replace_substrings(host, L",", L".");
+
+	if (proxy_layer_) {
+		// We do not have any information about the proxy's inner workings
+		return true;
+	}
+
+	std::wstring const peerIP = fz::to_wstring(socket_->peer_ip());
+	if (!fz::is_routable_address(host) && fz::is_routable_address(peerIP)) {
+		if (engine_.GetOptions().GetOptionVal(OPTION_PASVREPLYFALLBACKMODE) != 1 || triedActive) {
+			log(logmsg::status, _("Server sent passive reply with unroutable address. Using server address instead."));
+			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host, peerIP);
+			host = peerIP;
+		}
+		else {
+			log(logmsg::status, _("Server sent passive reply with unroutable address. Passive mode failed."));
+			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host, peerIP);
+			return false;
+		}
+	}
+	else if (engine_.GetOptions().GetOptionVal(OPTION_PASVREPLYFALLBACKMODE) == 2) {
+		// Always use server address
+		host = peerIP;
+	}
+
+	return true;
+}
+
+std::wstring CFtpControlSocket::GetPassiveCommand()
+{
+	std::wstring ret = L"PASV";
+
+	if (proxy_layer_) {
+		// We don't actually know the address family the other end of the proxy uses to reach the server. Hence prefer EPSV
+		// if the server supports it.
+		if (CServerCapabilities::GetCapability(currentServer_, epsv_command) == yes) {
+			ret = L"EPSV";
+		}
+	}
+	else if (socket_->address_family() == fz::address_type::ipv6) {
+		// EPSV is mandatory for IPv6, don't check capabilities
+		ret = L"EPSV";
+	}
+	return ret;
+}
+
 int CFtpControlSocket::SendCommand(std::wstring const& str, bool maskArgs, bool measureRTT)
 {
 	size_t pos;
@@ -333,6 +460,10 @@ int CFtpControlSocket::ResetOperation(int nErrorCode)
 	m_pIPResolver.reset();
 
 	m_repliesToSkip = m_pendingReplies;
+	if (prefetchReplyPosition_ != -1) {
+		// Gets handled on its own
+		--m_repliesToSkip;
+	}
 
 	if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
 		auto & data = static_cast<CFtpFileTransferOpData &>(*operations_.back());
@@ -399,6 +530,11 @@ bool CFtpControlSocket::CanSendNextCommand()
 		return false;
 	}
 
+	if (prefetchReplyPosition_ != -1) {
+		log(logmsg::debug_verbose, L"Waiting for reply to %s before sending next command...", prefetchCommand_);
+		return false;
+	}
+
 	return true;
 }
 
@@ -419,14 +555,14 @@ void CFtpControlSocket::ChangeDir(CServerPath const& path, std::wstring const& s
 	Push(std::move(pData));
 }
 
-void CFtpControlSocket::FileTransfer(std::wstring const& localFile, CServerPath const& remotePath,
-									std::wstring const& remoteFile, bool download,
-									CFileTransferCommand::t_transferSettings const& transferSettings)
+void CFtpControlSocket::FileTransfer(CFileTransferCommand const& cmd)
 {
 	log(logmsg::debug_verbose, L"CFtpControlSocket::FileTransfer()");
 
-	auto pData = std::make_unique<CFtpFileTransferOpData>(*this, download, localFile, remoteFile, remotePath, transferSettings);
-	pData->binary = transferSettings.binary;
+	auto pData = std::make_unique<CFtpFileTransferOpData>(*this, cmd.Download(), cmd.GetLocalFile(), cmd.GetRemoteFile(), cmd.GetRemotePath(), cmd.GetTransferSettings());
+	pData->binary = cmd.GetTransferSettings().binary;
+	pData->reader_ = cmd.GetReader();
+	pData->writer_ = cmd.GetWriter();
 	Push(std::move(pData));
 }
 
@@ -451,6 +587,7 @@ void CFtpControlSocket::TransferEnd()
 
 	if (reason == TransferEndReason::successful) {
 		SetAlive();
+		PrefetchDataConnection();
 	}
 
 	auto & data = static_cast<CFtpRawTransferOpData &>(*operations_.back());
@@ -475,6 +612,78 @@ void CFtpControlSocket::TransferEnd()
 	}
 }
 
+void CFtpControlSocket::PrefetchDataConnection()
+{
+	if (!engine_.GetOptions().GetOptionVal(OPTION_FTP_PREFETCH_DATACONNECTION)) {
+		return;
+	}
+
+	if (proxy_layer_ || prefetchReplyPosition_ != -1) {
+		return;
+	}
+
+	if (CServerCapabilities::GetCapability(currentServer_, data_connection_prefetch) == no) {
+		return;
+	}
+
+	// Only worth it in the middle of file transfers, after a listing usually
+	// something else follows.
+	if (operations_.size() < 2 || operations_[operations_.size() - 2]->opId != Command::transfer) {
+		return;
+	}
+
+	auto const& data = static_cast<CFtpRawTransferOpData const&>(*operations_.back());
+	if (!data.bPasv || data.bTriedActive) {
+		return;
+	}
+
+	prefetch_.reset();
+
+	prefetchCommand_ = GetPassiveCommand();
+	int const position = m_pendingReplies;
+	if (SendCommand(prefetchCommand_, false, false) == FZ_REPLY_WOULDBLOCK) {
+		prefetchReplyPosition_ = position;
+	}
+}
+
+void CFtpControlSocket::OnPrefetchReply()
+{
+	if (GetReplyCode() == 2) {
+		std::wstring host;
+		int port{};
+
+		bool parsed;
+		if (prefetchCommand_ == L"EPSV") {
+			parsed = ParseEpsvResponse(host, port);
+		}
+		else {
+			parsed = ParsePasvResponse(host, port, false);
+		}
+
+		if (parsed) {
+			prefetch_ = std::make_unique<CFtpDataPrefetch>(*this);
+			if (!prefetch_->Connect(host, port)) {
+				prefetch_.reset();
+			}
+		}
+	}
+
+	if (!prefetch_) {
+		log(logmsg::debug_info, L"Could not open data connection in advance");
+	}
+
+	// Commands held back by CanSendNextCommand can go out now
+	if (!m_repliesToSkip && !m_pendingReplies) {
+		if (operations_.empty()) {
+			SetWait(false);
+			StartKeepaliveTimer();
+		}
+		else {
+			SendNextCommand();
+		}
+	}
+}
+
 bool CFtpControlSocket::SetAsyncRequestReply(CAsyncRequestNotification *pNotification)
 {
 	log(logmsg::debug_verbose, L"CFtpControlSocket::SetAsyncRequestReply");
@@ -695,6 +904,24 @@ void CFtpControlSocket::OnExternalIPAddress()
 	SendNextCommand();
 }
 
+void CFtpControlSocket::OnLocalHash(CHashService::result const& result)
+{
+	log(logmsg::debug_verbose, L"CFtpControlSocket::OnLocalHash()");
+	if (operations_.empty() || operations_.back()->opId != Command::transfer) {
+		log(logmsg::debug_info, L"Ignoring event");
+		return;
+	}
+
+	auto & data = static_cast<CFtpFileTransferOpData &>(*operations_.back());
+	int res = data.OnLocalHash(result);
+	if (res == FZ_REPLY_CONTINUE) {
+		SendNextCommand();
+	}
+	else if (res != FZ_REPLY_WOULDBLOCK) {
+		ResetOperation(res);
+	}
+}
+
 void CFtpControlSocket::Transfer(std::wstring const& cmd, CFtpTransferOpData* oldData)
 {
 	assert(oldData);
@@ -834,6 +1061,10 @@ void CFtpControlSocket::operator()(fz::event_base const& ev)
 		return;
 	}
 
+	if (fz::dispatch<LocalHashEvent>(ev, this, &CFtpControlSocket::OnLocalHash)) {
+		return;
+	}
+
 	if (fz::dispatch<fz::certificate_verification_event>(ev, this, &CFtpControlSocket::OnVerifyCert)) {
 		return;
 	}
@@ -843,6 +1074,8 @@ void CFtpControlSocket::operator()(fz::event_base const& ev)
 
 void CFtpControlSocket::ResetSocket()
 {
+	prefetch_.reset();
+	prefetchReplyPosition_ = -1;
 	tls_layer_.reset();
 	CRealControlSocket::ResetSocket();
 }
@@ -4,6 +4,7 @@
 #include "logging_private.h"
 #include "ControlSocket.h"
 #include "externalipresolver.h"
+#include "hash_service.h"
 #include "rtt.h"
 
 #include <regex>
@@ -17,6 +18,7 @@ auto const rawtransfer = Command::private2;
 #define MAXLINELEN 2000
 
 class CTransferSocket;
+class CFtpDataPrefetch;
 class CFtpTransferOpData;
 class CFtpRawTransferOpData;
 
@@ -27,9 +29,13 @@ class tls_layer;
 struct filezilla_engine_ftp_transfer_end_event;
 typedef fz::simple_event<filezilla_engine_ftp_transfer_end_event> TransferEndEvent;
 
+struct filezilla_engine_ftp_local_hash_event;
+typedef fz::simple_event<filezilla_engine_ftp_local_hash_event, CHashService::result> LocalHashEvent;
+
 class CFtpControlSocket final : public CRealControlSocket
 {
 	friend class CTransferSocket;
+	friend class CFtpDataPrefetch;
 public:
 	CFtpControlSocket(CFileZillaEnginePrivate & engine);
 	virtual ~CFtpControlSocket();
@@ -44,9 +50,7 @@ protected:
 	virtual void Connect(CServer const& server, Credentials const& credentials) override;
 	virtual void List(CServerPath const& path = CServerPath(), std::wstring const& subDir = std::wstring(), int flags = 0) override;
 	void ChangeDir(CServerPath const& path = CServerPath(), std::wstring const& subDir = std::wstring(), bool link_discovery = false);
-	virtual void FileTransfer(std::wstring const& localFile, CServerPath const& remotePath,
-							 std::wstring const& remoteFile, bool download,
-							 CFileTransferCommand::t_transferSettings const& transferSettings) override;
+	virtual void FileTransfer(CFileTransferCommand const& cmd) override;
 	virtual void RawCommand(std::wstring const& command) override;
 	virtual void Delete(CServerPath const& path, std::deque<std::wstring>&& files) override;
 	virtual void RemoveDir(CServerPath const& path, std::wstring const& subDir) override;
@@ -77,6 +81,16 @@ protected:
 
 	int GetReplyCode() const;
 
+	std::wstring GetPassiveCommand();
+
+	// Parse the reply to PASV or EPSV
+	bool ParsePasvResponse(std::wstring & host, int & port, bool triedActive);
+	bool ParseEpsvResponse(std::wstring & host, int & port);
+
+	// See CFtpDataPrefetch
+	void PrefetchDataConnection();
+	void OnPrefetchReply();
+
 	int GetExternalIPAddress(std::string& address);
 
 	void StartKeepaliveTimer();
@@ -97,6 +111,13 @@ protected:
 
 	int m_pendingReplies{1};
 
+	std::unique_ptr<CFtpDataPrefetch> prefetch_;
+	std::wstring prefetchCommand_;
+
+	// Number of replies still to come before the one to prefetchCommand_,
+	// -1 if that reply is not pending.
+	int prefetchReplyPosition_{-1};
+
 	std::unique_ptr<CExternalIPResolver> m_pIPResolver;
 
 	std::unique_ptr<fz::tls_layer> tls_layer_;
@@ -104,6 +125,10 @@ protected:
 
 	int m_lastTypeBinary{-1};
 
+	// Checksum algorithm selected with OPTS HASH on this connection. The
+	// selection is per session, empty if the server default is in effect.
+	std::wstring m_selectedHashAlgorithm;
+
 	// Used by keepalive code so that we're not using keep alive
 	// till the end of time. Stop after a couple of minutes.
 	fz::monotonic_clock m_lastCommandCompletionTime;
@@ -115,6 +140,7 @@ protected:
 	virtual void operator()(fz::event_base const& ev) override;
 
 	void OnExternalIPAddress();
+	void OnLocalHash(CHashService::result const& result);
 	void OnTimer(fz::timer_id id);
 
 	std::unique_ptr<std::wregex> m_pasvReplyRegex; // Have it as class member to avoid recompiling the regex on each transfer or listing
@@ -144,6 +170,10 @@ public:
 	TransferEndReason transferEndReason{TransferEndReason::successful};
 	bool tranferCommandSent{};
 
+	// The transfer command failed because the server could not use the data
+	// connection opened in advance. Nothing has been transferred.
+	bool prefetchRejected{};
+
 	int64_t resumeOffset{};
 	bool binary{true};
 };
@@ -836,4 +836,26 @@ void CFtpLogonOpData::ParseFeat(std::wstring line)
 	else if (HasFeature(up, L"EPSV")) {
 		CServerCapabilities::SetCapability(currentServer_, epsv_command, yes);
 	}
+	else if (HasFeature(up, L"HASH")) {
+		std::wstring algorithms;
+		if (line.size() > 5) {
+			algorithms = line.substr(5);
+		}
+		CServerCapabilities::SetCapability(currentServer_, hash_command, yes, algorithms);
+	}
+	else if (HasFeature(up, L"XSHA512")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha512_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA256")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha256_command, yes);
+	}
+	else if (HasFeature(up, L"XSHA1")) {
+		CServerCapabilities::SetCapability(currentServer_, xsha1_command, yes);
+	}
+	else if (HasFeature(up, L"XMD5")) {
+		CServerCapabilities::SetCapability(currentServer_, xmd5_command, yes);
+	}
+	else if (HasFeature(up, L"XCRC")) {
+		CServerCapabilities::SetCapability(currentServer_, xcrc_command, yes);
+	}
 }
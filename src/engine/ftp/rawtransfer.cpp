@@ -1,11 +1,10 @@
 #include <filezilla.h>
 
+#include "dataprefetch.h"
 #include "rawtransfer.h"
 #include "servercapabilities.h"
 #include "transfersocket.h"
 
-#include <libfilezilla/iputils.hpp>
-
 int CFtpRawTransferOpData::ParseResponse()
 {
 	if (opState == rawtransfer_init) {
@@ -49,10 +48,10 @@ int CFtpRawTransferOpData::ParseResponse()
 		if (bPasv) {
 			bool parsed;
 			if (GetPassiveCommand() == L"EPSV") {
-				parsed = ParseEpsvResponse();
+				parsed = controlSocket_.ParseEpsvResponse(host_, port_);
 			}
 			else {
-				parsed = ParsePasvResponse();
+				parsed = controlSocket_.ParsePasvResponse(host_, port_, bTriedActive);
 			}
 			if (!parsed) {
 				if (!engine_.GetOptions().GetOptionVal(OPTION_ALLOW_TRANSFERMODEFALLBACK)) {
@@ -99,6 +98,7 @@ int CFtpRawTransferOpData::ParseResponse()
 			if (pOldData->transferEndReason == TransferEndReason::successful) {
 				pOldData->transferEndReason = TransferEndReason::transfer_command_failure_immediate;
 			}
+			CheckPrefetchRejected();
 			error = true;
 		}
 		break;
@@ -119,6 +119,7 @@ int CFtpRawTransferOpData::ParseResponse()
 			if (pOldData->transferEndReason == TransferEndReason::successful) {
 				pOldData->transferEndReason = TransferEndReason::transfer_command_failure_immediate;
 			}
+			CheckPrefetchRejected();
 			error = true;
 		}
 		break;
@@ -186,6 +187,24 @@ int CFtpRawTransferOpData::Send()
 		measureRTT = true;
 		break;
 	case rawtransfer_port_pasv:
+		if (controlSocket_.prefetch_) {
+			// Any other PASV or PORT command would invalidate it
+			if (bPasv) {
+				prefetchedSocket_ = controlSocket_.prefetch_->Take();
+			}
+			controlSocket_.prefetch_.reset();
+		}
+		if (prefetchedSocket_) {
+			log(logmsg::debug_verbose, L"Using data connection opened in advance");
+			usedPrefetch_ = true;
+			if (pOldData->resumeOffset > 0 || controlSocket_.m_sentRestartOffset) {
+				opState = rawtransfer_rest;
+			}
+			else {
+				opState = rawtransfer_transfer;
+			}
+			return FZ_REPLY_CONTINUE;
+		}
 		if (bPasv) {
 			cmd = GetPassiveCommand();
 		}
@@ -227,7 +246,13 @@ int CFtpRawTransferOpData::Send()
 		measureRTT = true;
 		break;
 	case rawtransfer_transfer:
-		if (bPasv) {
+		if (prefetchedSocket_) {
+			if (!controlSocket_.m_pTransferSocket->SetupPassiveTransfer(std::move(prefetchedSocket_))) {
+				log(logmsg::error, _("Could not establish connection to server"));
+				return FZ_REPLY_ERROR;
+			}
+		}
+		else if (bPasv) {
 			if (!controlSocket_.m_pTransferSocket->SetupPassiveTransfer(host_, port_)) {
 				log(logmsg::error, _("Could not establish connection to server"));
 				return FZ_REPLY_ERROR;
@@ -256,120 +281,28 @@ int CFtpRawTransferOpData::Send()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
-bool CFtpRawTransferOpData::ParseEpsvResponse()
+std::wstring CFtpRawTransferOpData::GetPassiveCommand()
 {
-	size_t pos = controlSocket_.m_Response.find(L"(|||");
-	if (pos == std::wstring::npos) {
-		return false;
-	}
-
-	size_t pos2 = controlSocket_.m_Response.find(L"|)", pos + 4);
-	if (pos2 == std::wstring::npos || pos2 == pos + 4) {
-		return false;
-	}
-
-	std::wstring number = controlSocket_.m_Response.substr(pos + 4, pos2 - pos - 4);
-	auto port = fz::to_integral<unsigned int>(number);
-
-	if (port == 0 || port > 65535) {
-		return false;
-	}
-
-	port_ = port;
+	assert(bPasv);
+	bTriedPasv = true;
 
-	if (controlSocket_.proxy_layer_) {
-		host_ = currentServer_.GetHost();
-	}
-	else {
-		host_ = fz::to_wstring(controlSocket_.socket_->peer_ip());
-	}
-	return true;
+	return controlSocket_.GetPassiveCommand();
 }
 
-bool CFtpRawTransferOpData::ParsePasvResponse()
+void CFtpRawTransferOpData::CheckPrefetchRejected()
 {
-	// Validate ip address
-	if (!controlSocket_.m_pasvReplyRegex) {
-		std::wstring digit = L"0*[0-9]{1,3}";
-		wchar_t const* const  dot = L",";
-		std::wstring exp = L"( |\\()(" + digit + dot + digit + dot + digit + dot + digit + dot + digit + dot + digit + L")( |\\)|$)";
-		controlSocket_.m_pasvReplyRegex = std::make_unique<std::wregex>(exp);
+	if (!usedPrefetch_) {
+		return;
 	}
 
-	std::wsmatch m;
-	if (!std::regex_search(controlSocket_.m_Response, m, *controlSocket_.m_pasvReplyRegex)) {
-		return false;
+	// Other failures, e.g. a missing file, are unrelated to the data connection
+	std::wstring const& response = controlSocket_.m_Response;
+	if (!fz::starts_with(response, std::wstring(L"425")) && !fz::starts_with(response, std::wstring(L"426"))) {
+		return;
 	}
 
-	host_ = m[2].str();
-
-	size_t i = host_.rfind(',');
-	if (i == std::wstring::npos) {
-		return false;
-	}
-	auto number = fz::to_integral<unsigned int>(host_.substr(i + 1));
-	if (number > 255) {
-		return false;
-	}
-
-	port_ = number; //get ls byte of server socket
-	host_ = host_.substr(0, i);
-	i = host_.rfind(',');
-	if (i == std::string::npos) {
-		return false;
-	}
-	number = fz::to_integral<unsigned int>(host_.substr(i + 1));
-	if (number > 255) {
-		return false;
-	}
-
-	port_ += 256 * number; //add ms byte of server socket
-	host_ = host_.substr(0, i);
-	fz::replace_substrings(host_, L",", L".");
-
-	if (controlSocket_.proxy_layer_) {
-		// We do not have any information about the proxy's inner workings
-		return true;
-	}
-
-	std::wstring const peerIP = fz::to_wstring(controlSocket_.socket_->peer_ip());
-	if (!fz::is_routable_address(host_) && fz::is_routable_address(peerIP)) {
-		if (engine_.GetOptions().GetOptionVal(OPTION_PASVREPLYFALLBACKMODE) != 1 || bTriedActive) {
-			log(logmsg::status, _("Server sent passive reply with unroutable address. Using server address instead."));
-			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host_, peerIP);
-			host_ = peerIP;
-		}
-		else {
-			log(logmsg::status, _("Server sent passive reply with unroutable address. Passive mode failed."));
-			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host_, peerIP);
-			return false;
-		}
-	}
-	else if (engine_.GetOptions().GetOptionVal(OPTION_PASVREPLYFALLBACKMODE) == 2) {
-		// Always use server address
-		host_ = peerIP;
-	}
-
-	return true;
-}
-
-std::wstring CFtpRawTransferOpData::GetPassiveCommand()
-{
-	std::wstring ret = L"PASV";
-
-	assert(bPasv);
-	bTriedPasv = true;
-
-	if (controlSocket_.proxy_layer_) {
-		// We don't actually know the address family the other end of the proxy uses to reach the server. Hence prefer EPSV
-		// if the server supports it.
-		if (CServerCapabilities::GetCapability(currentServer_, epsv_command) == yes) {
-			ret = L"EPSV";
-		}
-	}
-	else if (controlSocket_.socket_->address_family() == fz::address_type::ipv6) {
-		// EPSV is mandatory for IPv6, don't check capabilities
-		ret = L"EPSV";
-	}
-	return ret;
+	// Might not like the data connection having been opened before
+	log(logmsg::debug_info, L"Server could not use data connection opened in advance, no longer opening them for this server.");
+	CServerCapabilities::SetCapability(currentServer_, data_connection_prefetch, no);
+	pOldData->prefetchRejected = true;
 }
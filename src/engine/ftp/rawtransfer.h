@@ -29,8 +29,10 @@ public:
 	virtual int ParseResponse() override;
 
 	std::wstring GetPassiveCommand();
-	bool ParsePasvResponse();
-	bool ParseEpsvResponse();
+
+	// Checks whether a failed transfer command was caused by using the data
+	// connection opened in advance.
+	void CheckPrefetchRejected();
 
 	std::wstring cmd_;
 
@@ -42,6 +44,10 @@ public:
 
 	std::wstring host_;
 	int port_{};
+
+	// Taken over from CFtpDataPrefetch
+	std::unique_ptr<fz::socket> prefetchedSocket_;
+	bool usedPrefetch_{};
 };
 
 #endif
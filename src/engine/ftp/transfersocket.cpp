@@ -16,6 +16,7 @@ CTransferSocket::CTransferSocket(CFileZillaEnginePrivate & engine, CFtpControlSo
 , engine_(engine)
 , controlSocket_(controlSocket)
 , m_transferMode(transferMode)
+, tuning_(controlSocket.currentServer_, engine.GetOptions())
 {
 }
 
@@ -30,7 +31,9 @@ CTransferSocket::~CTransferSocket()
 	if (m_transferMode == TransferMode::upload || m_transferMode == TransferMode::download) {
 		if (ioThread_) {
 			if (m_transferMode == TransferMode::download) {
-				FinalizeWrite();
+				// Keep what has been received so far, the thread finishes
+				// writing it on its own. Does nothing if already finalized.
+				ioThread_->Finalize(BUFFERSIZE - m_transferBufferLen, false);
 			}
 			ioThread_->SetEventHandler(nullptr);
 		}
@@ -182,6 +185,8 @@ void CTransferSocket::OnConnect()
 		return;
 	}
 
+	tuning_.Apply(*socket_, controlSocket_, controlSocket_.m_rtt.GetLatency());
+
 	if (tls_layer_) {
 		// Re-enable Nagle algorithm
 		socket_->set_flags(socket_->flags() & (~fz::socket::flag_nodelay));
@@ -209,6 +214,10 @@ void CTransferSocket::OnReceive()
 		return;
 	}
 
+	if (socket_) {
+		tuning_.Rearm(*socket_);
+	}
+
 	if (m_transferEndReason == TransferEndReason::none) {
 		if (m_transferMode == TransferMode::list) {
 			for (;;) {
@@ -246,6 +255,11 @@ void CTransferSocket::OnReceive()
 			return;
 		}
 		else if (m_transferMode == TransferMode::download) {
+			if (finalizing_) {
+				// All data got received already
+				return;
+			}
+
 			int error;
 			int numread;
 
@@ -428,7 +442,7 @@ bool CTransferSocket::SetupPassiveTransfer(std::wstring const& host, int port)
 
 	socket_ = std::make_unique<fz::socket>(engine_.GetThreadPool(), nullptr);
 
-	SetSocketBufferSizes(*socket_);
+	tuning_.Prepare(*socket_, controlSocket_.m_rtt.GetLatency());
 
 	// Try to bind the source IP of the data connection to the same IP as the control connection.
 	// We can do so either if
@@ -469,9 +483,33 @@ bool CTransferSocket::SetupPassiveTransfer(std::wstring const& host, int port)
 	return true;
 }
 
+bool CTransferSocket::SetupPassiveTransfer(std::unique_ptr<fz::socket> && socket)
+{
+	ResetSocket();
+
+	socket_ = std::move(socket);
+	if (!socket_ || !InitLayers(false)) {
+		ResetSocket();
+		return false;
+	}
+
+	if (active_layer_->get_state() == fz::socket_state::connected) {
+		// Events from before the handover went elsewhere
+		if (m_transferMode == TransferMode::upload) {
+			m_postponedSend = true;
+		}
+		else {
+			m_postponedReceive = true;
+		}
+		OnConnect();
+	}
+
+	return true;
+}
+
 bool CTransferSocket::InitLayers(bool active)
 {
-	ratelimit_layer_ = std::make_unique<CRatelimitLayer>(nullptr, *socket_, engine_.GetRateLimiter());
+	ratelimit_layer_ = std::make_unique<CRatelimitLayer>(nullptr, *socket_, engine_.GetRateLimiter(), &engine_.GetMetrics(), "data");
 	active_layer_ = ratelimit_layer_.get();
 
 	if (controlSocket_.proxy_layer_ && !active) {
@@ -554,7 +592,7 @@ std::unique_ptr<fz::listen_socket> CTransferSocket::CreateSocketServer(int port)
 		socket.reset();
 	}
 	else {
-		SetSocketBufferSizes(*socket);
+		tuning_.Prepare(*socket, controlSocket_.m_rtt.GetLatency());
 	}
 
 	return socket;
@@ -666,7 +704,12 @@ void CTransferSocket::OnIOThreadEvent()
 	}
 
 	if (m_transferMode == TransferMode::download) {
-		OnReceive();
+		if (finalizing_) {
+			FinalizeWrite();
+		}
+		else {
+			OnReceive();
+		}
 	}
 	else if (m_transferMode == TransferMode::upload) {
 		OnSend();
@@ -675,14 +718,21 @@ void CTransferSocket::OnIOThreadEvent()
 
 void CTransferSocket::FinalizeWrite()
 {
-	bool res = ioThread_->Finalize(BUFFERSIZE - m_transferBufferLen);
+	int res = ioThread_->Finalize(BUFFERSIZE - m_transferBufferLen);
 	m_transferBufferLen = BUFFERSIZE;
 
 	if (m_transferEndReason != TransferEndReason::none) {
 		return;
 	}
 
-	if (res) {
+	if (res == IO_Again) {
+		// The thread is still writing, called again from OnIOThreadEvent
+		finalizing_ = true;
+		return;
+	}
+	finalizing_ = false;
+
+	if (res == IO_Success) {
 		TransferEnd(TransferEndReason::successful);
 	}
 	else {
@@ -716,17 +766,6 @@ void CTransferSocket::TriggerPostponedEvents()
 	}
 }
 
-void CTransferSocket::SetSocketBufferSizes(fz::socket_base& socket)
-{
-	const int size_read = engine_.GetOptions().GetOptionVal(OPTION_SOCKET_BUFFERSIZE_RECV);
-#if FZ_WINDOWS
-	const int size_write = -1;
-#else
-	const int size_write = engine_.GetOptions().GetOptionVal(OPTION_SOCKET_BUFFERSIZE_SEND);
-#endif
-	socket.set_buffer_sizes(size_read, size_write);
-}
-
 void CTransferSocket::operator()(fz::event_base const& ev)
 {
 	fz::dispatch<fz::socket_event, CIOThreadEvent, fz::timer_event>(ev, this,
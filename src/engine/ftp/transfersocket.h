@@ -4,6 +4,7 @@
 #include "iothread.h"
 #include "backend.h"
 #include "ControlSocket.h"
+#include "socket_tuning.h"
 
 class CFileZillaEnginePrivate;
 class CFtpControlSocket;
@@ -32,6 +33,9 @@ public:
 	std::wstring SetupActiveTransfer(std::string const& ip);
 	bool SetupPassiveTransfer(std::wstring const& host, int port);
 
+	// Uses a connection opened in advance, see CFtpDataPrefetch
+	bool SetupPassiveTransfer(std::unique_ptr<fz::socket> && socket);
+
 	void SetActive();
 
 	CDirectoryListingParser *m_pDirectoryListingParser{};
@@ -65,8 +69,6 @@ protected:
 	std::unique_ptr<fz::listen_socket> CreateSocketServer();
 	std::unique_ptr<fz::listen_socket> CreateSocketServer(int port);
 
-	void SetSocketBufferSizes(fz::socket_base & socket);
-
 	virtual void operator()(fz::event_base const& ev);
 	void OnIOThreadEvent();
 
@@ -95,6 +97,8 @@ protected:
 
 	fz::socket_layer* active_layer_{};
 
+	CTcpTuning const tuning_;
+
 
 	// Needed for the madeProgress field in CTransferStatus
 	// Initially 0, 2 if made progress
@@ -102,6 +106,9 @@ protected:
 	int m_madeProgress{};
 
 	CIOThread* ioThread_{};
+
+	// Waiting for the IO thread to write the last data of a download
+	bool finalizing_{};
 };
 
 #endif
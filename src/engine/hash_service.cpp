@@ -0,0 +1,242 @@
+#include <filezilla.h>
+
+#include "hash_service.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/hash.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace {
+size_t const block_size = 1024 * 1024;
+size_t const min_block_size = 64 * 1024;
+
+// Slicing-by-8, processes 8 bytes per iteration using 8 lookup tables
+class crc32_table final
+{
+public:
+	crc32_table()
+	{
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+			}
+			t_[0][i] = c;
+		}
+		for (uint32_t i = 0; i < 256; ++i) {
+			for (int k = 1; k < 8; ++k) {
+				t_[k][i] = (t_[k - 1][i] >> 8) ^ t_[0][t_[k - 1][i] & 0xff];
+			}
+		}
+	}
+
+	uint32_t update(uint32_t crc, uint8_t const* p, size_t len) const
+	{
+		crc = ~crc;
+		while (len >= 8) {
+			uint32_t const a = crc ^ (uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24));
+			uint32_t const b = uint32_t(p[4]) | (uint32_t(p[5]) << 8) | (uint32_t(p[6]) << 16) | (uint32_t(p[7]) << 24);
+			crc = t_[7][a & 0xff] ^ t_[6][(a >> 8) & 0xff] ^ t_[5][(a >> 16) & 0xff] ^ t_[4][a >> 24] ^
+				t_[3][b & 0xff] ^ t_[2][(b >> 8) & 0xff] ^ t_[1][(b >> 16) & 0xff] ^ t_[0][b >> 24];
+			p += 8;
+			len -= 8;
+		}
+		while (len--) {
+			crc = t_[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+private:
+	uint32_t t_[8][256];
+};
+
+crc32_table const& get_crc32_table()
+{
+	static crc32_table const table;
+	return table;
+}
+
+fz::hash_algorithm to_algorithm(file_hash h)
+{
+	switch (h) {
+	case file_hash::md5:
+		return fz::hash_algorithm::md5;
+	case file_hash::sha1:
+		return fz::hash_algorithm::sha1;
+	case file_hash::sha256:
+		return fz::hash_algorithm::sha256;
+	default:
+		return fz::hash_algorithm::sha512;
+	}
+}
+}
+
+CHashService::CHashService(fz::thread_pool & pool, size_t memoryBudget)
+	: pool_(pool)
+	, memoryBudget_(std::max(memoryBudget, 2 * min_block_size))
+{
+}
+
+void CHashService::Reserve(size_t & bufferSize)
+{
+	// Each file being hashed needs two buffers: One being hashed, one being read into
+	bufferSize = std::min(block_size, memoryBudget_ / 2);
+
+	fz::scoped_lock l(mtx_);
+	while (used_ + 2 * bufferSize > memoryBudget_) {
+		cond_.wait(l);
+	}
+	used_ += 2 * bufferSize;
+
+	// Pass the wakeup on, there might be room for another waiter
+	if (used_ + 2 * min_block_size <= memoryBudget_) {
+		cond_.signal(l);
+	}
+}
+
+void CHashService::Release(size_t bufferSize)
+{
+	fz::scoped_lock l(mtx_);
+	used_ -= 2 * bufferSize;
+	cond_.signal(l);
+}
+
+CHashService::result CHashService::Hash(std::wstring const& file, unsigned int hashes, std::atomic<bool> const* cancel)
+{
+	result res;
+	res.file = file;
+	if (cancel && *cancel) {
+		return res;
+	}
+
+	size_t bufferSize{};
+	Reserve(bufferSize);
+	HashFile(res, hashes, bufferSize, cancel);
+	Release(bufferSize);
+
+	return res;
+}
+
+std::vector<CHashService::result> CHashService::Hash(std::vector<std::wstring> const& files, unsigned int hashes)
+{
+	std::vector<result> results(files.size());
+	if (files.empty()) {
+		return results;
+	}
+	for (size_t i = 0; i < files.size(); ++i) {
+		results[i].file = files[i];
+	}
+
+	// Each worker needs two blocks, one being read and one being hashed
+	size_t workers = std::max(std::thread::hardware_concurrency(), 2u);
+	workers = std::max<size_t>(1, std::min(workers, memoryBudget_ / (2 * block_size)));
+	workers = std::min(workers, files.size());
+
+	std::atomic<size_t> next{};
+	auto const work = [&]() {
+		size_t bufferSize{};
+		Reserve(bufferSize);
+		for (size_t i = next++; i < results.size(); i = next++) {
+			HashFile(results[i], hashes, bufferSize);
+		}
+		Release(bufferSize);
+	};
+
+	// The calling thread is one of the workers
+	std::vector<fz::async_task> tasks;
+	for (size_t i = 1; i < workers; ++i) {
+		auto task = pool_.spawn(work);
+		if (!task) {
+			break;
+		}
+		tasks.emplace_back(std::move(task));
+	}
+	work();
+
+	for (auto & task : tasks) {
+		task.join();
+	}
+
+	return results;
+}
+
+void CHashService::HashFile(result & res, unsigned int hashes, size_t bufferSize, std::atomic<bool> const* cancel)
+{
+	res.success = false;
+	res.size = -1;
+
+	fz::file f;
+	if (!f.open(fz::to_native(res.file), fz::file::reading)) {
+		return;
+	}
+
+	std::vector<std::pair<file_hash, std::unique_ptr<fz::hash_accumulator>>> accumulators;
+	for (auto h : { file_hash::md5, file_hash::sha1, file_hash::sha256, file_hash::sha512 }) {
+		if (hashes & hash_bit(h)) {
+			accumulators.emplace_back(h, std::make_unique<fz::hash_accumulator>(to_algorithm(h)));
+		}
+	}
+	bool const crc = (hashes & hash_bit(file_hash::crc32)) != 0;
+	uint32_t crc32{};
+
+	std::unique_ptr<uint8_t[]> buffers[2]{ std::make_unique<uint8_t[]>(bufferSize), std::make_unique<uint8_t[]>(bufferSize) };
+
+	int64_t size{};
+	int64_t len = f.read(buffers[0].get(), bufferSize);
+	int current = 0;
+	while (len > 0) {
+		size += len;
+
+		// Read the next block while hashing the current one. Not worth it after
+		// a short read, as that usually means EOF got reached.
+		uint8_t* next = buffers[current ^ 1].get();
+		int64_t nextLen{};
+		fz::async_task reader;
+		if (static_cast<size_t>(len) == bufferSize) {
+			reader = pool_.spawn([&f, &nextLen, next, bufferSize]() { nextLen = f.read(next, bufferSize); });
+		}
+
+		uint8_t const* data = buffers[current].get();
+		for (auto & acc : accumulators) {
+			acc.second->update(data, static_cast<size_t>(len));
+		}
+		if (crc) {
+			crc32 = get_crc32_table().update(crc32, data, static_cast<size_t>(len));
+		}
+
+		if (reader) {
+			reader.join();
+		}
+		else {
+			nextLen = f.read(next, bufferSize);
+		}
+		len = nextLen;
+		current ^= 1;
+
+		if (cancel && *cancel) {
+			return;
+		}
+	}
+
+	if (len < 0) {
+		return;
+	}
+
+	for (auto & acc : accumulators) {
+		res.digests[static_cast<size_t>(acc.first)] = acc.second->digest();
+	}
+	if (crc) {
+		res.digests[static_cast<size_t>(file_hash::crc32)] = {
+			static_cast<uint8_t>(crc32 >> 24), static_cast<uint8_t>(crc32 >> 16),
+			static_cast<uint8_t>(crc32 >> 8), static_cast<uint8_t>(crc32)
+		};
+	}
+
+	res.size = size;
+	res.success = true;
+}
@@ -1,7 +1,10 @@
 #include <filezilla.h>
 
+#include "checksum.h"
 #include "filetransfer.h"
+#include "preallocate.h"
 
+#include <libfilezilla/encode.hpp>
 #include <libfilezilla/local_filesys.hpp>
 
 #include <string.h>
@@ -41,6 +44,12 @@ int CHttpFileTransferOpData::Send()
 			return FZ_REPLY_NOTSUPPORTED;
 		}
 
+		if (writer_ && writer_->blocking()) {
+			// Data gets written from the event loop
+			log(logmsg::error, _("Cannot download into %s using this protocol"), writer_->name());
+			return FZ_REPLY_CRITICALERROR | FZ_REPLY_NOTSUPPORTED;
+		}
+
 		if (rr_.request_.uri_.empty()) {
 			log(logmsg::error, _("Could not create URI for this transfer."));
 			return FZ_REPLY_ERROR;
@@ -93,6 +102,7 @@ int CHttpFileTransferOpData::OpenFile()
 		}
 		file_.close();
 	}
+	streaming_.Close();
 
 	controlSocket_.CreateLocalDir(localFile_);
 
@@ -121,6 +131,8 @@ int CHttpFileTransferOpData::OnHeader()
 {
 	log(logmsg::debug_verbose, L"CHttpFileTransferOpData::OnHeader");
 
+	hash_.reset();
+
 	if (rr_.response_.code_ == 416 && resume_) {
 		assert(file_.opened());
 		if (file_.seek(0, fz::file::begin) != 0) {
@@ -201,16 +213,120 @@ int CHttpFileTransferOpData::OnHeader()
 		engine_.transfer_status_.SetStartTime();
 	}
 
+	if (!localFile_.empty() && engine_.GetOptions().GetOptionVal(OPTION_PREALLOCATE_SPACE)) {
+		// When resuming, Content-Length only covers the requested range
+		int64_t const offset = resume_ ? localFileSize_ : 0;
+		int64_t sizeToPreallocate = fz::to_integral<int64_t>(rr_.response_.get_header("Content-Length"), -1);
+		if (sizeToPreallocate == -1 && remoteFileSize_ != -1) {
+			sizeToPreallocate = remoteFileSize_ - offset;
+		}
+		if (sizeToPreallocate > 0) {
+			log(logmsg::debug_info, L"Preallocating %d bytes for the file \"%s\"", sizeToPreallocate, localFile_);
+			auto const res = PreallocateFile(file_, localFile_, offset, sizeToPreallocate);
+			if (res == preallocation::error) {
+				log(logmsg::error, _("Could not seek to offset %d within file"), offset);
+				return FZ_REPLY_ERROR;
+			}
+			else if (res == preallocation::failed) {
+				log(logmsg::debug_warning, L"Could not preallocate the file");
+			}
+		}
+	}
+
+	if (!localFile_.empty() && (transferSettings_.streaming || engine_.GetOptions().GetOptionVal(OPTION_STREAMING_IO))) {
+		streaming_.Open(localFile_, false, resume_ ? localFileSize_ : 0);
+	}
+
+	PrepareVerification();
+
 	return FZ_REPLY_CONTINUE;
 }
 
+void CHttpFileTransferOpData::PrepareVerification()
+{
+	// Only complete downloads into a file or writer can be verified
+	if (!engine_.GetOptions().GetOptionVal(OPTION_VERIFY_TRANSFERS) || (localFile_.empty() && !writer_) || resume_) {
+		return;
+	}
+
+	// RFC 3230 instance digests, e.g. "SHA-256=X48E9qOokqqrvdts8nOJRJN3OWDUoyWxBf7kbu9DBPE=,MD5=..."
+	bool found{};
+	for (auto token : fz::strtok(rr_.response_.get_header("Digest"), ",")) {
+		fz::trim(token);
+		auto pos = token.find('=');
+		if (pos == std::string::npos) {
+			continue;
+		}
+
+		fz::hash_algorithm algorithm;
+		if (!ParseHashAlgorithm(fz::to_wstring_from_utf8(token.substr(0, pos)), algorithm)) {
+			continue;
+		}
+		if (found && GetHashStrength(algorithm) <= GetHashStrength(verifyAlgorithm_)) {
+			continue;
+		}
+
+		auto digest = fz::base64_decode(token.substr(pos + 1));
+		if (digest.size() == GetDigestSize(algorithm)) {
+			found = true;
+			verifyAlgorithm_ = algorithm;
+			expectedDigest_.assign(digest.cbegin(), digest.cend());
+		}
+	}
+
+	if (!found) {
+		auto digest = fz::base64_decode(rr_.response_.get_header("Content-MD5"));
+		if (digest.size() == GetDigestSize(fz::hash_algorithm::md5)) {
+			found = true;
+			verifyAlgorithm_ = fz::hash_algorithm::md5;
+			expectedDigest_.assign(digest.cbegin(), digest.cend());
+		}
+	}
+
+	if (found) {
+		hash_ = std::make_unique<fz::hash_accumulator>(verifyAlgorithm_);
+	}
+	else {
+		log(logmsg::debug_info, L"Server did not send a digest of the file, transfer will not be verified");
+		controlSocket_.ReportVerification(verification_result::unavailable);
+	}
+}
+
+int CHttpFileTransferOpData::VerifyChecksum()
+{
+	std::wstring const name = GetHashAlgorithmName(verifyAlgorithm_);
+
+	auto const local = hash_->digest();
+	hash_.reset();
+
+	if (local != expectedDigest_) {
+		log(logmsg::error, _("%s checksum mismatch, local file has %s, remote file has %s"), name, fz::hex_encode<std::wstring>(local), fz::hex_encode<std::wstring>(expectedDigest_));
+		controlSocket_.ReportVerification(verification_result::mismatch);
+		return FZ_REPLY_VERIFYFAILED;
+	}
+
+	log(logmsg::status, _("%s checksum of transferred file matches"), name);
+	controlSocket_.ReportVerification(verification_result::match);
+	return FZ_REPLY_OK;
+}
+
 int CHttpFileTransferOpData::OnData(unsigned char const* data, unsigned int len)
 {
 	if (opState != filetransfer_waittransfer) {
 		return FZ_REPLY_INTERNALERROR;
 	}
 
-	if (localFile_.empty()) {
+	if (writer_) {
+		if (!writer_->write(data, len)) {
+			log(logmsg::error, _("Could not write to %s"), writer_->name());
+			return FZ_REPLY_ERROR;
+		}
+
+		if (hash_) {
+			hash_->update(data, len);
+		}
+	}
+	else if (localFile_.empty()) {
 		char* q = new char[len];
 		memcpy(q, data, len);
 		engine_.AddNotification(new CDataNotification(q, len));
@@ -223,6 +339,11 @@ int CHttpFileTransferOpData::OnData(unsigned char const* data, unsigned int len)
 			log(logmsg::error, _("Failed to write to file %s"), localFile_);
 			return FZ_REPLY_ERROR;
 		}
+
+		if (hash_) {
+			hash_->update(data, len);
+		}
+		streaming_.Advance(write);
 	}
 
 	engine_.transfer_status_.Update(len);
@@ -242,6 +363,16 @@ int CHttpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 				file_.fsync();
 			}
 		}
+		streaming_.Close();
+
+		if (prevResult == FZ_REPLY_OK && hash_) {
+			prevResult = VerifyChecksum();
+		}
+
+		if (prevResult == FZ_REPLY_OK && writer_ && !writer_->finish()) {
+			log(logmsg::error, _("Could not write to %s"), writer_->name());
+			return FZ_REPLY_ERROR;
+		}
 	}
 
 	return prevResult;
@@ -2,8 +2,10 @@
 #define FILEZILLA_ENGINE_HTTP_FILETRANSFER_HEADER
 
 #include "httpcontrolsocket.h"
+#include "streaming_io.h"
 
 #include <libfilezilla/file.hpp>
+#include <libfilezilla/hash.hpp>
 
 class CServerPath;
 
@@ -23,8 +25,17 @@ private:
 	int OnHeader();
 	int OnData(unsigned char const* data, unsigned int len);
 
+	void PrepareVerification();
+	int VerifyChecksum();
+
 	HttpRequestResponse rr_;
 	fz::file file_;
+	CStreamingIO streaming_;
+
+	// Set if the received data gets compared against a digest sent by the server
+	std::unique_ptr<fz::hash_accumulator> hash_;
+	fz::hash_algorithm verifyAlgorithm_{};
+	std::vector<uint8_t> expectedDigest_;
 
 	int redirectCount_{};
 };
@@ -214,17 +214,18 @@ void CHttpControlSocket::OnConnect()
 	}
 }
 
-void CHttpControlSocket::FileTransfer(std::wstring const& localFile, CServerPath const& remotePath,
-									std::wstring const& remoteFile, bool download,
-									CFileTransferCommand::t_transferSettings const& settings)
+void CHttpControlSocket::FileTransfer(CFileTransferCommand const& cmd)
 {
 	log(logmsg::debug_verbose, L"CHttpControlSocket::FileTransfer()");
 
-	if (download) {
-		log(logmsg::status, _("Downloading %s"), remotePath.FormatFilename(remoteFile));
+	if (cmd.Download()) {
+		log(logmsg::status, _("Downloading %s"), cmd.GetRemotePath().FormatFilename(cmd.GetRemoteFile()));
 	}
 
-	Push(std::make_unique<CHttpFileTransferOpData>(*this, download, localFile, remoteFile, remotePath, settings));
+	auto pData = std::make_unique<CHttpFileTransferOpData>(*this, cmd.Download(), cmd.GetLocalFile(), cmd.GetRemoteFile(), cmd.GetRemotePath(), cmd.GetTransferSettings());
+	pData->reader_ = cmd.GetReader();
+	pData->writer_ = cmd.GetWriter();
+	Push(std::move(pData));
 }
 
 void CHttpControlSocket::FileTransfer(CHttpRequestCommand const& command)
@@ -1,6 +1,8 @@
 #include <filezilla.h>
 
 #include "iothread.h"
+#include "metrics.h"
+#include "transfer_io.h"
 
 #include <libfilezilla/file.hpp>
 
@@ -21,6 +23,8 @@ CIOThread::~CIOThread()
 
 	Close();
 
+	ReportMetrics();
+
 	delete [] m_buffers[0];
 }
 
@@ -35,17 +39,88 @@ void CIOThread::Close()
 
 		m_pFile.reset();
 	}
+	reader_.reset();
+	writer_.reset();
+	streaming_.Close();
+}
+
+void CIOThread::ReportMetrics()
+{
+	if (!threadWaitCounter_) {
+		return;
+	}
+
+	threadWaitCounter_->add(threadWait_.get_microseconds());
+	appWaitCounter_->add(appWait_.get_microseconds());
+	bytesCounter_->add(processed_);
+
+	threadWait_ = fz::duration();
+	appWait_ = fz::duration();
+	processed_ = 0;
 }
 
-bool CIOThread::Create(fz::thread_pool& pool, std::unique_ptr<fz::file> && pFile, bool read, bool binary)
+bool CIOThread::Create(fz::thread_pool& pool, std::unique_ptr<fz::file> && pFile, bool read, bool binary, CMetrics* metrics)
 {
 	assert(pFile);
 
 	Close();
+	ReportMetrics();
 
 	m_pFile = std::move(pFile);
+
+#ifdef SIMULATE_IO
+	size_ = m_pFile->size();
+#endif
+
+	if (!streamingFile_.empty()) {
+		int64_t const offset = m_pFile->seek(0, fz::file::current);
+		if (offset >= 0) {
+			streaming_.Open(streamingFile_, read, offset);
+		}
+	}
+
+	return Start(pool, read, binary, metrics);
+}
+
+bool CIOThread::Create(fz::thread_pool& pool, std::shared_ptr<transfer_reader> const& reader, bool binary, CMetrics* metrics)
+{
+	assert(reader);
+
+	Close();
+	ReportMetrics();
+
+	reader_ = reader;
+
+	return Start(pool, true, binary, metrics);
+}
+
+bool CIOThread::Create(fz::thread_pool& pool, std::shared_ptr<transfer_writer> const& writer, bool binary, CMetrics* metrics)
+{
+	assert(writer);
+
+	Close();
+	ReportMetrics();
+
+	writer_ = writer;
+
+	return Start(pool, false, binary, metrics);
+}
+
+bool CIOThread::Start(fz::thread_pool& pool, bool read, bool binary, CMetrics* metrics)
+{
 	m_read = read;
 	m_binary = binary;
+	if (metrics) {
+		std::string const labels = read ? "direction=\"read\"" : "direction=\"write\"";
+		threadWaitCounter_ = &metrics->GetCounter("fz_iothread_thread_wait_microseconds_total", labels);
+		appWaitCounter_ = &metrics->GetCounter("fz_iothread_app_wait_microseconds_total", labels);
+		bytesCounter_ = &metrics->GetCounter("fz_iothread_bytes_total", labels);
+	}
+	else {
+		threadWaitCounter_ = nullptr;
+		appWaitCounter_ = nullptr;
+		bytesCounter_ = nullptr;
+	}
 
 	if (read) {
 		m_curAppBuf = BUFFERCOUNT - 1;
@@ -56,9 +131,9 @@ bool CIOThread::Create(fz::thread_pool& pool, std::unique_ptr<fz::file> && pFile
 		m_curThreadBuf = 0;
 	}
 
-#ifdef SIMULATE_IO
-	size_ = m_pFile->size();
-#endif
+	finalizing_ = false;
+	finalComplete_ = false;
+	finalLen_ = 0;
 
 	m_running = true;
 
@@ -87,6 +162,7 @@ void CIOThread::entry()
 					break;
 				}
 				m_appWaiting = false;
+				appWait_ += fz::monotonic_clock::now() - appWaitStart_;
 				m_evtHandler->send_event<CIOThreadEvent>();
 			}
 
@@ -97,6 +173,7 @@ void CIOThread::entry()
 			}
 
 			m_bufferLens[m_curThreadBuf] = static_cast<unsigned int>(len);
+			processed_ += len;
 
 			if (!len) {
 				m_running = false;
@@ -111,7 +188,9 @@ void CIOThread::entry()
 
 				m_threadWaiting = true;
 				if (m_running) {
+					auto const start = fz::monotonic_clock::now();
 					m_condition.wait(l);
+					threadWait_ += fz::monotonic_clock::now() - start;
 				}
 			}
 		}
@@ -119,6 +198,10 @@ void CIOThread::entry()
 	else {
 		fz::scoped_lock l(m_mutex);
 		while (m_curAppBuf == -1) {
+			if (finalizing_) {
+				FinishWriting(l);
+				return;
+			}
 			if (!m_running) {
 				return;
 			}
@@ -130,11 +213,18 @@ void CIOThread::entry()
 
 		for (;;) {
 			while (m_curThreadBuf == m_curAppBuf) {
+				// Only the buffer of the application is left
+				if (finalizing_) {
+					FinishWriting(l);
+					return;
+				}
 				if (!m_running) {
 					return;
 				}
 				m_threadWaiting = true;
+				auto const start = fz::monotonic_clock::now();
 				m_condition.wait(l);
+				threadWait_ += fz::monotonic_clock::now() - start;
 			}
 
 			l.unlock();
@@ -145,13 +235,18 @@ void CIOThread::entry()
 				m_error = true;
 				m_running = false;
 			}
+			else {
+				processed_ += BUFFERSIZE;
+			}
 
-			if (m_appWaiting) {
+			// While finalizing, the app only waits for all data to be written
+			if (m_appWaiting && (!finalizing_ || m_error)) {
 				if (!m_evtHandler) {
 					m_running = false;
 					break;
 				}
 				m_appWaiting = false;
+				appWait_ += fz::monotonic_clock::now() - appWaitStart_;
 				m_evtHandler->send_event<CIOThreadEvent>();
 			}
 
@@ -181,6 +276,7 @@ int CIOThread::GetNextWriteBuffer(char** pBuffer)
 	int newBuf = (m_curAppBuf + 1) % BUFFERCOUNT;
 	if (newBuf == m_curThreadBuf) {
 		m_appWaiting = true;
+		appWaitStart_ = fz::monotonic_clock::now();
 		return IO_Again;
 	}
 
@@ -195,40 +291,76 @@ int CIOThread::GetNextWriteBuffer(char** pBuffer)
 	return IO_Success;
 }
 
-bool CIOThread::Finalize(int len)
+int CIOThread::Finalize(int len, bool complete)
 {
-	assert(m_pFile);
+	assert(!m_read);
 
-	Destroy();
+	{
+		fz::scoped_lock l(m_mutex);
+		if (!finalizing_) {
+			finalizing_ = true;
+			finalComplete_ = complete;
+			finalLen_ = len;
+			if (m_threadWaiting) {
+				m_threadWaiting = false;
+				m_condition.signal(l);
+			}
+		}
 
-	if (m_curAppBuf == -1) {
-		return true;
+		if (m_running) {
+			m_appWaiting = true;
+			appWaitStart_ = fz::monotonic_clock::now();
+			return IO_Again;
+		}
 	}
 
-	if (m_error) {
-		return false;
-	}
+	thread_.join();
 
-	if (!len) {
-		return true;
-	}
+	return m_error ? IO_Error : IO_Success;
+}
 
-	if (!WriteToFile(m_buffers[m_curAppBuf], len)) {
-		return false;
-	}
+void CIOThread::FinishWriting(fz::scoped_lock & l)
+{
+	int const buffer = m_curAppBuf;
+	int const len = finalLen_;
 
+	// m_running is only reset here by Destroy, i.e. if the transfer got aborted
+	bool const complete = finalComplete_ && m_running;
+
+	l.unlock();
+
+	bool success = true;
+	if (buffer != -1 && len) {
+		success = WriteToFile(m_buffers[buffer], len);
 #ifndef FZ_WINDOWS
-	if (!m_binary && m_wasCarriageReturn) {
-		const char CR = '\r';
-		if (m_pFile->write(&CR, 1) != 1) {
-			return false;
+		if (success && !m_binary && m_wasCarriageReturn) {
+			const char CR = '\r';
+			success = DoWrite(&CR, 1);
 		}
-	}
 #endif
+	}
+	if (success && complete && writer_) {
+		success = writer_->finish();
+	}
 
+	l.lock();
+
+	if (success) {
+		processed_ += len;
+	}
+	else {
+		m_error = true;
+	}
 	m_curAppBuf = -1;
+	m_running = false;
 
-	return true;
+	if (m_appWaiting) {
+		m_appWaiting = false;
+		appWait_ += fz::monotonic_clock::now() - appWaitStart_;
+		if (m_evtHandler) {
+			m_evtHandler->send_event<CIOThreadEvent>();
+		}
+	}
 }
 
 int CIOThread::GetNextReadBuffer(char** pBuffer)
@@ -248,6 +380,7 @@ int CIOThread::GetNextReadBuffer(char** pBuffer)
 		}
 		else {
 			m_appWaiting = true;
+			appWaitStart_ = fz::monotonic_clock::now();
 			return IO_Again;
 		}
 	}
@@ -265,10 +398,12 @@ int CIOThread::GetNextReadBuffer(char** pBuffer)
 
 void CIOThread::Destroy()
 {
+	bool cancel{};
 	{
 		fz::scoped_lock l(m_mutex);
 		if (m_running) {
 			m_running = false;
+			cancel = true;
 			if (m_threadWaiting) {
 				m_threadWaiting = false;
 				m_condition.signal(l);
@@ -276,9 +411,39 @@ void CIOThread::Destroy()
 		}
 	}
 
+	// The thread might be blocked in the reader or writer
+	if (cancel) {
+		if (reader_) {
+			reader_->cancel();
+		}
+		if (writer_) {
+			writer_->cancel();
+		}
+	}
+
 	thread_.join();
 }
 
+void CIOThread::EnableHashing(fz::hash_algorithm algorithm)
+{
+	hash_ = std::make_unique<fz::hash_accumulator>(algorithm);
+}
+
+void CIOThread::EnableStreaming(std::wstring const& file)
+{
+	streamingFile_ = file;
+}
+
+std::vector<uint8_t> CIOThread::GetDigest()
+{
+	Destroy();
+
+	if (!hash_) {
+		return std::vector<uint8_t>();
+	}
+	return hash_->digest();
+}
+
 int64_t CIOThread::ReadFromFile(char* pBuffer, int64_t maxLen)
 {
 #ifdef SIMULATE_IO
@@ -296,7 +461,14 @@ int64_t CIOThread::ReadFromFile(char* pBuffer, int64_t maxLen)
 	if (m_binary)
 #endif
 	{
-		return m_pFile->read(pBuffer, maxLen);
+		auto len = DoRead(pBuffer, maxLen);
+		if (len > 0) {
+			if (hash_) {
+				hash_->update(reinterpret_cast<uint8_t const*>(pBuffer), static_cast<size_t>(len));
+			}
+			streaming_.Advance(len);
+		}
+		return len;
 	}
 
 #ifndef FZ_WINDOWS
@@ -306,10 +478,14 @@ int64_t CIOThread::ReadFromFile(char* pBuffer, int64_t maxLen)
 	const int readLen = maxLen / 2;
 
 	char* r = pBuffer + readLen;
-	auto len = m_pFile->read(r, readLen);
+	auto len = DoRead(r, readLen);
 	if (!len || len <= -1) {
 		return len;
 	}
+	if (hash_) {
+		hash_->update(reinterpret_cast<uint8_t const*>(r), static_cast<size_t>(len));
+	}
+	streaming_.Advance(len);
 
 	const char* const end = r + len;
 	char* w = pBuffer;
@@ -399,10 +575,34 @@ bool CIOThread::WriteToFile(char* pBuffer, int64_t len)
 #endif
 }
 
+int64_t CIOThread::DoRead(char* pBuffer, int64_t len)
+{
+	if (reader_) {
+		return reader_->read(pBuffer, len);
+	}
+	return m_pFile->read(pBuffer, len);
+}
+
 bool CIOThread::DoWrite(char const* pBuffer, int64_t len)
 {
+	if (writer_) {
+		if (!writer_->write(pBuffer, len)) {
+			fz::scoped_lock locker(m_mutex);
+			m_error_description = fz::sprintf(_("Could not write to %s"), writer_->name());
+			return false;
+		}
+		if (hash_) {
+			hash_->update(reinterpret_cast<uint8_t const*>(pBuffer), static_cast<size_t>(len));
+		}
+		return true;
+	}
+
 	auto written = m_pFile->write(pBuffer, len);
 	if (written == len) {
+		if (hash_) {
+			hash_->update(reinterpret_cast<uint8_t const*>(pBuffer), static_cast<size_t>(len));
+		}
+		streaming_.Advance(len);
 		return true;
 	}
 
@@ -2,7 +2,12 @@
 #define FILEZILLA_ENGINE_IOTHREAD_HEADER
 
 #include <libfilezilla/event.hpp>
+#include <libfilezilla/hash.hpp>
 #include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include "metrics.h"
+#include "streaming_io.h"
 
 #define BUFFERCOUNT 8
 #define BUFFERSIZE 256*1024
@@ -26,15 +31,39 @@ namespace fz {
 class file;
 }
 
+class transfer_reader;
+class transfer_writer;
+
 class CIOThread final
 {
 public:
 	CIOThread();
 	~CIOThread();
 
-	bool Create(fz::thread_pool& pool, std::unique_ptr<fz::file> && pFile, bool read, bool binary);
+	// If metrics is set, accumulated wait times and the amount of data
+	// passed through get reported to it once the thread got destroyed.
+	bool Create(fz::thread_pool& pool, std::unique_ptr<fz::file> && pFile, bool read, bool binary, CMetrics* metrics = nullptr);
+
+	// Same as above, but reads from or writes to something other than a
+	// local file. The thread may block in the reader or writer, Destroy
+	// cancels them.
+	bool Create(fz::thread_pool& pool, std::shared_ptr<transfer_reader> const& reader, bool binary, CMetrics* metrics = nullptr);
+	bool Create(fz::thread_pool& pool, std::shared_ptr<transfer_writer> const& writer, bool binary, CMetrics* metrics = nullptr);
 	void Destroy(); // Only call that might be blocking
 
+	// Call before Create. The file contents get hashed on the fly as they
+	// are read or written, so that transfers can be verified without
+	// reading the file a second time.
+	void EnableHashing(fz::hash_algorithm algorithm);
+
+	// Call before Create. Keeps the file out of the page cache, see
+	// CStreamingIO. Meant for large transfers.
+	void EnableStreaming(std::wstring const& file);
+
+	// Digest of all data read or written. Waits for the thread to finish,
+	// only call after EOF got reached or after Finalize.
+	std::vector<uint8_t> GetDigest();
+
 	// Call before first call to one of the GetNext*Buffer functions
 	// This handler will receive the CIOThreadEvent events. The events
 	// get triggerd iff a buffer is available after a call to the
@@ -54,17 +83,29 @@ public:
 	//               IO_Success else
 	int GetNextWriteBuffer(char** pBuffer);
 
-	bool Finalize(int len);
+	// Hands the last write buffer, filled with len bytes, to the thread.
+	// Return value: IO_Again until all data got written, the event handler
+	//               receives a CIOThreadEvent then and Finalize needs to
+	//               be called again
+	//               IO_Error on error
+	//               IO_Success else
+	// If complete is false, the transfer did not finish. The data received
+	// so far still gets written, but writers do not get finished.
+	int Finalize(int len, bool complete = true);
 
 	std::wstring GetError();
 
 private:
+	bool Start(fz::thread_pool& pool, bool read, bool binary, CMetrics* metrics);
 	void Close();
+	void ReportMetrics();
 
 	void entry();
+	void FinishWriting(fz::scoped_lock & l);
 
 	int64_t ReadFromFile(char* pBuffer, int64_t maxLen);
 	bool WriteToFile(char* pBuffer, int64_t len);
+	int64_t DoRead(char* pBuffer, int64_t len);
 	bool DoWrite(char const* pBuffer, int64_t len);
 
 	fz::event_handler* m_evtHandler{};
@@ -72,6 +113,8 @@ private:
 	bool m_read{};
 	bool m_binary{};
 	std::unique_ptr<fz::file> m_pFile;
+	std::shared_ptr<transfer_reader> reader_;
+	std::shared_ptr<transfer_writer> writer_;
 
 	char* m_buffers[BUFFERCOUNT];
 	unsigned int m_bufferLens[BUFFERCOUNT];
@@ -89,8 +132,31 @@ private:
 
 	bool m_wasCarriageReturn{};
 
+	// Set by Finalize, protected by m_mutex
+	bool finalizing_{};
+	bool finalComplete_{};
+	int finalLen_{};
+
 	std::wstring m_error_description;
 
+	// Looked up once in Start if metrics are wanted
+	CMetrics::counter* threadWaitCounter_{};
+	CMetrics::counter* appWaitCounter_{};
+	CMetrics::counter* bytesCounter_{};
+
+	// Time spent by the thread waiting for buffers, and by the application
+	// waiting for the thread. Protected by m_mutex.
+	fz::duration threadWait_;
+	fz::duration appWait_;
+	fz::monotonic_clock appWaitStart_;
+	int64_t processed_{};
+
+	// Only accessed by the thread, or after it has finished
+	std::unique_ptr<fz::hash_accumulator> hash_;
+	CStreamingIO streaming_;
+
+	std::wstring streamingFile_;
+
 #ifdef SIMULATE_IO
 	int64_t size_{};
 #endif
@@ -0,0 +1,195 @@
+#include <filezilla.h>
+
+#include "metrics.h"
+
+#include <libfilezilla/file.hpp>
+
+namespace {
+std::string series(std::string const& name, std::string const& labels, std::string const& extra = std::string())
+{
+	std::string ret = name;
+	if (!labels.empty() || !extra.empty()) {
+		ret += '{';
+		ret += labels;
+		if (!labels.empty() && !extra.empty()) {
+			ret += ',';
+		}
+		ret += extra;
+		ret += '}';
+	}
+	return ret;
+}
+
+void escape_json(std::string & out, std::string const& in)
+{
+	for (auto const& c : in) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20) {
+			out += ' ';
+		}
+		else {
+			out += c;
+		}
+	}
+}
+
+bool write_file(std::wstring const& file, std::string const& data)
+{
+	if (file.empty()) {
+		return false;
+	}
+
+	fz::file f(fz::to_native(file), fz::file::writing, fz::file::empty);
+	if (!f.opened()) {
+		return false;
+	}
+
+	return f.write(data.c_str(), static_cast<int64_t>(data.size())) == static_cast<int64_t>(data.size());
+}
+}
+
+void CMetrics::histogram::observe(int64_t v)
+{
+	size_t bucket = 0;
+	int64_t bound = 1;
+	while (bucket < bucket_count && v > bound) {
+		bound <<= 2;
+		++bucket;
+	}
+	buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(v, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+int64_t CMetrics::histogram::bucket_bound(size_t bucket)
+{
+	return int64_t(1) << (2 * bucket);
+}
+
+CMetrics::CMetrics()
+	: epoch_(fz::monotonic_clock::now())
+{
+}
+
+CMetrics::counter& CMetrics::GetCounter(std::string const& name, std::string const& labels)
+{
+	fz::scoped_lock l(mutex_);
+	return counters_[name][labels];
+}
+
+CMetrics::histogram& CMetrics::GetHistogram(std::string const& name, std::string const& labels)
+{
+	fz::scoped_lock l(mutex_);
+	return histograms_[name][labels];
+}
+
+void CMetrics::EnableTracing(size_t max_spans)
+{
+	fz::scoped_lock l(mutex_);
+	max_spans_ = max_spans;
+	tracing_ = max_spans != 0;
+}
+
+void CMetrics::AddSpan(char const* category, std::string const& name, unsigned int id, fz::monotonic_clock const& start, fz::monotonic_clock const& end, int result)
+{
+	if (!Tracing() || !start || !end) {
+		return;
+	}
+
+	fz::scoped_lock l(mutex_);
+	if (spans_.size() >= max_spans_) {
+		++dropped_spans_;
+		return;
+	}
+
+	spans_.emplace_back();
+	auto & s = spans_.back();
+	s.category_ = category;
+	s.name_ = name;
+	s.id_ = id;
+	s.start_ = (start - epoch_).get_microseconds();
+	s.duration_ = (end - start).get_microseconds();
+	s.result_ = result;
+}
+
+std::string CMetrics::FormatPrometheus() const
+{
+	std::string ret;
+
+	fz::scoped_lock l(mutex_);
+	for (auto const& family : counters_) {
+		ret += "# TYPE " + family.first + " counter\n";
+		for (auto const& s : family.second) {
+			ret += series(family.first, s.first) + ' ' + std::to_string(s.second.get()) + '\n';
+		}
+	}
+
+	for (auto const& family : histograms_) {
+		ret += "# TYPE " + family.first + " histogram\n";
+		for (auto const& s : family.second) {
+			auto const& h = s.second;
+
+			// Prometheus buckets are cumulative
+			int64_t cumulative{};
+			for (size_t i = 0; i < histogram::bucket_count; ++i) {
+				cumulative += h.buckets_[i].load(std::memory_order_relaxed);
+				ret += series(family.first + "_bucket", s.first, "le=\"" + std::to_string(histogram::bucket_bound(i)) + "\"") + ' ' + std::to_string(cumulative) + '\n';
+			}
+			int64_t const count = h.count_.load(std::memory_order_relaxed);
+			ret += series(family.first + "_bucket", s.first, "le=\"+Inf\"") + ' ' + std::to_string(count) + '\n';
+			ret += series(family.first + "_sum", s.first) + ' ' + std::to_string(h.sum_.load(std::memory_order_relaxed)) + '\n';
+			ret += series(family.first + "_count", s.first) + ' ' + std::to_string(count) + '\n';
+		}
+	}
+
+	if (tracing_) {
+		ret += "# TYPE fz_trace_dropped_spans_total counter\n";
+		ret += "fz_trace_dropped_spans_total " + std::to_string(dropped_spans_) + '\n';
+	}
+
+	return ret;
+}
+
+std::string CMetrics::FormatChromeTrace() const
+{
+	std::string ret = "{\"traceEvents\":[";
+
+	fz::scoped_lock l(mutex_);
+	bool first = true;
+	for (auto const& s : spans_) {
+		if (!first) {
+			ret += ',';
+		}
+		first = false;
+
+		ret += "\n{\"name\":\"";
+		escape_json(ret, s.name_);
+		ret += "\",\"cat\":\"";
+		ret += s.category_;
+		ret += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+		ret += std::to_string(s.id_);
+		ret += ",\"ts\":";
+		ret += std::to_string(s.start_);
+		ret += ",\"dur\":";
+		ret += std::to_string(s.duration_);
+		ret += ",\"args\":{\"result\":";
+		ret += std::to_string(s.result_);
+		ret += "}}";
+	}
+	ret += "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return ret;
+}
+
+bool CMetrics::WritePrometheus(std::wstring const& file) const
+{
+	return write_file(file, FormatPrometheus());
+}
+
+bool CMetrics::WriteChromeTrace(std::wstring const& file) const
+{
+	return write_file(file, FormatChromeTrace());
+}
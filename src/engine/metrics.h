@@ -0,0 +1,108 @@
+#ifndef FILEZILLA_ENGINE_METRICS_HEADER
+#define FILEZILLA_ENGINE_METRICS_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+// Low-overhead instrumentation shared by all engines of a context.
+//
+// Counters and histograms are registered by name on first use and live as
+// long as the CMetrics instance. Registering takes a lock, so callers look
+// them up once and keep the returned reference around. Updating them is a
+// single atomic operation.
+//
+// Names follow the Prometheus conventions, a series is identified by its
+// family name and an optional label string, e.g. op="CFtpListOpData".
+//
+// Spans are only recorded if tracing got enabled, otherwise recording a span
+// is a single atomic load.
+class CMetrics final
+{
+public:
+	class counter final
+	{
+	public:
+		void add(int64_t v = 1) { value_.fetch_add(v, std::memory_order_relaxed); }
+		int64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+	private:
+		std::atomic<int64_t> value_{};
+	};
+
+	// Histogram with fixed, exponentially growing buckets. Bucket i holds
+	// observations <= 4^i, the last bucket holds everything else.
+	class histogram final
+	{
+	public:
+		static constexpr size_t bucket_count = 16;
+
+		void observe(int64_t v);
+
+		static int64_t bucket_bound(size_t bucket);
+
+	private:
+		friend class CMetrics;
+
+		std::atomic<int64_t> buckets_[bucket_count + 1]{};
+		std::atomic<int64_t> sum_{};
+		std::atomic<int64_t> count_{};
+	};
+
+	CMetrics();
+
+	CMetrics(CMetrics const&) = delete;
+	CMetrics& operator=(CMetrics const&) = delete;
+
+	counter& GetCounter(std::string const& name, std::string const& labels = std::string());
+	histogram& GetHistogram(std::string const& name, std::string const& labels = std::string());
+
+	// Number of buffered spans is limited to avoid unbounded growth during
+	// long sessions, further spans are dropped and counted.
+	void EnableTracing(size_t max_spans);
+	bool Tracing() const { return tracing_.load(std::memory_order_relaxed); }
+
+	// Category is one of a few static strings, e.g. "operation" or "io".
+	// The id is used as thread id in the trace, typically the engine id.
+	void AddSpan(char const* category, std::string const& name, unsigned int id, fz::monotonic_clock const& start, fz::monotonic_clock const& end, int result = 0);
+
+	// Prometheus text exposition format
+	std::string FormatPrometheus() const;
+
+	// Chrome trace event format, can be loaded in chrome://tracing or Perfetto
+	std::string FormatChromeTrace() const;
+
+	bool WritePrometheus(std::wstring const& file) const;
+	bool WriteChromeTrace(std::wstring const& file) const;
+
+private:
+	struct span final
+	{
+		char const* category_{};
+		std::string name_;
+		unsigned int id_{};
+		int64_t start_{};
+		int64_t duration_{};
+		int result_{};
+	};
+
+	fz::monotonic_clock const epoch_;
+
+	mutable fz::mutex mutex_{false};
+
+	// Family name -> labels -> series. Both levels are ordered so that
+	// the export is stable and all series of a family are adjacent.
+	std::map<std::string, std::map<std::string, counter>> counters_;
+	std::map<std::string, std::map<std::string, histogram>> histograms_;
+
+	std::atomic<bool> tracing_{};
+	size_t max_spans_{};
+	std::vector<span> spans_;
+	int64_t dropped_spans_{};
+};
+
+#endif
@@ -1,13 +1,13 @@
 #include <filezilla.h>
 
-#include "ControlSocket.h"
 #include "oplock_manager.h"
 
+#include <algorithm>
+
 #include <assert.h>
 
-OpLock::OpLock(OpLockManager * mgr, size_t socket, size_t lock)
+OpLock::OpLock(OpLockManager * mgr, OpLockManager::lock_info * lock)
 	: mgr_(mgr)
-	, socket_(socket)
 	, lock_(lock)
 {
 }
@@ -26,10 +26,10 @@ OpLock::OpLock(OpLock && op)
 		mgr_->Unlock(*this);
 	}
 	mgr_ = op.mgr_;
-	socket_ = op.socket_;
 	lock_ = op.lock_;
 
 	op.mgr_ = nullptr;
+	op.lock_ = nullptr;
 }
 
 OpLock& OpLock::operator=(OpLock && op)
@@ -39,10 +39,10 @@ OpLock& OpLock::operator=(OpLock && op)
 			mgr_->Unlock(*this);
 		}
 		mgr_ = op.mgr_;
-		socket_ = op.socket_;
 		lock_ = op.lock_;
 
 		op.mgr_ = nullptr;
+		op.lock_ = nullptr;
 	}
 
 	return *this;
@@ -57,179 +57,343 @@ bool OpLock::waiting() const
 	return false;
 }
 
-OpLock OpLockManager::Lock(CControlSocket * socket, locking_reason reason, CServerPath const& path, bool inclusive)
+OpLock OpLockManager::Lock(fz::event_handler * handler, CServer const& server, locking_reason reason, CServerPath const& path, bool inclusive)
 {
-	fz::scoped_lock l(mtx_);
+	// The reference is held by the lock
+	server_table & table = acquire(server);
 
-	size_t socket_index = get_or_create(socket);
-	auto & sli = socket_locks_[socket_index];
+	fz::scoped_lock l(table.mtx_);
 
-	lock_info info;
-	info.reason = reason;
-	info.inclusive = inclusive;
-	info.path = path;
+	auto & locks = table.handlers_[handler].locks_;
+	locks.emplace_back(std::make_unique<lock_info>());
 
-	for (auto const& other_sli : socket_locks_) {
-		if (other_sli.control_socket_ == socket || other_sli.server_ != sli.server_) {
-			continue;
-		}
+	lock_info & info = *locks.back();
+	info.table_ = &table;
+	info.node_ = &get_or_create(table, path);
+	info.handler_ = handler;
+	info.reason_ = reason;
+	info.inclusive_ = inclusive;
 
-		for (auto const& lock : other_sli.locks_) {
-			if (reason != lock.reason || lock.waiting || lock.released) {
-				continue;
-			}
-			if (lock.path == path || (lock.inclusive && lock.path.IsParentOf(path, false))) {
-				info.waiting = true;
-				break;
-			}
-			if (inclusive && path.IsParentOf(lock.path, false)) {
-				info.waiting = true;
-				break;
-			}
+	Add(info, Conflicts(info));
+
+	return OpLock(this, &info);
+}
+
+void OpLockManager::Unlock(OpLock & lock)
+{
+	assert(lock.lock_);
+
+	lock_info & info = *lock.lock_;
+	server_table & table = *info.table_;
+
+	{
+		fz::scoped_lock l(table.mtx_);
+
+		if (!info.waiting_) {
+			Wakeup(info);
 		}
-		if (info.waiting) {
-			break;
+
+		Remove(info);
+
+		auto hit = table.handlers_.find(info.handler_);
+		assert(hit != table.handlers_.end());
+
+		auto & locks = hit->second.locks_;
+		auto it = std::find_if(locks.begin(), locks.end(), [&info](std::unique_ptr<lock_info> const& p) { return p.get() == &info; });
+		assert(it != locks.end());
+		locks.erase(it);
+		if (locks.empty()) {
+			table.handlers_.erase(hit);
 		}
 	}
 
-	sli.locks_.push_back(info);
+	release(table);
 
-	return OpLock(this, socket_index, sli.locks_.size() - 1);
+	lock.mgr_ = nullptr;
+	lock.lock_ = nullptr;
 }
 
-void OpLockManager::Unlock(OpLock & lock)
+bool OpLockManager::Waiting(OpLock const& lock) const
 {
-	fz::scoped_lock l(mtx_);
-	assert(lock.socket_ < socket_locks_.size());
-	assert(lock.lock_ < socket_locks_[lock.socket_].locks_.size());
+	assert(lock.lock_);
 
-	bool was_waiting = false;
+	fz::scoped_lock l(lock.lock_->table_->mtx_);
+	return lock.lock_->waiting_;
+}
 
-	auto & sli = socket_locks_[lock.socket_];
+bool OpLockManager::Waiting(fz::event_handler * handler, CServer const& server) const
+{
+	server_table * table = find(server);
+	if (!table) {
+		return false;
+	}
+	table_ref ref(*this, table);
 
-	was_waiting = sli.locks_[lock.lock_].waiting;
+	fz::scoped_lock l(table->mtx_);
+	auto it = table->handlers_.find(handler);
+	return it != table->handlers_.end() && it->second.waiting_ != 0;
+}
 
-	if (lock.lock_ + 1 == sli.locks_.size()) {
-		sli.locks_.pop_back();
-		while (!sli.locks_.empty() && sli.locks_.back().released) {
-			sli.locks_.pop_back();
-		}
-		if (sli.locks_.empty()) {
-			if (lock.socket_ + 1 == socket_locks_.size()) {
-				socket_locks_.pop_back();
-				while (!socket_locks_.empty() && !socket_locks_.back().control_socket_) {
-					socket_locks_.pop_back();
-				}
-			}
-			else {
-				socket_locks_[lock.socket_].control_socket_ = nullptr;
-			}
+bool OpLockManager::ObtainWaiting(fz::event_handler * handler, CServer const& server)
+{
+	server_table * table = find(server);
+	if (!table) {
+		return false;
+	}
+	table_ref ref(*this, table);
+
+	fz::scoped_lock l(table->mtx_);
+
+	auto it = table->handlers_.find(handler);
+	if (it == table->handlers_.end() || !it->second.waiting_) {
+		return false;
+	}
+
+	bool obtained = false;
+	for (auto & lock : it->second.locks_) {
+		if (lock->waiting_ && !Conflicts(*lock)) {
+			Obtain(*lock);
+			obtained = true;
 		}
 	}
-	else {
-		sli.locks_[lock.lock_].waiting = false;
-		sli.locks_[lock.lock_].released = true;
+
+	return obtained;
+}
+
+bool OpLockManager::Conflicts(lock_info const& lock) const
+{
+	auto const conflicts = [&lock](lock_info const* other, bool parent) {
+		return other->reason_ == lock.reason_ && other->handler_ != lock.handler_ && (!parent || other->inclusive_);
+	};
+
+	node const& n = *lock.node_;
+	for (auto const* other : n.held_) {
+		if (conflicts(other, false)) {
+			return true;
+		}
 	}
 
-	lock.mgr_ = nullptr;
+	for (node const* parent = n.parent_; parent; parent = parent->parent_) {
+		for (auto const* other : parent->held_) {
+			if (conflicts(other, true)) {
+				return true;
+			}
+		}
+	}
 
-	if (!was_waiting) {
-		Wakeup();
+	if (lock.inclusive_) {
+		for (auto const* child : n.children_) {
+			if (ConflictsInSubtree(lock, *child)) {
+				return true;
+			}
+		}
 	}
+
+	return false;
 }
 
-void OpLockManager::Wakeup()
+bool OpLockManager::ConflictsInSubtree(lock_info const& lock, node const& n) const
 {
-	for (auto & sli : socket_locks_) {
-		for (auto & lock : sli.locks_) {
-			if (lock.waiting) {
-				sli.control_socket_->send_event<CObtainLockEvent>();
-				break;
-			}
+	if (!n.held_count_) {
+		return false;
+	}
+
+	for (auto const* other : n.held_) {
+		if (other->reason_ == lock.reason_ && other->handler_ != lock.handler_) {
+			return true;
 		}
 	}
+
+	for (auto const* child : n.children_) {
+		if (ConflictsInSubtree(lock, *child)) {
+			return true;
+		}
+	}
+
+	return false;
 }
 
-bool OpLockManager::ObtainWaiting(CControlSocket * socket)
+void OpLockManager::Wakeup(lock_info const& released)
 {
-	bool obtained = false;
+	// Only the waiting locks the released lock conflicted with can be obtained now
+	std::vector<fz::event_handler*> handlers;
 
-	fz::scoped_lock l(mtx_);
-	for (auto & sli : socket_locks_) {
-		if (sli.control_socket_ == socket) {
-			for (auto & lock : sli.locks_) {
-				if (lock.waiting) {
-					obtained |= ObtainWaiting(sli, lock);
-				}
-			}
+	node const& n = *released.node_;
+	CollectWaiting(released, n, false, handlers);
+
+	for (node const* parent = n.parent_; parent; parent = parent->parent_) {
+		CollectWaiting(released, *parent, true, handlers);
+	}
+
+	if (released.inclusive_) {
+		for (auto const* child : n.children_) {
+			CollectWaitingInSubtree(released, *child, handlers);
 		}
 	}
 
-	return obtained;
+	for (auto * handler : handlers) {
+		handler->send_event<CObtainLockEvent>();
+	}
 }
 
-bool OpLockManager::ObtainWaiting(socket_lock_info const& sli, lock_info& lock)
+void OpLockManager::CollectWaiting(lock_info const& released, node const& n, bool parent, std::vector<fz::event_handler*> & handlers)
 {
-	for (auto const& other_sli : socket_locks_) {
-		if (&other_sli == &sli) {
+	for (auto const* other : n.waiting_) {
+		if (other->reason_ != released.reason_ || other->handler_ == released.handler_) {
+			continue;
+		}
+		if (parent && !other->inclusive_) {
 			continue;
 		}
+		if (std::find(handlers.cbegin(), handlers.cend(), other->handler_) == handlers.cend()) {
+			handlers.push_back(other->handler_);
+		}
+	}
+}
 
-		for (auto const& other_lock : other_sli.locks_) {
-			if (lock.reason != other_lock.reason || other_lock.waiting || other_lock.released) {
-				continue;
-			}
-			if (other_lock.path == lock.path || (other_lock.inclusive && other_lock.path.IsParentOf(lock.path, false))) {
-				return false;
-			}
-			if (lock.inclusive && lock.path.IsParentOf(other_lock.path, false)) {
-				return false;
-			}
+void OpLockManager::CollectWaitingInSubtree(lock_info const& released, node const& n, std::vector<fz::event_handler*> & handlers)
+{
+	if (!n.waiting_count_) {
+		return;
+	}
+
+	CollectWaiting(released, n, false, handlers);
+	for (auto const* child : n.children_) {
+		CollectWaitingInSubtree(released, *child, handlers);
+	}
+}
+
+void OpLockManager::Add(lock_info & lock, bool waiting)
+{
+	lock.waiting_ = waiting;
+
+	node & n = *lock.node_;
+	if (waiting) {
+		n.waiting_.push_back(&lock);
+		for (node * p = &n; p; p = p->parent_) {
+			++p->waiting_count_;
 		}
+		++lock.table_->handlers_[lock.handler_].waiting_;
 	}
+	else {
+		n.held_.push_back(&lock);
+		for (node * p = &n; p; p = p->parent_) {
+			++p->held_count_;
+		}
+	}
+}
 
-	lock.waiting = false;
-	return true;
+void OpLockManager::Obtain(lock_info & lock)
+{
+	assert(lock.waiting_);
+	lock.waiting_ = false;
+
+	node & n = *lock.node_;
+	n.waiting_.erase(std::find(n.waiting_.begin(), n.waiting_.end(), &lock));
+	n.held_.push_back(&lock);
+	for (node * p = &n; p; p = p->parent_) {
+		--p->waiting_count_;
+		++p->held_count_;
+	}
+	--lock.table_->handlers_[lock.handler_].waiting_;
 }
 
-size_t OpLockManager::get_or_create(CControlSocket * socket)
+void OpLockManager::Remove(lock_info & lock)
 {
-	for (size_t i = 0; i < socket_locks_.size(); ++i) {
-		if (socket_locks_[i].control_socket_ == socket) {
-			return i;
+	node & n = *lock.node_;
+	if (lock.waiting_) {
+		n.waiting_.erase(std::find(n.waiting_.begin(), n.waiting_.end(), &lock));
+		for (node * p = &n; p; p = p->parent_) {
+			--p->waiting_count_;
+		}
+		--lock.table_->handlers_[lock.handler_].waiting_;
+	}
+	else {
+		n.held_.erase(std::find(n.held_.begin(), n.held_.end(), &lock));
+		for (node * p = &n; p; p = p->parent_) {
+			--p->held_count_;
 		}
 	}
 
-	socket_lock_info info;
-	info.control_socket_ = socket;
-	info.server_ = socket->GetCurrentServer();
-	socket_locks_.push_back(info);
+	lock.node_ = nullptr;
+	prune(*lock.table_, &n);
+}
+
+OpLockManager::node & OpLockManager::get_or_create(server_table & table, CServerPath const& path)
+{
+	auto it = table.nodes_.find(path);
+	if (it != table.nodes_.end()) {
+		return it->second;
+	}
+
+	node * parent{};
+	if (path.HasParent()) {
+		parent = &get_or_create(table, path.GetParent());
+	}
 
-	return socket_locks_.size() - 1;
+	node & n = table.nodes_[path];
+	n.path_ = path;
+	n.parent_ = parent;
+	if (parent) {
+		parent->children_.push_back(&n);
+	}
+
+	return n;
 }
 
-bool OpLockManager::Waiting(OpLock const& lock) const
+void OpLockManager::prune(server_table & table, node * n)
+{
+	// Remove nodes no longer having any locks on them or their children
+	while (n && !n->held_count_ && !n->waiting_count_) {
+		assert(n->children_.empty());
+
+		node * parent = n->parent_;
+		if (parent) {
+			parent->children_.erase(std::find(parent->children_.begin(), parent->children_.end(), n));
+		}
+
+		CServerPath const path = n->path_;
+		table.nodes_.erase(path);
+
+		n = parent;
+	}
+}
+
+OpLockManager::server_table & OpLockManager::acquire(CServer const& server)
 {
 	fz::scoped_lock l(mtx_);
-	assert(lock.socket_ < socket_locks_.size());
-	assert(lock.lock_ < socket_locks_[lock.socket_].locks_.size());
 
-	auto & sli = socket_locks_[lock.socket_];
-	return sli.locks_[lock.lock_].waiting;
+	auto & table = tables_[server];
+	if (!table) {
+		table = std::make_unique<server_table>();
+		table->server_ = server;
+	}
+	++table->refs_;
+
+	return *table;
 }
 
-bool OpLockManager::Waiting(CControlSocket * socket) const
+OpLockManager::server_table * OpLockManager::find(CServer const& server) const
 {
 	fz::scoped_lock l(mtx_);
-	for (auto const& sli : socket_locks_) {
-		if (sli.control_socket_ == socket) {
-			for (auto const& lock : sli.locks_) {
-				if (lock.waiting) {
-					return true;
-				}
-			}
-		}
+
+	auto it = tables_.find(server);
+	if (it != tables_.end()) {
+		++it->second->refs_;
+		return it->second.get();
 	}
 
-	return false;
+	return nullptr;
+}
+
+void OpLockManager::release(server_table & table) const
+{
+	fz::scoped_lock l(mtx_);
+
+	assert(table.refs_);
+	if (!--table.refs_) {
+		// Without any locks, all nodes have been pruned already
+		assert(table.nodes_.empty() && table.handlers_.empty());
+		tables_.erase(table.server_);
+	}
 }
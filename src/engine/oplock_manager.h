@@ -1,11 +1,15 @@
 #ifndef FILEZILLA_ENGINE_OPLOCK_MANAGER_HEADER
 #define FILEZILLA_ENGINE_OPLOCK_MANAGER_HEADER
 
+#include "server.h"
 #include "serverpath.h"
 
+#include <libfilezilla/event_handler.hpp>
 #include <libfilezilla/mutex.hpp>
 
+#include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 struct obtain_lock_event_type;
@@ -20,79 +24,163 @@ enum class locking_reason
 	private1
 };
 
-class CControlSocket;
-
-class OpLockManager;
-class OpLock final
+class OpLock;
+
+// Locks are kept in a separate table for each server, each table having its
+// own mutex. Within a table, locks are indexed by a tree of the locked paths
+// and their parents, so that conflicts are found by walking the parents and,
+// for inclusive locks, the locked subtree instead of comparing against all
+// locks of all handlers. A table is removed once nothing refers to it anymore.
+//
+// Locks are held by event handlers, usually control sockets. Releasing a lock
+// only sends a CObtainLockEvent to the handlers waiting for a lock that
+// conflicted with the released one.
+class OpLockManager final
 {
 public:
-	OpLock() = default;
-	~OpLock();
+	OpLockManager() = default;
 
-	OpLock(OpLock const&) = delete;
-	OpLock& operator=(OpLock const&) = delete;
+	OpLockManager(OpLockManager const&) = delete;
+	OpLockManager& operator=(OpLockManager const&) = delete;
 
-	OpLock(OpLock && op);
-	OpLock& operator=(OpLock && op);
+	OpLock Lock(fz::event_handler * handler, CServer const& server, locking_reason reason, CServerPath const& path, bool inclusive = false);
 
-	explicit operator bool() const {
-		return mgr_ != nullptr;
-	}
+	bool Waiting(fz::event_handler * handler, CServer const& server) const;
 
-	bool waiting() const;
+	bool ObtainWaiting(fz::event_handler * handler, CServer const& server);
 
 private:
-	friend class OpLockManager;
-
-	OpLock(OpLockManager * mgr, size_t socket, size_t lock);
+	friend class OpLock;
 
-	OpLockManager * mgr_{};
-	size_t socket_{};
-	size_t lock_{};
-};
+	struct server_table;
+	struct node;
 
+	struct lock_info final
+	{
+		server_table * table_{};
+		node * node_{};
+		fz::event_handler * handler_{};
 
-class OpLockManager final
-{
-public:
-	OpLock Lock(CControlSocket * socket, locking_reason reason, CServerPath const& path, bool inclusive = false);
+		locking_reason reason_{};
+		bool inclusive_{};
+		bool waiting_{};
+	};
 
-	bool Waiting(CControlSocket * socket) const;
+	// A locked path or a parent thereof
+	struct node final
+	{
+		CServerPath path_;
+		node * parent_{};
+		std::vector<node*> children_;
 
-	bool ObtainWaiting(CControlSocket * socket);
+		std::vector<lock_info*> held_;
+		std::vector<lock_info*> waiting_;
 
-private:
-	friend class OpLock;
+		// Number of held and waiting locks on this node and all its children
+		size_t held_count_{};
+		size_t waiting_count_{};
+	};
 
-	struct lock_info
+	struct handler_info final
 	{
-		locking_reason reason{};
-		CServerPath path;
-		bool inclusive{};
-		bool waiting{};
-		bool released{};
+		std::vector<std::unique_ptr<lock_info>> locks_;
+		size_t waiting_{};
 	};
 
-	struct socket_lock_info
+	struct server_table final
 	{
 		CServer server_;
-		CControlSocket * control_socket_;
 
-		std::vector<lock_info> locks_;
+		// Each lock and each pending lookup holds a reference, guarded by
+		// the manager's mutex
+		size_t refs_{};
+
+		mutable fz::mutex mtx_{false};
+
+		std::unordered_map<CServerPath, node> nodes_;
+		std::unordered_map<fz::event_handler*, handler_info> handlers_;
 	};
 
-	void Unlock(OpLock & lock);
+	// Keeps a table alive while it gets used
+	class table_ref final
+	{
+	public:
+		table_ref(OpLockManager const& mgr, server_table * table)
+			: mgr_(mgr)
+			, table_(table)
+		{}
+
+		~table_ref()
+		{
+			if (table_) {
+				mgr_.release(*table_);
+			}
+		}
+
+		table_ref(table_ref const&) = delete;
+		table_ref& operator=(table_ref const&) = delete;
+
+	private:
+		OpLockManager const& mgr_;
+		server_table * table_;
+	};
 
-	void Wakeup();
-	bool ObtainWaiting(socket_lock_info const& sli, lock_info& lock);
+	void Unlock(OpLock & lock);
 
 	bool Waiting(OpLock const& lock) const;
 
-	size_t get_or_create(CControlSocket * socket);
+	bool Conflicts(lock_info const& lock) const;
+	bool ConflictsInSubtree(lock_info const& lock, node const& n) const;
+
+	void Wakeup(lock_info const& released);
+	void CollectWaiting(lock_info const& released, node const& n, bool parent, std::vector<fz::event_handler*> & handlers);
+	void CollectWaitingInSubtree(lock_info const& released, node const& n, std::vector<fz::event_handler*> & handlers);
+
+	void Add(lock_info & lock, bool waiting);
+	void Obtain(lock_info & lock);
+	void Remove(lock_info & lock);
+
+	node & get_or_create(server_table & table, CServerPath const& path);
+	void prune(server_table & table, node * n);
 
-	std::vector<socket_lock_info> socket_locks_;
+	// Return the table with an added reference
+	server_table & acquire(CServer const& server);
+	server_table * find(CServer const& server) const;
+
+	// Removes the table once the last reference is gone
+	void release(server_table & table) const;
+
+	// A table's mutex is held without holding mtx_
+	mutable std::map<CServer, std::unique_ptr<server_table>> tables_;
 
 	mutable fz::mutex mtx_{false};
 };
 
+class OpLock final
+{
+public:
+	OpLock() = default;
+	~OpLock();
+
+	OpLock(OpLock const&) = delete;
+	OpLock& operator=(OpLock const&) = delete;
+
+	OpLock(OpLock && op);
+	OpLock& operator=(OpLock && op);
+
+	explicit operator bool() const {
+		return mgr_ != nullptr;
+	}
+
+	bool waiting() const;
+
+private:
+	friend class OpLockManager;
+
+	OpLock(OpLockManager * mgr, OpLockManager::lock_info * lock);
+
+	OpLockManager * mgr_{};
+	OpLockManager::lock_info * lock_{};
+};
+
 #endif
@@ -3,8 +3,22 @@
 
 #include <assert.h>
 
-CPathCache::CPathCache()
+size_t CPathCache::source_path_hash::operator()(CSourcePath const& p) const
 {
+	size_t ret = p.source.hash();
+	ret ^= std::hash<std::wstring>()(p.subdir) + static_cast<size_t>(0x9e3779b9) + (ret << 6) + (ret >> 2);
+	return ret;
+}
+
+CPathCache::CPathCache(CMetrics* metrics, size_t maxEntries)
+	: maxEntries_(maxEntries)
+{
+	if (metrics) {
+		hitCounter_ = &metrics->GetCounter("fz_path_cache_lookups_total", "result=\"hit\"");
+		missCounter_ = &metrics->GetCounter("fz_path_cache_lookups_total", "result=\"miss\"");
+		failureHitCounter_ = &metrics->GetCounter("fz_path_cache_lookups_total", "result=\"failure\"");
+		evictionCounter_ = &metrics->GetCounter("fz_path_cache_evictions_total");
+	}
 }
 
 CPathCache::~CPathCache()
@@ -17,55 +31,147 @@ void CPathCache::Store(CServer const& server, CServerPath const& target, CServer
 
 	assert(!target.empty() && !source.empty());
 
-	tCacheIterator iter = m_cache.find(server);
-	if (iter == m_cache.cend()) {
-		iter = m_cache.emplace(std::make_pair(server, tServerCache())).first;
+	CEntry& entry = Insert(server, CSourcePath{source, subdir});
+	entry.target = target;
+
+	Prune();
+}
+
+CServerPath CPathCache::Lookup(CServer const& server, CServerPath const& source, std::wstring const& subdir)
+{
+	fz::scoped_lock lock(mutex_);
+
+	CEntry* entry = Find(server, CSourcePath{source, subdir});
+	if (!entry || entry->target.empty()) {
+		++stats_.misses;
+		if (missCounter_) {
+			missCounter_->add();
+		}
+		return CServerPath();
 	}
-	tServerCache &serverCache = iter->second;
 
-	CSourcePath sourcePath;
+	++stats_.hits;
+	if (hitCounter_) {
+		hitCounter_->add();
+	}
 
-	sourcePath.source = source;
-	sourcePath.subdir = subdir;
+	Touch(*entry);
+	return entry->target;
+}
+
+void CPathCache::StoreFailure(CServer const& server, CServerPath const& source, std::wstring const& subdir)
+{
+	fz::scoped_lock lock(mutex_);
 
-	serverCache[sourcePath] = target;
+	if (source.empty()) {
+		return;
+	}
+
+	CEntry& entry = Insert(server, CSourcePath{source, subdir});
+	entry.target.clear();
+	entry.failureTime = fz::monotonic_clock::now();
+
+	Prune();
 }
 
-CServerPath CPathCache::Lookup(CServer const& server, CServerPath const& source, std::wstring const& subdir)
+bool CPathCache::LookupFailure(CServer const& server, CServerPath const& source, std::wstring const& subdir)
 {
 	fz::scoped_lock lock(mutex_);
 
-	const tCacheConstIterator iter = m_cache.find(server);
+	CSourcePath const sourcePath{source, subdir};
+
+	CServerEntry* serverEntry{};
+	CEntry* entry = Find(server, sourcePath, &serverEntry);
+	if (!entry || !entry->target.empty()) {
+		return false;
+	}
+
+	if (fz::monotonic_clock::now() - entry->failureTime > failureTtl_) {
+		Erase(*serverEntry, serverEntry->entries.find(sourcePath));
+		return false;
+	}
+
+	++stats_.failure_hits;
+	if (failureHitCounter_) {
+		failureHitCounter_->add();
+	}
+	return true;
+}
+
+CPathCache::CEntry* CPathCache::Find(CServer const& server, CSourcePath const& sourcePath, CServerEntry** serverEntry)
+{
+	tCacheIterator iter = m_cache.find(server);
 	if (iter == m_cache.end()) {
-		return CServerPath();
+		return nullptr;
 	}
 
-	CServerPath result = Lookup(iter->second, source, subdir);
+	auto it = iter->second.entries.find(sourcePath);
+	if (it == iter->second.entries.end()) {
+		return nullptr;
+	}
 
-#ifndef NDEBUG
-	if (result.empty()) {
-		m_misses++;
+	if (serverEntry) {
+		*serverEntry = &iter->second;
+	}
+	return &it->second;
+}
+
+CPathCache::CEntry& CPathCache::Insert(CServer const& server, CSourcePath && sourcePath)
+{
+	tCacheIterator iter = m_cache.find(server);
+	if (iter == m_cache.end()) {
+		iter = m_cache.emplace(server, CServerEntry()).first;
+	}
+	CServerEntry & serverEntry = iter->second;
+
+	auto inserted = serverEntry.entries.emplace(sourcePath, CEntry());
+	CEntry & entry = inserted.first->second;
+	if (inserted.second) {
+		entry.lruIt = m_lruList.emplace(m_lruList.end(), &serverEntry, std::move(sourcePath));
 	}
 	else {
-		m_hits++;
+		Touch(entry);
 	}
-#endif
 
-	return result;
+	return entry;
 }
 
-CServerPath CPathCache::Lookup(tServerCache const& serverCache, CServerPath const& source, std::wstring const& subdir)
+void CPathCache::Erase(CServerEntry & serverEntry, tServerCacheIterator const& it)
 {
-	CSourcePath sourcePath;
-	sourcePath.source = source;
-	sourcePath.subdir = subdir;
+	m_lruList.erase(it->second.lruIt);
+	serverEntry.entries.erase(it);
+}
 
-	tServerCacheConstIterator serverIter = serverCache.find(sourcePath);
-	if (serverIter == serverCache.end()) {
-		return CServerPath();
+void CPathCache::EraseFailures(CServerEntry & serverEntry)
+{
+	for (auto it = serverEntry.entries.begin(); it != serverEntry.entries.end(); ) {
+		if (it->second.target.empty()) {
+			m_lruList.erase(it->second.lruIt);
+			it = serverEntry.entries.erase(it);
+		}
+		else {
+			++it;
+		}
 	}
+}
+
+void CPathCache::Touch(CEntry & entry)
+{
+	m_lruList.splice(m_lruList.end(), m_lruList, entry.lruIt);
+}
+
+void CPathCache::Prune()
+{
+	while (m_lruList.size() > maxEntries_) {
+		auto const& oldest = m_lruList.front();
+		oldest.first->entries.erase(oldest.second);
+		m_lruList.pop_front();
 
-	return serverIter->second;
+		++stats_.evictions;
+		if (evictionCounter_) {
+			evictionCounter_->add();
+		}
+	}
 }
 
 void CPathCache::InvalidateServer(CServer const& server)
@@ -77,6 +183,9 @@ void CPathCache::InvalidateServer(CServer const& server)
 		return;
 	}
 
+	for (auto const& entry : iter->second.entries) {
+		m_lruList.erase(entry.second.lruIt);
+	}
 	m_cache.erase(iter);
 }
 
@@ -90,18 +199,16 @@ void CPathCache::InvalidatePath(CServer const& server, CServerPath const& path,
 	}
 }
 
-void CPathCache::InvalidatePath(tServerCache & serverCache, CServerPath const& path, std::wstring const& subdir)
+void CPathCache::InvalidatePath(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& subdir)
 {
-	CSourcePath sourcePath;
-
-	sourcePath.source = path;
-	sourcePath.subdir = subdir;
+	// Whatever got changed might be a directory we previously failed to change into
+	EraseFailures(serverEntry);
 
 	CServerPath target;
-	tServerCacheIterator serverIter = serverCache.find(sourcePath);
-	if (serverIter != serverCache.end()) {
-		target = serverIter->second;
-		serverCache.erase(serverIter);
+	tServerCacheIterator serverIter = serverEntry.entries.find(CSourcePath{path, subdir});
+	if (serverIter != serverEntry.entries.end()) {
+		target = serverIter->second.target;
+		Erase(serverEntry, serverIter);
 	}
 
 	if (target.empty() && !subdir.empty()) {
@@ -113,12 +220,12 @@ void CPathCache::InvalidatePath(tServerCache & serverCache, CServerPath const& p
 
 	if (!target.empty()) {
 		// Unfortunately O(n), don't know of a faster way.
-		for (serverIter = serverCache.begin(); serverIter != serverCache.end(); ) {
-			if (serverIter->second == target || target.IsParentOf(serverIter->second, false)) {
-				serverCache.erase(serverIter++);
-			}
-			else if (serverIter->first.source == target || target.IsParentOf(serverIter->first.source, false)) {
-				serverCache.erase(serverIter++);
+		for (serverIter = serverEntry.entries.begin(); serverIter != serverEntry.entries.end(); ) {
+			if (serverIter->second.target == target || target.IsParentOf(serverIter->second.target, false) ||
+				serverIter->first.source == target || target.IsParentOf(serverIter->first.source, false))
+			{
+				m_lruList.erase(serverIter->second.lruIt);
+				serverIter = serverEntry.entries.erase(serverIter);
 			}
 			else {
 				++serverIter;
@@ -127,8 +234,28 @@ void CPathCache::InvalidatePath(tServerCache & serverCache, CServerPath const& p
 	}
 }
 
+void CPathCache::InvalidateFailures(CServer const& server)
+{
+	fz::scoped_lock lock(mutex_);
+
+	tCacheIterator iter = m_cache.find(server);
+	if (iter != m_cache.end()) {
+		EraseFailures(iter->second);
+	}
+}
+
 void CPathCache::Clear()
 {
 	fz::scoped_lock lock(mutex_);
 	m_cache.clear();
+	m_lruList.clear();
+}
+
+CPathCache::statistics CPathCache::GetStatistics() const
+{
+	fz::scoped_lock lock(mutex_);
+
+	statistics ret = stats_;
+	ret.entries = m_lruList.size();
+	return ret;
 }
@@ -1,12 +1,27 @@
 #ifndef FILEZILLA_ENGINE_PATHCACHE_HEADER
 #define FILEZILLA_ENGINE_PATHCACHE_HEADER
 
+#include "metrics.h"
+
 #include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <list>
+#include <map>
+#include <unordered_map>
 
+// Remembers which directory the server actually changed into when asked to
+// change into a path, saving the PWD round trip when changing into the same
+// path again.
+//
+// Entries of all servers share a single LRU list, the total number of entries
+// is bounded. Failures to change into a directory are remembered for a short
+// time, so that further operations on the same inaccessible directory fail
+// without a round trip.
 class CPathCache final
 {
 public:
-	CPathCache();
+	explicit CPathCache(CMetrics* metrics = nullptr, size_t maxEntries = 100000);
 	~CPathCache();
 
 	CPathCache(CPathCache const&) = delete;
@@ -18,43 +33,98 @@ public:
 	// The source argument should be a canonicalized path already if subdir is non-empty happen
 	CServerPath Lookup(CServer const& server, CServerPath const& source, std::wstring const& subdir = std::wstring());
 
+	// Remembers that changing into the directory has failed
+	void StoreFailure(CServer const& server, CServerPath const& source, std::wstring const& subdir = std::wstring());
+
+	// Returns true if changing into the directory has failed recently
+	bool LookupFailure(CServer const& server, CServerPath const& source, std::wstring const& subdir = std::wstring());
+
 	void InvalidateServer(CServer const& server);
 
-	// Invalidate path
+	// Invalidate path, also forgets all failures of the server
 	void InvalidatePath(CServer const& server, CServerPath const& path, std::wstring const& subdir = std::wstring());
 
+	// Forgets all failures of the server, e.g. after a directory got created
+	void InvalidateFailures(CServer const& server);
+
 	void Clear();
 
+	struct statistics final
+	{
+		int64_t hits{};
+		int64_t misses{};
+		int64_t failure_hits{};
+		int64_t evictions{};
+		size_t entries{};
+	};
+	statistics GetStatistics() const;
+
 protected:
-	class CSourcePath
+	class CSourcePath final
 	{
 	public:
 		CServerPath source;
 		std::wstring subdir;
 
-		bool operator<(CSourcePath const& op) const
+		bool operator==(CSourcePath const& op) const
 		{
-			return std::tie(subdir, source) < std::tie(op.subdir, op.source);
+			return source == op.source && subdir == op.subdir;
 		}
 	};
 
-	fz::mutex mutex_;
+	struct source_path_hash final
+	{
+		size_t operator()(CSourcePath const& p) const;
+	};
 
-	typedef std::map<CSourcePath, CServerPath> tServerCache;
+	class CServerEntry;
+	typedef std::list<std::pair<CServerEntry*, CSourcePath>> tLruList;
+
+	class CEntry final
+	{
+	public:
+		// Empty if changing into the directory failed
+		CServerPath target;
+		fz::monotonic_clock failureTime;
+
+		tLruList::iterator lruIt;
+	};
+
+	typedef std::unordered_map<CSourcePath, CEntry, source_path_hash> tServerCache;
 	typedef tServerCache::iterator tServerCacheIterator;
-	typedef tServerCache::const_iterator tServerCacheConstIterator;
-	typedef std::map<CServer, tServerCache> tCache;
-	tCache m_cache;
+
+	class CServerEntry final
+	{
+	public:
+		tServerCache entries;
+	};
+
+	typedef std::map<CServer, CServerEntry> tCache;
 	typedef tCache::iterator tCacheIterator;
-	typedef tCache::const_iterator tCacheConstIterator;
 
-	CServerPath Lookup(tServerCache const& serverCache, CServerPath const& source, std::wstring const& subdir);
-	void InvalidatePath(tServerCache & serverCache, CServerPath const& path, std::wstring const& subdir = std::wstring());
+	mutable fz::mutex mutex_;
 
-#ifndef NDEBUG
-	int m_hits{};
-	int m_misses{};
-#endif
+	tCache m_cache;
+	tLruList m_lruList;
+
+	size_t const maxEntries_;
+	fz::duration const failureTtl_{fz::duration::from_seconds(10)};
+
+	CEntry* Find(CServer const& server, CSourcePath const& sourcePath, CServerEntry** serverEntry = nullptr);
+	CEntry& Insert(CServer const& server, CSourcePath && sourcePath);
+	void Erase(CServerEntry & serverEntry, tServerCacheIterator const& it);
+	void EraseFailures(CServerEntry & serverEntry);
+	void Touch(CEntry & entry);
+	void Prune();
+
+	void InvalidatePath(CServerEntry & serverEntry, CServerPath const& path, std::wstring const& subdir = std::wstring());
+
+	statistics stats_;
+
+	CMetrics::counter* hitCounter_{};
+	CMetrics::counter* missCounter_{};
+	CMetrics::counter* failureHitCounter_{};
+	CMetrics::counter* evictionCounter_{};
 };
 
 #endif
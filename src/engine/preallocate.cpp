@@ -0,0 +1,66 @@
+#include <filezilla.h>
+
+#include "preallocate.h"
+
+#ifndef FZ_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+preallocation PreallocateFile(fz::file & f, std::wstring const& name, int64_t offset, int64_t length)
+{
+	if (offset < 0 || length <= 0 || !f.opened()) {
+		return preallocation::failed;
+	}
+
+#if (defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)) || defined(F_PREALLOCATE)
+	int fd = open(fz::to_native(name).c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return preallocation::failed;
+	}
+
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+	int res;
+	do {
+		res = fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(length));
+	} while (res == -1 && errno == EINTR);
+	bool const ret = res == 0;
+#else
+	// Allocates past the physical end of the file. Try contiguous space first.
+	fstore_t store{F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(length), 0};
+	bool ret = fcntl(fd, F_PREALLOCATE, &store) != -1;
+	if (!ret) {
+		store.fst_flags = F_ALLOCATEALL;
+		ret = fcntl(fd, F_PREALLOCATE, &store) != -1;
+	}
+#endif
+
+	close(fd);
+	return ret ? preallocation::done : preallocation::failed;
+#else
+	(void)name;
+
+	// Extend the file through the open handle, the space would be released
+	// again if it got reserved without changing the size.
+	auto const oldPos = f.seek(0, fz::file::current);
+	if (oldPos < 0) {
+		return preallocation::failed;
+	}
+
+	// Never shrink the file
+	int64_t const end = offset + length;
+	if (f.size() >= end) {
+		return preallocation::done;
+	}
+
+	auto ret = preallocation::failed;
+	if (f.seek(end, fz::file::begin) == end && f.truncate()) {
+		ret = preallocation::done;
+	}
+	if (f.seek(oldPos, fz::file::begin) != oldPos) {
+		return preallocation::error;
+	}
+	return ret;
+#endif
+}
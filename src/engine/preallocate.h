@@ -0,0 +1,32 @@
+#ifndef FILEZILLA_ENGINE_PREALLOCATE_HEADER
+#define FILEZILLA_ENGINE_PREALLOCATE_HEADER
+
+#include <libfilezilla/file.hpp>
+
+#include <string>
+
+enum class preallocation
+{
+	done,
+	failed,
+
+	// The file position could not be restored, the file must not be written to.
+	error
+};
+
+// Reserves disk space for length bytes starting at offset in the given file,
+// so that downloading into it does not fragment the file. The file has to be
+// open for writing.
+//
+// Where the platform supports it, the size of the file does not change. This
+// keeps transfers that got interrupted resumable from the right offset and
+// leaves no zero-filled tail behind.
+//
+// On Windows, reserved space beyond the end of the file gets released once the
+// last handle gets closed. There the file is extended instead and the current
+// position within the file is restored afterwards.
+//
+// Failing is harmless, the file just gets allocated as written.
+preallocation PreallocateFile(fz::file & f, std::wstring const& name, int64_t offset, int64_t length);
+
+#endif
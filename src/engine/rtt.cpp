@@ -40,6 +40,10 @@ bool CLatencyMeasurement::Stop()
 	m_summed_latency += diff.get_milliseconds();
 	++m_measurements;
 
+	if (histogram_) {
+		histogram_->observe(diff.get_microseconds());
+	}
+
 	return true;
 }
 
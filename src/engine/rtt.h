@@ -4,6 +4,8 @@
 #include <libfilezilla/mutex.hpp>
 #include <libfilezilla/time.hpp>
 
+#include "metrics.h"
+
 class CLatencyMeasurement final
 {
 public:
@@ -19,12 +21,17 @@ public:
 
 	void Reset();
 
+	// Each completed measurement also gets reported to the histogram
+	void SetHistogram(CMetrics::histogram* histogram) { histogram_ = histogram; }
+
 protected:
 	fz::monotonic_clock m_start;
 
 	int64_t m_summed_latency{};
 	int m_measurements{};
 
+	CMetrics::histogram* histogram_{};
+
 	mutable fz::mutex m_sync{false};
 };
 
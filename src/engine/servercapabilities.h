@@ -29,6 +29,19 @@ enum capabilityNames
 	rest_stream, // supports REST+STOR in addition to APPE
 	epsv_command,
 
+	// Checksum commands. The option of hash_command is the list of algorithms
+	// from the FEAT reply, the currently selected one marked with an asterisk.
+	hash_command,
+	xsha512_command,
+	xsha256_command,
+	xsha1_command,
+	xmd5_command,
+	xcrc_command,
+
+	// Set to 'no' if an SFTP server supports neither the check-file-name
+	// nor the md5-hash extension
+	check_file_extension,
+
 	// Server timezone offset. If using FTP, LIST details are unspecified and
 	// can return different times than the UTC based times using the MLST or
 	// MDTM commands.
@@ -38,7 +51,11 @@ enum capabilityNames
 	timezone_offset,
 
 	auth_tls_command,
-	auth_ssl_command
+	auth_ssl_command,
+
+	// Set to 'no' if the server rejected a transfer command on a data
+	// connection opened in advance
+	data_connection_prefetch
 };
 
 class CCapabilities final
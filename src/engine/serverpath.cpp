@@ -30,17 +30,153 @@ static const CServerTypeTraits traits[SERVERTYPE_MAX] = {
 	{ L"/\\", false,    0,    0,    false, 0, 0,   true,  false } // DOS with forwardslashes
 };
 
+class CServerPathSegment final
+{
+public:
+	CServerPathSegment(std::shared_ptr<CServerPathSegment const> const& p, std::wstring && n)
+		: parent(p)
+		, name(std::move(n))
+		, depth(p ? p->depth + 1 : 1)
+		, hash(p ? p->hash : 0)
+	{
+		hash_combine(hash, std::hash<std::wstring>()(name));
+	}
+
+	~CServerPathSegment()
+	{
+		// Releasing a long chain would otherwise recurse once per segment.
+		// Detach the parents that are not shared with other paths one by
+		// one, each gets destroyed without a parent of its own.
+		std::shared_ptr<CServerPathSegment const> p = std::move(parent);
+		while (p && p.use_count() == 1) {
+			std::shared_ptr<CServerPathSegment const> next = std::move(p->parent);
+			p = std::move(next);
+		}
+	}
+
+	static void hash_combine(size_t & seed, size_t v)
+	{
+		seed ^= v + static_cast<size_t>(0x9e3779b9) + (seed << 6) + (seed >> 2);
+	}
+
+	// Only changed by the destructor
+	mutable std::shared_ptr<CServerPathSegment const> parent;
+	std::wstring const name;
+
+	// Number of segments up to and including this one
+	size_t const depth;
+
+	// Over all segments up to and including this one
+	size_t hash;
+};
+
+namespace {
+typedef std::shared_ptr<CServerPathSegment const> segment_ptr;
+
+size_t depth(CServerPathSegment const* s)
+{
+	return s ? s->depth : 0;
+}
+
+segment_ptr const& ancestor(segment_ptr const& s, size_t depth)
+{
+	segment_ptr const* p = &s;
+	while (*p && (*p)->depth > depth) {
+		p = &(*p)->parent;
+	}
+	return *p;
+}
+
+CServerPathSegment const* ancestor(CServerPathSegment const* s, size_t depth)
+{
+	while (s && s->depth > depth) {
+		s = s->parent.get();
+	}
+	return s;
+}
+
+// Segments need to be of the same depth. Shared ancestors are not compared.
+bool equal_segments(CServerPathSegment const* a, CServerPathSegment const* b, bool cmpNoCase)
+{
+	while (a != b) {
+		if (cmpNoCase) {
+			if (fz::stricmp(a->name, b->name)) {
+				return false;
+			}
+		}
+		else if (a->hash != b->hash || a->name != b->name) {
+			return false;
+		}
+		a = a->parent.get();
+		b = b->parent.get();
+	}
+	return true;
+}
+
+// Segments need to be of the same depth. Compares the first segment first.
+int compare_segments(CServerPathSegment const* a, CServerPathSegment const* b, bool cmpNoCase)
+{
+	// Walks from the last segment up, the difference closest to the root wins
+	int res = 0;
+	while (a != b) {
+		int const cmp = cmpNoCase ? fz::stricmp(a->name, b->name) : a->name.compare(b->name);
+		if (cmp) {
+			res = cmp;
+		}
+		a = a->parent.get();
+		b = b->parent.get();
+	}
+	return res;
+}
+
+// Returns the segments, first segment first
+std::vector<CServerPathSegment const*> get_segments(CServerPathSegment const* s)
+{
+	std::vector<CServerPathSegment const*> ret(depth(s));
+	for (auto it = ret.rbegin(); it != ret.rend(); ++it) {
+		*it = s;
+		s = s->parent.get();
+	}
+	return ret;
+}
+
+void get_segments(CServerPathSegment const* s, std::deque<std::wstring> & segments)
+{
+	segments.clear();
+	for (; s; s = s->parent.get()) {
+		segments.push_front(s->name);
+	}
+}
+
+// Builds the chain of segments, reusing the longest common prefix with old
+segment_ptr make_segments(std::deque<std::wstring> & segments, segment_ptr const& old)
+{
+	auto const oldSegments = get_segments(old.get());
+
+	size_t i = 0;
+	while (i < oldSegments.size() && i < segments.size() && oldSegments[i]->name == segments[i]) {
+		++i;
+	}
+
+	segment_ptr ret = ancestor(old, i);
+	for (; i < segments.size(); ++i) {
+		ret = std::make_shared<CServerPathSegment const>(ret, std::move(segments[i]));
+	}
+	return ret;
+}
+}
+
 bool CServerPathData::operator==(CServerPathData const& cmp) const
 {
 	if (m_prefix != cmp.m_prefix) {
 		return false;
 	}
 
-	if (m_segments != cmp.m_segments) {
+	if (depth(m_last.get()) != depth(cmp.m_last.get())) {
 		return false;
 	}
 
-	return true;
+	return equal_segments(m_last.get(), cmp.m_last.get(), false);
 }
 
 CServerPath::CServerPath()
@@ -147,29 +283,13 @@ std::wstring CServerPath::GetPath() const
 	if (traits[m_type].left_enclosure != 0) {
 		path += traits[m_type].left_enclosure;
 	}
-	if (m_data->m_segments.empty() && (!traits[m_type].has_root || !m_data->m_prefix || traits[m_type].separator_after_prefix)) {
+	if (!m_data->m_last && (!traits[m_type].has_root || !m_data->m_prefix || traits[m_type].separator_after_prefix)) {
 		path += traits[m_type].separators[0];
 	}
 
-	for (auto iter = m_data->m_segments.cbegin(); iter != m_data->m_segments.cend(); ++iter) {
-		std::wstring const& segment = *iter;
-		if (iter != m_data->m_segments.cbegin()) {
-			path += traits[m_type].separators[0];
-		}
-		else if (traits[m_type].has_root) {
-			if (!m_data->m_prefix || traits[m_type].separator_after_prefix) {
-				path += traits[m_type].separators[0];
-			}
-		}
-
-		if (traits[m_type].separatorEscape) {
-			std::wstring tmp = segment;
-			EscapeSeparators(m_type, tmp);
-			path += tmp;
-		}
-		else {
-			path += segment;
-		}
+	if (m_data->m_last) {
+		bool const rootSeparator = traits[m_type].has_root && (!m_data->m_prefix || traits[m_type].separator_after_prefix);
+		AppendSegments(path, *m_data->m_last, m_type, rootSeparator);
 	}
 
 	if (traits[m_type].prefixmode && m_data->m_prefix) {
@@ -182,13 +302,33 @@ std::wstring CServerPath::GetPath() const
 
 	// DOS is strange.
 	// C: is current working dir on drive C, C:\ the drive root.
-	if ((m_type == DOS || m_type == DOS_FWD_SLASHES) && m_data->m_segments.size() == 1) {
+	if ((m_type == DOS || m_type == DOS_FWD_SLASHES) && depth(m_data->m_last.get()) == 1) {
 		path += traits[m_type].separators[0];
 	}
 
 	return path;
 }
 
+void CServerPath::AppendSegments(std::wstring& path, CServerPathSegment const& segment, ServerType type, bool rootSeparator)
+{
+	bool first = true;
+	for (auto const* s : get_segments(&segment)) {
+		if (!first || rootSeparator) {
+			path += traits[type].separators[0];
+		}
+		first = false;
+
+		if (traits[type].separatorEscape) {
+			std::wstring tmp = s->name;
+			EscapeSeparators(type, tmp);
+			path += tmp;
+		}
+		else {
+			path += s->name;
+		}
+	}
+}
+
 bool CServerPath::HasParent() const
 {
 	if (empty()) {
@@ -196,10 +336,10 @@ bool CServerPath::HasParent() const
 	}
 
 	if (!traits[m_type].has_root) {
-		return m_data->m_segments.size() > 1;
+		return depth(m_data->m_last.get()) > 1;
 	}
 
-	return !m_data->m_segments.empty();
+	return static_cast<bool>(m_data->m_last);
 }
 
 CServerPath CServerPath::GetParent() const
@@ -216,7 +356,8 @@ CServerPath& CServerPath::MakeParent()
 	}
 	else {
 		CServerPathData& data = m_data.get();
-		data.m_segments.pop_back();
+		segment_ptr parent = data.m_last->parent;
+		data.m_last = std::move(parent);
 
 		if (m_type == MVS) {
 			data.m_prefix = fz::sparse_optional<std::wstring>(L".");
@@ -232,8 +373,8 @@ std::wstring CServerPath::GetFirstSegment() const
 		return std::wstring();
 	}
 
-	if (!m_data->m_segments.empty()) {
-		return m_data->m_segments.front();
+	if (m_data->m_last) {
+		return ancestor(m_data->m_last.get(), 1)->name;
 	}
 	else {
 		return std::wstring();
@@ -246,8 +387,8 @@ std::wstring CServerPath::GetLastSegment() const
 		return std::wstring();
 	}
 
-	if (!m_data->m_segments.empty()) {
-		return m_data->m_segments.back();
+	if (m_data->m_last) {
+		return m_data->m_last->name;
 	}
 	else {
 		return std::wstring();
@@ -285,9 +426,11 @@ std::wstring CServerPath::GetSafePath() const
 	size_t len = 5 // Type and 2x' ' and terminating 0
 		+ INTLENGTH; // Max length of prefix
 
+	auto const segments = get_segments(m_data->m_last.get());
+
 	len += m_data->m_prefix ? m_data->m_prefix->size() : 0;
-	for (auto const& segment : m_data->m_segments) {
-		len += segment.size() + 2 + INTLENGTH;
+	for (auto const& segment : segments) {
+		len += segment->name.size() + 2 + INTLENGTH;
 	}
 
 	std::wstring safepath;
@@ -305,12 +448,12 @@ std::wstring CServerPath::GetSafePath() const
 		t += m_data->m_prefix->size();
 	}
 
-	for (auto const& segment : m_data->m_segments) {
+	for (auto const& segment : segments) {
 		*(t++) = ' ';
-		t = fast_sprint_number(t, segment.size());
+		t = fast_sprint_number(t, segment->name.size());
 		*(t++) = ' ';
-		tstrcpy(t, segment.c_str());
-		t += segment.size();
+		tstrcpy(t, segment->name.c_str());
+		t += segment->name.size();
 	}
 	safepath.resize(t - start);
 	safepath.shrink_to_fit();
@@ -332,7 +475,7 @@ bool CServerPath::DoSetSafePath(std::wstring const& path)
 {
 	CServerPathData& data = m_data.get();
 	data.m_prefix.clear();
-	data.m_segments.clear();
+	data.m_last.reset();
 
 	// Optimized for speed, avoid expensive wxString functions
 	// Before the optimization this function was responsible for
@@ -418,7 +561,7 @@ bool CServerPath::DoSetSafePath(std::wstring const& path)
 		if (segment_len > end - p) {
 			return false;
 		}
-		data.m_segments.emplace_back(p, p + segment_len);
+		data.m_last = std::make_shared<CServerPathSegment const>(data.m_last, std::wstring(p, p + segment_len));
 
 		p += segment_len + 1;
 	}
@@ -479,26 +622,12 @@ bool CServerPath::IsSubdirOf(const CServerPath &path, bool cmpNoCase) const
 		return false;
 	}
 
-	tConstSegmentIter iter1 = m_data->m_segments.begin();
-	tConstSegmentIter iter2 = path.m_data->m_segments.begin();
-	while (iter1 != m_data->m_segments.end()) {
-		if (iter2 == path.m_data->m_segments.end()) {
-			return true;
-		}
-		if (cmpNoCase) {
-			if (fz::stricmp(*iter1, *iter2)) {
-				return false;
-			}
-		}
-		else if (*iter1 != *iter2) {
-			return false;
-		}
-
-		++iter1;
-		++iter2;
+	size_t const parentDepth = depth(path.m_data->m_last.get());
+	if (depth(m_data->m_last.get()) <= parentDepth) {
+		return false;
 	}
 
-	return false;
+	return equal_segments(ancestor(m_data->m_last.get(), parentDepth), path.m_data->m_last.get(), cmpNoCase);
 }
 
 bool CServerPath::IsParentOf(const CServerPath &path, bool cmpNoCase) const
@@ -537,8 +666,22 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 	}
 
 	bool const was_empty = empty();
+
+	// Most common by far is changing into a subdirectory by its plain name,
+	// append it directly if the path syntax has no special cases.
+	if (!was_empty && !isFile && (m_type == DEFAULT || m_type == UNIX || m_type == ZVM || m_type == DOS_VIRTUAL || m_type == CYGWIN) &&
+		dir.find_first_of(traits[m_type].separators) == std::wstring::npos && (!traits[m_type].has_dots || (dir != L"." && dir != L"..")))
+	{
+		CServerPathData& data = m_data.get();
+		data.m_last = std::make_shared<CServerPathSegment const>(data.m_last, std::move(dir));
+		return true;
+	}
+
 	CServerPathData& data = m_data.get();
 
+	tSegmentList segments;
+	get_segments(data.m_last.get(), segments);
+
 	switch (m_type)
 	{
 	case VMS:
@@ -580,13 +723,13 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				}
 				dir = dir.substr(pos1 + 1);
 
-				data.m_segments.clear();
+				segments.clear();
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
-			if (data.m_segments.empty() && was_empty) {
+			if (segments.empty() && was_empty) {
 				return false;
 			}
 		}
@@ -605,16 +748,16 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 			}
 
 			if (is_absolute) {
-				data.m_segments.clear();
+				segments.clear();
 			}
 			else if (IsSeparator(dir[0])) {
 				// Drive-relative path
-				if (data.m_segments.empty()) {
+				if (segments.empty()) {
 					return false;
 				}
-				std::wstring first = data.m_segments.front();
-				data.m_segments.clear();
-				data.m_segments.push_back(first);
+				std::wstring first = segments.front();
+				segments.clear();
+				segments.push_back(first);
 				dir = dir.substr(1);
 			}
 			// else: Any other relative path
@@ -623,10 +766,10 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
-			if (data.m_segments.empty() && was_empty) {
+			if (segments.empty() && was_empty) {
 				return false;
 			}
 		}
@@ -662,7 +805,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 
 			dir = dir.substr(1, dir.size() - 2);
 
-			data.m_segments.clear();
+			segments.clear();
 		}
 		else if (dir.back() == traits[m_type].right_enclosure) {
 			return false;
@@ -712,23 +855,23 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 			}
 		}
 
-		if (!Segmentize(dir, data.m_segments)) {
+		if (!Segmentize(dir, segments)) {
 			return false;
 		}
 		break;
 	case HPNONSTOP:
 		if (dir[0] == '\\') {
-			data.m_segments.clear();
+			segments.clear();
 		}
 
 		if (isFile && !ExtractFile(dir, file)) {
 			return false;
 		}
 
-		if (!Segmentize(dir, data.m_segments)) {
+		if (!Segmentize(dir, segments)) {
 			return false;
 		}
-		if (data.m_segments.empty() && was_empty) {
+		if (segments.empty() && was_empty) {
 			return false;
 		}
 
@@ -748,14 +891,14 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				data.m_prefix = fz::sparse_optional<std::wstring>(dir.substr(0, colon2 + 1));
 				dir = dir.substr(colon2 + 1);
 
-				data.m_segments.clear();
+				segments.clear();
 			}
 
 			if (isFile && !ExtractFile(dir, file)) {
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
 		}
@@ -763,7 +906,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 	case CYGWIN:
 		{
 			if (IsSeparator(dir[0])) {
-				data.m_segments.clear();
+				segments.clear();
 				data.m_prefix.clear();
 			}
 			else if (was_empty) {
@@ -778,7 +921,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
 		}
@@ -786,7 +929,7 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 	default:
 		{
 			if (IsSeparator(dir[0])) {
-				data.m_segments.clear();
+				segments.clear();
 			}
 			else if (was_empty) {
 				return false;
@@ -796,17 +939,19 @@ bool CServerPath::DoChangePath(std::wstring &subdir, bool isFile)
 				return false;
 			}
 
-			if (!Segmentize(dir, data.m_segments)) {
+			if (!Segmentize(dir, segments)) {
 				return false;
 			}
 		}
 		break;
 	}
 
-	if (!traits[m_type].has_root && data.m_segments.empty()) {
+	if (!traits[m_type].has_root && segments.empty()) {
 		return false;
 	}
 
+	data.m_last = make_segments(segments, data.m_last);
+
 	if (isFile) {
 		if (traits[m_type].has_dots) {
 			if (file == L".." || file == L".") {
@@ -864,22 +1009,16 @@ bool CServerPath::operator<(const CServerPath &op) const
 		return true;
 	}
 
-	tConstSegmentIter iter1, iter2;
-	for (iter1 = m_data->m_segments.begin(), iter2 = op.m_data->m_segments.begin(); iter1 != m_data->m_segments.end(); ++iter1, ++iter2) {
-		if (iter2 == op.m_data->m_segments.end()) {
-			return false;
-		}
+	CServerPathSegment const* const last = m_data->m_last.get();
+	CServerPathSegment const* const opLast = op.m_data->m_last.get();
 
-		const int cmp = std::wcscmp(iter1->c_str(), iter2->c_str());
-		if (cmp < 0) {
-			return true;
-		}
-		if (cmp > 0) {
-			return false;
-		}
+	size_t const common = std::min(depth(last), depth(opLast));
+	int const cmp = compare_segments(ancestor(last, common), ancestor(opLast, common), false);
+	if (cmp) {
+		return cmp < 0;
 	}
 
-	return iter2 != op.m_data->m_segments.end();
+	return depth(last) < depth(opLast);
 }
 
 std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omitPath) const
@@ -899,7 +1038,7 @@ std::wstring CServerPath::FormatFilename(std::wstring const& filename, bool omit
 
 	switch (m_type) {
 		case VXWORKS:
-			if (!result.empty() && !IsSeparator(result.back()) && !m_data->m_segments.empty()) {
+			if (!result.empty() && !IsSeparator(result.back()) && m_data->m_last) {
 				result += traits[m_type].separators[0];
 			}
 			break;
@@ -939,23 +1078,30 @@ int CServerPath::CmpNoCase(const CServerPath &op) const
 		return 1;
 	}
 
-	if (m_data->m_segments.size() > op.m_data->m_segments.size()) {
+	size_t const segments = depth(m_data->m_last.get());
+	size_t const opSegments = depth(op.m_data->m_last.get());
+	if (segments > opSegments) {
 		return 1;
 	}
-	else if (m_data->m_segments.size() < op.m_data->m_segments.size()) {
+	else if (segments < opSegments) {
 		return -1;
 	}
 
-	tConstSegmentIter iter = m_data->m_segments.begin();
-	tConstSegmentIter iter2 = op.m_data->m_segments.begin();
-	while (iter != m_data->m_segments.end()) {
-		int res = fz::stricmp(*(iter++), *(iter2++));
-		if (res) {
-			return res;
-		}
+	return compare_segments(m_data->m_last.get(), op.m_data->m_last.get(), true);
+}
+
+size_t CServerPath::hash() const
+{
+	if (empty()) {
+		return 0;
 	}
 
-	return 0;
+	size_t ret = m_data->m_last ? m_data->m_last->hash : 0;
+	CServerPathSegment::hash_combine(ret, static_cast<size_t>(m_type));
+	if (m_data->m_prefix) {
+		CServerPathSegment::hash_combine(ret, std::hash<std::wstring>()(*m_data->m_prefix));
+	}
+	return ret;
 }
 
 bool CServerPath::AddSegment(std::wstring const& segment)
@@ -965,7 +1111,8 @@ bool CServerPath::AddSegment(std::wstring const& segment)
 	}
 
 	// TODO: Check for invalid characters
-	m_data.get().m_segments.push_back(segment);
+	CServerPathData& data = m_data.get();
+	data.m_last = std::make_shared<CServerPathSegment const>(data.m_last, std::wstring(segment));
 
 	return true;
 }
@@ -1008,8 +1155,11 @@ CServerPath CServerPath::GetCommonParent(const CServerPath& path) const
 
 	CServerPathData& parentData = parent.m_data.get();
 
-	tConstSegmentIter last = m_data->m_segments.end();
-	tConstSegmentIter last2 = path.m_data->m_segments.end();
+	auto const segments = get_segments(m_data->m_last.get());
+	auto const segments2 = get_segments(path.m_data->m_last.get());
+
+	size_t last = segments.size();
+	size_t last2 = segments2.size();
 	if (traits[m_type].prefixmode == 1) {
 		if (!m_data->m_prefix) {
 			--last;
@@ -1023,24 +1173,20 @@ CServerPath CServerPath::GetCommonParent(const CServerPath& path) const
 		parentData.m_prefix = m_data->m_prefix;
 	}
 
-	tConstSegmentIter iter = m_data->m_segments.begin();
-	tConstSegmentIter iter2 = path.m_data->m_segments.begin();
-	while (iter != last && iter2 != last2) {
-		if (*iter != *iter2) {
-			if (!traits[m_type].has_root && parentData.m_segments.empty()) {
+	size_t i = 0;
+	while (i < last && i < last2) {
+		if (segments[i]->name != segments2[i]->name) {
+			if (!traits[m_type].has_root && !i) {
 				return CServerPath();
 			}
-			else {
-				return parent;
-			}
+			break;
 		}
-
-		parentData.m_segments.push_back(*iter);
-
-		++iter;
-		++iter2;
+		++i;
 	}
 
+	// Shares the segments with this path
+	parentData.m_last = ancestor(m_data->m_last, i);
+
 	return parent;
 }
 
@@ -1155,7 +1301,7 @@ void CServerPath::EscapeSeparators(ServerType type, std::wstring& subdir)
 
 size_t CServerPath::SegmentCount() const
 {
-	return empty() ? 0 : m_data->m_segments.size();
+	return empty() ? 0 : depth(m_data->m_last.get());
 }
 
 bool CServerPath::IsSeparator(wchar_t c) const
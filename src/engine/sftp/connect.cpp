@@ -23,6 +23,9 @@ int CSftpConnectOpData::Send()
 			if (engine_.GetOptions().GetOptionVal(OPTION_SFTP_COMPRESSION)) {
 				args.push_back(fzT("-C"));
 			}
+			if (engine_.GetOptions().GetOptionVal(OPTION_PREALLOCATE_SPACE)) {
+				args.push_back(fzT("-prealloc"));
+			}
 			if (!controlSocket_.process_->spawn(executable, args)) {
 				log(logmsg::debug_warning, L"Could not create process");
 				return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;;
@@ -11,6 +11,22 @@ enum cwdStates
 	cwd_cwd_subdir
 };
 
+namespace {
+// Only failures that do not go away by themselves are worth remembering,
+// not e.g. a lost connection. See fxp_got_status in src/putty/sftp.c for
+// the messages.
+bool is_permanent_failure(std::wstring error)
+{
+	fz::trim(error);
+	for (std::wstring const& reason : { std::wstring(L": no such file or directory"), std::wstring(L": permission denied") }) {
+		if (error.size() >= reason.size() && !error.compare(error.size() - reason.size(), reason.size(), reason)) {
+			return true;
+		}
+	}
+	return false;
+}
+}
+
 int CSftpChangeDirOpData::Send()
 {
 	std::wstring cmd;
@@ -67,6 +83,10 @@ int CSftpChangeDirOpData::Send()
 		cmd = L"pwd";
 		break;
 	case cwd_cwd:
+		if (!tryMkdOnFail_ && engine_.GetPathCache().LookupFailure(currentServer_, path_)) {
+			log(logmsg::debug_info, L"Changing into '%s' failed recently, not trying again.", path_.GetPath());
+			return FZ_REPLY_ERROR;
+		}
 		if (tryMkdOnFail_ && !opLock_) {
 			opLock_ = controlSocket_.Lock(locking_reason::mkdir, path_);
 		}
@@ -83,6 +103,10 @@ int CSftpChangeDirOpData::Send()
 		if (subDir_.empty()) {
 			return FZ_REPLY_INTERNALERROR;
 		}
+		else if (!link_discovery_ && engine_.GetPathCache().LookupFailure(currentServer_, path_, subDir_)) {
+			log(logmsg::debug_info, L"Changing into '%s' failed recently, not trying again.", path_.FormatFilename(subDir_));
+			return FZ_REPLY_ERROR;
+		}
 		else {
 			cmd = L"cd " + controlSocket_.QuoteFilename(subDir_);
 		}
@@ -121,6 +145,9 @@ int CSftpChangeDirOpData::ParseResponse()
 				return FZ_REPLY_CONTINUE;
 			}
 			else {
+				if (is_permanent_failure(controlSocket_.error_)) {
+					engine_.GetPathCache().StoreFailure(currentServer_, path_);
+				}
 				return FZ_REPLY_ERROR;
 			}
 		}
@@ -146,6 +173,9 @@ int CSftpChangeDirOpData::ParseResponse()
 				return FZ_REPLY_LINKNOTDIR;
 			}
 			else {
+				if (!successful && is_permanent_failure(controlSocket_.error_)) {
+					engine_.GetPathCache().StoreFailure(currentServer_, path_, subDir_);
+				}
 				return FZ_REPLY_ERROR;
 			}
 		}
@@ -1,7 +1,7 @@
 #ifndef FILEZILLA_ENGINE_SFTP_EVENT_HEADER
 #define FILEZILLA_ENGINE_SFTP_EVENT_HEADER
 
-#define FZSFTP_PROTOCOL_VERSION 8
+#define FZSFTP_PROTOCOL_VERSION 10
 
 enum class sftpEvent {
 	Unknown = -1,
@@ -31,6 +31,8 @@ enum class sftpEvent {
 	MacClientToServer,
 	MacServerToClient,
 	Hostkey,
+	Data,
+	DataRequest,
 
 	count
 };
@@ -1,8 +1,12 @@
 #include <filezilla.h>
 
+#include "checksum.h"
 #include "directorycache.h"
 #include "filetransfer.h"
+#include "input_thread.h"
+#include "servercapabilities.h"
 
+#include <libfilezilla/encode.hpp>
 #include <libfilezilla/local_filesys.hpp>
 
 enum filetransferStates
@@ -12,14 +16,25 @@ enum filetransferStates
 	filetransfer_waitlist,
 	filetransfer_mtime,
 	filetransfer_transfer,
-	filetransfer_chmtime
+	filetransfer_chmtime,
+	filetransfer_checksum,
+	filetransfer_compare
 };
 
+CSftpFileTransferOpData::~CSftpFileTransferOpData()
+{
+	// Releases the reader or writer, e.g. so that the other end of a pipe
+	// does not wait forever
+	if (controlSocket_.input_thread_) {
+		controlSocket_.input_thread_->SetTransfer(nullptr, nullptr);
+	}
+}
+
 int CSftpFileTransferOpData::Send()
 {
 	if (opState == filetransfer_init) {
 
-		if (localFile_.empty()) {
+		if (localFile_.empty() && !reader_ && !writer_) {
 			if (!download_) {
 				return FZ_REPLY_CRITICALERROR | FZ_REPLY_NOTSUPPORTED;
 			}
@@ -33,13 +48,18 @@ int CSftpFileTransferOpData::Send()
 			log(logmsg::status, _("Starting download of %s"), filename);
 		}
 		else {
-			log(logmsg::status, _("Starting upload of %s"), localFile_);
+			log(logmsg::status, _("Starting upload of %s"), reader_ ? reader_->name() : localFile_);
 		}
 
-		int64_t size;
-		bool isLink;
-		if (fz::local_filesys::get_file_info(fz::to_native(localFile_), isLink, &size, nullptr, nullptr) == fz::local_filesys::file) {
-			localFileSize_ = size;
+		if (reader_) {
+			localFileSize_ = reader_->size();
+		}
+		else if (!writer_) {
+			int64_t size;
+			bool isLink;
+			if (fz::local_filesys::get_file_info(fz::to_native(localFile_), isLink, &size, nullptr, nullptr) == fz::local_filesys::file) {
+				localFileSize_ = size;
+			}
 		}
 
 		opState = filetransfer_waitcwd;
@@ -52,8 +72,28 @@ int CSftpFileTransferOpData::Send()
 		return FZ_REPLY_CONTINUE;
 	}
 	else if (opState == filetransfer_transfer) {
+		if (compareContent_) {
+			compareContent_ = false;
+			if (reader_ || writer_) {
+				log(logmsg::debug_info, L"fzsftp only computes checksums of local files, cannot compare the content of the files");
+				return ComparisonUnavailable();
+			}
+			if (CServerCapabilities::GetCapability(currentServer_, check_file_extension) == no) {
+				log(logmsg::debug_info, L"Server does not support any checksum extensions, cannot compare the content of the files");
+				return ComparisonUnavailable();
+			}
+			opState = filetransfer_compare;
+			return SendChecksum();
+		}
+
+		if (reader_ || writer_) {
+			// fzsftp passes the data through its stdin and stdout, it cannot skip any
+			resume_ = false;
+		}
+
 		// Bit convoluted, but we need to guarantee that local filenames are passed as UTF-8 to fzsftp,
 		// whereas we need to use server encoding for remote filenames.
+		// Instead of a local filename, "-" makes fzsftp exchange the data with us.
 		std::string cmd;
 		std::wstring logstr;
 		if (resume_) {
@@ -61,7 +101,7 @@ int CSftpFileTransferOpData::Send()
 			logstr = L"re";
 		}
 		if (download_) {
-			if (!resume_) {
+			if (!resume_ && !writer_) {
 				controlSocket_.CreateLocalDir(localFile_);
 			}
 
@@ -77,7 +117,7 @@ int CSftpFileTransferOpData::Send()
 			cmd += remoteFile + " ";
 			logstr += controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_)) + L" "; 
 			
-			std::wstring localFile = controlSocket_.QuoteFilename(localFile_);
+			std::wstring localFile = writer_ ? L"-" : controlSocket_.QuoteFilename(localFile_);
 			cmd += fz::to_utf8(localFile);
 			logstr += localFile;
 		}
@@ -86,7 +126,7 @@ int CSftpFileTransferOpData::Send()
 			cmd += "put ";
 			logstr += L"put ";
 
-			std::wstring localFile = controlSocket_.QuoteFilename(localFile_);
+			std::wstring localFile = reader_ ? L"-" : controlSocket_.QuoteFilename(localFile_);
 			cmd += fz::to_utf8(localFile) + " ";
 			logstr += localFile + L" ";
 
@@ -98,6 +138,10 @@ int CSftpFileTransferOpData::Send()
 			cmd += remoteFile;
 			logstr += controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_));
 		}
+		if (reader_ || writer_) {
+			controlSocket_.input_thread_->SetTransfer(reader_, writer_);
+		}
+
 		engine_.transfer_status_.SetStartTime();
 		transferInitiated_ = true;
 		controlSocket_.SetWait(true);
@@ -126,6 +170,9 @@ int CSftpFileTransferOpData::Send()
 		std::wstring seconds = fz::sprintf(L"%d", ticks);
 		return controlSocket_.SendCommand(L"chmtime " + seconds + L" " + controlSocket_.WildcardEscape(quotedFilename), L"chmtime " + seconds + L" " + quotedFilename);
 	}
+	else if (opState == filetransfer_checksum || opState == filetransfer_compare) {
+		return SendChecksum();
+	}
 
 	return FZ_REPLY_INTERNALERROR;
 }
@@ -133,22 +180,26 @@ int CSftpFileTransferOpData::Send()
 int CSftpFileTransferOpData::ParseResponse()
 {
 	if (opState == filetransfer_transfer) {
-		if (controlSocket_.result_ == FZ_REPLY_OK && engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS)) {
-			if (download_) {
-				if (!fileTime_.empty()) {
-					if (!fz::local_filesys::set_modification_time(fz::to_native(localFile_), fileTime_))
-						log(logmsg::debug_warning, L"Could not set modification time");
-				}
-			}
-			else {
-				fileTime_ = fz::local_filesys::get_modification_time(fz::to_native(localFile_));
-				if (!fileTime_.empty()) {
-					opState = filetransfer_chmtime;
-					return FZ_REPLY_CONTINUE;
-				}
-			}
+		// All data has been written by the time fzsftp is done
+		if (controlSocket_.result_ == FZ_REPLY_OK && writer_ && !writer_->finish()) {
+			log(logmsg::error, _("Could not write to %s"), writer_->name());
+			return FZ_REPLY_ERROR;
+		}
+		if (controlSocket_.result_ == FZ_REPLY_OK && ShouldVerify()) {
+			opState = filetransfer_checksum;
+			return FZ_REPLY_CONTINUE;
 		}
-		return controlSocket_.result_;
+		return TransferFinished(controlSocket_.result_);
+	}
+	else if (opState == filetransfer_compare) {
+		return CompareChecksum();
+	}
+	else if (opState == filetransfer_checksum) {
+		int res = VerifyChecksum();
+		if (res != FZ_REPLY_OK) {
+			return res;
+		}
+		return TransferFinished(res);
 	}
 	else if (opState == filetransfer_mtime) {
 		if (controlSocket_.result_ == FZ_REPLY_OK && !controlSocket_.response_.empty()) {
@@ -309,3 +360,157 @@ int CSftpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 
 	return FZ_REPLY_CONTINUE;
 }
+
+int CSftpFileTransferOpData::TransferFinished(int result)
+{
+	if (result == FZ_REPLY_OK && !reader_ && !writer_ && engine_.GetOptions().GetOptionVal(OPTION_PRESERVE_TIMESTAMPS)) {
+		if (download_) {
+			if (!fileTime_.empty()) {
+				if (!fz::local_filesys::set_modification_time(fz::to_native(localFile_), fileTime_))
+					log(logmsg::debug_warning, L"Could not set modification time");
+			}
+		}
+		else {
+			fileTime_ = fz::local_filesys::get_modification_time(fz::to_native(localFile_));
+			if (!fileTime_.empty()) {
+				opState = filetransfer_chmtime;
+				return FZ_REPLY_CONTINUE;
+			}
+		}
+	}
+	return result;
+}
+
+int CSftpFileTransferOpData::SendChecksum()
+{
+	// As with the transfer itself, the local filename has to be passed as UTF-8
+	std::wstring const quotedFilename = controlSocket_.QuoteFilename(remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_));
+	std::string const remoteFile = controlSocket_.ConvToServer(controlSocket_.WildcardEscape(quotedFilename));
+	if (remoteFile.empty()) {
+		log(logmsg::error, _("Could not convert command to server encoding"));
+		return FZ_REPLY_ERROR;
+	}
+	std::wstring const localFile = controlSocket_.QuoteFilename(localFile_);
+
+	// In order of preference, the server picks the first one it supports
+	std::wstring const algorithms = L"sha512,sha256,sha1,md5";
+
+	controlSocket_.SetWait(true);
+	controlSocket_.log_raw(logmsg::command, L"checksum " + algorithms + L" " + quotedFilename + L" " + localFile);
+	return controlSocket_.AddToStream("checksum " + fz::to_utf8(algorithms) + " " + remoteFile + " " + fz::to_utf8(localFile) + "\r\n");
+}
+
+bool CSftpFileTransferOpData::ParseChecksumReply(fz::hash_algorithm & algorithm, std::vector<uint8_t> & remote, std::vector<uint8_t> & local)
+{
+	auto const& response = controlSocket_.response_;
+	if (controlSocket_.result_ == FZ_REPLY_OK && response == L"none") {
+		CServerCapabilities::SetCapability(currentServer_, check_file_extension, no);
+		log(logmsg::debug_info, L"Server does not support any checksum extensions");
+		return false;
+	}
+
+	// fzsftp replies with the algorithm picked by the server and the digests of the remote and the local file
+	auto const tokens = fz::strtok(response, L" ");
+	if (controlSocket_.result_ != FZ_REPLY_OK || tokens.size() != 3 || !ParseHashAlgorithm(tokens[0], algorithm)) {
+		log(logmsg::debug_warning, L"Could not obtain checksum of the remote file");
+		return false;
+	}
+	CServerCapabilities::SetCapability(currentServer_, check_file_extension, yes);
+
+	remote = FindHexDigest(tokens[1], algorithm);
+	local = FindHexDigest(tokens[2], algorithm);
+	if (remote.empty() || local.empty()) {
+		log(logmsg::debug_warning, L"Could not obtain %s checksum of the remote file", GetHashAlgorithmName(algorithm));
+		return false;
+	}
+
+	return true;
+}
+
+int CSftpFileTransferOpData::CompareChecksum()
+{
+	fz::hash_algorithm algorithm;
+	std::vector<uint8_t> remote;
+	std::vector<uint8_t> local;
+	if (!ParseChecksumReply(algorithm, remote, local)) {
+		return ComparisonUnavailable();
+	}
+
+	std::wstring const name = GetHashAlgorithmName(algorithm);
+	if (local == remote) {
+		log(logmsg::status, _("%s checksums of both files match"), name);
+		return SkipTransfer();
+	}
+
+	log(logmsg::debug_info, L"%s checksums differ, transferring the file", name);
+	opState = filetransfer_transfer;
+	return FZ_REPLY_CONTINUE;
+}
+
+int CSftpFileTransferOpData::ComparisonUnavailable()
+{
+	// Same as overwriteSizeOrNewer for files of equal size
+	if (!sourceNewer_) {
+		return SkipTransfer();
+	}
+
+	opState = filetransfer_transfer;
+	return FZ_REPLY_CONTINUE;
+}
+
+int CSftpFileTransferOpData::SkipTransfer()
+{
+	if (download_) {
+		log(logmsg::status, _("Skipping download of %s"), remotePath_.FormatFilename(remoteFile_));
+	}
+	else {
+		log(logmsg::status, _("Skipping upload of %s"), localFile_);
+	}
+	return FZ_REPLY_OK;
+}
+
+bool CSftpFileTransferOpData::ShouldVerify()
+{
+	// Only complete transfers can be compared with the server's checksum
+	if (!engine_.GetOptions().GetOptionVal(OPTION_VERIFY_TRANSFERS) || resume_) {
+		return false;
+	}
+
+	if (reader_ || writer_) {
+		log(logmsg::debug_info, L"fzsftp only computes checksums of local files, transfer will not be verified");
+		controlSocket_.ReportVerification(verification_result::unavailable);
+		return false;
+	}
+
+	if (CServerCapabilities::GetCapability(currentServer_, check_file_extension) == no) {
+		log(logmsg::debug_info, L"Server does not support any checksum extensions, transfer will not be verified");
+		controlSocket_.ReportVerification(verification_result::unavailable);
+		return false;
+	}
+
+	return true;
+}
+
+int CSftpFileTransferOpData::VerifyChecksum()
+{
+	fz::hash_algorithm algorithm;
+	std::vector<uint8_t> remote;
+	std::vector<uint8_t> local;
+	if (!ParseChecksumReply(algorithm, remote, local)) {
+		// Not being able to get the checksum isn't worth failing an otherwise successful transfer over
+		log(logmsg::debug_warning, L"Not verifying the transfer");
+		controlSocket_.ReportVerification(verification_result::unavailable);
+		return FZ_REPLY_OK;
+	}
+
+	std::wstring const name = GetHashAlgorithmName(algorithm);
+	if (local != remote) {
+		log(logmsg::error, _("%s checksum mismatch, local file has %s, remote file has %s"), name, fz::hex_encode<std::wstring>(local), fz::hex_encode<std::wstring>(remote));
+		controlSocket_.ReportVerification(verification_result::mismatch);
+		return FZ_REPLY_VERIFYFAILED;
+	}
+
+	log(logmsg::status, _("%s checksum of transferred file matches"), name);
+	controlSocket_.ReportVerification(verification_result::match);
+	return FZ_REPLY_OK;
+}
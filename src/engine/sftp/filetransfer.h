@@ -11,9 +11,24 @@ public:
 		, CSftpOpData(controlSocket)
 	{}
 
+	virtual ~CSftpFileTransferOpData();
+
 	virtual int Send() override;
 	virtual int ParseResponse() override;
 	virtual int SubcommandResult(int, COpData const&) override;
+
+private:
+	bool ShouldVerify();
+	int VerifyChecksum();
+	int TransferFinished(int result);
+
+	int SendChecksum();
+	bool ParseChecksumReply(fz::hash_algorithm & algorithm, std::vector<uint8_t> & remote, std::vector<uint8_t> & local);
+
+	// Comparing the content of existing files, see compareContent_
+	int CompareChecksum();
+	int ComparisonUnavailable();
+	int SkipTransfer();
 };
 
 #endif
@@ -3,9 +3,12 @@
 #include "event.h"
 #include "input_thread.h"
 #include "sftpcontrolsocket.h"
+#include "transfer_io.h"
 
 #include <libfilezilla/process.hpp>
 
+#include <algorithm>
+
 CSftpInputThread::CSftpInputThread(CSftpControlSocket& owner, fz::process& proc)
 	: process_(proc)
 	, owner_(owner)
@@ -25,6 +28,24 @@ bool CSftpInputThread::spawn(fz::thread_pool & pool)
 	return thread_.operator bool();
 }
 
+void CSftpInputThread::SetTransfer(std::shared_ptr<transfer_reader> const& reader, std::shared_ptr<transfer_writer> const& writer)
+{
+	fz::scoped_lock l(mutex_);
+	reader_ = reader;
+	writer_ = writer;
+}
+
+void CSftpInputThread::CancelTransfer()
+{
+	fz::scoped_lock l(mutex_);
+	if (reader_) {
+		reader_->cancel();
+	}
+	if (writer_) {
+		writer_->cancel();
+	}
+}
+
 uint64_t CSftpInputThread::ReadUInt(std::wstring &error)
 {
 	uint64_t ret{};
@@ -104,6 +125,81 @@ std::wstring CSftpInputThread::ReadLine(std::wstring &error)
 	return std::wstring();
 }
 
+void CSftpInputThread::WriteData(uint64_t len, std::wstring & error)
+{
+	if (!error.empty()) {
+		return;
+	}
+
+	std::shared_ptr<transfer_writer> writer;
+	{
+		fz::scoped_lock l(mutex_);
+		writer = writer_;
+	}
+	if (!writer) {
+		error = L"Received data outside of a transfer";
+		return;
+	}
+
+	while (len) {
+		if (!readFromProcess(error, true)) {
+			return;
+		}
+
+		size_t const n = static_cast<size_t>(std::min(static_cast<uint64_t>(recv_buffer_.size()), len));
+		if (!writer->write(recv_buffer_.get(), n)) {
+			// Stops the download, fzsftp cannot be told to abort it otherwise
+			error = fz::sprintf(_("Could not write to %s"), writer->name());
+			return;
+		}
+		recv_buffer_.consume(n);
+		len -= n;
+	}
+}
+
+void CSftpInputThread::SendData(uint64_t len, std::wstring & error)
+{
+	if (!error.empty()) {
+		return;
+	}
+
+	std::shared_ptr<transfer_reader> reader;
+	{
+		fz::scoped_lock l(mutex_);
+		reader = reader_;
+	}
+	if (!reader) {
+		error = L"Data requested outside of a transfer";
+		return;
+	}
+
+	// fzsftp asks for no more than its buffer holds, cap it nevertheless
+	len = std::min(len, static_cast<uint64_t>(64 * 1024));
+
+	fz::buffer data;
+	int64_t const read = reader->read(data.get(static_cast<size_t>(len)), static_cast<int64_t>(len));
+
+	std::string reply;
+	if (read < 0) {
+		reply = "=-\n";
+
+		auto msg = new CSftpEvent;
+		auto & message = std::get<0>(msg->v_);
+		message.type = sftpEvent::Error;
+		message.text[0] = fz::sprintf(_("Could not read from %s"), reader->name());
+		owner_.send_event(msg);
+	}
+	else {
+		reply = fz::sprintf("=%d\n", read);
+		reply.append(reinterpret_cast<char const*>(data.get()), static_cast<size_t>(read));
+	}
+
+	// fzsftp waits for the reply, nothing else gets written to it meanwhile
+	if (!process_.write(reply)) {
+		error = L"Unknown error writing to process";
+	}
+}
+
 bool CSftpInputThread::readFromProcess(std::wstring & error, bool eof_is_error)
 {
 	if (recv_buffer_.empty()) {
@@ -182,6 +278,18 @@ void CSftpInputThread::processEvent(sftpEvent eventType, std::wstring & error)
 			}
 		}
 		return;
+	case sftpEvent::Data:
+		{
+			uint64_t const len = ReadUInt(error);
+			WriteData(len, error);
+		}
+		return;
+	case sftpEvent::DataRequest:
+		{
+			uint64_t const len = ReadUInt(error);
+			SendData(len, error);
+		}
+		return;
 	};
 
 	auto msg = new CSftpEvent;
@@ -2,6 +2,7 @@
 
 #include "directorycache.h"
 #include "mkd.h"
+#include "pathcache.h"
 
 enum mkdStates
 {
@@ -96,6 +97,7 @@ int CSftpMkdirOpData::ParseResponse()
 				return FZ_REPLY_INTERNALERROR;
 			}
 			engine_.GetDirectoryCache().UpdateFile(currentServer_, currentMkdPath_, segments_.back(), true, CDirectoryCache::dir);
+			engine_.GetPathCache().InvalidateFailures(currentServer_);
 			controlSocket_.SendDirectoryListingNotification(currentMkdPath_, false);
 
 			currentMkdPath_.AddSegment(segments_.back());
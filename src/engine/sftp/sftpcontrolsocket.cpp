@@ -113,6 +113,7 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 		}
 		break;
 	case sftpEvent::Error:
+		error_ = message.text[0];
 		log_raw(logmsg::error, message.text[0]);
 		break;
 	case sftpEvent::Verbose:
@@ -321,6 +322,7 @@ void CSftpControlSocket::OnTerminate(std::wstring const& error)
 int CSftpControlSocket::SendCommand(std::wstring const& cmd, std::wstring const& show)
 {
 	SetWait(true);
+	error_.clear();
 
 	log_raw(logmsg::command, show.empty() ? cmd : show);
 
@@ -506,11 +508,11 @@ void CSftpControlSocket::ProcessReply(int result, std::wstring const& reply)
 		}
 	}
 }
-void CSftpControlSocket::FileTransfer(std::wstring const& localFile, CServerPath const& remotePath,
-									std::wstring const& remoteFile, bool download,
-									CFileTransferCommand::t_transferSettings const& transferSettings)
+void CSftpControlSocket::FileTransfer(CFileTransferCommand const& cmd)
 {
-	auto pData = std::make_unique<CSftpFileTransferOpData>(*this, download, localFile, remoteFile, remotePath, transferSettings);
+	auto pData = std::make_unique<CSftpFileTransferOpData>(*this, cmd.Download(), cmd.GetLocalFile(), cmd.GetRemoteFile(), cmd.GetRemotePath(), cmd.GetTransferSettings());
+	pData->reader_ = cmd.GetReader();
+	pData->writer_ = cmd.GetWriter();
 	Push(std::move(pData));
 }
 
@@ -523,6 +525,8 @@ int CSftpControlSocket::DoClose(int nErrorCode)
 	}
 
 	if (input_thread_) {
+		// Killing fzsftp does not help if blocked in a reader or writer
+		input_thread_->CancelTransfer();
 		input_thread_.reset();
 
 		auto threadEventsFilter = [&](fz::event_loop::Events::value_type const& ev) -> bool {
@@ -0,0 +1,165 @@
+#include <filezilla.h>
+
+#include "ControlSocket.h"
+#include "socket_tuning.h"
+
+#include <algorithm>
+
+#if HAVE_FZ_SOCKET_GET_DESCRIPTOR && !defined(FZ_WINDOWS)
+#define FZ_HAVE_SOCKET_OPTIONS 1
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace {
+int const min_buffer_size = 64 * 1024;
+int const max_buffer_size = 64 * 1024 * 1024;
+
+#if FZ_HAVE_SOCKET_OPTIONS
+// Returns 0 on success, error code otherwise
+int set_tcp_option(fz::socket & socket, int name, void const* value, socklen_t len)
+{
+	int const fd = static_cast<int>(socket.get_descriptor());
+	if (fd == -1) {
+		return EBADF;
+	}
+	if (setsockopt(fd, IPPROTO_TCP, name, value, len) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+int set_tcp_option(fz::socket & socket, int name, int value)
+{
+	return set_tcp_option(socket, name, &value, sizeof(value));
+}
+#endif
+}
+
+CTcpTuning::CTcpTuning(CServer const& server, COptionsBase & options)
+	: options_(options)
+{
+	congestion_ = fz::to_utf8(server.GetExtraParameter("tcp_congestion"));
+
+	std::wstring const b = server.GetExtraParameter("tcp_buffers");
+	if (b == L"auto") {
+		buffers_ = buffers::automatic;
+	}
+	else if (b == L"rtt") {
+		buffers_ = buffers::rtt;
+	}
+
+	int64_t const mbits = fz::to_integral<int64_t>(server.GetExtraParameter("tcp_bandwidth"));
+	if (mbits > 0 && mbits <= 1000000) {
+		bandwidth_ = mbits * 1000 * 1000 / 8;
+	}
+
+	notsentLowat_ = fz::to_integral<int>(server.GetExtraParameter("tcp_notsent_lowat"), -1);
+	quickack_ = server.GetExtraParameter("tcp_quickack") == L"1";
+}
+
+int CTcpTuning::GetBufferSize(int rtt) const
+{
+	if (rtt <= 0 || !bandwidth_) {
+		return -1;
+	}
+
+	// Part of a buffer goes to the bookkeeping of the kernel, twice the
+	// bandwidth-delay product leaves enough room to keep the link busy.
+	// The bandwidth is a multiple of 125000 bytes, dividing first is exact
+	// and cannot overflow.
+	int64_t const size = bandwidth_ / 1000 * rtt * 2;
+	return static_cast<int>(std::clamp<int64_t>(size, min_buffer_size, max_buffer_size));
+}
+
+void CTcpTuning::Prepare(fz::socket_base & socket, int rtt) const
+{
+	int size_read = -1;
+	int size_write = -1;
+
+	switch (buffers_) {
+	case buffers::options:
+		size_read = options_.GetOptionVal(OPTION_SOCKET_BUFFERSIZE_RECV);
+#ifndef FZ_WINDOWS
+		size_write = options_.GetOptionVal(OPTION_SOCKET_BUFFERSIZE_SEND);
+#endif
+		break;
+	case buffers::rtt:
+		size_read = GetBufferSize(rtt);
+		size_write = size_read;
+		break;
+	case buffers::automatic:
+		// Fixed sizes would disable the autotuning
+		break;
+	}
+
+	if (size_read != -1 || size_write != -1) {
+		socket.set_buffer_sizes(size_read, size_write);
+	}
+}
+
+void CTcpTuning::Apply(fz::socket & socket, CControlSocket & controlSocket, int rtt) const
+{
+#if FZ_HAVE_SOCKET_OPTIONS
+	if (!congestion_.empty()) {
+#ifdef TCP_CONGESTION
+		int const res = set_tcp_option(socket, TCP_CONGESTION, congestion_.c_str(), static_cast<socklen_t>(congestion_.size()));
+		if (res) {
+			controlSocket.log(logmsg::debug_warning, L"Could not select congestion control algorithm %s: %s", congestion_, fz::socket_error_description(res));
+		}
+#else
+		controlSocket.log(logmsg::debug_info, L"Selecting the congestion control algorithm is not supported on this platform");
+#endif
+	}
+
+	if (notsentLowat_ >= 0) {
+#ifdef TCP_NOTSENT_LOWAT
+		int const res = set_tcp_option(socket, TCP_NOTSENT_LOWAT, notsentLowat_);
+		if (res) {
+			controlSocket.log(logmsg::debug_warning, L"Could not set TCP_NOTSENT_LOWAT: %s", fz::socket_error_description(res));
+		}
+#else
+		controlSocket.log(logmsg::debug_info, L"TCP_NOTSENT_LOWAT is not supported on this platform");
+#endif
+	}
+
+	Rearm(socket);
+
+#if defined(TCP_INFO) && defined(__linux__)
+	if (buffers_ == buffers::rtt && rtt <= 0) {
+		// Known from the handshake
+		struct tcp_info info{};
+		socklen_t len = sizeof(info);
+		int const fd = static_cast<int>(socket.get_descriptor());
+		if (fd != -1 && !getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) && info.tcpi_rtt) {
+			rtt = std::max(1, static_cast<int>(info.tcpi_rtt / 1000));
+		}
+	}
+#endif
+#else
+	if (!congestion_.empty() || notsentLowat_ >= 0 || quickack_) {
+		controlSocket.log(logmsg::debug_info, L"TCP options other than the buffer sizes are not supported on this platform");
+	}
+#endif
+
+	if (buffers_ == buffers::rtt) {
+		int const size = GetBufferSize(rtt);
+		if (size != -1) {
+			controlSocket.log(logmsg::debug_verbose, L"Round-trip time %d ms, using socket buffers of %d bytes", rtt, size);
+			socket.set_buffer_sizes(size, size);
+		}
+	}
+}
+
+void CTcpTuning::Rearm(fz::socket & socket) const
+{
+#if FZ_HAVE_SOCKET_OPTIONS && defined(TCP_QUICKACK)
+	if (quickack_) {
+		set_tcp_option(socket, TCP_QUICKACK, 1);
+	}
+#else
+	(void)socket;
+#endif
+}
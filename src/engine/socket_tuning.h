@@ -0,0 +1,72 @@
+#ifndef FILEZILLA_ENGINE_SOCKET_TUNING_HEADER
+#define FILEZILLA_ENGINE_SOCKET_TUNING_HEADER
+
+#include <libfilezilla/socket.hpp>
+
+#include <string>
+
+class CControlSocket;
+class COptionsBase;
+class CServer;
+
+// TCP settings of a site, taken from the extra parameters of the server:
+//
+// tcp_congestion:    Name of the congestion control algorithm, e.g. bbr
+// tcp_buffers:       Empty to use the global buffer size options, "auto" to
+//                    leave the buffers to the autotuning of the system or
+//                    "rtt" to size them from bandwidth and round-trip time.
+//                    If empty, the buffers of control and HTTP connections
+//                    are left to the system.
+// tcp_bandwidth:     Bandwidth of the link in Mbit/s, needed for "rtt"
+// tcp_notsent_lowat: Limit in bytes of data in the send buffer not yet sent
+// tcp_quickack:      1 to acknowledge received data without delay
+//
+// Settings the platform does not support are skipped.
+class CTcpTuning final
+{
+public:
+	enum class buffers
+	{
+		options,
+		automatic,
+		rtt
+	};
+
+	CTcpTuning(CServer const& server, COptionsBase & options);
+
+	// To be called before connecting or listening. rtt is the round-trip time
+	// to the server in milliseconds if already known from another
+	// connection, -1 otherwise.
+	void Prepare(fz::socket_base & socket, int rtt) const;
+
+	// To be called once connected. If the buffers are sized from the
+	// round-trip time and it was not known yet, it gets taken from the
+	// connection itself.
+	void Apply(fz::socket & socket, CControlSocket & controlSocket, int rtt) const;
+
+	// Delayed acknowledgements get turned on again by the system, needs to be
+	// called after receiving.
+	void Rearm(fz::socket & socket) const;
+
+	// Size of the buffers if sized from the round-trip time in milliseconds.
+	// Returns -1 if unknown.
+	int GetBufferSize(int rtt) const;
+
+	std::string const& GetCongestion() const { return congestion_; }
+	buffers GetBuffers() const { return buffers_; }
+	int64_t GetBandwidth() const { return bandwidth_; }
+	int GetNotsentLowat() const { return notsentLowat_; }
+	bool GetQuickack() const { return quickack_; }
+
+private:
+
+	COptionsBase & options_;
+
+	std::string congestion_;
+	buffers buffers_{buffers::options};
+	int64_t bandwidth_{}; // In bytes per second
+	int notsentLowat_{-1};
+	bool quickack_{};
+};
+
+#endif
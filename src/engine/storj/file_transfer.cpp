@@ -2,6 +2,7 @@
 
 #include "directorycache.h"
 #include "file_transfer.h"
+#include "input_thread.h"
 
 #include <libfilezilla/local_filesys.hpp>
 
@@ -14,11 +15,20 @@ enum FileTransferStates
 	filetransfer_transfer
 };
 
+CStorjFileTransferOpData::~CStorjFileTransferOpData()
+{
+	// Releases the reader or writer, e.g. so that the other end of a pipe
+	// does not wait forever
+	if (controlSocket_.input_thread_) {
+		controlSocket_.input_thread_->SetTransfer(nullptr, nullptr);
+	}
+}
+
 int CStorjFileTransferOpData::Send()
 {
 	switch (opState) {
 	case filetransfer_init:
-		if (localFile_.empty()) {
+		if (localFile_.empty() && !reader_ && !writer_) {
 			if (!download_) {
 				return FZ_REPLY_CRITICALERROR | FZ_REPLY_NOTSUPPORTED;
 			}
@@ -39,13 +49,18 @@ int CStorjFileTransferOpData::Send()
 			log(logmsg::status, _("Starting download of %s"), filename);
 		}
 		else {
-			log(logmsg::status, _("Starting upload of %s"), localFile_);
+			log(logmsg::status, _("Starting upload of %s"), reader_ ? reader_->name() : localFile_);
 		}
 
-		int64_t size;
-		bool isLink;
-		if (fz::local_filesys::get_file_info(fz::to_native(localFile_), isLink, &size, 0, 0) == fz::local_filesys::file) {
-			localFileSize_ = size;
+		if (reader_) {
+			localFileSize_ = reader_->size();
+		}
+		else if (!writer_) {
+			int64_t size;
+			bool isLink;
+			if (fz::local_filesys::get_file_info(fz::to_native(localFile_), isLink, &size, 0, 0) == fz::local_filesys::file) {
+				localFileSize_ = size;
+			}
 		}
 
 		opState = filetransfer_resolve;
@@ -67,7 +82,7 @@ int CStorjFileTransferOpData::Send()
 		return FZ_REPLY_CONTINUE;
 	case filetransfer_transfer:
 
-		if (!resume_) {
+		if (!resume_ && !writer_) {
 			controlSocket_.CreateLocalDir(localFile_);
 		}
 
@@ -78,10 +93,20 @@ int CStorjFileTransferOpData::Send()
 			engine_.transfer_status_.Init(localFileSize_, 0, false);
 		}
 
+		if (reader_ || writer_) {
+			controlSocket_.input_thread_->SetTransfer(reader_, writer_);
+		}
+
 		engine_.transfer_status_.SetStartTime();
 		transferInitiated_ = true;
+
+		// Instead of a local filename, "-" makes fzstorj exchange the data with us.
 		if (download_) {
-			return controlSocket_.SendCommand(L"get " + bucket_ + L" " + fileId_ + L" " + controlSocket_.QuoteFilename(localFile_));
+			std::wstring cmd = L"get " + bucket_ + L" " + fileId_ + L" " + (writer_ ? L"-" : controlSocket_.QuoteFilename(localFile_));
+			if (!writer_ && remoteFileSize_ > 0 && engine_.GetOptions().GetOptionVal(OPTION_PREALLOCATE_SPACE)) {
+				cmd += fz::sprintf(L" %d", remoteFileSize_);
+			}
+			return controlSocket_.SendCommand(cmd);
 		}
 		else {
 			std::wstring path = remotePath_.GetPath();
@@ -92,7 +117,7 @@ int CStorjFileTransferOpData::Send()
 			else {
 				path = path.substr(pos + 1) + L"/";
 			}
-			return controlSocket_.SendCommand(L"put " + bucket_ + L" " + controlSocket_.QuoteFilename(localFile_) + L" " + controlSocket_.QuoteFilename(path + remoteFile_));
+			return controlSocket_.SendCommand(L"put " + bucket_ + L" " + (reader_ ? L"-" : controlSocket_.QuoteFilename(localFile_)) + L" " + controlSocket_.QuoteFilename(path + remoteFile_));
 		}
 
 
@@ -106,6 +131,11 @@ int CStorjFileTransferOpData::Send()
 int CStorjFileTransferOpData::ParseResponse()
 {
 	if (opState == filetransfer_transfer) {
+		// All data has been written by the time fzstorj is done
+		if (controlSocket_.result_ == FZ_REPLY_OK && writer_ && !writer_->finish()) {
+			log(logmsg::error, _("Could not write to %s"), writer_->name());
+			return FZ_REPLY_ERROR;
+		}
 		return controlSocket_.result_;
 	}
 
@@ -12,6 +12,8 @@ public:
 	{
 	}
 
+	virtual ~CStorjFileTransferOpData();
+
 	virtual int Send() override;
 	virtual int ParseResponse() override;
 	virtual int SubcommandResult(int prevResult, COpData const& previousOperation) override;
@@ -3,9 +3,12 @@
 #include "event.h"
 #include "input_thread.h"
 #include "storjcontrolsocket.h"
+#include "transfer_io.h"
 
 #include <libfilezilla/process.hpp>
 
+#include <algorithm>
+
 CStorjInputThread::CStorjInputThread(CStorjControlSocket& owner, fz::process& proc)
 	: process_(proc)
 	, owner_(owner)
@@ -25,6 +28,58 @@ bool CStorjInputThread::spawn(fz::thread_pool & pool)
 	return thread_.operator bool();
 }
 
+void CStorjInputThread::SetTransfer(std::shared_ptr<transfer_reader> const& reader, std::shared_ptr<transfer_writer> const& writer)
+{
+	fz::scoped_lock l(mutex_);
+	reader_ = reader;
+	writer_ = writer;
+}
+
+void CStorjInputThread::CancelTransfer()
+{
+	fz::scoped_lock l(mutex_);
+	if (reader_) {
+		reader_->cancel();
+	}
+	if (writer_) {
+		writer_->cancel();
+	}
+}
+
+uint64_t CStorjInputThread::ReadUInt(std::wstring &error)
+{
+	uint64_t ret{};
+
+	while (true) {
+		if (!readFromProcess(error, true)) {
+			return 0;
+		}
+
+		auto const* p = recv_buffer_.get();
+		size_t i;
+		for (i = 0; i < recv_buffer_.size(); ++i) {
+			unsigned char const c = p[i];
+			if (c == '\n') {
+				recv_buffer_.consume(i + 1);
+				return ret;
+			}
+			if (c == '\r') {
+				continue;
+			}
+
+			if (c < '0' || c > '9') {
+				error = L"Unexpected character";
+				return 0;
+			}
+			ret *= 10;
+			ret += c - '0';
+		}
+		recv_buffer_.clear();
+	}
+
+	return 0;
+}
+
 std::wstring CStorjInputThread::ReadLine(std::wstring &error)
 {
 	int len = 0;
@@ -69,6 +124,81 @@ std::wstring CStorjInputThread::ReadLine(std::wstring &error)
 	return std::wstring();
 }
 
+void CStorjInputThread::WriteData(uint64_t len, std::wstring & error)
+{
+	if (!error.empty()) {
+		return;
+	}
+
+	std::shared_ptr<transfer_writer> writer;
+	{
+		fz::scoped_lock l(mutex_);
+		writer = writer_;
+	}
+	if (!writer) {
+		error = L"Received data outside of a transfer";
+		return;
+	}
+
+	while (len) {
+		if (!readFromProcess(error, true)) {
+			return;
+		}
+
+		size_t const n = static_cast<size_t>(std::min(static_cast<uint64_t>(recv_buffer_.size()), len));
+		if (!writer->write(recv_buffer_.get(), n)) {
+			// Stops the download, fzstorj cannot be told to abort it otherwise
+			error = fz::sprintf(_("Could not write to %s"), writer->name());
+			return;
+		}
+		recv_buffer_.consume(n);
+		len -= n;
+	}
+}
+
+void CStorjInputThread::SendData(uint64_t len, std::wstring & error)
+{
+	if (!error.empty()) {
+		return;
+	}
+
+	std::shared_ptr<transfer_reader> reader;
+	{
+		fz::scoped_lock l(mutex_);
+		reader = reader_;
+	}
+	if (!reader) {
+		error = L"Data requested outside of a transfer";
+		return;
+	}
+
+	// fzstorj asks for no more than its buffer holds, cap it nevertheless
+	len = std::min(len, static_cast<uint64_t>(64 * 1024));
+
+	fz::buffer data;
+	int64_t const read = reader->read(data.get(static_cast<size_t>(len)), static_cast<int64_t>(len));
+
+	std::string reply;
+	if (read < 0) {
+		reply = "=-\n";
+
+		auto msg = new CStorjEvent;
+		auto & message = std::get<0>(msg->v_);
+		message.type = storjEvent::ErrorMsg;
+		message.text[0] = fz::sprintf(_("Could not read from %s"), reader->name());
+		owner_.send_event(msg);
+	}
+	else {
+		reply = fz::sprintf("=%d\n", read);
+		reply.append(reinterpret_cast<char const*>(data.get()), static_cast<size_t>(read));
+	}
+
+	// fzstorj waits for the reply, nothing else gets written to it meanwhile
+	if (!process_.write(reply)) {
+		error = L"Unknown error writing to process";
+	}
+}
+
 bool CStorjInputThread::readFromProcess(std::wstring & error, bool eof_is_error)
 {
 	if (recv_buffer_.empty()) {
@@ -119,6 +249,18 @@ void CStorjInputThread::processEvent(storjEvent eventType, std::wstring &error)
 	case storjEvent::Listentry:
 		lines = 4;
 		break;
+	case storjEvent::Data:
+		{
+			uint64_t const len = ReadUInt(error);
+			WriteData(len, error);
+		}
+		return;
+	case storjEvent::DataRequest:
+		{
+			uint64_t const len = ReadUInt(error);
+			SendData(len, error);
+		}
+		return;
 	};
 
 	auto msg = new CStorjEvent;
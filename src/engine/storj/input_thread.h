@@ -2,8 +2,11 @@
 #define FILEZILLA_ENGINE_STORJ_INPUT_THREAD_HEADER
 
 class CStorjControlSocket;
+class transfer_reader;
+class transfer_writer;
 
 #include <libfilezilla/buffer.hpp>
+#include <libfilezilla/mutex.hpp>
 #include <libfilezilla/thread_pool.hpp>
 
 namespace fz {
@@ -18,10 +21,21 @@ public:
 
 	bool spawn(fz::thread_pool & pool);
 
+	// The data of transfers from readers or into writers passes through
+	// this thread, it may block in the reader or writer.
+	void SetTransfer(std::shared_ptr<transfer_reader> const& reader, std::shared_ptr<transfer_writer> const& writer);
+
+	// Makes a blocked reader or writer return
+	void CancelTransfer();
+
 protected:
 
 	bool readFromProcess(std::wstring & error, bool eof_is_error);
 	std::wstring ReadLine(std::wstring &error);
+	uint64_t ReadUInt(std::wstring & error);
+
+	void WriteData(uint64_t len, std::wstring & error);
+	void SendData(uint64_t len, std::wstring & error);
 
 	void entry();
 
@@ -33,6 +47,10 @@ protected:
 	fz::async_task thread_;
 
 	fz::buffer recv_buffer_;
+
+	fz::mutex mutex_;
+	std::shared_ptr<transfer_reader> reader_;
+	std::shared_ptr<transfer_writer> writer_;
 };
 
 #endif
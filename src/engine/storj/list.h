@@ -26,7 +26,7 @@ private:
 	CServerPath path_;
 	std::wstring subDir_;
 
-	std::vector<fz::shared_value<CDirentry>> entries_;
+	std::vector<CDirentry> entries_;
 
 	fz::monotonic_clock time_before_locking_;
 
@@ -70,11 +70,11 @@ void CStorjControlSocket::List(CServerPath const& path, std::wstring const& subD
 	Push(std::make_unique<CStorjListOpData>(*this, newPath, std::wstring(), flags));
 }
 
-void CStorjControlSocket::FileTransfer(std::wstring const& localFile, CServerPath const& remotePath,
-						 std::wstring const& remoteFile, bool download,
-						 CFileTransferCommand::t_transferSettings const& transferSettings)
+void CStorjControlSocket::FileTransfer(CFileTransferCommand const& cmd)
 {
-	auto pData = std::make_unique<CStorjFileTransferOpData>(*this, download, localFile, remoteFile, remotePath, transferSettings);
+	auto pData = std::make_unique<CStorjFileTransferOpData>(*this, cmd.Download(), cmd.GetLocalFile(), cmd.GetRemoteFile(), cmd.GetRemotePath(), cmd.GetTransferSettings());
+	pData->reader_ = cmd.GetReader();
+	pData->writer_ = cmd.GetWriter();
 	Push(std::move(pData));
 }
 
@@ -349,6 +349,8 @@ int CStorjControlSocket::DoClose(int nErrorCode)
 	}
 
 	if (input_thread_) {
+		// Killing fzstorj does not help if blocked in a reader or writer
+		input_thread_->CancelTransfer();
 		input_thread_.reset();
 
 		auto threadEventsFilter = [&](fz::event_loop::Events::value_type const& ev) -> bool {
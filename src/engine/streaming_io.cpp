@@ -0,0 +1,120 @@
+#include <filezilla.h>
+
+#include "streaming_io.h"
+
+#include <algorithm>
+
+#ifndef FZ_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+int64_t const window_size = 8 * 1024 * 1024;
+}
+
+CStreamingIO::~CStreamingIO()
+{
+	Close();
+}
+
+bool CStreamingIO::Open(std::wstring const& file, bool read, int64_t offset)
+{
+	Close();
+
+#ifdef HAVE_POSIX_FADVISE
+	fd_ = open(fz::to_native(file).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd_ == -1) {
+		return false;
+	}
+
+	read_ = read;
+	start_ = offset;
+	pos_ = offset;
+	window_ = offset;
+
+	if (read_) {
+		posix_fadvise(fd_, offset, 2 * window_size, POSIX_FADV_WILLNEED);
+	}
+
+	return true;
+#else
+	(void)file;
+	(void)read;
+	(void)offset;
+	return false;
+#endif
+}
+
+void CStreamingIO::Close()
+{
+	if (fd_ == -1) {
+		return;
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	if (read_) {
+		// Including whatever got read ahead but not transferred
+		posix_fadvise(fd_, window_, 0, POSIX_FADV_DONTNEED);
+	}
+	else {
+		// Only clean pages get dropped, the remainder gets written back
+		// by the kernel as usual.
+		int64_t const from = std::max(start_, window_ - window_size);
+		if (pos_ > from) {
+			posix_fadvise(fd_, from, pos_ - from, POSIX_FADV_DONTNEED);
+		}
+	}
+	close(fd_);
+#endif
+
+	fd_ = -1;
+}
+
+void CStreamingIO::Advance(int64_t len)
+{
+	if (fd_ == -1 || len <= 0) {
+		return;
+	}
+
+	pos_ += len;
+	while (pos_ - window_ >= window_size) {
+		Drop(window_, window_size);
+		window_ += window_size;
+	}
+}
+
+void CStreamingIO::Drop(int64_t offset, int64_t len)
+{
+#ifdef HAVE_POSIX_FADVISE
+	if (read_) {
+		posix_fadvise(fd_, offset, len, POSIX_FADV_DONTNEED);
+		posix_fadvise(fd_, offset + 2 * window_size, window_size, POSIX_FADV_WILLNEED);
+		return;
+	}
+
+#ifdef SYNC_FILE_RANGE_WRITE
+	// Start writeback of the window just completed, wait for the one before
+	// to hit the disk so that its pages are clean and can be dropped.
+	// This also keeps the amount of dirty data bounded.
+	sync_file_range(fd_, offset, len, SYNC_FILE_RANGE_WRITE);
+	if (offset - len >= start_) {
+		int res;
+		do {
+			res = sync_file_range(fd_, offset - len, len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		} while (res == -1 && errno == EINTR);
+		posix_fadvise(fd_, offset - len, len, POSIX_FADV_DONTNEED);
+	}
+#else
+	// Without a way to wait for writeback, dirty pages of the previous
+	// window stay cached.
+	if (offset - len >= start_) {
+		posix_fadvise(fd_, offset - len, len, POSIX_FADV_DONTNEED);
+	}
+#endif
+#else
+	(void)offset;
+	(void)len;
+#endif
+}
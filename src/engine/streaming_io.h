@@ -0,0 +1,46 @@
+#ifndef FILEZILLA_ENGINE_STREAMING_IO_HEADER
+#define FILEZILLA_ENGINE_STREAMING_IO_HEADER
+
+#include <string>
+
+// Keeps a file that is transferred sequentially from filling the page cache.
+//
+// Written data gets flushed and dropped from the cache one window behind the
+// current position. For reads, the kernel is asked to read the next windows
+// ahead and to drop the ones already consumed.
+//
+// Uses a descriptor of its own, the advice applies to the cached pages of the
+// file no matter through which descriptor they got read or written.
+// Does nothing if the platform has no means to give such advice.
+class CStreamingIO final
+{
+public:
+	CStreamingIO() = default;
+	~CStreamingIO();
+
+	CStreamingIO(CStreamingIO const&) = delete;
+	CStreamingIO& operator=(CStreamingIO const&) = delete;
+
+	// offset is the position in the file the transfer starts at
+	bool Open(std::wstring const& file, bool read, int64_t offset);
+	void Close();
+
+	bool opened() const { return fd_ != -1; }
+
+	// To be called after len bytes have been read from or written to the file
+	void Advance(int64_t len);
+
+private:
+	void Drop(int64_t offset, int64_t len);
+
+	int fd_{-1};
+	bool read_{};
+
+	int64_t start_{};
+	int64_t pos_{};
+
+	// Start of the window currently being transferred
+	int64_t window_{};
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include <filezilla.h>
+
+#include "transfer_io.h"
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/mutex.hpp>
+
+#include <algorithm>
+
+#include <string.h>
+
+memory_reader::memory_reader(std::string const& data, std::wstring const& name)
+	: data_(data)
+	, name_(name)
+{
+}
+
+bool memory_reader::seek(int64_t offset)
+{
+	if (offset < 0 || offset > size()) {
+		return false;
+	}
+	pos_ = static_cast<size_t>(offset);
+	return true;
+}
+
+int64_t memory_reader::read(void* data, int64_t len)
+{
+	size_t const n = std::min(static_cast<size_t>(len), data_.size() - pos_);
+	memcpy(data, data_.data() + pos_, n);
+	pos_ += n;
+	return static_cast<int64_t>(n);
+}
+
+memory_writer::memory_writer(int64_t limit, std::wstring const& name)
+	: name_(name)
+	, limit_(limit)
+{
+}
+
+bool memory_writer::write(void const* data, int64_t len)
+{
+	if (limit_ != -1 && static_cast<int64_t>(data_.size()) + len > limit_) {
+		return false;
+	}
+	data_.append(static_cast<char const*>(data), static_cast<size_t>(len));
+	return true;
+}
+
+class transfer_pipe::state final
+{
+public:
+	state(int64_t size, size_t capacity, std::wstring const& name)
+		: size_(size)
+		, capacity_(capacity)
+		, name_(name)
+	{}
+
+	int64_t read(void* data, int64_t len)
+	{
+		fz::scoped_lock l(mutex_);
+		while (buffer_.empty() && !finished_ && !failed_) {
+			readable_.wait(l);
+		}
+		if (failed_) {
+			return -1;
+		}
+
+		size_t const n = std::min(static_cast<size_t>(len), buffer_.size());
+		if (n) {
+			memcpy(data, buffer_.get(), n);
+			buffer_.consume(n);
+			writable_.signal(l);
+		}
+		return static_cast<int64_t>(n);
+	}
+
+	bool write(void const* data, int64_t len)
+	{
+		auto p = static_cast<unsigned char const*>(data);
+		size_t remaining = static_cast<size_t>(len);
+
+		fz::scoped_lock l(mutex_);
+		while (remaining) {
+			while (buffer_.size() >= capacity_ && !failed_) {
+				writable_.wait(l);
+			}
+			if (failed_ || finished_) {
+				return false;
+			}
+
+			size_t const n = std::min(remaining, capacity_ - buffer_.size());
+			buffer_.append(p, n);
+			p += n;
+			remaining -= n;
+			readable_.signal(l);
+		}
+		return true;
+	}
+
+	void finish()
+	{
+		fz::scoped_lock l(mutex_);
+		finished_ = true;
+		readable_.signal(l);
+	}
+
+	// Wakes up both sides, unless the data is complete already
+	void fail()
+	{
+		fz::scoped_lock l(mutex_);
+		if (!finished_) {
+			failed_ = true;
+			readable_.signal(l);
+		}
+		writable_.signal(l);
+	}
+
+	int64_t const size_;
+	size_t const capacity_;
+	std::wstring const name_;
+
+private:
+	fz::mutex mutex_{false};
+	fz::condition readable_;
+	fz::condition writable_;
+
+	fz::buffer buffer_;
+	bool finished_{};
+	bool failed_{};
+};
+
+class transfer_pipe::pipe_reader final : public transfer_reader
+{
+public:
+	explicit pipe_reader(std::shared_ptr<state> const& s)
+		: state_(s)
+	{}
+
+	virtual ~pipe_reader()
+	{
+		state_->fail();
+	}
+
+	virtual std::wstring name() const override { return state_->name_; }
+	virtual int64_t size() const override { return state_->size_; }
+	virtual int64_t read(void* data, int64_t len) override { return state_->read(data, len); }
+	virtual void cancel() override { state_->fail(); }
+
+private:
+	std::shared_ptr<state> state_;
+};
+
+class transfer_pipe::pipe_writer final : public transfer_writer
+{
+public:
+	explicit pipe_writer(std::shared_ptr<state> const& s)
+		: state_(s)
+	{}
+
+	// Without finish, the download did not complete
+	virtual ~pipe_writer()
+	{
+		state_->fail();
+	}
+
+	virtual std::wstring name() const override { return state_->name_; }
+	virtual bool write(void const* data, int64_t len) override { return state_->write(data, len); }
+	virtual bool finish() override
+	{
+		state_->finish();
+		return true;
+	}
+	virtual void cancel() override { state_->fail(); }
+	virtual bool blocking() const override { return true; }
+
+private:
+	std::shared_ptr<state> state_;
+};
+
+transfer_pipe::transfer_pipe(int64_t size, size_t capacity, std::wstring const& name)
+	: state_(std::make_shared<state>(size, std::max(capacity, size_t(1)), name))
+{
+}
+
+std::shared_ptr<transfer_writer> transfer_pipe::writer()
+{
+	return std::make_shared<pipe_writer>(state_);
+}
+
+std::shared_ptr<transfer_reader> transfer_pipe::reader()
+{
+	return std::make_shared<pipe_reader>(state_);
+}
@@ -3,6 +3,7 @@
 
 #include "server.h"
 #include "serverpath.h"
+#include "transfer_io.h"
 
 #include <libfilezilla/uri.hpp>
 
@@ -59,6 +60,9 @@ enum class Command
 
 #define FZ_REPLY_CONTINUE 0x8000 // Used internally
 
+#define FZ_REPLY_VERIFYFAILED	(0x10000 | FZ_REPLY_ERROR) // Checksum of the transferred file does not match the one
+														   // reported by the server
+
 // --------------- //
 // Actual commands //
 // --------------- //
@@ -169,6 +173,11 @@ public:
 	public:
 		bool binary{true};
 		bool fsync{};
+
+		// Keep the local file out of the page cache, for bulk transfers
+		// that would otherwise evict everything else from it.
+		// Also enabled for all transfers by OPTION_STREAMING_IO.
+		bool streaming{};
 	};
 
 	// For uploads, set download to false.
@@ -177,18 +186,29 @@ public:
 	// FIXME: localFile empty iff protocol is HTTP.
 	CFileTransferCommand(std::wstring const& localFile, CServerPath const& remotePath, std::wstring const& remoteFile, bool download, t_transferSettings const& m_transferSettings);
 
+	// Uploads from reader or downloads into writer instead of a local file,
+	// see transfer_io.h
+	CFileTransferCommand(std::shared_ptr<transfer_reader> const& reader, CServerPath const& remotePath, std::wstring const& remoteFile, t_transferSettings const& transferSettings);
+	CFileTransferCommand(std::shared_ptr<transfer_writer> const& writer, CServerPath const& remotePath, std::wstring const& remoteFile, t_transferSettings const& transferSettings);
+
 	std::wstring GetLocalFile() const;
 	CServerPath GetRemotePath() const;
 	std::wstring GetRemoteFile() const;
 	bool Download() const;
 	const t_transferSettings& GetTransferSettings() const { return m_transferSettings; }
 
+	std::shared_ptr<transfer_reader> const& GetReader() const { return reader_; }
+	std::shared_ptr<transfer_writer> const& GetWriter() const { return writer_; }
+
 protected:
 	std::wstring const m_localFile;
 	CServerPath const m_remotePath;
 	std::wstring const m_remoteFile;
 	bool const m_download;
 	t_transferSettings const m_transferSettings;
+
+	std::shared_ptr<transfer_reader> const reader_;
+	std::shared_ptr<transfer_writer> const writer_;
 };
 
 class CHttpRequestCommand final : public CCommandHelper<CHttpRequestCommand, Command::httprequest>
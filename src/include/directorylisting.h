@@ -5,15 +5,18 @@
 #include <libfilezilla/shared.hpp>
 #include <libfilezilla/time.hpp>
 
-#include <unordered_map>
+#include <vector>
 
 class CDirentry
 {
 public:
 	std::wstring name;
 	int64_t size;
-	fz::shared_value<std::wstring> permissions;
-	fz::shared_value<std::wstring> ownerGroup;
+
+	// Default-constructed entries share a single empty string, so creating
+	// an entry does not allocate.
+	fz::shared_value<std::wstring> permissions{empty_string()};
+	fz::shared_value<std::wstring> ownerGroup{empty_string()};
 
 	enum _flags
 	{
@@ -59,6 +62,8 @@ public:
 
 	std::wstring dump() const;
 	bool operator==(const CDirentry &op) const;
+
+	static fz::shared_value<std::wstring> const& empty_string();
 };
 
 class CDirectoryListing final
@@ -76,10 +81,11 @@ public:
 	CDirentry const& operator[](size_t index) const;
 
 	// Word of caution: You MUST NOT change the name of the returned
-	// entry if you do not call ClearFindMap afterwards
+	// entry if you do not call ClearFindMap afterwards. Use RenameEntry
+	// instead, it keeps the search maps intact.
 	CDirentry& get(size_t index);
 
-	size_t size() const { return m_entries ? m_entries->size() : 0; }
+	size_t size() const;
 
 	void Append(CDirentry&& entry);
 
@@ -126,20 +132,114 @@ public:
 	bool has_perms() const { return (m_flags & listing_has_perms) != 0; }
 	bool has_usergroup() const { return (m_flags & listing_has_usergroup) != 0; }
 
-	void Assign(std::vector<fz::shared_value<CDirentry>> && entries);
+	void Assign(std::vector<CDirentry> && entries);
 
 	bool RemoveEntry(size_t index);
+	void RenameEntry(size_t index, std::wstring const& name);
 
 	void GetFilenames(std::vector<std::wstring> &names) const;
 
 protected:
 
-	fz::shared_optional<std::vector<fz::shared_value<CDirentry>>> m_entries;
+	// Entries are stored by value in blocks of up to block_size entries.
+	// Copies of a listing share the blocks, modifying or removing an entry
+	// only copies the block containing it. Compared to individually
+	// allocated entries this saves an allocation and a control block per
+	// entry.
+	static constexpr size_t block_size = 1024;
+	typedef std::vector<CDirentry> block;
+
+	struct block_list
+	{
+		std::vector<fz::shared_value<block>> blocks;
+
+		// Index of the first entry of each block. Blocks are only full
+		// until entries get removed from them.
+		std::vector<size_t> starts;
+	};
+
+	// Returns the block containing the entry at the given index
+	size_t find_block(size_t index) const;
+
+	fz::shared_optional<block_list> m_entries;
+
+	// Open addressing hash index over the names of the first count()
+	// entries. Only hashes and entry indexes are stored, candidates are
+	// verified against the entries themselves. Further entries are added
+	// on demand during lookups.
+	class name_index final
+	{
+	public:
+		size_t count() const { return count_; }
+
+		template<typename Matches>
+		size_t find(uint32_t hash, Matches const& matches) const;
+
+		void insert(uint32_t hash, size_t index);
+		void erase(uint32_t hash, size_t index);
+
+		// Adjusts the indexes after the entry at the given index got removed
+		void remove(uint32_t hash, size_t index);
+
+	private:
+		// Slots keep the indexes the entries had before the removals
+		// recorded in removed_, so that removing an entry does not need
+		// to touch all slots. Once enough removals have accumulated, the
+		// slots get rewritten.
+		struct slot
+		{
+			uint32_t hash;
+			uint32_t index;
+		};
+		static constexpr uint32_t empty = static_cast<uint32_t>(-1);
 
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_case;
-	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_nocase;
+		size_t current(uint32_t stored) const;
+		uint32_t stored(size_t index) const;
+
+		void erase_stored(uint32_t hash, uint32_t value);
+
+		void grow();
+		void compact();
+
+		std::vector<slot> slots_;
+		size_t count_{};
+
+		// Sorted
+		std::vector<uint32_t> removed_;
+	};
+
+	static uint32_t name_hash(std::wstring const& name);
+
+	size_t FindFile(fz::shared_optional<name_index> & index, std::wstring const& name, bool nocase) const;
+
+	mutable fz::shared_optional<name_index> m_searchmap_case;
+	mutable fz::shared_optional<name_index> m_searchmap_nocase;
+
+	friend class CDirectoryListingTest;
 };
 
+template<typename Matches>
+size_t CDirectoryListing::name_index::find(uint32_t hash, Matches const& matches) const
+{
+	if (slots_.empty()) {
+		return std::string::npos;
+	}
+
+	// Names need not be unique, return the first matching entry
+	size_t ret = std::string::npos;
+	size_t const mask = slots_.size() - 1;
+	for (size_t pos = hash & mask; slots_[pos].index != empty; pos = (pos + 1) & mask) {
+		auto const& s = slots_[pos];
+		if (s.hash == hash) {
+			size_t const index = removed_.empty() ? s.index : current(s.index);
+			if (index < ret && matches(index)) {
+				ret = index;
+			}
+		}
+	}
+	return ret;
+}
+
 // Checks if listing2 is a subset of listing1. Compares only filenames.
 bool CheckInclusion(CDirectoryListing const& listing1, CDirectoryListing const& listing2);
 
@@ -4,6 +4,8 @@
 #include <memory>
 
 class CDirectoryCache;
+class CHashService;
+class CMetrics;
 class COptionsBase;
 class CPathCache;
 class CRateLimiter;
@@ -38,8 +40,10 @@ public:
 	CRateLimiter& GetRateLimiter();
 	CDirectoryCache& GetDirectoryCache();
 	CPathCache& GetPathCache();
+	CHashService& GetHashService();
 	CustomEncodingConverterBase const& GetCustomEncodingConverter() { return customEncodingConverter_; }
 	OpLockManager& GetOpLockManager();
+	CMetrics& GetMetrics();
 	fz::tls_system_trust_store& GetTlsSystemTrustStore();
 
 protected:
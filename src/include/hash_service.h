@@ -0,0 +1,87 @@
+#ifndef FILEZILLA_ENGINE_HASH_SERVICE_HEADER
+#define FILEZILLA_ENGINE_HASH_SERVICE_HEADER
+
+#include <libfilezilla/mutex.hpp>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace fz {
+class thread_pool;
+}
+
+enum class file_hash : unsigned int
+{
+	md5,
+	sha1,
+	sha256,
+	sha512,
+	crc32,
+
+	count
+};
+
+inline unsigned int hash_bit(file_hash h)
+{
+	return 1u << static_cast<unsigned int>(h);
+}
+
+// Hashes local files using the engine's thread pool.
+//
+// All requested algorithms are computed in a single pass over the file.
+// Reading the next block of a file overlaps with hashing the current one,
+// and multiple files get hashed concurrently. The buffers of all files
+// being hashed at the same time stay within a fixed memory budget.
+//
+// The functions are blocking and may be called from any thread, including
+// concurrently.
+class CHashService final
+{
+public:
+	explicit CHashService(fz::thread_pool & pool, size_t memoryBudget = 32 * 1024 * 1024);
+
+	CHashService(CHashService const&) = delete;
+	CHashService& operator=(CHashService const&) = delete;
+
+	struct result final
+	{
+		std::wstring file;
+
+		// False if the file could not be opened or read
+		bool success{};
+		int64_t size{-1};
+
+		// Digests of the requested algorithms, indexed by file_hash. CRC32 is
+		// stored in big-endian byte order.
+		std::vector<uint8_t> digests[static_cast<size_t>(file_hash::count)];
+
+		std::vector<uint8_t> const& digest(file_hash h) const {
+			return digests[static_cast<size_t>(h)];
+		}
+	};
+
+	// hashes is a combination of hash_bit values.
+	// If cancel gets set while hashing, Hash returns early with an unsuccessful result.
+	result Hash(std::wstring const& file, unsigned int hashes, std::atomic<bool> const* cancel = nullptr);
+
+	// Results are in the same order as the files
+	std::vector<result> Hash(std::vector<std::wstring> const& files, unsigned int hashes);
+
+private:
+	void Reserve(size_t & bufferSize);
+	void Release(size_t bufferSize);
+
+	void HashFile(result & res, unsigned int hashes, size_t bufferSize, std::atomic<bool> const* cancel = nullptr);
+
+	fz::thread_pool & pool_;
+
+	size_t const memoryBudget_;
+
+	// Memory currently used for buffers, protected by mtx_
+	size_t used_{};
+	fz::mutex mtx_{false};
+	fz::condition cond_;
+};
+
+#endif
@@ -178,6 +178,7 @@ public:
 		resume, // Overwrites if cannot be resumed
 		rename,
 		skip,
+		overwriteChanged, // Overwrite if source file is different in size or content than target file. Files of equal size and time count as unchanged. Otherwise content is compared using checksums if the server supports them, else like overwriteSizeOrNewer.
 
 		ACTION_COUNT
 	};
@@ -83,6 +83,15 @@ enum engineOptions
 
 	OPTION_CACHE_TTL,
 
+	OPTION_METRICS_FILE,		// If set, metrics are written in Prometheus text format on exit
+	OPTION_TRACE_FILE,			// If set, operation spans are written in Chrome trace format on exit
+
+	OPTION_VERIFY_TRANSFERS,	// Compare checksums of transferred files if the server provides them
+
+	OPTION_STREAMING_IO,		// Keep transferred files out of the page cache
+
+	OPTION_FTP_PREFETCH_DATACONNECTION, // Open the next passive mode data connection while a transfer finishes
+
 	OPTIONS_ENGINE_NUM
 };
 
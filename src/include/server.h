@@ -96,7 +96,8 @@ enum class ProtocolFeature
 	RecursiveDelete,
 	ServerAssignedHome,
 	TemporaryUrl,
-	S3Sse
+	S3Sse,
+	Checksums // Content of existing files can be compared, see CFileExistsNotification::overwriteChanged
 };
 
 class Credentials;
@@ -5,11 +5,16 @@
 #include <libfilezilla/shared.hpp>
 
 #include <deque>
+#include <memory>
+
+class CServerPathSegment;
 
 class CServerPathData final
 {
 public:
-	std::deque<std::wstring> m_segments;
+	// Last segment of the path, each segment links to its parent. Segments
+	// are immutable and shared between all paths derived from each other.
+	std::shared_ptr<CServerPathSegment const> m_last;
 	fz::sparse_optional<std::wstring> m_prefix;
 
 	bool operator==(const CServerPathData& cmp) const;
@@ -62,6 +67,9 @@ public:
 
 	int CmpNoCase(CServerPath const& op) const;
 
+	// Consistent with operator==, the hashes of the segments are precomputed
+	size_t hash() const;
+
 	// omitPath is just a hint. For example dataset member names on MVS servers
 	// always use absolute filenames including the full path
 	std::wstring FormatFilename(std::wstring const& filename, bool omitPath = false) const;
@@ -81,8 +89,6 @@ private:
 	ServerType m_type;
 
 	typedef std::deque<std::wstring> tSegmentList;
-	typedef tSegmentList::iterator tSegmentIter;
-	typedef tSegmentList::const_iterator tConstSegmentIter;
 
 	bool Segmentize(std::wstring const& str, tSegmentList& segments);
 	bool SegmentizeAddSegment(std::wstring & segment, tSegmentList& segments, bool& append);
@@ -90,7 +96,20 @@ private:
 
 	static void EscapeSeparators(ServerType type, std::wstring& subdir);
 
+	static void AppendSegments(std::wstring& path, CServerPathSegment const& segment, ServerType type, bool rootSeparator);
+
 	fz::shared_optional<CServerPathData> m_data;
 };
 
+namespace std {
+template<>
+struct hash<CServerPath>
+{
+	size_t operator()(CServerPath const& path) const
+	{
+		return path.hash();
+	}
+};
+}
+
 #endif
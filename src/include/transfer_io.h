@@ -0,0 +1,123 @@
+#ifndef FILEZILLA_ENGINE_TRANSFER_IO_HEADER
+#define FILEZILLA_ENGINE_TRANSFER_IO_HEADER
+
+#include <memory>
+#include <string>
+
+// Sources of uploads and sinks of downloads other than local files, e.g.
+// memory buffers or another engine. Pass them to CFileTransferCommand.
+//
+// Unless noted otherwise, read and write get called from a worker thread of
+// the engine and may block. If the transfer gets aborted while a call
+// blocks, cancel gets called from another thread and has to make the
+// blocked call return with an error.
+//
+// Supported by FTP, SFTP and Storj for both directions and by HTTP for
+// downloads into non-blocking writers. For SFTP and Storj the data passes
+// through the helper process, resuming and verifying such transfers is not
+// possible.
+
+class transfer_reader
+{
+public:
+	virtual ~transfer_reader() = default;
+
+	// Shown in the log instead of the local filename
+	virtual std::wstring name() const = 0;
+
+	// Total size in bytes, -1 if unknown
+	virtual int64_t size() const { return -1; }
+
+	// Only called before the first read, when resuming an upload. Return
+	// false if the reader cannot skip data.
+	virtual bool seek(int64_t offset) { return !offset; }
+
+	// Returns the number of bytes read, 0 at the end of the data or -1 on error
+	virtual int64_t read(void* data, int64_t len) = 0;
+
+	virtual void cancel() {}
+};
+
+class transfer_writer
+{
+public:
+	virtual ~transfer_writer() = default;
+
+	// Shown in the log instead of the local filename
+	virtual std::wstring name() const = 0;
+
+	// Returns false on error
+	virtual bool write(void const* data, int64_t len) = 0;
+
+	// Called after the last write of a successful transfer. Returns false
+	// on error.
+	virtual bool finish() { return true; }
+
+	virtual void cancel() {}
+
+	// Writers that never block may also be called from the event loop of
+	// the engine, which HTTP does.
+	virtual bool blocking() const { return false; }
+};
+
+// Uploads the contents of a string
+class memory_reader final : public transfer_reader
+{
+public:
+	explicit memory_reader(std::string const& data, std::wstring const& name = L"memory");
+
+	virtual std::wstring name() const override { return name_; }
+	virtual int64_t size() const override { return static_cast<int64_t>(data_.size()); }
+	virtual bool seek(int64_t offset) override;
+	virtual int64_t read(void* data, int64_t len) override;
+
+private:
+	std::string const data_;
+	std::wstring const name_;
+	size_t pos_{};
+};
+
+// Collects a download in memory. Only access the data once the transfer has
+// finished.
+class memory_writer final : public transfer_writer
+{
+public:
+	// Fails the transfer if it gets larger than limit bytes, -1 for no limit
+	explicit memory_writer(int64_t limit = -1, std::wstring const& name = L"memory");
+
+	virtual std::wstring name() const override { return name_; }
+	virtual bool write(void const* data, int64_t len) override;
+
+	std::string const& data() const { return data_; }
+
+private:
+	std::string data_;
+	std::wstring const name_;
+	int64_t const limit_;
+};
+
+// Connects the download of one engine to the upload of another, so that
+// files can be relayed between servers without touching the disk. The
+// download writes into the pipe and blocks once it holds capacity bytes,
+// the upload reads from it.
+//
+// The engines may share an event loop. If either side gets aborted, the
+// other one fails as well.
+class transfer_pipe final
+{
+public:
+	// size is the size of the file if known, it is reported by the reader
+	explicit transfer_pipe(int64_t size = -1, size_t capacity = 4 * 1024 * 1024, std::wstring const& name = L"pipe");
+
+	std::shared_ptr<transfer_writer> writer();
+	std::shared_ptr<transfer_reader> reader();
+
+private:
+	class state;
+	class pipe_reader;
+	class pipe_writer;
+
+	std::shared_ptr<state> state_;
+};
+
+#endif
@@ -10,6 +10,7 @@
 #include "cmdline.h"
 #include "welcome_dialog.h"
 #include "msgbox.h"
+#include "startup_tasks.h"
 #include "themeprovider.h"
 #include "wxfilesystem_blob_handler.h"
 #include <libfilezilla/local_filesys.hpp>
@@ -61,10 +62,8 @@ std::wstring const PATH_SEP = L";";
 #else
 std::wstring const PATH_SEP = L":";
 #endif
-}
 
-// If non-empty, always terminated by a separator
-std::wstring GetOwnExecutableDir()
+std::wstring DoGetOwnExecutableDir()
 {
 #ifdef FZ_WINDOWS
 	// Add executable path
@@ -117,6 +116,45 @@ std::wstring GetOwnExecutableDir()
 #endif
 	return std::wstring();
 }
+}
+
+// If non-empty, always terminated by a separator
+std::wstring GetOwnExecutableDir()
+{
+	// Does not change while running, and startup looks it up repeatedly
+	static std::wstring const dir = DoGetOwnExecutableDir();
+	return dir;
+}
+
+#ifdef __WXMAC__
+std::wstring GetBundleDataDir()
+{
+	// wxStandardPaths must only be used on the main thread. Startup tasks get
+	// the cached value, it is looked up before they are started.
+	static std::wstring const dir = wxStandardPaths::Get().GetDataDir().ToStdWstring();
+	return dir;
+}
+#endif
+
+// Filesystem lookups done during startup. They do not depend on each other,
+// so they run concurrently while the main thread initializes the locale and
+// the options.
+struct CFileZillaApp::startup_state final
+{
+	CLocalPath resourceDir_;
+	CLocalPath localesDir_;
+	std::wstring fzsftp_;
+	std::wstring fzstorj_;
+
+	CStartupTasks::task_id resourceDirTask_{};
+	CStartupTasks::task_id localesDirTask_{};
+	CStartupTasks::task_id fzsftpTask_{};
+	CStartupTasks::task_id fzstorjTask_{};
+
+	// Declared last so that the tasks are finished before anything else gets destroyed
+	fz::thread_pool pool_;
+	CStartupTasks tasks_{pool_};
+};
 
 CFileZillaApp::CFileZillaApp()
 {
@@ -126,6 +164,7 @@ CFileZillaApp::CFileZillaApp()
 
 CFileZillaApp::~CFileZillaApp()
 {
+	startup_.reset();
 	COptions::Destroy();
 }
 
@@ -239,15 +278,6 @@ bool CFileZillaApp::OnInit()
 		return false;
 	}
 
-	LoadLocales();
-
-	if (cmdline_result < 0) {
-		if (m_pCommandLine) {
-			m_pCommandLine->DisplayUsage();
-		}
-		return false;
-	}
-
 #if USE_MAC_SANDBOX
 	// Set PUTTYDIR so that fzsftp uses the sandboxed home to put settings.
 	std::wstring home = GetEnv("Home");
@@ -258,6 +288,19 @@ bool CFileZillaApp::OnInit()
 		wxSetEnv("PUTTYDIR", home + L".config/putty");
 	}
 #endif
+
+	// The tasks read the environment, so this has to come after the above
+	StartStartupTasks();
+
+	LoadLocales();
+
+	if (cmdline_result < 0) {
+		if (m_pCommandLine) {
+			m_pCommandLine->DisplayUsage();
+		}
+		return false;
+	}
+
 	InitDefaultsDir();
 
 	COptions::Init();
@@ -294,6 +337,9 @@ USE AT OWN RISK"), _T("Important Information"));
 	CheckExistsFzstorj();
 #endif
 
+	// All results have been collected
+	startup_.reset();
+
 	// Turn off idle events, we don't need them
 	wxIdleEvent::SetMode(wxIDLE_PROCESS_SPECIFIED);
 
@@ -329,6 +375,15 @@ USE AT OWN RISK"), _T("Important Information"));
 	CMainFrame *frame = new CMainFrame();
 	frame->Show(true);
 	SetTopWindow(frame);
+	AddStartupProfileRecord("CFileZillaApp::OnInit main window shown");
+
+	// Pending events get processed once the main loop runs, from then on the
+	// window is interactive. Queued before PostInitialize so that work it
+	// defers does not get counted.
+	CallAfter([this]() {
+		m_profile_interactive = fz::monotonic_clock::now();
+		AddStartupProfileRecord("CFileZillaApp main loop running");
+	});
 
 	if (!welcome_skip) {
 		CWelcomeDialog::RunDelayed(frame);
@@ -337,7 +392,9 @@ USE AT OWN RISK"), _T("Important Information"));
 	frame->ProcessCommandLine();
 	frame->PostInitialize();
 
-	ShowStartupProfile();
+	CallAfter([this]() {
+		ShowStartupProfile();
+	});
 
 	return true;
 }
@@ -400,7 +457,7 @@ CLocalPath CFileZillaApp::GetDataDir(std::vector<std::wstring> const& fileToFind
 #ifdef __WXMAC__
 	(void)prefixSub;
 
-	if (searchSelfDir && testPath(wxStandardPaths::Get().GetDataDir().ToStdWstring())) {
+	if (searchSelfDir && testPath(GetBundleDataDir())) {
 		return ret;
 	}
 
@@ -462,7 +519,13 @@ CLocalPath CFileZillaApp::GetDataDir(std::vector<std::wstring> const& fileToFind
 bool CFileZillaApp::LoadResourceFiles()
 {
 	AddStartupProfileRecord("CFileZillaApp::LoadResourceFiles");
-	m_resourceDir = GetDataDir({L"resources/defaultfilters.xml"}, L"share/filezilla");
+	if (startup_) {
+		WaitForStartupTask(startup_->resourceDirTask_);
+		m_resourceDir = startup_->resourceDir_;
+	}
+	else {
+		m_resourceDir = GetDataDir({L"resources/defaultfilters.xml"}, L"share/filezilla");
+	}
 
 	wxImage::AddHandler(new wxPNGHandler());
 
@@ -502,18 +565,30 @@ bool CFileZillaApp::InitDefaultsDir()
 	return !m_defaultsDir.empty();
 }
 
-bool CFileZillaApp::LoadLocales()
+CLocalPath CFileZillaApp::FindLocalesDir() const
 {
-	AddStartupProfileRecord("CFileZillaApp::LoadLocales");
-	m_localesDir = GetDataDir({L"locales/de/filezilla.mo"}, std::wstring());
-	if (!m_localesDir.empty()) {
-		m_localesDir.AddSegment(_T("locales"));
+	CLocalPath dir = GetDataDir({L"locales/de/filezilla.mo"}, std::wstring());
+	if (!dir.empty()) {
+		dir.AddSegment(_T("locales"));
 	}
 #ifndef __WXMAC__
 	else {
-		m_localesDir = GetDataDir({L"de/filezilla.mo", L"de/LC_MESSAGES/filezilla.mo"}, L"share/locale", false);
+		dir = GetDataDir({L"de/filezilla.mo", L"de/LC_MESSAGES/filezilla.mo"}, L"share/locale", false);
 	}
 #endif
+	return dir;
+}
+
+bool CFileZillaApp::LoadLocales()
+{
+	AddStartupProfileRecord("CFileZillaApp::LoadLocales");
+	if (startup_) {
+		WaitForStartupTask(startup_->localesDirTask_);
+		m_localesDir = startup_->localesDir_;
+	}
+	else {
+		m_localesDir = FindLocalesDir();
+	}
 	if (!m_localesDir.empty()) {
 		wxLocale::AddCatalogLookupPathPrefix(m_localesDir.GetPath());
 	}
@@ -605,18 +680,34 @@ CWrapEngine* CFileZillaApp::GetWrapEngine()
 void CFileZillaApp::CheckExistsFzsftp()
 {
 	AddStartupProfileRecord("FileZillaApp::CheckExistsFzsftp");
-	CheckExistsTool(L"fzsftp", L"../putty/", "FZ_FZSFTP", OPTION_FZSFTP_EXECUTABLE, fztranslate("SFTP support"));
+	std::wstring executable;
+	if (startup_) {
+		WaitForStartupTask(startup_->fzsftpTask_);
+		executable = startup_->fzsftp_;
+	}
+	else {
+		executable = FindTool(L"fzsftp", L"../putty/", "FZ_FZSFTP");
+	}
+	CheckExistsTool(executable, L"fzsftp", "FZ_FZSFTP", OPTION_FZSFTP_EXECUTABLE, fztranslate("SFTP support"));
 }
 
 #if ENABLE_STORJ
 void CFileZillaApp::CheckExistsFzstorj()
 {
 	AddStartupProfileRecord("FileZillaApp::CheckExistsFzstorj");
-	CheckExistsTool(L"fzstorj", L"../storj/", "FZ_FZSTORJ", OPTION_FZSTORJ_EXECUTABLE, fztranslate("Storj support"));
+	std::wstring executable;
+	if (startup_) {
+		WaitForStartupTask(startup_->fzstorjTask_);
+		executable = startup_->fzstorj_;
+	}
+	else {
+		executable = FindTool(L"fzstorj", L"../storj/", "FZ_FZSTORJ");
+	}
+	CheckExistsTool(executable, L"fzstorj", "FZ_FZSTORJ", OPTION_FZSTORJ_EXECUTABLE, fztranslate("Storj support"));
 }
 #endif
 
-void CFileZillaApp::CheckExistsTool(std::wstring const& tool, std::wstring const& buildRelPath, std::string const& env, int setting, std::wstring const& description)
+std::wstring CFileZillaApp::FindTool(std::wstring const& tool, std::wstring const& buildRelPath, std::string const& env) const
 {
 	// Get the correct path to the specified tool
 
@@ -692,14 +783,20 @@ void CFileZillaApp::CheckExistsTool(std::wstring const& tool, std::wstring const
 #endif
 
 	if (!found) {
-		// Quote path if it contains spaces
-		if (executable.find(' ') != std::wstring::npos && executable.front() != '"' && executable.front() != '\'') {
-			executable = L"\"" + executable + L"\"";
-		}
+		executable.clear();
+	}
+	return executable;
+}
 
+void CFileZillaApp::CheckExistsTool(std::wstring const& executable, std::wstring const& tool, std::string const& env, int setting, std::wstring const& description)
+{
+	if (executable.empty()) {
+		std::wstring program = tool;
+#ifdef __WXMSW__
+		program += L".exe";
+#endif
 		wxMessageBoxEx(fz::sprintf(fztranslate("%s could not be found. Without this component of FileZilla, %s will not work.\n\nPossible solutions:\n- Make sure %s is in a directory listed in your PATH environment variable.\n- Set the full path to %s in the %s environment variable."), program, description, program, program, env),
 			_("File not found"), wxICON_ERROR | wxOK);
-		executable.clear();
 	}
 	COptions::Get()->SetOption(setting, executable);
 }
@@ -754,10 +851,49 @@ void CFileZillaApp::AddStartupProfileRecord(std::string const& msg)
 	m_startupProfile.emplace_back(fz::monotonic_clock::now(), msg);
 }
 
+void CFileZillaApp::StartStartupTasks()
+{
+	// Not safe to be looked up for the first time off the main thread on all platforms
+	GetOwnExecutableDir();
+#ifdef __WXMAC__
+	GetBundleDataDir();
+#endif
+
+	startup_ = std::make_unique<startup_state>();
+	auto & s = *startup_;
+	s.resourceDirTask_ = s.tasks_.Add("Find resource dir", [this, &s]() {
+		s.resourceDir_ = GetDataDir({L"resources/defaultfilters.xml"}, L"share/filezilla");
+	});
+	s.localesDirTask_ = s.tasks_.Add("Find locales dir", [this, &s]() {
+		s.localesDir_ = FindLocalesDir();
+	});
+	s.fzsftpTask_ = s.tasks_.Add("Find fzsftp", [this, &s]() {
+		s.fzsftp_ = FindTool(L"fzsftp", L"../putty/", "FZ_FZSFTP");
+	});
+#if ENABLE_STORJ
+	s.fzstorjTask_ = s.tasks_.Add("Find fzstorj", [this, &s]() {
+		s.fzstorj_ = FindTool(L"fzstorj", L"../storj/", "FZ_FZSTORJ");
+	});
+#endif
+}
+
+void CFileZillaApp::WaitForStartupTask(CStartupTasks::task_id id)
+{
+	auto const start = fz::monotonic_clock::now();
+	startup_->tasks_.Wait(id);
+	auto const waited = fz::monotonic_clock::now() - start;
+
+	AddStartupProfileRecord(fz::sprintf("Startup task '%s' took %d ms, waited %d ms for it", startup_->tasks_.GetName(id), startup_->tasks_.GetRuntime(id).get_milliseconds(), waited.get_milliseconds()));
+}
+
 void CFileZillaApp::ShowStartupProfile()
 {
 	if (m_profile_start && m_pCommandLine && m_pCommandLine->HasSwitch(CCommandLine::debug_startup)) {
 		AddStartupProfileRecord("CFileZillaApp::ShowStartupProfile");
+
+		int64_t const interactive = m_profile_interactive ? (m_profile_interactive - m_profile_start).get_milliseconds() : -1;
+		int64_t const total = (fz::monotonic_clock::now() - m_profile_start).get_milliseconds();
+
 		wxString msg = _T("Profile:\n");
 		for (auto const& p : m_startupProfile) {
 			auto const diff = p.first - m_profile_start;
@@ -767,10 +903,17 @@ void CFileZillaApp::ShowStartupProfile()
 			msg += fz::to_wstring(p.second);
 			msg += _T("\n");
 		}
+		if (interactive >= 0) {
+			msg += fz::sprintf(L"\nTime to first interactive window: %d ms\n", interactive);
+		}
+
+		// Machine-readable summary, in the same format as the benchmark suite uses
+		msg += fz::sprintf(L"\n{\"benchmark\":\"startup\",\"interactive_ms\":%d,\"total_ms\":%d}\n", interactive, total);
 		wxMessageBoxEx(msg);
 	}
 
 	m_profile_start = fz::monotonic_clock();
+	m_profile_interactive = fz::monotonic_clock();
 	m_startupProfile.clear();
 }
 
@@ -251,6 +251,7 @@ BEGIN_EVENT_TABLE(CLocalListView, CFileListCtrl<CLocalFileData>)
 	// Map both ID_UPLOAD and ID_ADDTOQUEUE to OnMenuUpload, code is identical
 	EVT_MENU(XRCID("ID_UPLOAD"), CLocalListView::OnMenuUpload)
 	EVT_MENU(XRCID("ID_ADDTOQUEUE"), CLocalListView::OnMenuUpload)
+	EVT_MENU(XRCID("ID_SYNC_UPLOAD"), CLocalListView::OnMenuUpload)
 	EVT_MENU(XRCID("ID_MKDIR"), CLocalListView::OnMenuMkdir)
 	EVT_MENU(XRCID("ID_MKDIR_CHGDIR"), CLocalListView::OnMenuMkdirChgDir)
 	EVT_MENU(XRCID("ID_DELETE"), CLocalListView::OnMenuDelete)
@@ -273,6 +274,8 @@ CLocalListView::CLocalListView(CView* pParent, CState& state, CQueueView *pQueue
 	m_parentView(pParent)
 {
 	wxGetApp().AddStartupProfileRecord("CLocalListView::CLocalListView");
+	m_sortPool = &state.pool_;
+
 	m_state.RegisterHandler(this, STATECHANGE_LOCAL_DIR);
 	m_state.RegisterHandler(this, STATECHANGE_APPLYFILTER);
 	m_state.RegisterHandler(this, STATECHANGE_LOCAL_REFRESH_FILE);
@@ -382,6 +385,7 @@ bool CLocalListView::DisplayDir(CLocalPath const& dirname)
 regular_dir:
 #endif
 		CStateFilterManager const& filter = m_state.GetStateFilterManager();
+		bool const filterActive = filter.IsFilterActive(true);
 		fz::local_filesys local_filesys;
 
 		if (!local_filesys.begin_find_files(fz::to_native(m_dir.GetPath()), false)) {
@@ -407,7 +411,7 @@ regular_dir:
 			}
 
 			m_fileData.push_back(data);
-			if (!filter.FilenameFiltered(data.name, m_dir.GetPath(), data.dir, data.size, true, data.attributes, data.time)) {
+			if (!filterActive || !filter.FilenameFiltered(data.name, m_dir.GetPath(), data.dir, data.size, true, data.attributes, data.time)) {
 				if (data.dir) {
 					totalDirCount++;
 				}
@@ -787,6 +791,7 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 	item = new wxMenuItem(&menu, XRCID("ID_ADDTOQUEUE"), _("&Add files to queue"), _("Add selected files and folders to the transfer queue"));
 	item->SetBitmap(wxArtProvider::GetBitmap(_T("ART_UPLOADADD"), wxART_MENU));
 	menu.Append(item);
+	menu.Append(XRCID("ID_SYNC_UPLOAD"), _("S&ynchronize to server"), _("Upload only new and changed files of the selected directories"));
 	menu.Append(XRCID("ID_ENTER"), _("E&nter directory"), _("Enter selected directory"));
 	
 	menu.AppendSeparator();
@@ -807,6 +812,7 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 		menu.Enable(XRCID("ID_EDIT"), COptions::Get()->GetOptionVal(OPTION_EDIT_TRACK_LOCAL) == 0);
 		menu.Enable(XRCID("ID_UPLOAD"), false);
 		menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
+		menu.Enable(XRCID("ID_SYNC_UPLOAD"), false);
 	}
 
 	int index = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
@@ -833,6 +839,7 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 		menu.Delete(XRCID("ID_ENTER"));
 		menu.Enable(XRCID("ID_UPLOAD"), false);
 		menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
+		menu.Enable(XRCID("ID_SYNC_UPLOAD"), false);
 		menu.Enable(XRCID("ID_DELETE"), false);
 		menu.Enable(XRCID("ID_RENAME"), false);
 		menu.Enable(XRCID("ID_EDIT"), false);
@@ -852,8 +859,12 @@ void CLocalListView::OnContextMenu(wxContextMenuEvent& event)
 		if (m_state.GetLocalRecursiveOperation() && m_state.GetLocalRecursiveOperation()->IsActive()) {
 			menu.Enable(XRCID("ID_UPLOAD"), false);
 			menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
+			menu.Enable(XRCID("ID_SYNC_UPLOAD"), false);
 		}
 	}
+	else {
+		menu.Enable(XRCID("ID_SYNC_UPLOAD"), false);
+	}
 
 	PopupMenu(&menu);
 }
@@ -869,6 +880,8 @@ void CLocalListView::OnMenuUpload(wxCommandEvent& event)
 	bool added = false;
 
 	bool queue_only = event.GetId() == XRCID("ID_ADDTOQUEUE");
+	bool const synchronize = event.GetId() == XRCID("ID_SYNC_UPLOAD");
+	auto const existsAction = synchronize ? CFileExistsNotification::overwriteChanged : CFileExistsNotification::unknown;
 
 	auto recursiveOperation = m_state.GetLocalRecursiveOperation();
 	if (!recursiveOperation || recursiveOperation->IsActive()) {
@@ -915,7 +928,8 @@ void CLocalListView::OnMenuUpload(wxCommandEvent& event)
 			root.add_dir_to_visit(localPath, remotePath);
 		}
 		else {
-			m_pQueue->QueueFile(queue_only, false, data->name, wxEmptyString, m_dir, remotePath, site, data->size);
+			m_pQueue->QueueFile(queue_only, false, data->name, wxEmptyString, m_dir, remotePath, site, data->size,
+				CEditHandler::none, QueuePriority::normal, existsAction);
 			added = true;
 		}
 	}
@@ -927,7 +941,8 @@ void CLocalListView::OnMenuUpload(wxCommandEvent& event)
 	if (!root.empty()) {
 		recursiveOperation->AddRecursionRoot(std::move(root));
 		CFilterManager filter;
-		recursiveOperation->StartRecursiveOperation(CRecursiveOperation::recursive_transfer, filter.GetActiveFilters(), !queue_only);
+		auto const mode = synchronize ? CRecursiveOperation::recursive_synchronize_upload : CRecursiveOperation::recursive_transfer;
+		recursiveOperation->StartRecursiveOperation(mode, filter.GetActiveFilters(), !queue_only);
 	}
 }
 
@@ -1532,11 +1547,19 @@ void CLocalListView::RefreshFile(std::wstring const& file)
 
 		// Update the data
 		data.fileType = oldData.fileType;
+		data.comparison_flags = oldData.comparison_flags;
 
+		bool const dirChanged = oldData.dir != data.dir;
 		*iter = data;
 		if (IsComparing()) {
-			// Sort order doesn't change
-			RefreshComparison();
+			if (dirChanged) {
+				RefreshComparison();
+			}
+			else {
+				// Sort order doesn't change, only this item needs to be compared again
+				auto const it = std::find(m_indexMapping.cbegin(), m_indexMapping.cend(), i);
+				RefreshComparisonItem(it != m_indexMapping.cend() ? static_cast<int>(it - m_indexMapping.cbegin()) : -1);
+			}
 		}
 		else {
 			if (m_sortColumn) {
@@ -1639,16 +1662,7 @@ void CLocalListView::StartComparison()
 		SortList(0, 0);
 	}
 
-	ComparisonRememberSelections();
-
-	if (m_originalIndexMapping.empty()) {
-		m_originalIndexMapping.swap(m_indexMapping);
-	}
-	else {
-		m_indexMapping.clear();
-	}
-
-	m_comparisonIndex = -1;
+	PrepareComparison();
 
 	if (m_fileData.empty() || m_fileData.back().comparison_flags != fill) {
 		CLocalFileData data;
@@ -1660,32 +1674,28 @@ void CLocalListView::StartComparison()
 	}
 }
 
-bool CLocalListView::get_next_file(std::wstring & name, bool& dir, int64_t& size, fz::datetime& date)
+bool CLocalListView::GetFileEntry(unsigned int index, entry & e) const
 {
-	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
-		return false;
-	}
-
-	const unsigned int index = m_originalIndexMapping[m_comparisonIndex];
 	if (index >= m_fileData.size()) {
 		return false;
 	}
 
 	CLocalFileData const& data = m_fileData[index];
+	if (data.comparison_flags == fill) {
+		return false;
+	}
 
-	name = data.name;
-	dir = data.dir;
-	size = data.size;
-	date = data.time;
+	e.name = data.name;
+	e.dir = data.dir;
+	e.size = data.size;
+	e.date = data.time;
 
 	return true;
 }
 
 void CLocalListView::FinishComparison()
 {
-	SetItemCount(m_indexMapping.size());
-
-	ComparisonRestoreSelections();
+	CommitComparison();
 
 	RefreshListOnly();
 
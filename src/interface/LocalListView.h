@@ -63,8 +63,8 @@ protected:
 public:
 	virtual bool CanStartComparison();
 	virtual void StartComparison();
-	virtual bool get_next_file(std::wstring & name, bool &dir, int64_t &size, fz::datetime& date) override;
 	virtual void FinishComparison();
+	virtual bool GetFileEntry(unsigned int index, entry & e) const override;
 
 	virtual bool ItemIsDir(int index) const;
 	virtual int64_t ItemGetSize(int index) const;
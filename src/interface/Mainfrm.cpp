@@ -473,7 +473,7 @@ CMainFrame::CMainFrame()
 	ConnectNavigationHandler(m_pStatusView);
 	ConnectNavigationHandler(m_pQueuePane);
 
-	CEditHandler::Create()->SetQueue(m_pQueueView);
+	CEditHandler::Create(m_engineContext.GetThreadPool())->SetQueue(m_pQueueView);
 
 	CAutoAsciiFiles::SettingsChanged();
 
@@ -2723,6 +2723,15 @@ void CMainFrame::OnSearch(wxCommandEvent&)
 
 void CMainFrame::PostInitialize()
 {
+	// Loading a large queue takes a while, do it once the window is up
+	if (m_pQueueView) {
+		CallAfter([this]() {
+			if (m_pQueueView) {
+				m_pQueueView->LoadQueue();
+			}
+		});
+	}
+
 #ifdef __WXMAC__
 	// Focus first control
 	NavigateIn(wxNavigationKeyEvent::IsForward);
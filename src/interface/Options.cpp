@@ -4,8 +4,11 @@
 #include "ipcmutex.h"
 #include "locale_initializer.h"
 #include <option_change_event_handler.h>
+#include "settings_store.h"
 #include "sizeformatting.h"
 
+#include <libfilezilla/local_filesys.hpp>
+
 #include <algorithm>
 #include <string>
 
@@ -111,6 +114,11 @@ static const t_Option options[OPTIONS_NUM] =
 	{ "Size decimal places", number, _T("1"), normal },
 	{ "TCP Keepalive Interval", number, _T("15"), normal },
 	{ "Cache TTL", number, _T("600"), normal },
+	{ "Metrics file", string, _T(""), normal },
+	{ "Trace file", string, _T(""), normal },
+	{ "Verify transfers", number, _T("0"), normal },
+	{ "Streaming IO", number, _T("0"), normal },
+	{ "Prefetch data connections", number, _T("1"), normal },
 
 	// Interface settings
 	{ "Number of Transfers", number, _T("2"), normal },
@@ -233,6 +241,42 @@ t_OptionsCache& t_OptionsCache::operator=(std::unique_ptr<pugi::xml_document> co
 	return *this;
 }
 
+namespace {
+// Store entry recording which filezilla.xml the store is in sync with
+char const xmlStampName[] = "<filezilla.xml>";
+
+std::string GetXmlStamp(std::wstring const& file)
+{
+	bool link{};
+	int64_t size{};
+	fz::datetime mtime;
+	if (fz::local_filesys::get_file_info(fz::to_native(file), link, &size, &mtime, nullptr) != fz::local_filesys::file) {
+		return std::string();
+	}
+	return fz::sprintf("%d %d", size, mtime.empty() ? 0 : mtime.get_time_t());
+}
+
+struct string_xml_writer final : public pugi::xml_writer
+{
+	virtual void write(void const* data, size_t size) override {
+		out_.append(static_cast<char const*>(data), size);
+	}
+
+	std::string out_;
+};
+
+CSettingsStore::value ToStoreValue(pugi::xml_node setting)
+{
+	auto const child = setting.first_child();
+	if (child.type() == pugi::node_element) {
+		string_xml_writer writer;
+		child.print(writer, "", pugi::format_raw);
+		return CSettingsStore::value(CSettingsStore::kind::xml, writer.out_);
+	}
+	return CSettingsStore::value(CSettingsStore::kind::text, setting.child_value());
+}
+}
+
 COptions::COptions()
 {
 	m_theOptions = this;
@@ -247,17 +291,132 @@ COptions::COptions()
 	CLocalPath const dir = InitSettingsDir();
 
 	CInterProcessMutex mutex(MUTEX_OPTIONS);
-	xmlFile_ = std::make_unique<CXmlFile>(dir.GetPath() + _T("filezilla.xml"));
+	xmlFileName_ = dir.GetPath() + L"filezilla.xml";
+
+	// Kiosk mode 2 must not write anything, just use the XML file read-only
+	std::unique_ptr<CSettingsStore> store;
+	if (GetOptionVal(OPTION_DEFAULT_KIOSKMODE) != 2) {
+		store = std::make_unique<CSettingsStore>(dir.GetPath() + L"filezilla.settings");
+
+		// The store is only used if filezilla.xml has not been changed since
+		// it was last written from the store, e.g. by an older version.
+		if (store->Load()) {
+			auto const& values = store->Values();
+			auto const it = values.find(xmlStampName);
+			if (it != values.cend() && it->second.data_ == GetXmlStamp(xmlFileName_)) {
+				LoadOptions(nameOptionMap, *store);
+				store_ = std::move(store);
+				return;
+			}
+		}
+	}
+
+	xmlFile_ = std::make_unique<CXmlFile>(xmlFileName_);
 	if (!xmlFile_->Load()) {
 		wxString msg = xmlFile_->GetError() + _T("\n\n") + _("For this session the default settings will be used. Any changes to the settings will not be saved.");
 		wxMessageBoxEx(msg, _("Error loading xml file"), wxICON_ERROR);
 		xmlFile_.reset();
+		store.reset();
 	}
 	else {
 		CreateSettingsXmlElement();
 	}
 
 	LoadOptions(nameOptionMap);
+
+	if (store && ImportIntoStore(*store)) {
+		// From now on the XML file only gets written on exit
+		store_ = std::move(store);
+		xmlFile_.reset();
+	}
+}
+
+bool COptions::ImportIntoStore(CSettingsStore & store)
+{
+	std::map<std::string, CSettingsStore::value> values;
+
+	auto settings = CreateSettingsXmlElement();
+	for (auto setting = settings.child("Setting"); setting; setting = setting.next_sibling("Setting")) {
+		char const* name = setting.attribute("name").value();
+		if (*name) {
+			values[name] = ToStoreValue(setting);
+		}
+	}
+	values[xmlStampName] = CSettingsStore::value(CSettingsStore::kind::text, GetXmlStamp(xmlFileName_));
+
+	return store.Replace(values);
+}
+
+void COptions::WriteSettingsXml(pugi::xml_node settings)
+{
+	if (!store_) {
+		auto const source = CreateSettingsXmlElement();
+		for (auto child = source.first_child(); child; child = child.next_sibling()) {
+			settings.append_copy(child);
+		}
+		return;
+	}
+
+	auto const& values = store_->Values();
+	auto const add = [&](std::string const& name, CSettingsStore::value const& v) {
+		auto setting = settings.append_child("Setting");
+		SetTextAttributeUtf8(setting, "name", name);
+		if (v.kind_ == CSettingsStore::kind::xml) {
+			pugi::xml_document doc;
+			if (doc.load_string(v.data_.c_str())) {
+				setting.append_copy(doc.first_child());
+			}
+		}
+		else {
+			setting.text() = v.data_.c_str();
+		}
+	};
+
+	// Known settings in their usual order, followed by unknown ones, e.g. from newer versions
+	auto const nameOptionMap = GetNameOptionMap();
+	for (unsigned int i = 0; i < OPTIONS_NUM; ++i) {
+		auto const it = values.find(options[i].name);
+		if (it != values.cend()) {
+			add(it->first, it->second);
+		}
+	}
+	for (auto const& v : values) {
+		if (v.first[0] != '<' && nameOptionMap.find(v.first) == nameOptionMap.cend()) {
+			add(v.first, v.second);
+		}
+	}
+}
+
+void COptions::WriteXmlFile()
+{
+	CInterProcessMutex mutex(MUTEX_OPTIONS);
+
+	// Include what other instances have changed in the meantime
+	store_->Refresh();
+
+	CXmlFile xml(xmlFileName_);
+	auto element = xml.CreateEmpty();
+	WriteSettingsXml(element.append_child("Settings"));
+	if (!xml.Save(true)) {
+		return;
+	}
+
+	if (store_->Update({{xmlStampName, CSettingsStore::value(CSettingsStore::kind::text, GetXmlStamp(xmlFileName_))}})) {
+		xmlOutdated_ = false;
+	}
+}
+
+void COptions::Export(pugi::xml_node element)
+{
+	// Make sure the store is up to date
+	Save();
+
+	CInterProcessMutex mutex(MUTEX_OPTIONS);
+	if (store_) {
+		store_->Refresh();
+	}
+	auto settings = element.append_child("Settings");
+	WriteSettingsXml(settings);
 }
 
 std::map<std::string, unsigned int> COptions::GetNameOptionMap() const
@@ -451,6 +610,11 @@ void COptions::SetXmlValue(unsigned int nID, int value)
 
 void COptions::SetXmlValue(unsigned int nID, std::wstring const& value)
 {
+	if (store_) {
+		pendingChanges_[options[nID].name] = CSettingsStore::value(CSettingsStore::kind::text, fz::to_utf8(value));
+		return;
+	}
+
 	if (!xmlFile_) {
 		return;
 	}
@@ -480,6 +644,19 @@ void COptions::SetXmlValue(unsigned int nID, std::wstring const& value)
 
 void COptions::SetXmlValue(unsigned int nID, std::unique_ptr<pugi::xml_document> const& value)
 {
+	if (store_) {
+		auto & change = pendingChanges_[options[nID].name];
+		if (value && value->first_child()) {
+			string_xml_writer writer;
+			value->first_child().print(writer, "", pugi::format_raw);
+			change = CSettingsStore::value(CSettingsStore::kind::xml, writer.out_);
+		}
+		else {
+			change = CSettingsStore::value(CSettingsStore::kind::erase, std::string());
+		}
+		return;
+	}
+
 	if (!xmlFile_) {
 		return;
 	}
@@ -660,7 +837,29 @@ COptions* COptions::Get()
 
 void COptions::Import(pugi::xml_node element)
 {
-	LoadOptions(GetNameOptionMap(), element);
+	auto const nameOptionMap = GetNameOptionMap();
+	LoadOptions(nameOptionMap, element);
+
+	// Persist what has been imported
+	for (auto setting = element.child("Setting"); setting; setting = setting.next_sibling("Setting")) {
+		auto const iter = nameOptionMap.find(setting.attribute("name").value());
+		if (iter == nameOptionMap.cend()) {
+			continue;
+		}
+		unsigned int const nID = iter->second;
+		if (options[nID].flags == normal || options[nID].flags == default_priority) {
+			if (options[nID].type == number) {
+				SetXmlValue(nID, GetOptionVal(nID));
+			}
+			else if (options[nID].type == string) {
+				SetXmlValue(nID, GetOption(nID));
+			}
+			else {
+				SetXmlValue(nID, GetOptionXml(nID));
+			}
+		}
+	}
+
 	if (!m_save_timer.IsRunning()) {
 		m_save_timer.Start(15000, true);
 	}
@@ -680,6 +879,25 @@ void COptions::LoadOptions(std::map<std::string, unsigned int> const& nameOption
 	}
 }
 
+void COptions::LoadOptions(std::map<std::string, unsigned int> const& nameOptionMap, CSettingsStore const& store)
+{
+	for (auto const& v : store.Values()) {
+		auto const iter = nameOptionMap.find(v.first);
+		if (iter == nameOptionMap.end()) {
+			continue;
+		}
+
+		if (v.second.kind_ == CSettingsStore::kind::xml) {
+			pugi::xml_document doc;
+			doc.load_string(v.second.data_.c_str());
+			LoadOptionValue(iter->second, std::wstring(), doc.first_child(), false);
+		}
+		else {
+			LoadOptionValue(iter->second, fz::to_wstring_from_utf8(v.second.data_), pugi::xml_node(), false);
+		}
+	}
+}
+
 void COptions::LoadOptionFromElement(pugi::xml_node option, std::map<std::string, unsigned int> const& nameOptionMap, bool allowDefault)
 {
 	const char* name = option.attribute("name").value();
@@ -689,42 +907,46 @@ void COptions::LoadOptionFromElement(pugi::xml_node option, std::map<std::string
 
 	auto const iter = nameOptionMap.find(name);
 	if (iter != nameOptionMap.end()) {
-		if (!allowDefault && options[iter->second].flags == default_only) {
-			return;
-		}
-		std::wstring value = GetTextElement(option);
-		if (options[iter->second].flags == default_priority) {
-			if (allowDefault) {
-				fz::scoped_lock l(m_sync_);
-				m_optionsCache[iter->second].from_default = true;
-			}
-			else {
-				fz::scoped_lock l(m_sync_);
-				if (m_optionsCache[iter->second].from_default) {
-					return;
-				}
-			}
-		}
+		LoadOptionValue(iter->second, GetTextElement(option), option.first_child(), allowDefault);
+	}
+}
 
-		if (options[iter->second].type == number) {
-			int numValue = fz::to_integral<int>(value);
-			numValue = Validate(iter->second, numValue);
-			fz::scoped_lock l(m_sync_);
-			m_optionsCache[iter->second] = numValue;
-		}
-		else if (options[iter->second].type == string) {
-			value = Validate(iter->second, value);
+void COptions::LoadOptionValue(unsigned int nID, std::wstring value, pugi::xml_node xmlValue, bool allowDefault)
+{
+	if (!allowDefault && options[nID].flags == default_only) {
+		return;
+	}
+	if (options[nID].flags == default_priority) {
+		if (allowDefault) {
 			fz::scoped_lock l(m_sync_);
-			m_optionsCache[iter->second] = value;
+			m_optionsCache[nID].from_default = true;
 		}
 		else {
 			fz::scoped_lock l(m_sync_);
-			if (!option.first_child().empty()) {
-				m_optionsCache[iter->second].xmlValue = std::make_unique<pugi::xml_document>();
-				m_optionsCache[iter->second].xmlValue->append_copy(option.first_child());
+			if (m_optionsCache[nID].from_default) {
+				return;
 			}
 		}
 	}
+
+	if (options[nID].type == number) {
+		int numValue = fz::to_integral<int>(value);
+		numValue = Validate(nID, numValue);
+		fz::scoped_lock l(m_sync_);
+		m_optionsCache[nID] = numValue;
+	}
+	else if (options[nID].type == string) {
+		value = Validate(nID, value);
+		fz::scoped_lock l(m_sync_);
+		m_optionsCache[nID] = value;
+	}
+	else {
+		fz::scoped_lock l(m_sync_);
+		if (!xmlValue.empty()) {
+			m_optionsCache[nID].xmlValue = std::make_unique<pugi::xml_document>();
+			m_optionsCache[nID].xmlValue->append_copy(xmlValue);
+		}
+	}
 }
 
 void COptions::LoadGlobalDefaultOptions(std::map<std::string, unsigned int> const& nameOptionMap)
@@ -764,6 +986,21 @@ void COptions::Save()
 		return;
 	}
 
+	if (store_) {
+		if (pendingChanges_.empty()) {
+			return;
+		}
+
+		std::vector<std::pair<std::string, CSettingsStore::value>> const changes(pendingChanges_.cbegin(), pendingChanges_.cend());
+
+		CInterProcessMutex mutex(MUTEX_OPTIONS);
+		if (store_->Update(changes)) {
+			pendingChanges_.clear();
+			xmlOutdated_ = true;
+		}
+		return;
+	}
+
 	if (!xmlFile_) {
 		return;
 	}
@@ -777,6 +1014,22 @@ bool COptions::Cleanup()
 	bool ret = false;
 
 	needsCleanup_ = false;
+
+	if (store_) {
+		auto const nameOptionMap = GetNameOptionMap();
+		for (auto const& v : store_->Values()) {
+			if (v.first[0] != '<' && nameOptionMap.find(v.first) == nameOptionMap.cend()) {
+				pendingChanges_[v.first] = CSettingsStore::value(CSettingsStore::kind::erase, std::string());
+				ret = true;
+			}
+		}
+		return ret;
+	}
+
+	if (!xmlFile_) {
+		return ret;
+	}
+
 	auto element = xmlFile_->GetElement();
 	auto child = element.first_child();
 
@@ -826,12 +1079,27 @@ void COptions::SaveIfNeeded()
 {
 	bool save = m_save_timer.IsRunning();
 
+	bool const cleanup = needsCleanup_;
 	if (needsCleanup_) {
 		save |= Cleanup();
 	}
 
 	m_save_timer.Stop();
 	Save();
+
+	if (store_) {
+		if (cleanup) {
+			// Overwritten values could be private data, they must not stay in the file
+			CInterProcessMutex mutex(MUTEX_OPTIONS);
+			store_->Refresh();
+			store_->Replace(store_->Values());
+		}
+
+		// Keep filezilla.xml current for older versions and for anything else reading it
+		if (xmlOutdated_) {
+			WriteXmlFile();
+		}
+	}
 }
 
 namespace {
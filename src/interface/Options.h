@@ -9,6 +9,7 @@
 
 #include <wx/timer.h>
 
+#include "settings_store.h"
 #include "xmlfunctions.h"
 
 enum interfaceOptions
@@ -146,6 +147,9 @@ public:
 
 	void Import(pugi::xml_node element);
 
+	// Appends a Settings element with all settings
+	void Export(pugi::xml_node element);
+
 	void RequireCleanup();
 	void SaveIfNeeded();
 
@@ -169,18 +173,36 @@ protected:
 
 	std::map<std::string, unsigned int> GetNameOptionMap() const;
 	void LoadOptions(std::map<std::string, unsigned int> const& nameOptionMap, pugi::xml_node settings = pugi::xml_node());
+	void LoadOptions(std::map<std::string, unsigned int> const& nameOptionMap, CSettingsStore const& store);
 	void LoadGlobalDefaultOptions(std::map<std::string, unsigned int> const& nameOptionMap);
 	void LoadOptionFromElement(pugi::xml_node option, std::map<std::string, unsigned int> const& nameOptionMap, bool allowDefault);
+	void LoadOptionValue(unsigned int nID, std::wstring value, pugi::xml_node xmlValue, bool allowDefault);
 	CLocalPath InitSettingsDir();
 	void SetDefaultValues();
 
 	bool Cleanup(); // Removes all unknown elements from the XML
 	void Save();
 
+	bool ImportIntoStore(CSettingsStore & store);
+	void WriteSettingsXml(pugi::xml_node settings);
+	void WriteXmlFile();
+
 	void NotifyChangedOptions();
 
+	std::wstring xmlFileName_;
+
+	// Settings are kept in the binary store, filezilla.xml gets written on
+	// exit for compatibility. If the store cannot be used, e.g. in kiosk
+	// mode, the XML file is used directly.
+	std::unique_ptr<CSettingsStore> store_;
 	std::unique_ptr<CXmlFile> xmlFile_;
 
+	// Changes not yet written to the store
+	std::map<std::string, CSettingsStore::value> pendingChanges_;
+
+	// The store has changes not yet written to filezilla.xml
+	bool xmlOutdated_{};
+
 	t_OptionsCache m_optionsCache[OPTIONS_NUM];
 
 	static COptions* m_theOptions;
@@ -194,6 +194,7 @@ EVT_MENU(XRCID("ID_PRIORITY_HIGH"), CQueueView::OnSetPriority)
 EVT_MENU(XRCID("ID_PRIORITY_NORMAL"), CQueueView::OnSetPriority)
 EVT_MENU(XRCID("ID_PRIORITY_LOW"), CQueueView::OnSetPriority)
 EVT_MENU(XRCID("ID_PRIORITY_LOWEST"), CQueueView::OnSetPriority)
+EVT_MENU(XRCID("ID_STREAMING_IO"), CQueueView::OnSetStreaming)
 
 EVT_COMMAND(wxID_ANY, fzEVT_GRANTEXCLUSIVEENGINEACCESS, CQueueView::OnExclusiveEngineRequestGranted)
 
@@ -254,7 +255,7 @@ bool CQueueView::QueueFile(const bool queueOnly, const bool download,
 						   std::wstring const& sourceFile, std::wstring const& targetFile,
 						   const CLocalPath& localPath, const CServerPath& remotePath,
 						   Site const& site, int64_t size, CEditHandler::fileType edit,
-						   QueuePriority priority)
+						   QueuePriority priority, CFileExistsNotification::OverwriteAction existsAction)
 {
 	CServerItem* pServerItem = CreateServerItem(site);
 
@@ -284,6 +285,7 @@ bool CQueueView::QueueFile(const bool queueOnly, const bool download,
 		if (edit != CEditHandler::none) {
 			fileItem->m_onetime_action = CFileExistsNotification::overwrite;
 		}
+		fileItem->m_defaultFileExistsAction = existsAction;
 	}
 
 	fileItem->SetPriorityRaw(priority);
@@ -354,7 +356,8 @@ bool CQueueView::QueueFiles(const bool queueOnly, const CLocalPath& localPath, c
 	return true;
 }
 
-bool CQueueView::QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing)
+bool CQueueView::QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing,
+	CFileExistsNotification::OverwriteAction existsAction)
 {
 	CServerItem* pServerItem = CreateServerItem(site);
 
@@ -374,6 +377,7 @@ bool CQueueView::QueueFiles(const bool queueOnly, Site const& site, CLocalRecurs
 			if (hasDataTypeConcept) {
 				fileItem->SetAscii(CAutoAsciiFiles::TransferLocalAsAscii(file.name, listing.remotePath.GetType()));
 			}
+			fileItem->m_defaultFileExistsAction = existsAction;
 
 			InsertItem(pServerItem, fileItem);
 		}
@@ -872,7 +876,8 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 		// user interaction at a minimum if connection is unstable.
 
 		if (pEngineData->pItem->GetType() == QueueItemType::File && ((CFileItem*)pEngineData->pItem)->made_progress() &&
-			(replyCode & FZ_REPLY_WRITEFAILED) != FZ_REPLY_WRITEFAILED)
+			(replyCode & FZ_REPLY_WRITEFAILED) != FZ_REPLY_WRITEFAILED &&
+			(replyCode & FZ_REPLY_VERIFYFAILED) != FZ_REPLY_VERIFYFAILED)
 		{
 			// Don't increase error count if there has been progress
 			CFileItem* pItem = (CFileItem*)pEngineData->pItem;
@@ -899,6 +904,15 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 				ResetEngine(*pEngineData, ResetReason::failure);
 				return;
 			}
+			else if ((replyCode & FZ_REPLY_VERIFYFAILED) == FZ_REPLY_VERIFYFAILED) {
+				// Transfer the whole file again, resuming would keep the corrupted data
+				pEngineData->pItem->SetStatusMessage(CFileItem::Status::checksum_mismatch);
+				if (pEngineData->pItem->GetType() == QueueItemType::File) {
+					CFileItem* pItem = (CFileItem*)pEngineData->pItem;
+					pItem->set_made_progress(false);
+					pItem->m_onetime_action = CFileExistsNotification::overwrite;
+				}
+			}
 			else {
 				pEngineData->pItem->SetStatusMessage(CFileItem::Status::could_not_start);
 			}
@@ -1262,6 +1276,7 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 
 			CFileTransferCommand::t_transferSettings transferSettings;
 			transferSettings.binary = !fileItem->Ascii();
+			transferSettings.streaming = fileItem->Streaming();
 			int res = engineData.pEngine->Execute(CFileTransferCommand(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), fileItem->GetRemotePath(),
 												fileItem->GetRemoteFile(), fileItem->Download(), transferSettings));
 			wxASSERT((res & FZ_REPLY_BUSY) != FZ_REPLY_BUSY);
@@ -1604,6 +1619,11 @@ void CQueueView::LoadQueueFromXML()
 
 void CQueueView::LoadQueue()
 {
+	if (m_queueLoaded) {
+		return;
+	}
+	m_queueLoaded = true;
+
 	wxGetApp().AddStartupProfileRecord("CQueueView::LoadQueue");
 	// We have to synchronize access to queue.xml so that multiple processed don't write
 	// to the same file or one is reading while the other one writes.
@@ -1707,6 +1727,7 @@ void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
 				}
 				bool binary = dataType != 0;
 				int overwrite_action = GetTextElementInt(file, "OverwriteAction", CFileExistsNotification::unknown);
+				bool streaming = GetTextElementInt(file, "StreamingIO") != 0;
 
 				CServerPath remotePath;
 				if (!localFile.empty() && !remoteFile.empty() && remotePath.SetSafePath(safeRemotePath) &&
@@ -1733,6 +1754,7 @@ void CQueueView::ImportQueue(pugi::xml_node element, bool updateSelections)
 						(remoteFile != localFileName) ? (download ? localFileName : remoteFile) : std::wstring(),
 						previousLocalPath, previousRemotePath, size);
 					fileItem->SetAscii(!binary);
+					fileItem->SetStreaming(streaming);
 					fileItem->SetPriorityRaw(QueuePriority(priority));
 					fileItem->m_errorCount = errorCount;
 					InsertItem(pServerItem, fileItem);
@@ -1818,6 +1840,7 @@ void CQueueView::OnContextMenu(wxContextMenuEvent&)
     menu.AppendSeparator();
 	menu.Append(XRCID("ID_REMOVE"), _("&Remove selected"));
 	menu.Append(XRCID("ID_DEFAULT_FILEEXISTSACTION"), _("&Default file exists action..."));
+	menu.Append(XRCID("ID_STREAMING_IO"), _("&Keep out of file cache"), _("Use for large transfers so they do not push other data out of the system's file cache"), wxITEM_CHECK);
 
 	auto menuPriority = new wxMenu;
 	menu.AppendSubMenu(menuPriority, _("Set &Priority"))->SetId(XRCID("ID_PRIORITY"));
@@ -1846,7 +1869,20 @@ void CQueueView::OnContextMenu(wxContextMenuEvent&)
 
 	bool has_selection = HasSelection();
 
+	// Checked if all selected files are kept out of the cache
+	bool streaming{};
+	for (long item = -1; (item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) != -1;) {
+		CQueueItem* pItem = GetQueueItem(item);
+		if (pItem && pItem->GetType() == QueueItemType::File) {
+			streaming = static_cast<CFileItem*>(pItem)->Streaming();
+			if (!streaming) {
+				break;
+			}
+		}
+	}
+
 	menu.Check(XRCID("ID_PROCESSQUEUE"), IsActive() ? true : false);
+	menu.Check(XRCID("ID_STREAMING_IO"), streaming);
 	menu.Check(XRCID("ID_ACTIONAFTER_NONE"), IsActionAfter(ActionAfterState::None));
 	menu.Check(XRCID("ID_ACTIONAFTER_SHOW_NOTIFICATION_BUBBLE"), IsActionAfter(ActionAfterState::ShowNotification));
 	menu.Check(XRCID("ID_ACTIONAFTER_REQUEST_ATTENTION"), IsActionAfter(ActionAfterState::RequestAttention));
@@ -1863,6 +1899,7 @@ void CQueueView::OnContextMenu(wxContextMenuEvent&)
 
 	menu.Enable(XRCID("ID_PRIORITY"), has_selection);
 	menu.Enable(XRCID("ID_DEFAULT_FILEEXISTSACTION"), has_selection);
+	menu.Enable(XRCID("ID_STREAMING_IO"), has_selection);
 #if defined(__WXMSW__) || defined(__WXMAC__)
 	menu.Enable(XRCID("ID_ACTIONAFTER"), m_actionAfterWarnDialog == NULL);
 #endif
@@ -2604,6 +2641,34 @@ void CQueueView::OnSetPriority(wxCommandEvent& event)
 	RefreshListOnly();
 }
 
+void CQueueView::OnSetStreaming(wxCommandEvent& event)
+{
+	bool const streaming = event.IsChecked();
+
+	CQueueItem* pSkip = 0;
+	long item = -1;
+	while (-1 != (item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED))) {
+		CQueueItem* pItem = GetQueueItem(item);
+		if (!pItem) {
+			continue;
+		}
+
+		if (pItem->GetType() == QueueItemType::Server) {
+			pSkip = pItem;
+			static_cast<CServerItem*>(pItem)->SetStreaming(streaming);
+		}
+		else if (pItem->GetTopLevelItem() == pSkip) {
+			continue;
+		}
+		else {
+			pSkip = 0;
+			if (pItem->GetType() == QueueItemType::File) {
+				static_cast<CFileItem*>(pItem)->SetStreaming(streaming);
+			}
+		}
+	}
+}
+
 void CQueueView::OnExclusiveEngineRequestGranted(wxCommandEvent& event)
 {
 	CFileZillaEngine* pEngine = 0;
@@ -120,11 +120,13 @@ public:
 		std::wstring const& localFile, std::wstring const& remoteFile,
 		const CLocalPath& localPath, const CServerPath& remotePath,
 		Site const& site, int64_t size, CEditHandler::fileType edit = CEditHandler::none,
-		QueuePriority priority = QueuePriority::normal);
+		QueuePriority priority = QueuePriority::normal,
+		CFileExistsNotification::OverwriteAction existsAction = CFileExistsNotification::unknown);
 
 	void QueueFile_Finish(const bool start); // Need to be called after QueueFile
 	bool QueueFiles(const bool queueOnly, CLocalPath const& localPath, const CRemoteDataObject& dataObject);
-	bool QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing);
+	bool QueueFiles(const bool queueOnly, Site const& site, CLocalRecursiveOperation::listing const& listing,
+		CFileExistsNotification::OverwriteAction existsAction = CFileExistsNotification::unknown);
 
 	bool empty() const;
 	int IsActive() const { return m_activeMode; }
@@ -287,6 +289,10 @@ protected:
 
 	CQueueStorage m_queue_storage;
 
+	// Happens after startup, see CMainFrame::PostInitialize. Saving does not
+	// depend on it, it appends to whatever is still stored.
+	bool m_queueLoaded{};
+
 	// Get the current transfer speed.
 	// Unit is byte/s.
 	wxFileOffset GetCurrentSpeed(bool countDownload, bool countUpload);
@@ -313,6 +319,7 @@ protected:
 	void OnTimer(wxTimerEvent& evnet);
 
 	void OnSetPriority(wxCommandEvent& event);
+	void OnSetStreaming(wxCommandEvent& event);
 
 	void OnExclusiveEngineRequestGranted(wxCommandEvent& event);
 
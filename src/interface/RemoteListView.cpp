@@ -24,6 +24,7 @@
 #include <wx/dcclient.h>
 
 #include <algorithm>
+#include <thread>
 
 #include <libfilezilla/file.hpp>
 #include <libfilezilla/local_filesys.hpp>
@@ -360,6 +361,7 @@ BEGIN_EVENT_TABLE(CRemoteListView, CFileListCtrl<CGenericFileData>)
 	// Map both ID_DOWNLOAD and ID_ADDTOQUEUE to OnMenuDownload, code is identical
 	EVT_MENU(XRCID("ID_DOWNLOAD"), CRemoteListView::OnMenuDownload)
 	EVT_MENU(XRCID("ID_ADDTOQUEUE"), CRemoteListView::OnMenuDownload)
+	EVT_MENU(XRCID("ID_SYNC_DOWNLOAD"), CRemoteListView::OnMenuDownload)
 	EVT_MENU(XRCID("ID_MKDIR"), CRemoteListView::OnMenuMkdir)
 	EVT_MENU(XRCID("ID_MKDIR_CHGDIR"), CRemoteListView::OnMenuMkdirChgDir)
 	EVT_MENU(XRCID("ID_NEW_FILE"), CRemoteListView::OnMenuNewfile)
@@ -381,6 +383,8 @@ CRemoteListView::CRemoteListView(CView* pParent, CState& state, CQueueView* pQue
 	CStateEventHandler(state),
 	m_parentView(pParent)
 {
+	m_sortPool = &state.pool_;
+
 	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR);
 	state.RegisterHandler(this, STATECHANGE_APPLYFILTER);
 	state.RegisterHandler(this, STATECHANGE_REMOTE_LINKNOTDIR);
@@ -486,12 +490,9 @@ void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryLis
 
 	bool const has_selections = GetSelectedItemCount() != 0;
 
-	std::vector<int> added_indexes;
-	if (has_selections) {
-		added_indexes.reserve(to_add);
-	}
+	std::vector<unsigned int> added;
+	added.reserve(to_add);
 
-	std::unique_ptr<CFileListCtrlSortBase> compare = GetSortComparisonObject();
 	for (size_t i = pDirectoryListing->size() - to_add; i < pDirectoryListing->size(); ++i) {
 		CDirentry const& entry = (*pDirectoryListing)[i];
 		CGenericFileData data;
@@ -518,26 +519,11 @@ void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryLis
 			}
 		}
 
-		// Find correct position in index mapping
-		std::vector<unsigned int>::iterator start = m_indexMapping.begin();
-		if (m_hasParent) {
-			++start;
-		}
-		std::vector<unsigned int>::iterator insertPos = std::lower_bound(start, m_indexMapping.end(), i, SortPredicate(compare));
-
-		const int added_index = insertPos - m_indexMapping.begin();
-		m_indexMapping.insert(insertPos, i);
-
-		// Remember inserted index
-		if (has_selections) {
-			auto const added_indexes_insert_pos = std::lower_bound(added_indexes.begin(), added_indexes.end(), added_index);
-			for (auto index = added_indexes_insert_pos; index != added_indexes.end(); ++index) {
-				++(*index);
-			}
-			added_indexes.insert(added_indexes_insert_pos, added_index);
-		}
+		added.push_back(i);
 	}
 
+	std::vector<int> const added_indexes = MergeIntoIndexMapping(std::move(added), has_selections);
+
 	m_fileData.push_back(last);
 
 	SetItemCount(m_indexMapping.size());
@@ -736,6 +722,52 @@ bool CRemoteListView::UpdateDirectoryListing(std::shared_ptr<CDirectoryListing>
 	return true;
 }
 
+namespace {
+// Returns whether each entry of the listing is filtered, or nothing if no
+// filter is active. Large listings get split into chunks which are filtered
+// concurrently.
+std::vector<uint8_t> FilterListing(CStateFilterManager const& filter, CDirectoryListing const& listing, fz::thread_pool & pool)
+{
+	std::vector<uint8_t> filtered;
+	if (!filter.IsFilterActive(false)) {
+		return filtered;
+	}
+
+	filtered.resize(listing.size());
+
+	std::wstring const path = listing.path.GetPath();
+	auto const run = [&](size_t from, size_t to) {
+		for (size_t i = from; i < to; ++i) {
+			CDirentry const& entry = listing[i];
+			filtered[i] = filter.FilenameFiltered(entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time) ? 1 : 0;
+		}
+	};
+
+	// Below this, spawning tasks isn't worth it
+	size_t const minChunkSize = 20000;
+
+	size_t const count = filtered.size();
+	size_t const chunks = std::max(size_t(1), std::min(static_cast<size_t>(std::thread::hardware_concurrency()), count / minChunkSize));
+
+	std::vector<fz::async_task> tasks;
+	for (size_t i = 1; i < chunks; ++i) {
+		size_t const from = count * i / chunks;
+		size_t const to = count * (i + 1) / chunks;
+		tasks.emplace_back(pool.spawn([&run, from, to]() { run(from, to); }));
+		if (!tasks.back()) {
+			run(from, to);
+		}
+	}
+	run(0, count / chunks);
+
+	for (auto & task : tasks) {
+		task.join();
+	}
+
+	return filtered;
+}
+}
+
 void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
 	CancelLabelEdit();
@@ -807,26 +839,29 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	if (m_pDirectoryListing) {
 		SetInfoText();
 
-		m_indexMapping.push_back(m_pDirectoryListing->size());
+		size_t const count = m_pDirectoryListing->size();
+
+		m_indexMapping.reserve(count + 1);
+		m_indexMapping.push_back(count);
 
-		std::wstring const path = m_pDirectoryListing->path.GetPath();
+		// File icons and types are only looked up once the items get displayed
+		m_fileData.resize(count + 1);
+		m_fileData.back().icon = m_dirIcon;
 
-		CFilterManager const& filter = m_state.GetStateFilterManager();
-		
-		for (unsigned int i = 0; i < m_pDirectoryListing->size(); ++i) {
+		std::vector<uint8_t> const filtered = FilterListing(m_state.GetStateFilterManager(), *m_pDirectoryListing, m_state.pool_);
+
+		for (unsigned int i = 0; i < count; ++i) {
 			const CDirentry& entry = (*m_pDirectoryListing)[i];
-			CGenericFileData data;
 			if (entry.is_dir()) {
-				data.icon = m_dirIcon;
+				m_fileData[i].icon = m_dirIcon;
 #ifndef __WXMSW__
 				if (entry.is_link()) {
-					data.icon += 3;
+					m_fileData[i].icon += 3;
 				}
 #endif
 			}
-			m_fileData.push_back(data);
 
-			if (filter.FilenameFiltered(entry.name, path, entry.is_dir(), entry.size, false, 0, entry.time)) {
+			if (!filtered.empty() && filtered[i]) {
 				++hidden;
 				continue;
 			}
@@ -846,10 +881,6 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 
 			m_indexMapping.push_back(i);
 		}
-
-		CGenericFileData data;
-		data.icon = m_dirIcon;
-		m_fileData.push_back(data);
 	}
 	else {
 		eraseBackground = true;
@@ -1125,6 +1156,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 	item = new wxMenuItem(&menu, XRCID("ID_ADDTOQUEUE"), _("&Add files to queue"), _("Add selected files and folders to the transfer queue"));
 	item->SetBitmap(wxArtProvider::GetBitmap(_T("ART_DOWNLOADADD"), wxART_MENU));
 	menu.Append(item);
+	menu.Append(XRCID("ID_SYNC_DOWNLOAD"), _("S&ynchronize to local directory"), _("Download only new and changed files of the selected directories, removing local files no longer on the server"));
 	menu.Append(XRCID("ID_ENTER"), _("E&nter directory"), _("Enter selected directory"));
 	menu.Append(XRCID("ID_EDIT"), _("&View/Edit"));
 
@@ -1142,6 +1174,7 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 	menu.Append(XRCID("ID_CHMOD"), _("&File permissions..."), _("Change the file permissions."));
 
 
+	bool canSync = false;
 	bool const idle = m_state.IsRemoteIdle();
 	bool const userIdle = m_state.IsRemoteIdle(true);
 	if (!m_state.IsRemoteConnected() || !idle) {
@@ -1252,8 +1285,12 @@ void CRemoteListView::OnContextMenu(wxContextMenuEvent& event)
 				menu.Enable(XRCID("ID_DOWNLOAD"), false);
 				menu.Enable(XRCID("ID_ADDTOQUEUE"), false);
 			}
+			else {
+				canSync = selectedDir;
+			}
 		}
 	}
+	menu.Enable(XRCID("ID_SYNC_DOWNLOAD"), canSync);
 
 	menu.Delete(XRCID(wxGetKeyState(WXK_SHIFT) ? "ID_GETURL" : "ID_GETURL_PASSWORD"));
 
@@ -1291,10 +1328,21 @@ void CRemoteListView::OnMenuDownload(wxCommandEvent& event)
 		}
 	}
 
-	TransferSelectedFiles(localDir, event.GetId() == XRCID("ID_ADDTOQUEUE"));
+	bool const synchronize = event.GetId() == XRCID("ID_SYNC_DOWNLOAD");
+	if (synchronize) {
+		if (!idle) {
+			wxBell();
+			return;
+		}
+		if (wxMessageBoxEx(_("Synchronizing deletes local files and directories which do not exist on the server.\nFiles which have the same size and are not newer on the server are skipped.\n\nDo you really want to synchronize the selected directories?"), _("Confirm synchronization"), wxICON_QUESTION | wxYES_NO, this) != wxYES) {
+			return;
+		}
+	}
+
+	TransferSelectedFiles(localDir, event.GetId() == XRCID("ID_ADDTOQUEUE"), synchronize);
 }
 
-void CRemoteListView::TransferSelectedFiles(const CLocalPath& local_parent, bool queue_only)
+void CRemoteListView::TransferSelectedFiles(const CLocalPath& local_parent, bool queue_only, bool synchronize)
 {
 	bool idle = m_state.IsRemoteIdle();
 
@@ -1351,7 +1399,9 @@ void CRemoteListView::TransferSelectedFiles(const CLocalPath& local_parent, bool
 			}
 			m_pQueue->QueueFile(queue_only, true,
 				name, (name == localFile) ? std::wstring() : localFile,
-				local_parent, m_pDirectoryListing->path, site, entry.size);
+				local_parent, m_pDirectoryListing->path, site, entry.size,
+				CEditHandler::none, QueuePriority::normal,
+				synchronize ? CFileExistsNotification::overwriteChanged : CFileExistsNotification::unknown);
 			added = true;
 		}
 	}
@@ -1362,7 +1412,8 @@ void CRemoteListView::TransferSelectedFiles(const CLocalPath& local_parent, bool
 	if (!root.empty()) {
 		pRecursiveOperation->AddRecursionRoot(std::move(root));
 		CFilterManager filter;
-		pRecursiveOperation->StartRecursiveOperation(CRecursiveOperation::recursive_transfer, filter.GetActiveFilters(), m_pDirectoryListing->path, !queue_only);
+		auto const mode = synchronize ? CRecursiveOperation::recursive_synchronize_download : CRecursiveOperation::recursive_transfer;
+		pRecursiveOperation->StartRecursiveOperation(mode, filter.GetActiveFilters(), m_pDirectoryListing->path, !queue_only);
 	}
 }
 
@@ -2494,16 +2545,7 @@ void CRemoteListView::StartComparison()
 		SortList(0, 0);
 	}
 
-	ComparisonRememberSelections();
-
-	if (m_originalIndexMapping.empty()) {
-		m_originalIndexMapping.swap(m_indexMapping);
-	}
-	else {
-		m_indexMapping.clear();
-	}
-
-	m_comparisonIndex = -1;
+	PrepareComparison();
 
 	if (m_fileData.empty() || m_fileData.back().comparison_flags != fill) {
 		CGenericFileData data;
@@ -2513,41 +2555,35 @@ void CRemoteListView::StartComparison()
 	}
 }
 
-bool CRemoteListView::get_next_file(std::wstring & name, bool& dir, int64_t& size, fz::datetime& date)
+bool CRemoteListView::GetFileEntry(unsigned int index, entry & e) const
 {
-	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
-		return false;
-	}
-
-	const unsigned int index = m_originalIndexMapping[m_comparisonIndex];
-	if (index >= m_fileData.size()) {
+	if (index >= m_fileData.size() || m_fileData[index].comparison_flags == fill) {
 		return false;
 	}
 
 	if (index == m_pDirectoryListing->size()) {
-		name = _T("..");
-		dir = true;
-		size = -1;
+		e.name = L"..";
+		e.dir = true;
+		e.size = -1;
+		e.date = fz::datetime();
 		return true;
 	}
 
 	CDirentry const& entry = (*m_pDirectoryListing)[index];
 
-	name = entry.name;
-	dir = entry.is_dir();
-	size = entry.size;
-	date = entry.time;
+	e.name = entry.name;
+	e.dir = entry.is_dir();
+	e.size = entry.size;
+	e.date = entry.time;
 
 	return true;
 }
 
 void CRemoteListView::FinishComparison()
 {
-	SetInfoText();
+	CommitComparison();
 
-	SetItemCount(m_indexMapping.size());
-
-	ComparisonRestoreSelections();
+	SetInfoText();
 
 	RefreshListOnly();
 }
@@ -21,8 +21,8 @@ public:
 
 	virtual bool CanStartComparison();
 	virtual void StartComparison();
-	virtual bool get_next_file(std::wstring & name, bool &dir, int64_t &size, fz::datetime& date) override;
 	virtual void FinishComparison();
+	virtual bool GetFileEntry(unsigned int index, entry & e) const override;
 	virtual void OnExitComparisonMode();
 
 	void LinkIsNotDir(CServerPath const& path, std::wstring const& link);
@@ -83,7 +83,7 @@ protected:
 	std::shared_ptr<CDirectoryListing> m_pDirectoryListing;
 
 	// Caller is responsible to check selection is valid!
-	void TransferSelectedFiles(const CLocalPath& local_parent, bool queue_only);
+	void TransferSelectedFiles(const CLocalPath& local_parent, bool queue_only, bool synchronize = false);
 
 	void HandleGenericChmod(ChmodUICommand &command);
 
@@ -4,6 +4,7 @@
 #include "edithandler.h"
 #include "filezillaapp.h"
 #include "file_utils.h"
+#include "file_watcher.h"
 #include "Options.h"
 #include "queue.h"
 #include "window_state_manager.h"
@@ -46,13 +47,20 @@ END_EVENT_TABLE()
 
 CEditHandler* CEditHandler::m_pEditHandler = 0;
 
-CEditHandler::CEditHandler()
+CEditHandler::CEditHandler(fz::thread_pool & pool)
 {
 	m_pQueue = 0;
 
 	m_timer.SetOwner(this);
 	m_busyTimer.SetOwner(this);
 
+	m_watcher = std::make_unique<CFileWatcher>(pool, [this]() {
+		// Called from the watcher thread, coalesce notifications until handled
+		if (!m_changePending.exchange(true)) {
+			QueueEvent(new wxCommandEvent(fzEDIT_CHANGEDFILE));
+		}
+	});
+
 #ifdef __WXMSW__
 	m_lockfile_handle = INVALID_HANDLE_VALUE;
 #else
@@ -60,10 +68,10 @@ CEditHandler::CEditHandler()
 #endif
 }
 
-CEditHandler* CEditHandler::Create()
+CEditHandler* CEditHandler::Create(fz::thread_pool & pool)
 {
 	if (!m_pEditHandler) {
-		m_pEditHandler = new CEditHandler();
+		m_pEditHandler = new CEditHandler(pool);
 	}
 
 	return m_pEditHandler;
@@ -211,6 +219,8 @@ std::wstring CEditHandler::GetLocalDirectory()
 
 void CEditHandler::Release()
 {
+	m_watcher.reset();
+
 	if (m_timer.IsRunning()) {
 		m_timer.Stop();
 	}
@@ -335,6 +345,7 @@ bool CEditHandler::AddFile(CEditHandler::fileType type, std::wstring& fileName,
 
 	if (type == remote || StartEditing(type, data)) {
 		m_fileDataList[type].push_back(data);
+		SetTimerState();
 	}
 
 	return true;
@@ -850,14 +861,24 @@ void CEditHandler::OnTimerEvent(wxTimerEvent&)
 
 void CEditHandler::SetTimerState()
 {
-	bool editing = GetFileCount(none, edit) != 0;
+	std::vector<std::wstring> files;
+	for (auto const& fileDataList : m_fileDataList) {
+		for (auto const& data : fileDataList) {
+			if (data.state == edit) {
+				files.push_back(data.file);
+			}
+		}
+	}
+
+	bool const watched = m_watcher && m_watcher->Watch(files);
+	bool const poll = !files.empty() && !watched;
 
 	if (m_timer.IsRunning()) {
-		if (!editing) {
+		if (!poll) {
 			m_timer.Stop();
 		}
 	}
-	else if (editing) {
+	else if (poll) {
 		m_timer.Start(15000);
 	}
 }
@@ -994,7 +1015,12 @@ wxString CEditHandler::GetCustomOpenCommand(const wxString& file, bool& program_
 
 void CEditHandler::OnChangedFileEvent(wxCommandEvent&)
 {
+	m_changePending = false;
 	CheckForModifications();
+
+	// Removed directories are no longer watched. CheckForModifications can
+	// return early, so always watch the files again or fall back to polling.
+	SetTimerState();
 }
 
 std::wstring CEditHandler::GetTemporaryFile(std::wstring name)
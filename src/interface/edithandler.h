@@ -6,6 +6,11 @@
 
 #include <wx/timer.h>
 
+#include <libfilezilla/thread_pool.hpp>
+
+#include <atomic>
+#include <memory>
+
 // Handles all aspects about remote file viewing/editing
 
 namespace edit_choices {
@@ -16,6 +21,7 @@ enum type
 };
 }
 
+class CFileWatcher;
 class CQueueView;
 class CEditHandler final : protected wxEvtHandler
 {
@@ -38,7 +44,7 @@ public:
 		remote
 	};
 
-	static CEditHandler* Create();
+	static CEditHandler* Create(fz::thread_pool & pool);
 	static CEditHandler* Get();
 
 	std::wstring GetLocalDirectory();
@@ -120,7 +126,7 @@ public:
 protected:
 	bool DoEdit(CEditHandler::fileType type, FileData const& file, CServerPath const& path, Site const& site, wxWindow* parent, size_t fileCount, int & already_editing_action);
 
-	CEditHandler();
+	CEditHandler(fz::thread_pool & pool);
 
 	static CEditHandler* m_pEditHandler;
 
@@ -130,6 +136,8 @@ protected:
 
 	wxString GetCustomOpenCommand(wxString const& file, bool& program_exists);
 
+	// Watches the files being edited, falls back to polling using
+	// the timer for files that cannot be watched.
 	void SetTimerState();
 
 	bool UploadFile(fileType type, std::list<t_fileData>::iterator iter, bool unedit);
@@ -146,6 +154,9 @@ protected:
 	wxTimer m_timer;
 	wxTimer m_busyTimer;
 
+	std::unique_ptr<CFileWatcher> m_watcher;
+	std::atomic<bool> m_changePending{};
+
 	void RemoveTemporaryFiles(wxString const& temp);
 	void RemoveTemporaryFilesInSpecificDir(std::wstring const& temp);
 
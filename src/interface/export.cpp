@@ -3,6 +3,7 @@
 #include "filezillaapp.h"
 #include "xmlfunctions.h"
 #include "ipcmutex.h"
+#include "Options.h"
 #include "queue.h"
 #include "xrc_helper.h"
 
@@ -73,15 +74,7 @@ void CExportDialog::Run()
 		}
 	}
 	if (settings) {
-		CInterProcessMutex mutex(MUTEX_OPTIONS);
-		CXmlFile file(wxGetApp().GetSettingsFile(_T("filezilla")));
-		auto document = file.Load();
-		if (document) {
-			auto element = document.child("Settings");
-			if (element) {
-				exportRoot.append_copy(element);
-			}
-		}
+		COptions::Get()->Export(exportRoot);
 	}
 
 	if (queue) {
@@ -0,0 +1,201 @@
+#include <filezilla.h>
+#include "file_watcher.h"
+
+#if HAVE_SYS_INOTIFY_H
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+CFileWatcher::CFileWatcher(fz::thread_pool & pool, std::function<void()> const& onChange)
+	: onChange_(onChange)
+#if HAVE_SYS_INOTIFY_H
+	, pool_(pool)
+#endif
+{
+#if !HAVE_SYS_INOTIFY_H
+	(void)pool;
+#endif
+}
+
+CFileWatcher::~CFileWatcher()
+{
+#if HAVE_SYS_INOTIFY_H
+	if (task_) {
+		char const c = 0;
+		while (write(wakeup_[1], &c, 1) == -1 && errno == EINTR) {
+		}
+		task_.join();
+	}
+
+	if (fd_ != -1) {
+		close(fd_);
+	}
+	if (wakeup_[0] != -1) {
+		close(wakeup_[0]);
+		close(wakeup_[1]);
+	}
+#endif
+}
+
+bool CFileWatcher::Watch(std::vector<std::wstring> const& files)
+{
+#if HAVE_SYS_INOTIFY_H
+	if (files.empty() && fd_ == -1) {
+		return true;
+	}
+
+	if (!Init()) {
+		return false;
+	}
+
+	std::map<std::string, std::set<std::string>> wanted;
+	for (auto const& file : files) {
+		std::string const native = fz::to_native(file);
+		size_t const pos = native.rfind('/');
+		if (pos == std::string::npos || pos + 1 == native.size()) {
+			continue;
+		}
+		wanted[pos ? native.substr(0, pos) : std::string("/")].insert(native.substr(pos + 1));
+	}
+
+	fz::scoped_lock l(mutex_);
+
+	for (auto it = directories_.begin(); it != directories_.end(); ) {
+		auto w = wanted.find(it->second.path);
+		if (w == wanted.end()) {
+			inotify_rm_watch(fd_, it->first);
+			it = directories_.erase(it);
+		}
+		else {
+			it->second.names = std::move(w->second);
+			wanted.erase(w);
+			++it;
+		}
+	}
+
+	bool all = true;
+	for (auto & w : wanted) {
+		int const wd = inotify_add_watch(fd_, w.first.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_ATTRIB | IN_DELETE | IN_ONLYDIR);
+		if (wd == -1) {
+			all = false;
+			continue;
+		}
+
+		// Another path to the same directory yields the same descriptor
+		auto & d = directories_[wd];
+		if (d.path.empty()) {
+			d.path = w.first;
+		}
+		d.names.insert(w.second.cbegin(), w.second.cend());
+	}
+
+	return all;
+#else
+	return files.empty();
+#endif
+}
+
+#if HAVE_SYS_INOTIFY_H
+bool CFileWatcher::Init()
+{
+	if (fd_ != -1) {
+		return true;
+	}
+	if (failed_) {
+		return false;
+	}
+
+	fd_ = inotify_init1(IN_CLOEXEC);
+	if (fd_ != -1 && !pipe2(wakeup_, O_CLOEXEC)) {
+		task_ = pool_.spawn([this]() { entry(); });
+		if (task_) {
+			return true;
+		}
+	}
+
+	failed_ = true;
+	if (fd_ != -1) {
+		close(fd_);
+		fd_ = -1;
+	}
+	if (wakeup_[0] != -1) {
+		close(wakeup_[0]);
+		close(wakeup_[1]);
+		wakeup_[0] = -1;
+		wakeup_[1] = -1;
+	}
+	return false;
+}
+
+void CFileWatcher::entry()
+{
+	alignas(inotify_event) char buffer[8192];
+
+	for (;;) {
+		pollfd fds[2]{};
+		fds[0].fd = fd_;
+		fds[0].events = POLLIN;
+		fds[1].fd = wakeup_[0];
+		fds[1].events = POLLIN;
+
+		int res = poll(fds, 2, -1);
+		if (res == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (fds[1].revents) {
+			break;
+		}
+		if (fds[0].revents & (POLLERR | POLLNVAL)) {
+			break;
+		}
+		if (!(fds[0].revents & POLLIN)) {
+			continue;
+		}
+
+		ssize_t const len = read(fd_, buffer, sizeof(buffer));
+		if (len <= 0) {
+			if (len == -1 && (errno == EINTR || errno == EAGAIN)) {
+				continue;
+			}
+			break;
+		}
+
+		bool changed = false;
+		{
+			fz::scoped_lock l(mutex_);
+			for (char const* p = buffer; p < buffer + len; ) {
+				auto const* ev = reinterpret_cast<inotify_event const*>(p);
+				p += sizeof(inotify_event) + ev->len;
+
+				if (ev->mask & IN_Q_OVERFLOW) {
+					changed = true;
+					continue;
+				}
+
+				auto it = directories_.find(ev->wd);
+				if (it == directories_.end()) {
+					continue;
+				}
+				if (ev->mask & IN_IGNORED) {
+					// Directory is gone
+					directories_.erase(it);
+					changed = true;
+				}
+				else if (ev->len && it->second.names.count(ev->name)) {
+					changed = true;
+				}
+			}
+		}
+
+		if (changed) {
+			onChange_();
+		}
+	}
+}
+#endif
@@ -0,0 +1,59 @@
+#ifndef FILEZILLA_INTERFACE_FILE_WATCHER_HEADER
+#define FILEZILLA_INTERFACE_FILE_WATCHER_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Watches files for modifications and calls the change handler from a
+// worker thread whenever one of them might have changed. Notifications can
+// be spurious, the handler needs to check the files itself.
+//
+// Watching is implemented using inotify. On other platforms, or once the
+// inotify watch limit is exhausted, Watch returns false and the caller has to
+// fall back to polling.
+class CFileWatcher final
+{
+public:
+	CFileWatcher(fz::thread_pool & pool, std::function<void()> const& onChange);
+	~CFileWatcher();
+
+	CFileWatcher(CFileWatcher const&) = delete;
+	CFileWatcher& operator=(CFileWatcher const&) = delete;
+
+	// Replaces the set of watched files. Returns true if all of them are being watched.
+	bool Watch(std::vector<std::wstring> const& files);
+
+private:
+	std::function<void()> const onChange_;
+
+#if HAVE_SYS_INOTIFY_H
+	bool Init();
+	void entry();
+
+	fz::thread_pool & pool_;
+	fz::async_task task_;
+
+	fz::mutex mutex_;
+
+	int fd_{-1};
+	int wakeup_[2]{-1, -1};
+	bool failed_{};
+
+	// Editors often save by replacing the file, so the parent directories
+	// get watched, not the files themselves.
+	struct directory final
+	{
+		std::string path;
+		std::set<std::string> names;
+	};
+	std::map<int, directory> directories_;
+#endif
+};
+
+#endif
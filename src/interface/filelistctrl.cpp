@@ -7,6 +7,8 @@
 #include "Options.h"
 #include "conditionaldialog.h"
 #include <algorithm>
+#include <functional>
+#include <thread>
 #include "filelist_statusbar.h"
 #include "themeprovider.h"
 #if defined(__WXGTK__) && !defined(__WXGTK3__)
@@ -376,8 +378,7 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 	if (m_hasParent) {
 		++start;
 	}
-	std::unique_ptr<CFileListCtrlSortBase> object = GetSortComparisonObject();
-	std::sort(start, m_indexMapping.end(), SortPredicate(object));
+	SortIndexes(start, m_indexMapping.end());
 
 	if (updateSelections) {
 		SortList_UpdateSelections(selected, focused_item, focused_index);
@@ -385,6 +386,106 @@ template<class CFileData> void CFileListCtrl<CFileData>::SortList(int column /*=
 	}
 }
 
+template<class CFileData> void CFileListCtrl<CFileData>::SortIndexes(std::vector<unsigned int>::iterator first, std::vector<unsigned int>::iterator last)
+{
+	std::unique_ptr<CFileListCtrlSortBase> object = GetSortComparisonObject();
+	object->Prepare();
+
+	// Below this, spawning tasks isn't worth it
+	size_t const minChunkSize = 10000;
+
+	size_t const count = last - first;
+	size_t chunks = 1;
+	if (m_sortPool) {
+		chunks = std::min({static_cast<size_t>(std::thread::hardware_concurrency()), size_t(8), count / minChunkSize});
+	}
+	if (chunks < 2) {
+		std::sort(first, last, SortPredicate(object));
+		return;
+	}
+
+	// Sort the chunks concurrently, then merge adjacent chunks until only one is left
+	std::vector<std::vector<unsigned int>::iterator> bounds;
+	for (size_t i = 0; i < chunks; ++i) {
+		bounds.push_back(first + count * i / chunks);
+	}
+	bounds.push_back(last);
+
+	auto const run = [this](std::vector<std::function<void()>> const& jobs) {
+		std::vector<fz::async_task> tasks;
+		for (size_t i = 1; i < jobs.size(); ++i) {
+			tasks.emplace_back(m_sortPool->spawn(jobs[i]));
+			if (!tasks.back()) {
+				jobs[i]();
+			}
+		}
+		jobs.front()();
+		for (auto & task : tasks) {
+			task.join();
+		}
+	};
+
+	std::vector<std::function<void()>> jobs;
+	for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+		jobs.emplace_back([&object, from = bounds[i], to = bounds[i + 1]]() {
+			std::sort(from, to, SortPredicate(object));
+		});
+	}
+	run(jobs);
+
+	while (bounds.size() > 2) {
+		jobs.clear();
+		std::vector<std::vector<unsigned int>::iterator> merged;
+		for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+			merged.push_back(bounds[i]);
+			if (i + 2 < bounds.size()) {
+				jobs.emplace_back([&object, from = bounds[i], middle = bounds[i + 1], to = bounds[i + 2]]() {
+					std::inplace_merge(from, middle, to, SortPredicate(object));
+				});
+			}
+		}
+		merged.push_back(last);
+		bounds.swap(merged);
+		run(jobs);
+	}
+}
+
+template<class CFileData> std::vector<int> CFileListCtrl<CFileData>::MergeIntoIndexMapping(std::vector<unsigned int> && added, bool positions)
+{
+	std::vector<int> added_positions;
+	if (added.empty()) {
+		return added_positions;
+	}
+
+	std::unique_ptr<CFileListCtrlSortBase> compare = GetSortComparisonObject();
+	std::sort(added.begin(), added.end(), SortPredicate(compare));
+
+	auto it = m_indexMapping.cbegin();
+	if (m_hasParent && it != m_indexMapping.cend()) {
+		++it;
+	}
+
+	std::vector<unsigned int> merged;
+	merged.reserve(m_indexMapping.size() + added.size());
+	merged.insert(merged.end(), m_indexMapping.cbegin(), it);
+
+	// Like inserting at the lower bound, added items go before equal ones
+	for (auto const& index : added) {
+		for (; it != m_indexMapping.cend() && (*compare)(*it, index); ++it) {
+			merged.push_back(*it);
+		}
+		if (positions) {
+			added_positions.push_back(static_cast<int>(merged.size()));
+		}
+		merged.push_back(index);
+	}
+	merged.insert(merged.end(), it, m_indexMapping.cend());
+
+	m_indexMapping.swap(merged);
+
+	return added_positions;
+}
+
 template<class CFileData> void CFileListCtrl<CFileData>::SortList_UpdateSelections(bool* selections, int focused_item, unsigned int focused_index)
 {
 	if (focused_item >= 0) {
@@ -650,6 +751,7 @@ template<class CFileData> void CFileListCtrl<CFileData>::OnExitComparisonMode()
 
 	ComparisonRememberSelections();
 
+	m_comparisonMapping.clear();
 	m_indexMapping.clear();
 	m_indexMapping.swap(m_originalIndexMapping);
 
@@ -664,17 +766,77 @@ template<class CFileData> void CFileListCtrl<CFileData>::OnExitComparisonMode()
 	RefreshListOnly();
 }
 
-template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags)
+template<class CFileData> bool CFileListCtrl<CFileData>::get_next_file(entry & e)
+{
+	if (++m_comparisonIndex >= (int)m_originalIndexMapping.size()) {
+		return false;
+	}
+
+	return GetFileEntry(m_originalIndexMapping[m_comparisonIndex], e);
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::CompareAddFile(t_fileEntryFlags flags, size_t position)
 {
 	if (flags == fill) {
-		m_indexMapping.push_back(m_fileData.size() - 1);
+		m_comparisonMapping.push_back(m_fileData.size() - 1);
 		return;
 	}
 
-	int index = m_originalIndexMapping[m_comparisonIndex];
+	unsigned int const index = m_originalIndexMapping[position];
 	m_fileData[index].comparison_flags = flags;
 
-	m_indexMapping.push_back(index);
+	m_comparisonMapping.push_back(index);
+}
+
+template<class CFileData> bool CFileListCtrl<CFileData>::GetComparisonItem(int item, entry & e)
+{
+	if (item < 0 || item >= static_cast<int>(m_indexMapping.size())) {
+		return false;
+	}
+
+	unsigned int const index = m_indexMapping[item];
+	if (m_fileData[index].comparison_flags == fill) {
+		return false;
+	}
+
+	return GetFileEntry(index, e);
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::SetComparisonFlags(int item, t_fileEntryFlags flags)
+{
+	if (item < 0 || item >= static_cast<int>(m_indexMapping.size())) {
+		return;
+	}
+
+	m_fileData[m_indexMapping[item]].comparison_flags = flags;
+	RefreshItem(item);
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::PrepareComparison()
+{
+	if (m_originalIndexMapping.empty()) {
+		m_originalIndexMapping = m_indexMapping;
+	}
+
+	// Keep showing the current items until the comparison has finished
+	if (GetItemCount() != static_cast<int>(m_indexMapping.size())) {
+		SetItemCount(m_indexMapping.size());
+	}
+
+	m_comparisonMapping.clear();
+	m_comparisonIndex = -1;
+}
+
+template<class CFileData> void CFileListCtrl<CFileData>::CommitComparison()
+{
+	ComparisonRememberSelections();
+
+	m_indexMapping.swap(m_comparisonMapping);
+	m_comparisonMapping.clear();
+
+	SetItemCount(m_indexMapping.size());
+
+	ComparisonRestoreSelections();
 }
 
 template<class CFileData> void CFileListCtrl<CFileData>::ComparisonRememberSelections()
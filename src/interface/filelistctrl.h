@@ -5,7 +5,11 @@
 #include "systemimagelist.h"
 #include "listingcomparison.h"
 
+#include <libfilezilla/thread_pool.hpp>
+
 #include <cstring>
+#include <cwctype>
+#include <map>
 #include <memory>
 
 class CQueueView;
@@ -105,63 +109,107 @@ public:
 		return CmpNatural(str1.c_str(), str2.c_str());
 	}
 
+	// Compares names case-insensitively, with runs of digits compared by their
+	// numeric value. Leading zeros only break ties between otherwise equal names.
 	static int CmpNatural(wchar_t const* p1, wchar_t const* p2)
 	{
-		int res = 0;
-		int zeroCount = 0;
-		bool isNumber = false;
-		for (; *p1 && *p2; ++p1, ++p2) {
-			int diff = static_cast<int>(wxTolower(*p1)) - static_cast<int>(wxTolower(*p2));
-			if (isNumber) {
-				if (res == 0) {
-					res = diff;
+		int zeroDiff = 0;
+		while (*p1 && *p2) {
+			if (wxIsdigit(*p1) && wxIsdigit(*p2)) {
+				wchar_t const* const start1 = p1;
+				wchar_t const* const start2 = p2;
+				for (; *p1 == '0' && wxIsdigit(*(p1 + 1)); ++p1) {
 				}
-				int nbDigits = (wxIsdigit(*p1) ? 1 : 0) + (wxIsdigit(*p2) ? 1 : 0);
-				if (nbDigits == 0 && res == 0) {
-					if (zeroCount) {
-						break;
-					}
-					isNumber = false;
+				for (; *p2 == '0' && wxIsdigit(*(p2 + 1)); ++p2) {
 				}
-				else if (nbDigits != 2) {
-					break;
+				if (!zeroDiff) {
+					zeroDiff = static_cast<int>((p1 - start1) - (p2 - start2));
 				}
-			}
-			else if (wxIsdigit(*p1) && wxIsdigit(*p2)) {
-				zeroCount = 0;
-				for (; *p1 == '0' && *(p1 + 1) && wxIsdigit(*(p1 + 1)); ++p1) {
-					zeroCount++;
+
+				wchar_t const* const digits1 = p1;
+				wchar_t const* const digits2 = p2;
+				for (; wxIsdigit(*p1); ++p1) {
+				}
+				for (; wxIsdigit(*p2); ++p2) {
 				}
-				for (; *p2 == '0' && *(p2 + 1) && wxIsdigit(*(p2 + 1)); ++p2) {
-					zeroCount--;
+				if (p1 - digits1 != p2 - digits2) {
+					return (p1 - digits1) < (p2 - digits2) ? -1 : 1; // Fewer digits
+				}
+				for (size_t i = 0; digits1 + i != p1; ++i) {
+					if (digits1[i] != digits2[i]) {
+						return digits1[i] < digits2[i] ? -1 : 1;
+					}
 				}
-				res = *p1 - *p2;
-				isNumber = true;
 			}
-			else if (diff) {
-				return diff;
+			else {
+				int const diff = static_cast<int>(wxTolower(*p1)) - static_cast<int>(wxTolower(*p2));
+				if (diff) {
+					return diff;
+				}
+				++p1;
+				++p2;
 			}
 		}
 
-		if (res == 0 && isNumber) {
-			res = zeroCount;
+		if (*p1 || *p2) {
+			return *p1 ? 1 : -1;
 		}
+		return zeroDiff;
+	}
 
-		if (!*p1 && !*p2) {
-			return res;
-		}
-		if (!isNumber || res == 0) {
-			return !*p1 ? -1 : 1;
+	// Returns a key for the name such that comparing the keys of two names
+	// orders them like CmpNoCase or CmpNatural respectively, but without
+	// case folding and parsing numbers in every comparison. Names with equal
+	// keys can still differ, e.g. in case.
+	//
+	// In natural keys, each number is encoded as '0', followed by the count and
+	// the digits without leading zeros. The counts of leading zeros are
+	// appended after a null character.
+	static std::wstring GetSortKey(std::wstring const& name, NameSortMode mode)
+	{
+		if (mode == namesort_casesensitive) {
+			return name;
 		}
-		if (*p1 && wxIsdigit(*p1)) {
-			return 1;       //more digits
+
+		std::wstring key;
+		key.reserve(name.size());
+		if (mode == namesort_natural) {
+			std::wstring zeros;
+			for (wchar_t const* p = name.c_str(); *p; ) {
+				if (!wxIsdigit(*p)) {
+					key += static_cast<wchar_t>(wxTolower(*p++));
+					continue;
+				}
+
+				wchar_t const* const start = p;
+				for (; *p == '0' && wxIsdigit(*(p + 1)); ++p) {
+				}
+				zeros += static_cast<wchar_t>(std::min<size_t>(p - start, 0xffff));
+
+				wchar_t const* const digits = p;
+				for (; wxIsdigit(*p); ++p) {
+				}
+				key += '0';
+				key += static_cast<wchar_t>(std::min<size_t>(p - digits, 0xffff));
+				key.append(digits, p);
+			}
+			if (!zeros.empty()) {
+				key += wchar_t();
+				key += zeros;
+			}
 		}
-		if (*p2 && wxIsdigit(*p2)) {
-			return -1;      //fewer digits
+		else {
+			for (auto const& c : name) {
+				key += static_cast<wchar_t>(std::towlower(c));
+			}
 		}
-		return res;         //same length, compare first different digit in the sequence
+		return key;
 	}
 
+	// Called once before sorting. Afterwards operator() must not modify any
+	// state so that parts of the listing can be sorted concurrently.
+	virtual void Prepare() {}
+
 	typedef int (* CompareFunction)(std::wstring const&, std::wstring const&);
 	static CompareFunction GetCmpFunction(NameSortMode mode)
 	{
@@ -260,6 +308,18 @@ public:
 		return DoCmpName(data1, data2, m_nameSortMode);
 	}
 
+	// Uses the precomputed keys if available, only equal keys need the full comparison
+	inline int CmpNameIndex(int a, int b) const
+	{
+		if (!m_nameKeys.empty()) {
+			int const res = m_nameKeys[a].compare(m_nameKeys[b]);
+			if (res) {
+				return res;
+			}
+		}
+		return DoCmpName(m_listing[a], m_listing[b], m_nameSortMode);
+	}
+
 	inline int CmpSize(const value_type &data1, const value_type &data2) const
 	{
 		int64_t const diff = data1.size - data2.size;
@@ -292,11 +352,61 @@ public:
 		}
 	}
 
+	virtual void Prepare() override
+	{
+		if (m_nameSortMode == namesort_casesensitive) {
+			return;
+		}
+
+		m_nameKeys.resize(m_listing.size());
+		for (size_t i = 0; i < m_nameKeys.size(); ++i) {
+			m_nameKeys[i] = GetSortKey(m_listing[i].name, m_nameSortMode);
+		}
+	}
+
 protected:
+	// Assigns ranks to the strings such that comparing ranks gives the same
+	// order as CmpStringNoCase. Listings only contain few distinct types,
+	// permissions and owners, so this is much cheaper than comparing the
+	// strings in every comparison.
+	template<typename Getter>
+	static std::vector<unsigned int> RankNoCase(size_t count, Getter const& get)
+	{
+		std::map<std::wstring, unsigned int> distinct;
+		for (size_t i = 0; i < count; ++i) {
+			distinct.emplace(get(i), 0);
+		}
+
+		std::vector<std::pair<wxString, unsigned int*>> sorted;
+		sorted.reserve(distinct.size());
+		for (auto & d : distinct) {
+			sorted.emplace_back(d.first, &d.second);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](auto const& lhs, auto const& rhs) { return lhs.first.CmpNoCase(rhs.first) < 0; });
+
+		unsigned int rank{};
+		for (size_t i = 0; i < sorted.size(); ++i) {
+			if (i && sorted[i - 1].first.CmpNoCase(sorted[i].first)) {
+				++rank;
+			}
+			*sorted[i].second = rank;
+		}
+
+		std::vector<unsigned int> ranks;
+		ranks.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			ranks.push_back(distinct[get(i)]);
+		}
+		return ranks;
+	}
+
 	Listing const& m_listing;
 
 	DirSortMode const m_dirSortMode;
 	NameSortMode const m_nameSortMode;
+
+	// Indexed like the listing, only set after Prepare
+	std::vector<std::wstring> m_nameKeys;
 };
 
 template<class CFileData> class CFileListCtrl;
@@ -331,7 +441,7 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpNameIndex, a, b);
 	}
 };
 
@@ -353,7 +463,7 @@ public:
 
 		CMP(CmpSize, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpNameIndex, a, b);
 	}
 };
 
@@ -373,23 +483,45 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		DataEntry &type1 = m_fileData[a];
-		DataEntry &type2 = m_fileData[b];
-		if (type1.fileType.empty()) {
-			type1.fileType = m_pListView->GetType(data1.name, data1.is_dir());
+		if (!m_typeRanks.empty()) {
+			if (m_typeRanks[a] != m_typeRanks[b]) {
+				return m_typeRanks[a] < m_typeRanks[b];
+			}
 		}
-		if (type2.fileType.empty()) {
-			type2.fileType = m_pListView->GetType(data2.name, data2.is_dir());
+		else {
+			DataEntry &type1 = m_fileData[a];
+			DataEntry &type2 = m_fileData[b];
+			if (type1.fileType.empty()) {
+				type1.fileType = m_pListView->GetType(data1.name, data1.is_dir());
+			}
+			if (type2.fileType.empty()) {
+				type2.fileType = m_pListView->GetType(data2.name, data2.is_dir());
+			}
+
+			CMP(CmpStringNoCase, type1.fileType, type2.fileType);
 		}
 
-		CMP(CmpStringNoCase, type1.fileType, type2.fileType);
+		CMP_LESS(CmpNameIndex, a, b);
+	}
+
+	virtual void Prepare() override
+	{
+		CFileListCtrlSort<Listing>::Prepare();
 
-		CMP_LESS(CmpName, data1, data2);
+		size_t const count = std::min(static_cast<size_t>(this->m_listing.size()), m_fileData.size());
+		for (size_t i = 0; i < count; ++i) {
+			if (m_fileData[i].fileType.empty()) {
+				m_fileData[i].fileType = m_pListView->GetType(this->m_listing[i].name, this->m_listing[i].is_dir());
+			}
+		}
+		m_typeRanks = this->RankNoCase(count, [this](size_t i) -> std::wstring const& { return m_fileData[i].fileType; });
 	}
 
 protected:
 	CFileListCtrl<DataEntry>* const m_pListView;
 	std::vector<DataEntry>& m_fileData;
+
+	std::vector<unsigned int> m_typeRanks;
 };
 
 template<typename Listing, typename DataEntry>
@@ -410,7 +542,7 @@ public:
 
 		CMP(CmpTime, data1, data2);
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpNameIndex, a, b);
 	}
 };
 
@@ -430,10 +562,26 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP(CmpStringNoCase, *data1.permissions, *data2.permissions);
+		if (!m_ranks.empty()) {
+			if (m_ranks[a] != m_ranks[b]) {
+				return m_ranks[a] < m_ranks[b];
+			}
+		}
+		else {
+			CMP(CmpStringNoCase, *data1.permissions, *data2.permissions);
+		}
+
+		CMP_LESS(CmpNameIndex, a, b);
+	}
 
-		CMP_LESS(CmpName, data1, data2);
+	virtual void Prepare() override
+	{
+		CFileListCtrlSort<Listing>::Prepare();
+		m_ranks = this->RankNoCase(this->m_listing.size(), [this](size_t i) -> std::wstring const& { return *this->m_listing[i].permissions; });
 	}
+
+protected:
+	std::vector<unsigned int> m_ranks;
 };
 
 template<typename Listing, typename DataEntry>
@@ -452,10 +600,26 @@ public:
 
 		CMP(CmpDir, data1, data2);
 
-		CMP(CmpStringNoCase, *data1.ownerGroup, *data2.ownerGroup);
+		if (!m_ranks.empty()) {
+			if (m_ranks[a] != m_ranks[b]) {
+				return m_ranks[a] < m_ranks[b];
+			}
+		}
+		else {
+			CMP(CmpStringNoCase, *data1.ownerGroup, *data2.ownerGroup);
+		}
+
+		CMP_LESS(CmpNameIndex, a, b);
+	}
 
-		CMP_LESS(CmpName, data1, data2);
+	virtual void Prepare() override
+	{
+		CFileListCtrlSort<Listing>::Prepare();
+		m_ranks = this->RankNoCase(this->m_listing.size(), [this](size_t i) -> std::wstring const& { return *this->m_listing[i].ownerGroup; });
 	}
+
+protected:
+	std::vector<unsigned int> m_ranks;
 };
 
 template<typename Listing, typename DataEntry>
@@ -480,7 +644,7 @@ public:
 			return false;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpNameIndex, a, b);
 	}
 	std::vector<DataEntry>& m_fileData;
 };
@@ -501,7 +665,7 @@ public:
 		typename Listing::value_type const& data2 = this->m_listing[b];
 
 		CMP(CmpDir, data1, data2);
-		CMP(CmpName, data1, data2);
+		CMP(CmpNameIndex, a, b);
 
 		if (data1.path < data2.path) {
 			return true;
@@ -510,7 +674,7 @@ public:
 			return false;
 		}
 
-		CMP_LESS(CmpName, data1, data2);
+		CMP_LESS(CmpNameIndex, a, b);
 	}
 	std::vector<DataEntry>& m_fileData;
 };
@@ -562,6 +726,14 @@ protected:
 	CFileListCtrlSortBase::NameSortMode GetNameSortMode();
 	virtual std::unique_ptr<CFileListCtrlSortBase> GetSortComparisonObject() = 0;
 
+	// Sorts the added indexes and merges them into the sorted index mapping
+	// in a single pass. If requested, returns the positions of the added
+	// items, sorted ascending.
+	std::vector<int> MergeIntoIndexMapping(std::vector<unsigned int> && added, bool positions);
+
+	// If set, large listings get sorted in parallel
+	fz::thread_pool* m_sortPool{};
+
 	// An empty path denotes a virtual file
 	std::wstring GetType(std::wstring name, bool dir, std::wstring const& path = std::wstring());
 
@@ -569,10 +741,26 @@ protected:
 	virtual void ScrollTopItem(int item);
 	virtual void OnPostScroll();
 	virtual void OnExitComparisonMode();
-	virtual void CompareAddFile(t_fileEntryFlags flags);
+	virtual bool get_next_file(entry & e) override;
+	virtual void CompareAddFile(t_fileEntryFlags flags, size_t position) override;
+	virtual bool GetComparisonItem(int item, entry & e) override;
+	virtual void SetComparisonFlags(int item, t_fileEntryFlags flags) override;
+
+	// Returns false for the fill entry
+	virtual bool GetFileEntry(unsigned int index, entry & e) const = 0;
+
+	// Copies the current mapping to m_originalIndexMapping if needed and
+	// prepares for a new comparison
+	void PrepareComparison();
+
+	// Replaces the displayed items with the comparison result
+	void CommitComparison();
 
 	int m_comparisonIndex{-1};
 
+	// Comparison results are collected here until the comparison has finished
+	std::vector<unsigned int> m_comparisonMapping;
+
 	// Remembers which non-fill items are selected if enabling/disabling comparison.
 	// Exploit fact that sort order doesn't change -> O(n)
 	void ComparisonRememberSelections();
@@ -604,6 +792,8 @@ private:
 
 	void SortList_UpdateSelections(bool* selections, int focused_item, unsigned int focused_index);
 
+	void SortIndexes(std::vector<unsigned int>::iterator first, std::vector<unsigned int>::iterator last);
+
 	// If this is set to true, don't process selection changed events
 	bool m_insideSetSelection{};
 
@@ -2,6 +2,7 @@
 #define FILEZILLA_INTERFACE_FILEZILLAAPP_HEADER
 
 #include "local_path.h"
+#include "startup_tasks.h"
 
 #include <vector>
 
@@ -45,11 +46,19 @@ public:
 	void AddStartupProfileRecord(std::string const& msg);
 
 protected:
-	void CheckExistsTool(std::wstring const& tool, std::wstring const& buildRelPath, std::string const& env, int setting, std::wstring const& description);
+	// Returns an empty string if not found. Safe to call from any thread.
+	std::wstring FindTool(std::wstring const& tool, std::wstring const& buildRelPath, std::string const& env) const;
+
+	// Stores the executable in the given setting, complains if it is empty
+	void CheckExistsTool(std::wstring const& executable, std::wstring const& tool, std::string const& env, int setting, std::wstring const& description);
+
+	void StartStartupTasks();
+	void WaitForStartupTask(CStartupTasks::task_id id);
 
 	bool InitDefaultsDir();
 	bool LoadResourceFiles();
 	bool LoadLocales();
+	CLocalPath FindLocalesDir() const;
 	int ProcessCommandLine();
 
 	std::unique_ptr<wxLocale> m_pLocale;
@@ -71,9 +80,14 @@ protected:
 	std::unique_ptr<CCommandLine> m_pCommandLine;
 
 	fz::monotonic_clock m_profile_start;
+	fz::monotonic_clock m_profile_interactive;
 	std::vector<std::pair<fz::monotonic_clock, std::string>> m_startupProfile;
 
 	std::unique_ptr<CThemeProvider> themeProvider_;
+
+	// Only exists while OnInit runs
+	struct startup_state;
+	std::unique_ptr<startup_state> startup_;
 };
 
 DECLARE_APP(CFileZillaApp)
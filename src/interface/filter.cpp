@@ -11,13 +11,18 @@
 
 #include <libfilezilla/local_filesys.hpp>
 
+#include <algorithm>
 #include <array>
+#include <map>
+#include <type_traits>
 
 bool CFilterManager::m_loaded = false;
 std::vector<CFilter> CFilterManager::m_globalFilters;
 std::vector<CFilterSet> CFilterManager::m_globalFilterSets;
 unsigned int CFilterManager::m_globalCurrentFilterSet = 0;
 bool CFilterManager::m_filters_disabled = false;
+CFilterProgram CFilterManager::m_globalPrograms[2];
+bool CFilterManager::m_globalProgramsValid = false;
 
 BEGIN_EVENT_TABLE(CFilterDialog, wxDialogEx)
 EVT_BUTTON(XRCID("wxID_OK"), CFilterDialog::OnOkOrApply)
@@ -41,6 +46,56 @@ std::array<std::wstring, 4> matchTypeXmlNames =
 	{ L"All", L"Any", L"None", L"Not all" };
 }
 
+namespace {
+// Checks whether the regular expression is a literal, optionally anchored at
+// the start and/or end. If so, returns the equivalent literal condition and
+// the unescaped literal.
+bool LiteralFromRegex(std::wstring const& regex, int & condition, std::wstring & literal)
+{
+	size_t start = 0;
+	size_t end = regex.size();
+
+	bool const anchorStart = !regex.empty() && regex[0] == '^';
+	if (anchorStart) {
+		++start;
+	}
+
+	bool anchorEnd = false;
+	literal.clear();
+	for (size_t i = start; i < end; ++i) {
+		wchar_t const c = regex[i];
+		if (c == '\\') {
+			// Escaped punctuation is literal, escaped alphanumerics are classes or assertions
+			if (++i == end) {
+				return false;
+			}
+			wchar_t const e = regex[i];
+			if ((e >= '0' && e <= '9') || (e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z') || e > 127) {
+				return false;
+			}
+			literal += e;
+		}
+		else if (c == '$' && i + 1 == end) {
+			anchorEnd = true;
+		}
+		else if (wcschr(L"^$.*+?()[]{}|", c)) {
+			return false;
+		}
+		else {
+			literal += c;
+		}
+	}
+
+	if (anchorStart) {
+		condition = anchorEnd ? 1 : 2;
+	}
+	else {
+		condition = anchorEnd ? 3 : 0;
+	}
+	return true;
+}
+}
+
 bool CFilterCondition::set(t_filterType t, std::wstring const& v, int c, bool matchCase)
 {
 	if (v.empty()) {
@@ -49,9 +104,12 @@ bool CFilterCondition::set(t_filterType t, std::wstring const& v, int c, bool ma
 
 	type = t;
 	condition = c;
+	matchCondition = c;
 	strValue = v;
 
 	pRegEx.reset();
+	matchValue.clear();
+	lowerValue.clear();
 
 	switch (t) {
 	case filter_name:
@@ -60,6 +118,13 @@ bool CFilterCondition::set(t_filterType t, std::wstring const& v, int c, bool ma
 			if (strValue.size() > 2000) {
 				return false;
 			}
+			if (LiteralFromRegex(strValue, matchCondition, matchValue)) {
+				if (!matchCase) {
+					lowerValue = fz::str_tolower(matchValue);
+				}
+				break;
+			}
+			matchValue.clear();
 			try {
 				auto flags = std::regex_constants::ECMAScript;
 				if (!matchCase) {
@@ -72,6 +137,7 @@ bool CFilterCondition::set(t_filterType t, std::wstring const& v, int c, bool ma
 			}
 		}
 		else {
+			matchValue = v;
 			if (!matchCase) {
 				lowerValue = fz::str_tolower(v);
 			}
@@ -150,6 +216,7 @@ void CFilterDialog::OnOkOrApply(wxCommandEvent& event)
 	m_globalFilters = m_filters;
 	m_globalFilterSets = m_filterSets;
 	m_globalCurrentFilterSet = m_currentFilterSet;
+	InvalidatePrograms();
 
 	SaveFilters();
 	m_filters_disabled = false;
@@ -502,105 +569,300 @@ bool CFilterManager::FilenameFiltered(std::wstring const& name, std::wstring con
 
 	wxASSERT(m_globalCurrentFilterSet < m_globalFilterSets.size());
 
-	CFilterSet const& set = m_globalFilterSets[m_globalCurrentFilterSet];
-	auto const& active = local ? set.local : set.remote;
+	return GetProgram(local).Filtered(name, path, dir, size, attributes, date);
+}
 
-	// Check active filters
-	for (unsigned int i = 0; i < m_globalFilters.size(); ++i) {
-		if (active[i]) {
-			if (FilenameFilteredByFilter(m_globalFilters[i], name, path, dir, size, attributes, date)) {
-				return true;
+bool CFilterManager::FilenameFiltered(CFilterProgram const& filters, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const
+{
+	return filters.Filtered(name, path, dir, size, attributes, date);
+}
+
+CFilterProgram const& CFilterManager::GetProgram(bool local)
+{
+	if (!m_globalProgramsValid) {
+		std::vector<CFilter> active[2];
+		if (!m_globalFilterSets.empty()) {
+			CFilterSet const& set = m_globalFilterSets[m_globalCurrentFilterSet];
+			for (unsigned int i = 0; i < m_globalFilters.size(); ++i) {
+				if (set.local[i]) {
+					active[0].push_back(m_globalFilters[i]);
+				}
+				if (set.remote[i]) {
+					active[1].push_back(m_globalFilters[i]);
+				}
 			}
 		}
+		m_globalPrograms[0] = CFilterProgram(active[0]);
+		m_globalPrograms[1] = CFilterProgram(active[1]);
+		m_globalProgramsValid = true;
 	}
 
-	return false;
+	return m_globalPrograms[local ? 0 : 1];
 }
 
-bool CFilterManager::FilenameFiltered(std::vector<CFilter> const& filters, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const
+void CFilterManager::InvalidatePrograms()
 {
-	for (auto const& filter : filters) {
-		if (FilenameFilteredByFilter(filter, name, path, dir, size, attributes, date)) {
-			return true;
-		}
+	m_globalProgramsValid = false;
+	m_globalPrograms[0] = CFilterProgram();
+	m_globalPrograms[1] = CFilterProgram();
+}
+
+std::wstring const& CFilterSubject::field::lower()
+{
+	if (!lowered_) {
+		lower_ = fz::str_tolower(value);
+		lowered_ = true;
+	}
+	return lower_;
+}
+
+namespace {
+bool StringMatch(std::wstring const& subject, std::wstring const& value, int condition)
+{
+	switch (condition)
+	{
+	case 0:
+		return subject.find(value) != std::wstring::npos;
+	case 1:
+		return subject == value;
+	case 2:
+		return fz::starts_with(subject, value);
+	case 3:
+		return fz::ends_with(subject, value);
+	case 5:
+		return subject.find(value) == std::wstring::npos;
 	}
 
 	return false;
 }
 
-static bool StringMatch(std::wstring const& subject, CFilterCondition const& condition, bool matchCase)
+bool StringMatch(CFilterSubject::field & subject, CFilterCondition const& condition, bool matchCase)
+{
+	if (condition.pRegEx) {
+		return std::regex_search(subject.value, *condition.pRegEx);
+	}
+	if (matchCase) {
+		return StringMatch(subject.value, condition.matchValue, condition.matchCondition);
+	}
+	return StringMatch(subject.lower(), condition.lowerValue, condition.matchCondition);
+}
+
+// Cheap conditions are evaluated first, the result of a filter does not
+// depend on the order in which its conditions are evaluated.
+int EvaluationPass(CFilterCondition const& condition)
+{
+	if (condition.type != filter_name && condition.type != filter_path) {
+		return 0;
+	}
+	return condition.pRegEx ? 2 : 1;
+}
+
+// Returns 1 if the condition matches, 0 if it does not and -1 if it does not
+// apply to the entry, e.g. if the size is unknown.
+int MatchCondition(CFilterCondition const& condition, CFilterSubject & subject, bool matchCase, int64_t size, int attributes, fz::datetime const& date)
 {
 	bool match = false;
 
-	switch (condition.condition)
+	switch (condition.type)
 	{
-	case 0:
-		if (matchCase) {
-			if (subject.find(condition.strValue) != std::wstring::npos) {
+	case filter_name:
+		match = StringMatch(subject.name, condition, matchCase);
+		break;
+	case filter_path:
+		match = StringMatch(subject.path, condition, matchCase);
+		break;
+	case filter_size:
+		if (size == -1) {
+			return -1;
+		}
+		switch (condition.condition)
+		{
+		case 0:
+			if (size > condition.value) {
 				match = true;
 			}
-		}
-		else {
-			if (fz::str_tolower(subject).find(condition.lowerValue) != std::wstring::npos) {
+			break;
+		case 1:
+			if (size == condition.value) {
 				match = true;
 			}
-		}
-		break;
-	case 1:
-		if (matchCase) {
-			if (subject == condition.strValue) {
+			break;
+		case 2:
+			if (size != condition.value) {
 				match = true;
 			}
-		}
-		else {
-			if (fz::str_tolower(subject) == condition.lowerValue) {
+			break;
+		case 3:
+			if (size < condition.value) {
 				match = true;
 			}
+			break;
 		}
 		break;
-	case 2:
+	case filter_attributes:
+#ifndef __WXMSW__
+		return -1;
+#else
+		if (!attributes) {
+			return -1;
+		}
+
 		{
-			if (matchCase) {
-				match = fz::starts_with(subject, condition.strValue);
+			int flag = 0;
+			switch (condition.condition)
+			{
+			case 0:
+				flag = FILE_ATTRIBUTE_ARCHIVE;
+				break;
+			case 1:
+				flag = FILE_ATTRIBUTE_COMPRESSED;
+				break;
+			case 2:
+				flag = FILE_ATTRIBUTE_ENCRYPTED;
+				break;
+			case 3:
+				flag = FILE_ATTRIBUTE_HIDDEN;
+				break;
+			case 4:
+				flag = FILE_ATTRIBUTE_READONLY;
+				break;
+			case 5:
+				flag = FILE_ATTRIBUTE_SYSTEM;
+				break;
 			}
-			else {
-				match = fz::starts_with(fz::str_tolower(subject), condition.lowerValue);
+
+			int set = (flag & attributes) ? 1 : 0;
+			if (set == condition.value) {
+				match = true;
 			}
 		}
+#endif //__WXMSW__
 		break;
-	case 3:
+	case filter_permissions:
+#ifdef __WXMSW__
+		return -1;
+#else
+		if (attributes == -1) {
+			return -1;
+		}
+
 		{
-			if (matchCase) {
-				match = fz::ends_with(subject, condition.strValue);
+			int flag = 0;
+			switch (condition.condition)
+			{
+			case 0:
+				flag = S_IRUSR;
+				break;
+			case 1:
+				flag = S_IWUSR;
+				break;
+			case 2:
+				flag = S_IXUSR;
+				break;
+			case 3:
+				flag = S_IRGRP;
+				break;
+			case 4:
+				flag = S_IWGRP;
+				break;
+			case 5:
+				flag = S_IXGRP;
+				break;
+			case 6:
+				flag = S_IROTH;
+				break;
+			case 7:
+				flag = S_IWOTH;
+				break;
+			case 8:
+				flag = S_IXOTH;
+				break;
 			}
-			else {
-				match = fz::ends_with(fz::str_tolower(subject), condition.lowerValue);
+
+			int set = (flag & attributes) ? 1 : 0;
+			if (set == condition.value) {
+				match = true;
 			}
 		}
+#endif //__WXMSW__
 		break;
-	case 4:
-		if (condition.pRegEx && std::regex_search(subject, *condition.pRegEx)) {
-			match = true;
+	case filter_date:
+		if (!date.empty()) {
+			int cmp = date.compare(condition.date);
+			switch (condition.condition)
+			{
+			case 0: // Before
+				match = cmp < 0;
+				break;
+			case 1: // Equals
+				match = cmp == 0;
+				break;
+			case 2: // Not equals
+				match = cmp != 0;
+				break;
+			case 3: // After
+				match = cmp > 0;
+				break;
+			}
 		}
 		break;
-	case 5:
-		if (matchCase) {
-			if (subject.find(condition.strValue) == std::wstring::npos) {
-				match = true;
-			}
+	default:
+		wxFAIL_MSG(_T("Unhandled filter type"));
+		break;
+	}
+
+	return match ? 1 : 0;
+}
+
+// Returns true if the result of a filter is known after a condition
+// evaluated to match. The result is stored in filtered.
+bool Decided(CFilter::t_matchType matchType, bool match, bool & filtered)
+{
+	if (match) {
+		if (matchType == CFilter::any) {
+			filtered = true;
+			return true;
 		}
-		else {
-			if (fz::str_tolower(subject).find(condition.lowerValue) == std::wstring::npos) {
-				match = true;
-			}
+		else if (matchType == CFilter::none) {
+			filtered = false;
+			return true;
 		}
-		break;
+	}
+	else {
+		if (matchType == CFilter::all) {
+			filtered = false;
+			return true;
+		}
+		else if (matchType == CFilter::not_all) {
+			filtered = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Result of a filter for which no condition decided the result
+bool Undecided(CFilter::t_matchType matchType, bool empty)
+{
+	if (matchType == CFilter::not_all) {
+		return false;
+	}
+
+	if (matchType != CFilter::any || empty) {
+		return true;
 	}
 
-	return match;
+	return false;
+}
 }
 
 bool CFilterManager::FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date)
+{
+	CFilterSubject subject(name, path);
+	return FilteredByFilter(filter, subject, dir, size, attributes, date);
+}
+
+bool CFilterManager::FilteredByFilter(CFilter const& filter, CFilterSubject & subject, bool dir, int64_t size, int attributes, fz::datetime const& date)
 {
 	if (dir && !filter.filterDirs) {
 		return false;
@@ -609,180 +871,373 @@ bool CFilterManager::FilenameFilteredByFilter(CFilter const& filter, std::wstrin
 		return false;
 	}
 
-	for (auto const& condition : filter.filters) {
-		bool match = false;
-
-		switch (condition.type)
-		{
-		case filter_name:
-			match = StringMatch(name, condition, filter.matchCase);
-			break;
-		case filter_path:
-			match = StringMatch(path, condition, filter.matchCase);
-			break;
-		case filter_size:
-			if (size == -1) {
+	for (int pass = 0; pass < 3; ++pass) {
+		for (auto const& condition : filter.filters) {
+			if (EvaluationPass(condition) != pass) {
 				continue;
 			}
-			switch (condition.condition)
-			{
-			case 0:
-				if (size > condition.value) {
-					match = true;
-				}
-				break;
-			case 1:
-				if (size == condition.value) {
-					match = true;
-				}
-				break;
-			case 2:
-				if (size != condition.value) {
-					match = true;
-				}
-				break;
-			case 3:
-				if (size < condition.value) {
-					match = true;
-				}
-				break;
+
+			int const match = MatchCondition(condition, subject, filter.matchCase, size, attributes, date);
+			bool filtered;
+			if (match != -1 && Decided(filter.matchType, match != 0, filtered)) {
+				return filtered;
 			}
-			break;
-		case filter_attributes:
-#ifndef __WXMSW__
-			continue;
-#else
-			if (!attributes) {
-				continue;
+		}
+	}
+
+	return Undecided(filter.matchType, filter.filters.empty());
+}
+
+namespace {
+// Aho-Corasick automaton finding all occurrences of a set of literals in a
+// single pass over the subject. For each literal, records whether it occurs
+// at all, at the start, at the end or as the whole subject.
+class literal_matcher final
+{
+public:
+	enum : uint8_t
+	{
+		found = 0x1,
+		at_start = 0x2,
+		at_end = 0x4,
+		whole = 0x8
+	};
+
+	// Returns the index of the literal
+	uint32_t add(std::wstring const& literal);
+
+	// To be called once all literals are added. The flags of the literals
+	// start at the given offset.
+	void build(uint32_t first);
+
+	uint32_t first() const { return first_; }
+	uint32_t size() const { return static_cast<uint32_t>(lengths_.size()); }
+
+	// Sets the flags of all literals
+	void match(std::wstring const& subject, uint8_t * flags) const;
+
+private:
+	struct node final
+	{
+		uint32_t fail{};
+
+		// Ranges in edges_ and outputs_
+		uint32_t edgeFirst{};
+		uint32_t edgeCount{};
+		uint32_t outFirst{};
+		uint32_t outCount{};
+	};
+
+	uint32_t next(uint32_t state, wchar_t c) const;
+	uint32_t child(uint32_t state, wchar_t c) const;
+
+	uint32_t first_{};
+	std::vector<size_t> lengths_;
+
+	// Only needed while adding literals
+	std::vector<std::map<wchar_t, uint32_t>> trie_{1};
+	std::vector<std::vector<uint32_t>> trieOut_{1};
+
+	std::vector<node> nodes_;
+	std::vector<std::pair<wchar_t, uint32_t>> edges_; // Sorted per node
+	std::vector<uint32_t> outputs_; // Literal indexes
+
+	// Complete transitions for ASCII characters, 128 per node, so that the
+	// common case needs neither a search nor failure links. Left empty for
+	// very large automatons.
+	std::vector<uint32_t> ascii_;
+};
+
+size_t const max_ascii_nodes = 4096;
+
+uint32_t literal_matcher::add(std::wstring const& literal)
+{
+	uint32_t state = 0;
+	for (wchar_t const c : literal) {
+		auto it = trie_[state].find(c);
+		if (it == trie_[state].end()) {
+			it = trie_[state].emplace(c, static_cast<uint32_t>(trie_.size())).first;
+			trie_.emplace_back();
+			trieOut_.emplace_back();
+		}
+		state = it->second;
+	}
+	trieOut_[state].push_back(static_cast<uint32_t>(lengths_.size()));
+	lengths_.push_back(literal.size());
+	return static_cast<uint32_t>(lengths_.size() - 1);
+}
+
+void literal_matcher::build(uint32_t first)
+{
+	first_ = first;
+	nodes_.resize(trie_.size());
+	for (size_t i = 0; i < trie_.size(); ++i) {
+		nodes_[i].edgeFirst = static_cast<uint32_t>(edges_.size());
+		nodes_[i].edgeCount = static_cast<uint32_t>(trie_[i].size());
+		edges_.insert(edges_.end(), trie_[i].cbegin(), trie_[i].cend());
+	}
+
+	// Breadth-first, so that the failure link of a node, always of lower
+	// depth, is complete before the node itself. Each node outputs its own
+	// literals followed by those of its failure link.
+	bool const ascii = nodes_.size() <= max_ascii_nodes;
+	if (ascii) {
+		ascii_.resize(nodes_.size() * 128);
+	}
+
+	std::vector<uint32_t> queue{0};
+	for (size_t i = 0; i < queue.size(); ++i) {
+		uint32_t const state = queue[i];
+		node & n = nodes_[state];
+
+		if (ascii) {
+			for (wchar_t c = 0; c < 128; ++c) {
+				uint32_t const s = child(state, c);
+				ascii_[state * 128 + c] = (s || !state) ? s : ascii_[n.fail * 128 + c];
 			}
+		}
 
-			{
-				int flag = 0;
-				switch (condition.condition)
-				{
-				case 0:
-					flag = FILE_ATTRIBUTE_ARCHIVE;
-					break;
-				case 1:
-					flag = FILE_ATTRIBUTE_COMPRESSED;
-					break;
-				case 2:
-					flag = FILE_ATTRIBUTE_ENCRYPTED;
-					break;
-				case 3:
-					flag = FILE_ATTRIBUTE_HIDDEN;
-					break;
-				case 4:
-					flag = FILE_ATTRIBUTE_READONLY;
-					break;
-				case 5:
-					flag = FILE_ATTRIBUTE_SYSTEM;
-					break;
+		n.outFirst = static_cast<uint32_t>(outputs_.size());
+		outputs_.insert(outputs_.end(), trieOut_[state].cbegin(), trieOut_[state].cend());
+		if (state) {
+			node const& f = nodes_[n.fail];
+			for (uint32_t o = f.outFirst; o < f.outFirst + f.outCount; ++o) {
+				outputs_.push_back(outputs_[o]);
+			}
+		}
+		n.outCount = static_cast<uint32_t>(outputs_.size()) - n.outFirst;
+
+		for (auto const& edge : trie_[state]) {
+			nodes_[edge.second].fail = state ? next(n.fail, edge.first) : 0;
+			queue.push_back(edge.second);
+		}
+	}
+
+	trie_.clear();
+	trieOut_.clear();
+}
+
+uint32_t literal_matcher::child(uint32_t state, wchar_t c) const
+{
+	node const& n = nodes_[state];
+	auto const begin = edges_.cbegin() + n.edgeFirst;
+	auto const end = begin + n.edgeCount;
+	auto const it = std::lower_bound(begin, end, c, [](std::pair<wchar_t, uint32_t> const& edge, wchar_t v) { return edge.first < v; });
+	if (it != end && it->first == c) {
+		return it->second;
+	}
+	return 0;
+}
+
+uint32_t literal_matcher::next(uint32_t state, wchar_t c) const
+{
+	if (!ascii_.empty() && static_cast<std::make_unsigned_t<wchar_t>>(c) < 128) {
+		return ascii_[state * 128 + c];
+	}
+
+	for (;;) {
+		uint32_t const s = child(state, c);
+		if (s || !state) {
+			return s;
+		}
+		state = nodes_[state].fail;
+	}
+}
+
+void literal_matcher::match(std::wstring const& subject, uint8_t * flags) const
+{
+	std::fill(flags + first_, flags + first_ + lengths_.size(), 0);
+
+	size_t const size = subject.size();
+	uint32_t state = 0;
+	for (size_t i = 0; i < size; ++i) {
+		state = next(state, subject[i]);
+
+		node const& n = nodes_[state];
+		for (uint32_t o = n.outFirst; o < n.outFirst + n.outCount; ++o) {
+			uint32_t const literal = outputs_[o];
+			uint8_t f = found;
+			if (i + 1 == lengths_[literal]) {
+				f |= at_start;
+			}
+			if (i + 1 == size) {
+				f |= at_end;
+			}
+			if (f == (found | at_start | at_end)) {
+				f |= whole;
+			}
+			flags[first_ + literal] |= f;
+		}
+	}
+}
+
+// The literal conditions on names and paths, with and without matching case
+enum : size_t
+{
+	name_case,
+	name_nocase,
+	path_case,
+	path_nocase,
+	matcher_count
+};
+}
+
+struct CFilterProgram::data final
+{
+	std::vector<CFilter> source;
+
+	struct condition final
+	{
+		CFilterCondition const* condition{};
+
+		// If set, the condition is a literal found by a matcher
+		size_t matcher{matcher_count};
+		uint32_t literal{};
+	};
+
+	struct filter final
+	{
+		CFilter const* source{};
+
+		// Ordered cheapest first
+		std::vector<condition> conditions;
+	};
+	std::vector<filter> filters;
+
+	literal_matcher matchers[matcher_count];
+	uint32_t literals{};
+};
+
+CFilterProgram::CFilterProgram(std::vector<CFilter> const& filters)
+{
+	if (filters.empty()) {
+		return;
+	}
+
+	auto d = std::make_shared<data>();
+	d->source = filters;
+
+	for (auto const& source : d->source) {
+		data::filter f;
+		f.source = &source;
+		for (int pass = 0; pass < 3; ++pass) {
+			for (auto const& condition : source.filters) {
+				if (EvaluationPass(condition) != pass) {
+					continue;
 				}
 
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
+				data::condition c;
+				c.condition = &condition;
+
+				// Empty literals, e.g. from the regular expression ^$, cannot be found by the matchers
+				if (pass == 1 && !condition.matchValue.empty()) {
+					size_t const field = condition.type == filter_name ? name_case : path_case;
+					if (source.matchCase) {
+						c.matcher = field;
+						c.literal = d->matchers[c.matcher].add(condition.matchValue);
+					}
+					else {
+						c.matcher = field + 1;
+						c.literal = d->matchers[c.matcher].add(condition.lowerValue);
+					}
 				}
+				f.conditions.push_back(c);
 			}
-#endif //__WXMSW__
-			break;
-		case filter_permissions:
-#ifdef __WXMSW__
+		}
+		d->filters.push_back(std::move(f));
+	}
+
+	for (auto & matcher : d->matchers) {
+		matcher.build(d->literals);
+		d->literals += matcher.size();
+	}
+
+	data_ = std::move(d);
+}
+
+bool CFilterProgram::Filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const
+{
+	if (!data_) {
+		return false;
+	}
+
+	// Flags of all literals, each matcher runs at most once per entry
+	thread_local std::vector<uint8_t> flags;
+	if (flags.size() < data_->literals) {
+		flags.resize(data_->literals);
+	}
+	bool matched[matcher_count]{};
+
+	CFilterSubject subject(name, path);
+
+	for (auto const& f : data_->filters) {
+		CFilter const& filter = *f.source;
+		if (dir ? !filter.filterDirs : !filter.filterFiles) {
 			continue;
-#else
-			if (attributes == -1) {
-				continue;
-			}
+		}
 
-			{
-				int flag = 0;
-				switch (condition.condition)
-				{
+		bool filtered{};
+		bool decided{};
+		for (auto const& c : f.conditions) {
+			int match;
+			if (c.matcher != matcher_count) {
+				auto const& matcher = data_->matchers[c.matcher];
+				if (!matched[c.matcher]) {
+					switch (c.matcher) {
+					case name_case:
+						matcher.match(subject.name.value, flags.data());
+						break;
+					case name_nocase:
+						matcher.match(subject.name.lower(), flags.data());
+						break;
+					case path_case:
+						matcher.match(subject.path.value, flags.data());
+						break;
+					default:
+						matcher.match(subject.path.lower(), flags.data());
+						break;
+					}
+					matched[c.matcher] = true;
+				}
+
+				uint8_t const flag = flags[matcher.first() + c.literal];
+				switch (c.condition->matchCondition) {
 				case 0:
-					flag = S_IRUSR;
+					match = (flag & literal_matcher::found) ? 1 : 0;
 					break;
 				case 1:
-					flag = S_IWUSR;
+					match = (flag & literal_matcher::whole) ? 1 : 0;
 					break;
 				case 2:
-					flag = S_IXUSR;
+					match = (flag & literal_matcher::at_start) ? 1 : 0;
 					break;
 				case 3:
-					flag = S_IRGRP;
-					break;
-				case 4:
-					flag = S_IWGRP;
+					match = (flag & literal_matcher::at_end) ? 1 : 0;
 					break;
 				case 5:
-					flag = S_IXGRP;
-					break;
-				case 6:
-					flag = S_IROTH;
-					break;
-				case 7:
-					flag = S_IWOTH;
+					match = (flag & literal_matcher::found) ? 0 : 1;
 					break;
-				case 8:
-					flag = S_IXOTH;
-					break;
-				}
-
-				int set = (flag & attributes) ? 1 : 0;
-				if (set == condition.value) {
-					match = true;
-				}
-			}
-#endif //__WXMSW__
-			break;
-		case filter_date:
-			if (!date.empty()) {
-				int cmp = date.compare(condition.date);
-				switch (condition.condition)
-				{
-				case 0: // Before
-					match = cmp < 0;
-					break;
-				case 1: // Equals
-					match = cmp == 0;
-					break;
-				case 2: // Not equals
-					match = cmp != 0;
-					break;
-				case 3: // After
-					match = cmp > 0;
+				default:
+					match = 0;
 					break;
 				}
 			}
-			break;
-		default:
-			wxFAIL_MSG(_T("Unhandled filter type"));
-			break;
-		}
-		if (match) {
-			if (filter.matchType == CFilter::any) {
-				return true;
-			}
-			else if (filter.matchType == CFilter::none) {
-				return false;
-			}
-		}
-		else {
-			if (filter.matchType == CFilter::all) {
-				return false;
+			else {
+				match = MatchCondition(*c.condition, subject, filter.matchCase, size, attributes, date);
 			}
-			else if (filter.matchType == CFilter::not_all) {
-				return true;
+
+			if (match != -1 && Decided(filter.matchType, match != 0, filtered)) {
+				decided = true;
+				break;
 			}
 		}
-	}
-
-	if (filter.matchType == CFilter::not_all) {
-		return false;
-	}
 
-	if (filter.matchType != CFilter::any || filter.filters.empty()) {
-		return true;
+		if (!decided) {
+			filtered = Undecided(filter.matchType, filter.filters.empty());
+		}
+		if (filtered) {
+			return true;
+		}
 	}
 
 	return false;
@@ -897,6 +1352,8 @@ void CFilterManager::Import(pugi::xml_node& element)
 
 void CFilterManager::LoadFilters(pugi::xml_node& element)
 {
+	InvalidatePrograms();
+
 	auto xFilters = element.child("Filters");
 	if (xFilters) {
 
@@ -1096,23 +1553,9 @@ bool CFilterManager::HasActiveRemoteFilters() const
 
 ActiveFilters CFilterManager::GetActiveFilters()
 {
-	ActiveFilters filters;
-
 	if (m_filters_disabled) {
-		return filters;
-	}
-
-	const CFilterSet& set = m_globalFilterSets[m_globalCurrentFilterSet];
-
-	// Check active filters
-	for (unsigned int i = 0; i < m_globalFilters.size(); ++i) {
-		if (set.local[i]) {
-			filters.first.push_back(m_globalFilters[i]);
-		}
-		if (set.remote[i]) {
-			filters.second.push_back(m_globalFilters[i]);
-		}
+		return ActiveFilters();
 	}
 
-	return filters;
+	return ActiveFilters(GetProgram(true), GetProgram(false));
 }
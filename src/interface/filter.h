@@ -29,6 +29,7 @@ public:
 	bool set(t_filterType t, std::wstring const& v, int c, bool matchCase);
 
 	std::wstring strValue;
+	std::wstring matchValue; // Name and path matches
 	std::wstring lowerValue; // Name and path matches
 	fz::datetime date; // If type is date
 	int64_t value{}; // If type is size
@@ -36,6 +37,11 @@ public:
 
 	t_filterType type{filter_name};
 	int condition{};
+
+	// Condition actually evaluated. Regular expressions that are just an
+	// optionally anchored literal are matched like the equivalent literal
+	// condition, with the unescaped literal in matchValue.
+	int matchCondition{};
 };
 
 class CFilter
@@ -81,7 +87,64 @@ public:
 	std::vector<bool> remote;
 };
 
-typedef std::pair<std::vector<CFilter>, std::vector<CFilter>> ActiveFilters;
+// A list of filters compiled once for evaluating many entries.
+//
+// The literal name and path conditions of all filters are found in a single
+// pass over the name and the path by a multi-pattern matcher, instead of
+// searching each literal on its own. Conditions of each filter are evaluated
+// cheapest first: size, attributes and date, then literals, regular
+// expressions last.
+//
+// Compiled programs are immutable, copies are cheap and can be used from
+// any thread.
+class CFilterProgram final
+{
+public:
+	CFilterProgram() = default;
+	explicit CFilterProgram(std::vector<CFilter> const& filters);
+
+	bool empty() const { return !data_; }
+
+	// True if any of the filters matches the entry
+	bool Filtered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const;
+
+private:
+	struct data;
+	std::shared_ptr<data const> data_;
+};
+
+typedef std::pair<CFilterProgram, CFilterProgram> ActiveFilters;
+
+// Name and path of an entry being filtered. The lowercased variants needed
+// by case-insensitive conditions are computed at most once per entry, no
+// matter how many filters are checked.
+class CFilterSubject final
+{
+public:
+	CFilterSubject(std::wstring const& n, std::wstring const& p)
+		: name(n)
+		, path(p)
+	{}
+
+	class field final
+	{
+	public:
+		explicit field(std::wstring const& v)
+			: value(v)
+		{}
+
+		std::wstring const& lower();
+
+		std::wstring const& value;
+
+	private:
+		std::wstring lower_;
+		bool lowered_{};
+	};
+
+	field name;
+	field path;
+};
 
 namespace pugi { class xml_node; }
 class CFilterManager
@@ -92,7 +155,7 @@ public:
 
 	// Note: Under non-windows, attributes are permissions
 	virtual bool FilenameFiltered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, bool local, int attributes, fz::datetime const& date) const;
-	bool FilenameFiltered(std::vector<CFilter> const& filters, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const;
+	bool FilenameFiltered(CFilterProgram const& filters, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date) const;
 	static bool FilenameFilteredByFilter(CFilter const& filter, std::wstring const& name, std::wstring const& path, bool dir, int64_t size, int attributes, fz::datetime const& date);
 	static bool HasActiveFilters(bool ignore_disabled = false);
 
@@ -110,6 +173,8 @@ public:
 	static void SaveFilter(pugi::xml_node& element, const CFilter& filter);
 
 protected:
+	static bool FilteredByFilter(CFilter const& filter, CFilterSubject & subject, bool dir, int64_t size, int attributes, fz::datetime const& date);
+
 	static void LoadFilters();
 	static void LoadFilters(pugi::xml_node& element);
 	static void SaveFilters();
@@ -122,6 +187,14 @@ protected:
 	static unsigned int m_globalCurrentFilterSet;
 
 	static bool m_filters_disabled;
+
+	// Compiled from the active local and remote filters of the current set,
+	// rebuilt on demand after the filters changed.
+	static CFilterProgram const& GetProgram(bool local);
+	static void InvalidatePrograms();
+
+	static CFilterProgram m_globalPrograms[2];
+	static bool m_globalProgramsValid;
 };
 
 class CMainFrame;
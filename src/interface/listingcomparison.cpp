@@ -62,12 +62,23 @@ void CComparableListing::RefreshComparison()
 	m_pComparisonManager->CompareListings();
 }
 
+void CComparableListing::RefreshComparisonItem(int item)
+{
+	if (!m_pComparisonManager || !IsComparing()) {
+		return;
+	}
+
+	m_pComparisonManager->UpdateItem(*this, item);
+}
+
 bool CComparisonManager::CompareListings()
 {
 	if (!m_pLeft || !m_pRight) {
 		return false;
 	}
 
+	CancelComparison();
+
 	CFilterManager filters;
 	if (filters.HasActiveFilters() && !filters.HasSameLocalAndRemoteFilters()) {
 		m_state.NotifyHandlers(STATECHANGE_COMPARISON);
@@ -85,106 +96,236 @@ bool CComparisonManager::CompareListings()
 		return true;
 	}
 
-	const int mode = COptions::Get()->GetOptionVal(OPTION_COMPARISONMODE);
-	fz::duration const threshold = fz::duration::from_minutes( COptions::Get()->GetOptionVal(OPTION_COMPARISON_THRESHOLD) );
+	m_options.mode = COptions::Get()->GetOptionVal(OPTION_COMPARISONMODE);
+	m_options.threshold = fz::duration::from_minutes( COptions::Get()->GetOptionVal(OPTION_COMPARISON_THRESHOLD) );
+	m_options.dirSortMode = COptions::Get()->GetOptionVal(OPTION_FILELIST_DIRSORT);
+	m_options.hideIdentical = COptions::Get()->GetOptionVal(OPTION_COMPARE_HIDEIDENTICAL) != 0;
 
 	m_pLeft->StartComparison();
 	m_pRight->StartComparison();
 
-	std::wstring localFile, remoteFile;
-	bool localDir = false;
-	bool remoteDir = false;
-	int64_t localSize, remoteSize;
-	fz::datetime localDate, remoteDate;
+	// The listings keep showing their current contents while the worker
+	// merges snapshots of them.
+	std::vector<CComparableListing::entry> left, right;
+	CComparableListing::entry e;
+	while (m_pLeft->get_next_file(e)) {
+		left.emplace_back(std::move(e));
+	}
+	while (m_pRight->get_next_file(e)) {
+		right.emplace_back(std::move(e));
+	}
+
+	m_task = m_state.pool_.spawn([this, left = std::move(left), right = std::move(right)]() {
+		Merge(left, right);
+	});
+	if (!m_task) {
+		m_isComparing = false;
+		m_state.NotifyHandlers(STATECHANGE_COMPARISON);
+		return false;
+	}
+
+	return true;
+}
 
-	const int dirSortMode = COptions::Get()->GetOptionVal(OPTION_FILELIST_DIRSORT);
+void CComparisonManager::CancelComparison()
+{
+	{
+		fz::scoped_lock l(m_mutex);
+		m_cancelled = true;
+	}
 
-	const bool hide_identical = COptions::Get()->GetOptionVal(OPTION_COMPARE_HIDEIDENTICAL) != 0;
+	m_task.join();
 
-	bool gotLocal = m_pLeft->get_next_file(localFile, localDir, localSize, localDate);
-	bool gotRemote = m_pRight->get_next_file(remoteFile, remoteDir, remoteSize, remoteDate);
+	fz::scoped_lock l(m_mutex);
+	m_cancelled = false;
+	m_results.clear();
+}
 
-	while (gotLocal && gotRemote) {
-		int cmp = CompareFiles(dirSortMode, localFile, remoteFile, localDir, remoteDir);
-		if (!cmp) {
-			if (!mode) {
-				const CComparableListing::t_fileEntryFlags flag = (localDir || localSize == remoteSize) ? CComparableListing::normal : CComparableListing::different;
+void CComparisonManager::Merge(std::vector<CComparableListing::entry> const& left, std::vector<CComparableListing::entry> const& right)
+{
+	size_t const chunkSize = 10000;
 
-				if (!hide_identical || flag != CComparableListing::normal || localFile == L"..") {
-					m_pLeft->CompareAddFile(flag);
-					m_pRight->CompareAddFile(flag);
-				}
-			}
-			else {
-				if (localDate.empty() || remoteDate.empty()) {
-					if (!hide_identical || !localDate.empty() || !remoteDate.empty() || localFile == L"..") {
-						const CComparableListing::t_fileEntryFlags flag = CComparableListing::normal;
-						m_pLeft->CompareAddFile(flag);
-						m_pRight->CompareAddFile(flag);
-					}
-				}
-				else {
-					CComparableListing::t_fileEntryFlags localFlag, remoteFlag;
-
-					int dateCmp = localDate.compare(remoteDate);
-					if (dateCmp < 0) {
-						localDate += threshold;
-					}
-					else if (dateCmp > 0 ) {
-						remoteDate += threshold;
-					}
-					int adjustedDateCmp = localDate.compare(remoteDate);
-					if (dateCmp && dateCmp == -adjustedDateCmp) {
-						dateCmp = 0;
-					}
-
-					localFlag = CComparableListing::normal;
-					remoteFlag = CComparableListing::normal;
-					if (dateCmp < 0 ) {
-						remoteFlag = CComparableListing::newer;
-					}
-					else if (dateCmp > 0) {
-						localFlag = CComparableListing::newer;
-					}
-					if (!hide_identical || localFlag != CComparableListing::normal || remoteFlag != CComparableListing::normal || localFile == L"..") {
-						m_pLeft->CompareAddFile(localFlag);
-						m_pRight->CompareAddFile(remoteFlag);
-					}
-				}
+	std::vector<row> rows;
+	rows.reserve(chunkSize);
+
+	auto add = [&](CComparableListing::t_fileEntryFlags leftFlag, size_t leftPosition, CComparableListing::t_fileEntryFlags rightFlag, size_t rightPosition) {
+		rows.push_back({leftFlag, rightFlag, leftPosition, rightPosition});
+		if (rows.size() >= chunkSize) {
+			if (!AddResults(std::move(rows))) {
+				return false;
 			}
-			gotLocal = m_pLeft->get_next_file(localFile, localDir, localSize, localDate);
-			gotRemote = m_pRight->get_next_file(remoteFile, remoteDir, remoteSize, remoteDate);
-			continue;
+			rows.clear();
+			rows.reserve(chunkSize);
 		}
+		return true;
+	};
 
-		if (cmp < 0) {
-			m_pLeft->CompareAddFile(CComparableListing::lonely);
-			m_pRight->CompareAddFile(CComparableListing::fill);
-			gotLocal = m_pLeft->get_next_file(localFile, localDir, localSize, localDate);
+	size_t l = 0;
+	size_t r = 0;
+	bool ok = true;
+	while (ok && l < left.size() && r < right.size()) {
+		int cmp = CompareFiles(m_options.dirSortMode, left[l].name, right[r].name, left[l].dir, right[r].dir);
+		if (!cmp) {
+			CComparableListing::t_fileEntryFlags leftFlag, rightFlag;
+			if (CompareEntries(m_options, left[l], right[r], leftFlag, rightFlag)) {
+				ok = add(leftFlag, l, rightFlag, r);
+			}
+			++l;
+			++r;
+		}
+		else if (cmp < 0) {
+			ok = add(CComparableListing::lonely, l++, CComparableListing::fill, 0);
 		}
 		else {
-			m_pLeft->CompareAddFile(CComparableListing::fill);
-			m_pRight->CompareAddFile(CComparableListing::lonely);
-			gotRemote = m_pRight->get_next_file(remoteFile, remoteDir, remoteSize, remoteDate);
+			ok = add(CComparableListing::fill, 0, CComparableListing::lonely, r++);
 		}
 	}
-	while (gotLocal) {
-		m_pLeft->CompareAddFile(CComparableListing::lonely);
-		m_pRight->CompareAddFile(CComparableListing::fill);
-		gotLocal = m_pLeft->get_next_file(localFile, localDir, localSize, localDate);
+	while (ok && l < left.size()) {
+		ok = add(CComparableListing::lonely, l++, CComparableListing::fill, 0);
 	}
-	while (gotRemote) {
-		m_pLeft->CompareAddFile(CComparableListing::fill);
-		m_pRight->CompareAddFile(CComparableListing::lonely);
-		gotRemote = m_pRight->get_next_file(remoteFile, remoteDir, remoteSize, remoteDate);
+	while (ok && r < right.size()) {
+		ok = add(CComparableListing::fill, 0, CComparableListing::lonely, r++);
 	}
 
-	m_pRight->FinishComparison();
-	m_pLeft->FinishComparison();
+	if (ok && !rows.empty()) {
+		ok = AddResults(std::move(rows));
+	}
+	if (ok) {
+		AddResults(std::vector<row>());
+	}
+}
+
+bool CComparisonManager::AddResults(std::vector<row> && rows)
+{
+	fz::scoped_lock l(m_mutex);
+	if (m_cancelled) {
+		return false;
+	}
+
+	m_results.emplace_back(std::move(rows));
+
+	// Hand off to GUI thread
+	if (m_results.size() == 1) {
+		CallAfter(&CComparisonManager::OnResults);
+	}
 
 	return true;
 }
 
+void CComparisonManager::OnResults()
+{
+	if (!m_isComparing || !m_pLeft || !m_pRight) {
+		return;
+	}
+
+	bool finished = false;
+	while (!finished) {
+		std::vector<row> rows;
+		{
+			fz::scoped_lock l(m_mutex);
+			if (m_results.empty()) {
+				break;
+			}
+			rows = std::move(m_results.front());
+			m_results.pop_front();
+		}
+
+		if (rows.empty()) {
+			finished = true;
+		}
+
+		for (auto const& r : rows) {
+			m_pLeft->CompareAddFile(r.leftFlag, r.leftPosition);
+			m_pRight->CompareAddFile(r.rightFlag, r.rightPosition);
+		}
+	}
+
+	if (finished) {
+		m_task.join();
+
+		m_pRight->FinishComparison();
+		m_pLeft->FinishComparison();
+	}
+}
+
+bool CComparisonManager::CompareEntries(options const& o, CComparableListing::entry const& left, CComparableListing::entry const& right,
+	CComparableListing::t_fileEntryFlags & leftFlag, CComparableListing::t_fileEntryFlags & rightFlag)
+{
+	if (!o.mode) {
+		leftFlag = (left.dir || left.size == right.size) ? CComparableListing::normal : CComparableListing::different;
+		rightFlag = leftFlag;
+
+		return !o.hideIdentical || leftFlag != CComparableListing::normal || left.name == L"..";
+	}
+
+	leftFlag = CComparableListing::normal;
+	rightFlag = CComparableListing::normal;
+
+	if (left.date.empty() || right.date.empty()) {
+		return !o.hideIdentical || !left.date.empty() || !right.date.empty() || left.name == L"..";
+	}
+
+	fz::datetime leftDate = left.date;
+	fz::datetime rightDate = right.date;
+
+	int dateCmp = leftDate.compare(rightDate);
+	if (dateCmp < 0) {
+		leftDate += o.threshold;
+	}
+	else if (dateCmp > 0) {
+		rightDate += o.threshold;
+	}
+	int adjustedDateCmp = leftDate.compare(rightDate);
+	if (dateCmp && dateCmp == -adjustedDateCmp) {
+		dateCmp = 0;
+	}
+
+	if (dateCmp < 0) {
+		rightFlag = CComparableListing::newer;
+	}
+	else if (dateCmp > 0) {
+		leftFlag = CComparableListing::newer;
+	}
+
+	return !o.hideIdentical || leftFlag != CComparableListing::normal || rightFlag != CComparableListing::normal || left.name == L"..";
+}
+
+void CComparisonManager::UpdateItem(CComparableListing& listing, int item)
+{
+	CComparableListing* pOther = listing.GetOther();
+	if (!pOther) {
+		return;
+	}
+
+	bool const running = static_cast<bool>(m_task);
+	if (running || item < 0) {
+		CompareListings();
+		return;
+	}
+
+	CComparableListing::entry e, other;
+	if (!listing.GetComparisonItem(item, e)) {
+		return;
+	}
+	if (!pOther->GetComparisonItem(item, other)) {
+		// Lonely items stay lonely
+		return;
+	}
+
+	CComparableListing::entry const& left = (&listing == m_pLeft) ? e : other;
+	CComparableListing::entry const& right = (&listing == m_pLeft) ? other : e;
+
+	CComparableListing::t_fileEntryFlags leftFlag, rightFlag;
+	if (left.dir != right.dir || !CompareEntries(m_options, left, right, leftFlag, rightFlag)) {
+		// Item either needs to be moved or hidden
+		CompareListings();
+		return;
+	}
+
+	m_pLeft->SetComparisonFlags(item, leftFlag);
+	m_pRight->SetComparisonFlags(item, rightFlag);
+}
+
 int CComparisonManager::CompareFiles(const int dirSortMode, std::wstring const& local, std::wstring const& remote, bool localDir, bool remoteDir)
 {
 	switch (dirSortMode)
@@ -213,11 +354,55 @@ int CComparisonManager::CompareFiles(const int dirSortMode, std::wstring const&
 	return 0;
 }
 
+CSyncComparator::CSyncComparator()
+	: threshold_(fz::duration::from_minutes(COptions::Get()->GetOptionVal(OPTION_COMPARISON_THRESHOLD)))
+{
+}
+
+CSyncComparator::action CSyncComparator::Compare(int64_t sourceSize, fz::datetime const& sourceTime, int64_t targetSize, fz::datetime const& targetTime) const
+{
+	bool const haveTimes = !sourceTime.empty() && !targetTime.empty();
+
+	if (sourceSize >= 0 && targetSize >= 0) {
+		if (sourceSize != targetSize) {
+			return action::transfer;
+		}
+
+		// Same size and same time within the threshold: Unchanged
+		if (haveTimes) {
+			fz::datetime later = targetTime;
+			later += threshold_;
+			fz::datetime earlier = targetTime;
+			earlier -= threshold_;
+			if (sourceTime.compare(later) <= 0 && sourceTime.compare(earlier) >= 0) {
+				return action::skip;
+			}
+		}
+
+		// Could still be the same, let the engine compare checksums
+		return action::compare;
+	}
+
+	if (haveTimes) {
+		fz::datetime adjusted = targetTime;
+		adjusted += threshold_;
+		return sourceTime.compare(adjusted) > 0 ? action::transfer : action::skip;
+	}
+
+	// Without any information, be safe and transfer
+	return action::transfer;
+}
+
 CComparisonManager::CComparisonManager(CState& state)
 	: m_state(state)
 {
 }
 
+CComparisonManager::~CComparisonManager()
+{
+	CancelComparison();
+}
+
 void CComparisonManager::SetListings(CComparableListing* pLeft, CComparableListing* pRight)
 {
 	wxASSERT((pLeft && pRight) || (!pLeft && !pRight));
@@ -250,6 +435,8 @@ void CComparisonManager::ExitComparisonMode()
 		return;
 	}
 
+	CancelComparison();
+
 	m_isComparing = false;
 	if (m_pLeft) {
 		m_pLeft->OnExitComparisonMode();
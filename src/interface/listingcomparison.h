@@ -1,6 +1,10 @@
 #ifndef FILEZILLA_INTERFACE_LISTINGCOMPARISON_HEADER
 #define FILEZILLA_INTERFACE_LISTINGCOMPARISON_HEADER
 
+#include <libfilezilla/thread_pool.hpp>
+
+#include <deque>
+
 class CComparisonManager;
 class CComparableListing
 {
@@ -18,17 +22,36 @@ public:
 		lonely
 	};
 
+	class entry final
+	{
+	public:
+		std::wstring name;
+		int64_t size{-1};
+		fz::datetime date;
+		bool dir{};
+	};
+
 	virtual bool CanStartComparison() = 0;
 	virtual void StartComparison() = 0;
-	virtual bool get_next_file(std::wstring & name, bool &dir, int64_t &size, fz::datetime& date) = 0;
-	virtual void CompareAddFile(t_fileEntryFlags flags) = 0;
+	virtual bool get_next_file(entry & e) = 0;
+
+	// Position is the number of the entry as returned by get_next_file, it is ignored for fill entries.
+	virtual void CompareAddFile(t_fileEntryFlags flags, size_t position) = 0;
 	virtual void FinishComparison() = 0;
+
+	// Access to the items of a finished comparison. GetComparisonItem returns false for fill items.
+	virtual bool GetComparisonItem(int item, entry & e) = 0;
+	virtual void SetComparisonFlags(int item, t_fileEntryFlags flags) = 0;
+
 	virtual void ScrollTopItem(int item) = 0;
 	virtual void OnExitComparisonMode() = 0;
 
 	void RefreshComparison();
 	void ExitComparisonMode();
 
+	// Call after the entry shown in the given item has changed without affecting the sort order
+	void RefreshComparisonItem(int item);
+
 	bool IsComparing() const;
 
 	void SetOther(CComparableListing* pOther) { m_pOther = pOther; }
@@ -45,12 +68,39 @@ private:
 	CComparisonManager* m_pComparisonManager;
 };
 
+// Decides whether a file has to be transferred during synchronization.
+// Files of equal size and with times within the comparison threshold are
+// skipped. Other files of equal size are compared by content when
+// transferring, see CFileExistsNotification::overwriteChanged.
+class CSyncComparator final
+{
+public:
+	CSyncComparator();
+
+	enum class action
+	{
+		skip,
+		transfer,
+		compare
+	};
+
+	// A size of -1 or an empty date means unknown
+	action Compare(int64_t sourceSize, fz::datetime const& sourceTime, int64_t targetSize, fz::datetime const& targetTime) const;
+
+private:
+	fz::duration threshold_;
+};
+
 class CState;
-class CComparisonManager
+class CComparisonManager final : public wxEvtHandler
 {
 public:
 	CComparisonManager(CState& state);
+	virtual ~CComparisonManager();
 
+	// Takes snapshots of both listings and merges them on a worker thread.
+	// Results are handed back to the listings in chunks, once all have been
+	// added, FinishComparison is called.
 	bool CompareListings();
 	bool IsComparing() const { return m_isComparing; }
 
@@ -58,8 +108,40 @@ public:
 
 	void SetListings(CComparableListing* pLeft, CComparableListing* pRight);
 
+	// Updates the flags of a single item of a finished comparison and its
+	// counterpart in the other listing.
+	void UpdateItem(CComparableListing& listing, int item);
+
 protected:
-	int CompareFiles(const int dirSortMode, std::wstring const& local, std::wstring const& remote, bool localDir, bool remoteDir);
+	struct options final
+	{
+		int mode{};
+		int dirSortMode{};
+		bool hideIdentical{};
+		fz::duration threshold;
+	};
+
+	struct row final
+	{
+		CComparableListing::t_fileEntryFlags leftFlag;
+		CComparableListing::t_fileEntryFlags rightFlag;
+		size_t leftPosition;
+		size_t rightPosition;
+	};
+
+	static int CompareFiles(const int dirSortMode, std::wstring const& local, std::wstring const& remote, bool localDir, bool remoteDir);
+
+	// Returns false if the entries are identical and should be hidden
+	static bool CompareEntries(options const& o, CComparableListing::entry const& left, CComparableListing::entry const& right,
+		CComparableListing::t_fileEntryFlags & leftFlag, CComparableListing::t_fileEntryFlags & rightFlag);
+
+	void CancelComparison();
+
+	// Runs on the worker thread
+	void Merge(std::vector<CComparableListing::entry> const& left, std::vector<CComparableListing::entry> const& right);
+	bool AddResults(std::vector<row> && rows);
+
+	void OnResults();
 
 	CState& m_state;
 
@@ -68,6 +150,15 @@ protected:
 	CComparableListing* m_pRight{};
 
 	bool m_isComparing{};
+
+	options m_options;
+
+	fz::async_task m_task;
+	fz::mutex m_mutex;
+	bool m_cancelled{};
+
+	// An empty chunk marks the end of the results
+	std::deque<std::vector<row>> m_results;
 };
 
 #endif
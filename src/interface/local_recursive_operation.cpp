@@ -89,7 +89,7 @@ bool CLocalRecursiveOperation::DoStartRecursiveOperation(OperationMode mode, Act
 		}
 	}
 
-	if ((mode == CRecursiveOperation::recursive_transfer || mode == CRecursiveOperation::recursive_transfer_flatten) && immediate) {
+	if ((mode == CRecursiveOperation::recursive_transfer || mode == CRecursiveOperation::recursive_transfer_flatten || mode == CRecursiveOperation::recursive_synchronize_upload) && immediate) {
 		m_actionAfterBlocker = m_pQueue->GetActionAfterBlocker();
 	}
 
@@ -142,7 +142,7 @@ void CLocalRecursiveOperation::EnqueueEnumeratedListing(fz::scoped_lock& l, list
 
 		CServerPath remoteSub = d.remotePath;
 		if (!remoteSub.empty()) {
-			if (m_operationMode == recursive_transfer) {
+			if (m_operationMode == recursive_transfer || m_operationMode == recursive_synchronize_upload) {
 				// Non-flatten case
 				remoteSub.AddSegment(entry.name);
 			}
@@ -256,7 +256,7 @@ void CLocalRecursiveOperation::OnListedDirectory()
 		return;
 	}
 
-	bool const queue = m_operationMode == recursive_transfer || m_operationMode == recursive_transfer_flatten;
+	bool const queue = m_operationMode == recursive_transfer || m_operationMode == recursive_transfer_flatten || m_operationMode == recursive_synchronize_upload;
 
 	listing d;
 
@@ -278,7 +278,10 @@ void CLocalRecursiveOperation::OnListedDirectory()
 		}
 		else {
 			if (queue) {
-				m_pQueue->QueueFiles(!m_immediate, site_, d);
+				// When synchronizing, the engine decides whether to transfer each file once it
+				// looked up the remote file, that way it does not rely on a cached listing.
+				auto const existsAction = (m_operationMode == recursive_synchronize_upload) ? CFileExistsNotification::overwriteChanged : CFileExistsNotification::unknown;
+				m_pQueue->QueueFiles(!m_immediate, site_, d, existsAction);
 			}
 			++m_processedDirectories;
 			processed += d.files.size();
@@ -312,6 +312,9 @@ void CFileItem::SaveItem(pugi::xml_node& element) const
 		AddTextElement(file, "Priority", static_cast<int>(m_priority));
 	}
 	AddTextElementUtf8(file, "DataType", Ascii() ? "0" : "1");
+	if (Streaming()) {
+		AddTextElementUtf8(file, "StreamingIO", "1");
+	}
 	if (m_defaultFileExistsAction != CFileExistsNotification::unknown) {
 		AddTextElement(file, "OverwriteAction", m_defaultFileExistsAction);
 	}
@@ -358,7 +361,8 @@ wxString const& CFileItem::GetStatusMessage() const
 		_("Could not write to local file"),
 		_("Could not start transfer"),
 		_("Transferring"),
-		_("Creating directory")
+		_("Creating directory"),
+		_("Checksum mismatch")
 	};
 
 	return statusTexts[std::underlying_type_t<Status>(m_status)];
@@ -483,6 +487,16 @@ void CServerItem::SetDefaultFileExistsAction(CFileExistsNotification::OverwriteA
 	}
 }
 
+void CServerItem::SetStreaming(bool streaming)
+{
+	for (auto iter = m_children.begin() + m_removed_at_front; iter != m_children.end(); ++iter) {
+		CQueueItem *pItem = *iter;
+		if (pItem->GetType() == QueueItemType::File) {
+			static_cast<CFileItem*>(pItem)->SetStreaming(streaming);
+		}
+	}
+}
+
 void CServerItem::Sort(int col, bool reverse)
 {
 	auto const cmpLocalName = [](CFileItem const& l, CFileItem const& r) {
@@ -1593,8 +1607,6 @@ CQueue::CQueue(wxWindow* parent, CMainFrame *pMainFrame, CAsyncRequestQueue *pAs
 	AddPage(m_pQueueView_Successful, m_pQueueView_Successful->GetTitle());
 
 	RemoveExtraBorders();
-
-	m_pQueueView->LoadQueue();
 }
 
 void CQueue::SetFocus()
@@ -106,6 +106,7 @@ public:
 	virtual void SaveItem(pugi::xml_node& element) const;
 
 	void SetDefaultFileExistsAction(CFileExistsNotification::OverwriteAction action, const TransferDirection direction);
+	void SetStreaming(bool streaming);
 
 	void DetachChildren();
 
@@ -217,7 +218,8 @@ public:
 		local_file_unwriteable,
 		could_not_start,
 		transferring,
-		creating_dir
+		creating_dir,
+		checksum_mismatch
 	};
 
 	wxString const& GetStatusMessage() const;
@@ -237,7 +239,8 @@ protected:
 		flag_made_progress = 0x04,
 		flag_queued = 0x08,
 		flag_remove = 0x10,
-		flag_ascii = 0x20
+		flag_ascii = 0x20,
+		flag_streaming = 0x40
 	};
 	unsigned char flags{};
 	Status m_status{};
@@ -269,6 +272,19 @@ public:
 		}
 	}
 
+	// Keep the local file out of the page cache during the transfer
+	bool Streaming() const { return (flags & flag_streaming) != 0; }
+
+	void SetStreaming(bool streaming)
+	{
+		if (streaming) {
+			flags |= flag_streaming;
+		}
+		else {
+			flags &= ~flag_streaming;
+		}
+	}
+
 protected:
 	std::wstring const m_sourceFile;
 	fz::sparse_optional<std::wstring> m_targetFile;
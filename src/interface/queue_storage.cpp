@@ -94,7 +94,8 @@ namespace file_table_column_names
 		error_count,
 		priority,
 		ascii_file,
-		default_exists_action
+		default_exists_action,
+		streaming_io
 	};
 }
 
@@ -110,7 +111,8 @@ _column file_table_columns[] = {
 	{ "error_count", Column_type::integer, 0 },
 	{ "priority", Column_type::integer, 0 },
 	{ "ascii_file", Column_type::integer, 0 },
-	{ "default_exists_action", Column_type::integer, 0 }
+	{ "default_exists_action", Column_type::integer, 0 },
+	{ "streaming_io", Column_type::integer, 0 }
 };
 
 namespace path_table_column_names
@@ -295,7 +297,7 @@ bool CQueueStorage::Impl::MigrateSchema()
 	bool ret = sqlite3_exec(db_, "PRAGMA user_version", int_callback, &version, 0) == SQLITE_OK;
 
 	if (ret) {
-		if (version > 5) {
+		if (version > 6) {
 			ret = false;
 		}
 		else if (version > 0) {
@@ -309,9 +311,12 @@ bool CQueueStorage::Impl::MigrateSchema()
 			if (ret && version < 5) {
 				ret = sqlite3_exec(db_, "ALTER TABLE servers ADD COLUMN site_path TEXT DEFAULT NULL", 0, 0, 0) == SQLITE_OK;
 			}
+			if (ret && version < 6) {
+				ret = sqlite3_exec(db_, "ALTER TABLE files ADD COLUMN streaming_io INTEGER", 0, 0, 0) == SQLITE_OK;
+			}
 		}
-		if (ret && version != 5) {
-			ret = sqlite3_exec(db_, "PRAGMA user_version = 5", 0, 0, 0) == SQLITE_OK;
+		if (ret && version != 6) {
+			ret = sqlite3_exec(db_, "PRAGMA user_version = 6", 0, 0, 0) == SQLITE_OK;
 		}
 	}
 
@@ -830,6 +835,13 @@ bool CQueueStorage::Impl::SaveFile(CFileItem const& file)
 		BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
 	}
 
+	if (file.Streaming()) {
+		Bind(insertFileQuery_, file_table_column_names::streaming_io, 1);
+	}
+	else {
+		BindNull(insertFileQuery_, file_table_column_names::streaming_io);
+	}
+
 	int res;
 	do {
 		res = sqlite3_step(insertFileQuery_);
@@ -872,6 +884,7 @@ bool CQueueStorage::Impl::SaveDirectory(CFolderItem const& directory)
 	BindNull(insertFileQuery_, file_table_column_names::ascii_file);
 
 	BindNull(insertFileQuery_, file_table_column_names::default_exists_action);
+	BindNull(insertFileQuery_, file_table_column_names::streaming_io);
 
 	int res;
 	do {
@@ -1101,6 +1114,7 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 
 		bool ascii = GetColumnInt(selectFilesQuery_, file_table_column_names::ascii_file) != 0;
 		int overwrite_action = GetColumnInt(selectFilesQuery_, file_table_column_names::default_exists_action, CFileExistsNotification::unknown);
+		bool streaming = GetColumnInt(selectFilesQuery_, file_table_column_names::streaming_io) != 0;
 
 		if (sourceFile.empty() || localPath.empty() ||
 			remotePath.empty() ||
@@ -1113,6 +1127,7 @@ int64_t CQueueStorage::Impl::ParseFileFromRow(CFileItem** pItem)
 		CFileItem* fileItem = new CFileItem(0, true, download, sourceFile, targetFile, localPath, remotePath, size);
 		*pItem = fileItem;
 		fileItem->SetAscii(ascii);
+		fileItem->SetStreaming(streaming);
 		fileItem->SetPriorityRaw(QueuePriority(priority));
 		fileItem->m_errorCount = errorCount;
 
@@ -8,7 +8,9 @@ void CRecursiveOperation::SetQueue(CQueueView * pQueue)
 
 void CRecursiveOperation::SetImmediate(bool immediate)
 {
-	if (m_operationMode == recursive_transfer || m_operationMode == recursive_transfer_flatten) {
+	if (m_operationMode == recursive_transfer || m_operationMode == recursive_transfer_flatten ||
+		m_operationMode == recursive_synchronize_download || m_operationMode == recursive_synchronize_upload)
+	{
 		m_immediate = immediate;
 		if (!immediate) {
 			m_actionAfterBlocker.reset();
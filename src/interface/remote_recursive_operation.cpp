@@ -3,6 +3,7 @@
 #include "commandqueue.h"
 #include "chmoddialog.h"
 #include "filter.h"
+#include "listingcomparison.h"
 #include "Options.h"
 #include "queue.h"
 
@@ -78,7 +79,7 @@ void CRemoteRecursiveOperation::StartRecursiveOperation(OperationMode mode, Acti
 		return;
 	}
 
-	if ((mode == recursive_transfer || mode == recursive_transfer_flatten) && !m_pQueue) {
+	if ((mode == recursive_transfer || mode == recursive_transfer_flatten || mode == recursive_synchronize_download) && !m_pQueue) {
 		return;
 	}
 
@@ -93,7 +94,7 @@ void CRemoteRecursiveOperation::StartRecursiveOperation(OperationMode mode, Acti
 	m_immediate = immediate;
 	m_operationMode = mode;
 
-	if ((mode == CRecursiveOperation::recursive_transfer || mode == CRecursiveOperation::recursive_transfer_flatten) && immediate) {
+	if ((mode == CRecursiveOperation::recursive_transfer || mode == CRecursiveOperation::recursive_transfer_flatten || mode == CRecursiveOperation::recursive_synchronize_download) && immediate) {
 		m_actionAfterBlocker = m_pQueue->GetActionAfterBlocker();
 	}
 
@@ -237,7 +238,7 @@ void CRemoteRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing*
 		return;
 	}
 
-	if (!pDirectoryListing->size() && m_operationMode == recursive_transfer) {
+	if (!pDirectoryListing->size() && (m_operationMode == recursive_transfer || m_operationMode == recursive_synchronize_download)) {
 		if (m_immediate) {
 			wxFileName::Mkdir(dir.localDir.GetPath(), 0777, wxPATH_MKDIR_FULL);
 			m_state.RefreshLocalFile(dir.localDir.GetPath());
@@ -257,6 +258,9 @@ void CRemoteRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing*
 
 	std::wstring const remotePath = pDirectoryListing->path.GetPath();
 
+	// Local files which are kept during synchronization, by name
+	std::map<std::wstring, std::pair<int64_t, fz::datetime>> localFiles;
+
 	if (m_operationMode == recursive_synchronize_download && !dir.localDir.empty()) {
 		// Step one in synchronization: Delete local files not on the server
 		fz::local_filesys fs;
@@ -288,6 +292,9 @@ void CRemoteRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing*
 
 						if (isDir == entry.is_dir() || entry.is_link()) {
 							// Normal item, nothing we should do
+							if (!isDir) {
+								localFiles.emplace(wname, std::make_pair(size, time));
+							}
 							continue;
 						}
 					}
@@ -304,6 +311,8 @@ void CRemoteRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing*
 
 	bool added = false;
 
+	CSyncComparator const comparator;
+
 	for (size_t i = pDirectoryListing->size(); i > 0; --i) {
 		const CDirentry& entry = (*pDirectoryListing)[i - 1];
 
@@ -350,9 +359,23 @@ void CRemoteRecursiveOperation::ProcessDirectoryListing(const CDirectoryListing*
 					if (pDirectoryListing->path.GetType() == VMS && COptions::Get()->GetOptionVal(OPTION_STRIP_VMS_REVISION)) {
 						localFile = StripVMSRevision(localFile);
 					}
+
+					auto existsAction = CFileExistsNotification::unknown;
+					if (m_operationMode == recursive_synchronize_download) {
+						auto const it = localFiles.find(localFile);
+						if (it != localFiles.cend()) {
+							if (comparator.Compare(entry.size, entry.time, it->second.first, it->second.second) == CSyncComparator::action::skip) {
+								// Local copy is up to date
+								break;
+							}
+						}
+						existsAction = CFileExistsNotification::overwriteChanged;
+					}
+
 					m_pQueue->QueueFile(!m_immediate, true,
 						entry.name, (entry.name == localFile) ? std::wstring() : localFile,
-						dir.localDir, pDirectoryListing->path, site, entry.size);
+						dir.localDir, pDirectoryListing->path, site, entry.size,
+						CEditHandler::none, QueuePriority::normal, existsAction);
 					added = true;
 				}
 				break;
@@ -123,8 +123,7 @@ protected:
 private:
 	virtual bool CanStartComparison() { return false; }
 	virtual void StartComparison() {}
-	virtual bool get_next_file(std::wstring &, bool &, int64_t&, fz::datetime&) override { return false; }
-	virtual void CompareAddFile(CComparableListing::t_fileEntryFlags) {}
+	virtual bool GetFileEntry(unsigned int, entry &) const override { return false; }
 	virtual void FinishComparison() {}
 	virtual void ScrollTopItem(int) {}
 	virtual void OnExitComparisonMode() {}
@@ -452,6 +451,7 @@ bool CSearchDialog::Load()
 	}
 
 	m_results = new CSearchDialogFileList(this, 0);
+	m_results->m_sortPool = &m_state.pool_;
 	ReplaceControl(XRCCTRL(*this, "ID_RESULTS", wxWindow), m_results);
 
 	m_results->SetFilelistStatusBar(pStatusBar);
@@ -565,127 +565,206 @@ void CSearchDialog::ProcessDirectoryListing(std::shared_ptr<CDirectoryListing> c
 		return;
 	}
 
-	int old_count = m_results->m_fileData.size();
-	int added_count = 0;
+	size_t const id = IndexListing(listing);
+	AddResults(m_index.Find(m_search_filter, {id}, m_state.pool_));
+}
 
-	std::wstring const path = listing->path.GetPath();
+void CSearchDialog::ProcessDirectoryListing(CLocalRecursiveOperation::listing const& listing)
+{
+	size_t const id = IndexListing(listing);
+	AddResults(m_index.Find(m_search_filter, {id}, m_state.pool_));
+}
 
-	bool const has_selections = m_results->GetSelectedItemCount() != 0;
+size_t CSearchDialog::IndexListing(std::shared_ptr<CDirectoryListing> const& listing)
+{
+	std::wstring const path = listing->path.GetPath();
 
-	std::vector<int> added_indexes;
-	if (has_selections) {
-		added_indexes.reserve(listing->size());
+	size_t const old = m_index.FindDirectory(path);
+	if (old != CSearchIndex::npos) {
+		m_remoteListings[old].reset();
 	}
 
-	std::unique_ptr<CFileListCtrlSortBase> compare = m_results->GetSortComparisonObject();
+	size_t const id = m_index.AddDirectory(path);
 	for (size_t i = 0; i < listing->size(); ++i) {
 		CDirentry const& entry = (*listing)[i];
+		m_index.AddEntry(entry.name, entry.is_dir(), entry.size, 0, entry.time);
+	}
+
+	m_remoteListings.resize(id + 1);
+	m_remoteListings[id] = listing;
+
+	return id;
+}
+
+size_t CSearchDialog::IndexListing(CLocalRecursiveOperation::listing const& listing)
+{
+	std::wstring const path = listing.localPath.GetPath();
+
+	size_t const old = m_index.FindDirectory(path);
+	if (old != CSearchIndex::npos) {
+		m_localListings[old] = CLocalRecursiveOperation::listing();
+	}
+
+	// Files first, AddResults relies on this order
+	size_t const id = m_index.AddDirectory(path);
+	for (auto const& file : listing.files) {
+		m_index.AddEntry(file.name, false, file.size, file.attributes, file.time);
+	}
+	for (auto const& dir : listing.dirs) {
+		m_index.AddEntry(dir.name, true, dir.size, dir.attributes, dir.time);
+	}
+
+	m_localListings.resize(id + 1);
+	m_localListings[id] = listing;
 
-		if (!CFilterManager::FilenameFilteredByFilter(m_search_filter, entry.name, path, entry.is_dir(), entry.size, 0, entry.time)) {
+	return id;
+}
+
+void CSearchDialog::SearchIndex(recursion_root & root)
+{
+	std::vector<size_t> ids;
+
+	std::vector<CServerPath> dirs{m_remote_search_root};
+	while (!dirs.empty()) {
+		CServerPath const path = std::move(dirs.back());
+		dirs.pop_back();
+
+		if (m_visited.find(path) != m_visited.end()) {
 			continue;
 		}
 
-		CRemoteSearchFileData remoteData;
-		static_cast<CDirentry&>(remoteData) = entry;
-		remoteData.path = listing->path;
-		m_results->remoteFileData_.push_back(remoteData);
+		size_t id = m_index.FindDirectory(path.GetPath());
 
-		CGenericFileData data;
-		data.icon = entry.is_dir() ? m_results->m_dirIcon : -2;
-		m_results->m_fileData.push_back(data);
+		// Prefer the directory cache, it also sees listings made outside the search
+		auto listing = std::make_shared<CDirectoryListing>();
+		if (m_state.m_pEngine->CacheLookup(path, *listing) == FZ_REPLY_OK && !listing->failed()) {
+			if (id == CSearchIndex::npos) {
+				id = IndexListing(listing);
+			}
+			else {
+				auto const& indexed = *m_remoteListings[id];
+				if (indexed.m_firstListTime != listing->m_firstListTime || indexed.m_flags != listing->m_flags || indexed.size() != listing->size()) {
+					id = IndexListing(listing);
+				}
+			}
+		}
+		else if (id == CSearchIndex::npos) {
+			root.add_dir_to_visit_restricted(path, std::wstring(), true);
+			continue;
+		}
 
-		auto insertPos = std::lower_bound(m_results->m_indexMapping.begin(), m_results->m_indexMapping.end(), old_count + added_count, SortPredicate(compare));
-		int const added_index = insertPos - m_results->m_indexMapping.begin();
-		m_results->m_indexMapping.insert(insertPos, old_count + added_count++);
+		m_visited.insert(path);
+		ids.push_back(id);
 
-		// Remember inserted index
-		if (has_selections) {
-			auto const added_indexes_insert_pos = std::lower_bound(added_indexes.begin(), added_indexes.end(), added_index);
-			for (auto index = added_indexes_insert_pos; index != added_indexes.end(); ++index) {
-				++(*index);
+		// Links are not followed, their targets might be outside the search root
+		auto const& indexed = *m_remoteListings[id];
+		for (size_t i = 0; i < indexed.size(); ++i) {
+			CDirentry const& entry = indexed[i];
+			if (entry.is_dir() && !entry.is_link()) {
+				CServerPath subdir = path;
+				if (subdir.AddSegment(entry.name)) {
+					dirs.push_back(std::move(subdir));
+				}
 			}
-			added_indexes.insert(added_indexes_insert_pos, added_index);
 		}
+	}
 
-		if (entry.is_dir()) {
-			m_results->GetFilelistStatusBar()->AddDirectory();
+	AddResults(m_index.Find(m_search_filter, ids, m_state.pool_));
+}
+
+void CSearchDialog::SearchIndex(local_recursion_root & root)
+{
+	std::vector<size_t> ids;
+
+	std::set<CLocalPath> visited;
+	std::vector<CLocalPath> dirs{m_local_search_root};
+	while (!dirs.empty()) {
+		CLocalPath const path = std::move(dirs.back());
+		dirs.pop_back();
+
+		if (!visited.insert(path).second) {
+			continue;
 		}
-		else {
-			m_results->GetFilelistStatusBar()->AddFile(entry.size);
+
+		size_t const id = m_index.FindDirectory(path.GetPath());
+		if (id == CSearchIndex::npos) {
+			root.add_dir_to_visit(path);
+			continue;
 		}
-	}
 
-	if (added_count) {
-		m_results->SetItemCount(old_count + added_count);
-		m_results->UpdateSelections_ItemsAdded(added_indexes);
-		m_results->RefreshListOnly(false);
+		ids.push_back(id);
+
+		for (auto const& dir : m_localListings[id].dirs) {
+			CLocalPath subdir = path;
+			subdir.AddSegment(dir.name);
+			dirs.push_back(std::move(subdir));
+		}
 	}
+
+	AddResults(m_index.Find(m_search_filter, ids, m_state.pool_));
 }
 
-void CSearchDialog::ProcessDirectoryListing(CLocalRecursiveOperation::listing const& listing)
+void CSearchDialog::AddResults(std::vector<CSearchIndex::match> const& matches)
 {
+	if (matches.empty()) {
+		return;
+	}
+
 	int old_count = m_results->m_fileData.size();
 	int added_count = 0;
 
-	std::wstring const path = listing.localPath.GetPath();
-
 	bool const has_selections = m_results->GetSelectedItemCount() != 0;
 
-	std::vector<int> added_indexes;
-	if (has_selections) {
-		added_indexes.reserve(listing.files.size() + listing.dirs.size());
-	}
+	std::vector<unsigned int> added;
+	added.reserve(matches.size());
 
-	std::unique_ptr<CFileListCtrlSortBase> compare = m_results->GetSortComparisonObject();
+	for (auto const& match : matches) {
+		bool dir{};
+		int64_t size{};
+		if (m_indexMode == search_mode::remote) {
+			CDirectoryListing const& listing = *m_remoteListings[match.directory];
+			CDirentry const& entry = listing[match.entry];
 
-	auto const& add_entry = [&](CLocalRecursiveOperation::listing::entry const& entry, bool dir) {
-		if (!CFilterManager::FilenameFilteredByFilter(m_search_filter, entry.name, path, dir, entry.size, entry.attributes, entry.time)) {
-			return;
+			CRemoteSearchFileData remoteData;
+			static_cast<CDirentry&>(remoteData) = entry;
+			remoteData.path = listing.path;
+			m_results->remoteFileData_.push_back(remoteData);
+
+			dir = entry.is_dir();
+			size = entry.size;
 		}
+		else {
+			CLocalRecursiveOperation::listing const& listing = m_localListings[match.directory];
+			dir = match.entry >= listing.files.size();
+			auto const& entry = dir ? listing.dirs[match.entry - listing.files.size()] : listing.files[match.entry];
+
+			CLocalSearchFileData localData;
+			static_cast<CLocalRecursiveOperation::listing::entry&>(localData) = entry;
+			localData.path = listing.localPath;
+			localData.dir = dir;
+			m_results->localFileData_.push_back(localData);
 
-		CLocalSearchFileData localData;
-		static_cast<CLocalRecursiveOperation::listing::entry&>(localData) = entry;
-		localData.path = listing.localPath;
-		localData.dir = dir;
-		m_results->localFileData_.push_back(localData);
+			size = entry.size;
+		}
 
 		CGenericFileData data;
 		data.icon = dir ? m_results->m_dirIcon : -2;
 		m_results->m_fileData.push_back(data);
 
-		auto insertPos = std::lower_bound(m_results->m_indexMapping.begin(), m_results->m_indexMapping.end(), old_count + added_count, SortPredicate(compare));
-		int const added_index = insertPos - m_results->m_indexMapping.begin();
-		m_results->m_indexMapping.insert(insertPos, old_count + added_count++);
-
-		// Remember inserted index
-		if (has_selections) {
-			auto const added_indexes_insert_pos = std::lower_bound(added_indexes.begin(), added_indexes.end(), added_index);
-			for (auto index = added_indexes_insert_pos; index != added_indexes.end(); ++index) {
-				++(*index);
-			}
-			added_indexes.insert(added_indexes_insert_pos, added_index);
-		}
+		added.push_back(old_count + added_count++);
 
 		if (dir) {
 			m_results->GetFilelistStatusBar()->AddDirectory();
 		}
 		else {
-			m_results->GetFilelistStatusBar()->AddFile(entry.size);
+			m_results->GetFilelistStatusBar()->AddFile(size);
 		}
-	};
-
-	for (auto const& file : listing.files) {
-		add_entry(file, false);
-	}
-	for (auto const& dir : listing.dirs) {
-		add_entry(dir, true);
 	}
 
-	if (added_count) {
-		m_results->SetItemCount(old_count + added_count);
-		m_results->UpdateSelections_ItemsAdded(added_indexes);
-		m_results->RefreshListOnly(false);
-	}
+	std::vector<int> const added_indexes = m_results->MergeIntoIndexMapping(std::move(added), has_selections);
+	m_results->SetItemCount(old_count + added_count);
+	m_results->UpdateSelections_ItemsAdded(added_indexes);
+	m_results->RefreshListOnly(false);
 }
 
 void CSearchDialog::OnSearch(wxCommandEvent&)
@@ -754,21 +833,55 @@ void CSearchDialog::OnSearch(wxCommandEvent&)
 	m_results->set_mode(m_searching);
 	m_visited.clear();
 
+	// Listings of the other side or of a different server are of no use
+	CServer const server = localSearch ? CServer() : m_state.GetSite().server;
+	if (m_indexMode != m_searching || m_indexServer != server) {
+		m_index.clear();
+		m_remoteListings.clear();
+		m_localListings.clear();
+		m_indexMode = m_searching;
+		m_indexServer = server;
+	}
+
+	bool const useIndex = xrc_call(*this, "ID_USE_INDEX", &wxCheckBox::GetValue);
+
 	// Start
 
 	if (localSearch) {
 		local_recursion_root root;
-		root.add_dir_to_visit(m_local_search_root);
-		m_state.GetLocalRecursiveOperation()->AddRecursionRoot(std::move(root));
-		ActiveFilters const filters; // Empty, recurse into everything
-		m_state.GetLocalRecursiveOperation()->StartRecursiveOperation(CRecursiveOperation::recursive_list, filters);
+		if (useIndex) {
+			SearchIndex(root);
+		}
+		else {
+			root.add_dir_to_visit(m_local_search_root);
+		}
+
+		if (root.empty()) {
+			m_searching = search_mode::none;
+		}
+		else {
+			m_state.GetLocalRecursiveOperation()->AddRecursionRoot(std::move(root));
+			ActiveFilters const filters; // Empty, recurse into everything
+			m_state.GetLocalRecursiveOperation()->StartRecursiveOperation(CRecursiveOperation::recursive_list, filters);
+		}
 	}
 	else {
 		recursion_root root(m_remote_search_root, true);
-		root.add_dir_to_visit_restricted(m_remote_search_root, std::wstring(), true);
-		m_state.GetRemoteRecursiveOperation()->AddRecursionRoot(std::move(root));
-		ActiveFilters const filters; // Empty, recurse into everything
-		m_state.GetRemoteRecursiveOperation()->StartRecursiveOperation(CRecursiveOperation::recursive_list, filters, m_remote_search_root);
+		if (useIndex) {
+			SearchIndex(root);
+		}
+		else {
+			root.add_dir_to_visit_restricted(m_remote_search_root, std::wstring(), true);
+		}
+
+		if (root.empty()) {
+			m_searching = search_mode::none;
+		}
+		else {
+			m_state.GetRemoteRecursiveOperation()->AddRecursionRoot(std::move(root));
+			ActiveFilters const filters; // Empty, recurse into everything
+			m_state.GetRemoteRecursiveOperation()->StartRecursiveOperation(CRecursiveOperation::recursive_list, filters, m_remote_search_root);
+		}
 	}
 
 	SetCtrlState();
@@ -3,6 +3,7 @@
 
 #include "filter_conditions_dialog.h"
 #include "local_recursive_operation.h"
+#include "search_index.h"
 #include "state.h"
 #include <set>
 
@@ -10,6 +11,7 @@ class CWindowStateManager;
 class CSearchDialogFileList;
 class CQueueView;
 class CFilelistStatusBar;
+class recursion_root;
 class CSearchDialog final : protected CFilterConditionsDialog, public CStateEventHandler
 {
 	friend class CSearchDialogFileList;
@@ -31,6 +33,18 @@ protected:
 	void ProcessDirectoryListing(std::shared_ptr<CDirectoryListing> const& listing);
 	void ProcessDirectoryListing(CLocalRecursiveOperation::listing const& listing);
 
+	// Adds the listing to the index, returns the id of its directory
+	size_t IndexListing(std::shared_ptr<CDirectoryListing> const& listing);
+	size_t IndexListing(CLocalRecursiveOperation::listing const& listing);
+
+	// Searches the directories below the search root known to the index or,
+	// for remote searches, to the directory cache. Directories not known get
+	// added to the root for listing.
+	void SearchIndex(recursion_root & root);
+	void SearchIndex(local_recursion_root & root);
+
+	void AddResults(std::vector<CSearchIndex::match> const& matches);
+
 	void SetCtrlState();
 
 	void SaveConditions();
@@ -67,6 +81,13 @@ protected:
 
 	CLocalPath m_local_search_root;
 	CServerPath m_remote_search_root;
+
+	// Listings seen during this session, indexed by directory id
+	CSearchIndex m_index;
+	search_mode m_indexMode{};
+	CServer m_indexServer;
+	std::vector<std::shared_ptr<CDirectoryListing>> m_remoteListings;
+	std::vector<CLocalRecursiveOperation::listing> m_localListings;
 };
 
 #endif
@@ -0,0 +1,268 @@
+#include <filezilla.h>
+#include "search_index.h"
+#include "filter.h"
+
+#include <libfilezilla/string.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+// Below this, spawning tasks isn't worth it
+size_t const minChunkSize = 10000;
+
+// Compaction only pays off once a fair share of the entries is gone
+size_t const minRemovedEntries = 100000;
+
+uint64_t make_trigram(wchar_t const* p)
+{
+	uint64_t const mask = 0x1fffff;
+	return ((static_cast<uint64_t>(p[0]) & mask) << 42) | ((static_cast<uint64_t>(p[1]) & mask) << 21) | (static_cast<uint64_t>(p[2]) & mask);
+}
+
+std::vector<uint64_t> get_trigrams(std::wstring const& s)
+{
+	std::vector<uint64_t> ret;
+	if (s.size() >= 3) {
+		ret.reserve(s.size() - 2);
+		for (size_t i = 0; i + 2 < s.size(); ++i) {
+			ret.push_back(make_trigram(s.c_str() + i));
+		}
+		std::sort(ret.begin(), ret.end());
+		ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+	}
+	return ret;
+}
+
+// Returns a lowercased string every name matched by the filter has to
+// contain, or the empty string if there is none.
+std::wstring RequiredLiteral(CFilter const& filter)
+{
+	if (filter.matchType != CFilter::all && (filter.matchType != CFilter::any || filter.filters.size() != 1)) {
+		return std::wstring();
+	}
+
+	std::wstring ret;
+	for (auto const& condition : filter.filters) {
+		// Contains, equals, begins with and ends with
+		if (condition.type != filter_name || condition.pRegEx || condition.matchCondition < 0 || condition.matchCondition > 3) {
+			continue;
+		}
+		if (condition.matchValue.size() > ret.size()) {
+			ret = condition.matchValue;
+		}
+	}
+
+	return fz::str_tolower(ret);
+}
+}
+
+size_t CSearchIndex::AddDirectory(std::wstring const& path)
+{
+	auto it = directoryIds_.find(path);
+	if (it != directoryIds_.end()) {
+		directory & old = directories_[it->second];
+		old.removed = true;
+		removedEntries_ += old.count;
+		old.count = 0;
+
+		if (removedEntries_ >= minRemovedEntries && removedEntries_ > names_.size() / 2) {
+			Compact();
+		}
+	}
+
+	size_t const id = directories_.size();
+	directoryIds_[path] = id;
+
+	directory d;
+	d.path = path;
+	d.first = names_.size();
+	directories_.push_back(d);
+
+	return id;
+}
+
+void CSearchIndex::AddEntry(std::wstring const& name, bool dir, int64_t size, int attributes, fz::datetime const& time)
+{
+	if (directories_.empty()) {
+		return;
+	}
+
+	uint32_t const index = static_cast<uint32_t>(names_.size());
+	for (auto const& trigram : get_trigrams(fz::str_tolower(name))) {
+		trigrams_[trigram].push_back(index);
+	}
+
+	names_.push_back(name);
+	sizes_.push_back(size);
+	times_.push_back(time);
+	attributes_.push_back(attributes);
+	dirFlags_.push_back(dir ? 1 : 0);
+	parents_.push_back(static_cast<uint32_t>(directories_.size() - 1));
+
+	++directories_.back().count;
+}
+
+size_t CSearchIndex::FindDirectory(std::wstring const& path) const
+{
+	auto it = directoryIds_.find(path);
+	if (it == directoryIds_.end()) {
+		return npos;
+	}
+	return it->second;
+}
+
+bool CSearchIndex::Candidates(std::wstring const& literal, size_t limit, std::vector<uint32_t> & candidates) const
+{
+	candidates.clear();
+
+	std::vector<std::vector<uint32_t> const*> lists;
+	for (auto const& trigram : get_trigrams(literal)) {
+		auto it = trigrams_.find(trigram);
+		if (it == trigrams_.end()) {
+			return true;
+		}
+		lists.push_back(&it->second);
+	}
+	if (lists.empty()) {
+		return false;
+	}
+
+	// Intersect, starting with the shortest list to keep intermediate results small
+	std::sort(lists.begin(), lists.end(), [](auto const& lhs, auto const& rhs) { return lhs->size() < rhs->size(); });
+	if (lists.front()->size() > limit) {
+		return false;
+	}
+
+	candidates = *lists.front();
+	for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+		std::vector<uint32_t> intersection;
+		std::set_intersection(candidates.cbegin(), candidates.cend(), lists[i]->cbegin(), lists[i]->cend(), std::back_inserter(intersection));
+		candidates.swap(intersection);
+	}
+	return true;
+}
+
+std::vector<CSearchIndex::match> CSearchIndex::Find(CFilter const& filter, std::vector<size_t> const& directories, fz::thread_pool & pool) const
+{
+	std::vector<uint8_t> selected(directories_.size());
+	size_t selectedEntries{};
+	for (auto const& id : directories) {
+		if (id < directories_.size() && !directories_[id].removed && !selected[id]) {
+			selected[id] = 1;
+			selectedEntries += directories_[id].count;
+		}
+	}
+
+	std::vector<uint32_t> candidates;
+	std::wstring const literal = RequiredLiteral(filter);
+	if (literal.size() >= 3 && Candidates(literal, selectedEntries, candidates)) {
+		candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](uint32_t entry) { return !selected[parents_[entry]]; }), candidates.end());
+	}
+	else {
+		candidates.reserve(selectedEntries);
+		for (size_t id = 0; id < directories_.size(); ++id) {
+			if (selected[id]) {
+				for (size_t entry = directories_[id].first; entry < directories_[id].first + directories_[id].count; ++entry) {
+					candidates.push_back(static_cast<uint32_t>(entry));
+				}
+			}
+		}
+	}
+
+	std::vector<uint8_t> matched(candidates.size());
+	auto const run = [&](size_t from, size_t to) {
+		for (size_t i = from; i < to; ++i) {
+			uint32_t const entry = candidates[i];
+			matched[i] = CFilterManager::FilenameFilteredByFilter(filter, names_[entry], directories_[parents_[entry]].path, dirFlags_[entry] != 0, sizes_[entry], attributes_[entry], times_[entry]) ? 1 : 0;
+		}
+	};
+
+	size_t const count = candidates.size();
+	size_t const chunks = std::max(size_t(1), std::min(static_cast<size_t>(std::thread::hardware_concurrency()), count / minChunkSize));
+
+	std::vector<fz::async_task> tasks;
+	for (size_t i = 1; i < chunks; ++i) {
+		size_t const from = count * i / chunks;
+		size_t const to = count * (i + 1) / chunks;
+		tasks.emplace_back(pool.spawn([&run, from, to]() { run(from, to); }));
+		if (!tasks.back()) {
+			run(from, to);
+		}
+	}
+	run(0, count / chunks);
+
+	for (auto & task : tasks) {
+		task.join();
+	}
+
+	std::vector<match> ret;
+	for (size_t i = 0; i < count; ++i) {
+		if (matched[i]) {
+			uint32_t const entry = candidates[i];
+			ret.push_back({parents_[entry], entry - directories_[parents_[entry]].first});
+		}
+	}
+	return ret;
+}
+
+void CSearchIndex::clear()
+{
+	directories_.clear();
+	directoryIds_.clear();
+	names_.clear();
+	sizes_.clear();
+	times_.clear();
+	attributes_.clear();
+	dirFlags_.clear();
+	parents_.clear();
+	trigrams_.clear();
+	removedEntries_ = 0;
+}
+
+void CSearchIndex::Compact()
+{
+	// Directory ids stay unchanged, only the entries of replaced directories get dropped
+	std::vector<std::wstring> names;
+	std::vector<int64_t> sizes;
+	std::vector<fz::datetime> times;
+	std::vector<int> attributes;
+	std::vector<uint8_t> dirFlags;
+	std::vector<uint32_t> parents;
+
+	size_t const count = names_.size() - removedEntries_;
+	names.reserve(count);
+	sizes.reserve(count);
+	times.reserve(count);
+	attributes.reserve(count);
+	dirFlags.reserve(count);
+	parents.reserve(count);
+
+	trigrams_.clear();
+
+	for (auto & d : directories_) {
+		size_t const first = names.size();
+		for (size_t entry = d.first; entry < d.first + d.count; ++entry) {
+			for (auto const& trigram : get_trigrams(fz::str_tolower(names_[entry]))) {
+				trigrams_[trigram].push_back(static_cast<uint32_t>(names.size()));
+			}
+
+			names.push_back(std::move(names_[entry]));
+			sizes.push_back(sizes_[entry]);
+			times.push_back(times_[entry]);
+			attributes.push_back(attributes_[entry]);
+			dirFlags.push_back(dirFlags_[entry]);
+			parents.push_back(parents_[entry]);
+		}
+		d.first = first;
+	}
+
+	names_.swap(names);
+	sizes_.swap(sizes);
+	times_.swap(times);
+	attributes_.swap(attributes);
+	dirFlags_.swap(dirFlags);
+	parents_.swap(parents);
+
+	removedEntries_ = 0;
+}
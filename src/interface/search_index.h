@@ -0,0 +1,80 @@
+#ifndef FILEZILLA_INTERFACE_SEARCH_INDEX_HEADER
+#define FILEZILLA_INTERFACE_SEARCH_INDEX_HEADER
+
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class CFilter;
+
+// Index over directory listings, so that repeated searches do not need to
+// list the same directories again.
+//
+// Entries are stored column-wise. Names are additionally indexed by their
+// trigrams: if every entry matching a filter has to contain a literal string
+// in its name, only the entries containing all trigrams of that string need
+// to be checked against the filter.
+class CSearchIndex final
+{
+public:
+	static size_t const npos = std::numeric_limits<size_t>::max();
+
+	// Adds a directory, replacing any directory previously added under the
+	// same path. The entries of the directory have to be added right after.
+	// Returns the id of the directory, ids stay valid until clear is called.
+	size_t AddDirectory(std::wstring const& path);
+	void AddEntry(std::wstring const& name, bool dir, int64_t size, int attributes, fz::datetime const& time);
+
+	// Returns npos if the directory is not known
+	size_t FindDirectory(std::wstring const& path) const;
+
+	struct match final
+	{
+		size_t directory;
+
+		// Position of the entry in the order it got added to the directory
+		size_t entry;
+	};
+
+	// Returns the entries of the given directories matched by the filter,
+	// grouped by directory. Entries get checked concurrently on the pool.
+	std::vector<match> Find(CFilter const& filter, std::vector<size_t> const& directories, fz::thread_pool & pool) const;
+
+	void clear();
+
+private:
+	void Compact();
+
+	// Fails if there are more candidates than limit, scanning is cheaper then
+	bool Candidates(std::wstring const& literal, size_t limit, std::vector<uint32_t> & candidates) const;
+
+	struct directory final
+	{
+		std::wstring path;
+		size_t first{};
+		size_t count{};
+		bool removed{};
+	};
+	std::vector<directory> directories_;
+	std::unordered_map<std::wstring, size_t> directoryIds_;
+
+	// One element per entry, the entries of a directory are contiguous
+	std::vector<std::wstring> names_;
+	std::vector<int64_t> sizes_;
+	std::vector<fz::datetime> times_;
+	std::vector<int> attributes_;
+	std::vector<uint8_t> dirFlags_;
+	std::vector<uint32_t> parents_;
+
+	// Sorted entry indexes for each trigram of the lowercased names
+	std::unordered_map<uint64_t, std::vector<uint32_t>> trigrams_;
+
+	// Entries of replaced directories, not yet removed by Compact
+	size_t removedEntries_{};
+};
+
+#endif
@@ -12,6 +12,7 @@ bool COptionsPageConnectionFTP::LoadPage()
 	SetRCheck(XRCID("ID_PASSIVE"), use_pasv, failure);
 	SetRCheck(XRCID("ID_ACTIVE"), !use_pasv, failure);
 	SetCheckFromOption(XRCID("ID_FALLBACK"), OPTION_ALLOW_TRANSFERMODEFALLBACK, failure);
+	SetCheckFromOption(XRCID("ID_PREFETCH"), OPTION_FTP_PREFETCH_DATACONNECTION, failure);
 	SetCheckFromOption(XRCID("ID_USEKEEPALIVE"), OPTION_FTP_SENDKEEPALIVE, failure);
 	return !failure;
 }
@@ -20,6 +21,7 @@ bool COptionsPageConnectionFTP::SavePage()
 {
 	m_pOptions->SetOption(OPTION_USEPASV, GetRCheck(XRCID("ID_PASSIVE")) ? 1 : 0);
 	SetOptionFromCheck(XRCID("ID_FALLBACK"), OPTION_ALLOW_TRANSFERMODEFALLBACK);
+	SetOptionFromCheck(XRCID("ID_PREFETCH"), OPTION_FTP_PREFETCH_DATACONNECTION);
 	SetOptionFromCheck(XRCID("ID_USEKEEPALIVE"), OPTION_FTP_SENDKEEPALIVE);
 	return true;
 }
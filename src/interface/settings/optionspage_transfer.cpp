@@ -71,6 +71,8 @@ bool COptionsPageTransfer::LoadPage()
 	XRCCTRL(*this, "ID_REPLACED", wxStaticText)->SetLabel(filtered);
 
 	SetCheckFromOption(XRCID("ID_ENABLE_PREALLOCATION"), OPTION_PREALLOCATE_SPACE, failure);
+	SetCheckFromOption(XRCID("ID_VERIFY_TRANSFERS"), OPTION_VERIFY_TRANSFERS, failure);
+	SetCheckFromOption(XRCID("ID_STREAMING_IO"), OPTION_STREAMING_IO, failure);
 
 	return !failure;
 }
@@ -90,6 +92,8 @@ bool COptionsPageTransfer::SavePage()
 	SetOptionFromCheck(XRCID("ID_ENABLE_REPLACE"), OPTION_INVALID_CHAR_REPLACE_ENABLE);
 
 	SetOptionFromCheck(XRCID("ID_ENABLE_PREALLOCATION"), OPTION_PREALLOCATE_SPACE);
+	SetOptionFromCheck(XRCID("ID_VERIFY_TRANSFERS"), OPTION_VERIFY_TRANSFERS);
+	SetOptionFromCheck(XRCID("ID_STREAMING_IO"), OPTION_STREAMING_IO);
 
 	return true;
 }
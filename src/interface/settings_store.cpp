@@ -0,0 +1,394 @@
+#include <filezilla.h>
+#include "settings_store.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/util.hpp>
+
+#include <wx/filefn.h>
+
+#include <cstring>
+#include <limits>
+
+#ifdef FZ_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// File starts with the magic, a version and the generation
+char const magic[4] = { 'F', 'Z', 'S', 'T' };
+uint32_t const version = 1;
+int64_t const header_size = 16;
+
+// Each record consists of kind, name length, value length, name, value and
+// a checksum over all of these. Integers are little-endian.
+int64_t const record_overhead = 1 + 2 + 4 + 4;
+
+// Rewrite the file if it is larger than this and mostly obsolete
+int64_t const compact_threshold = 64 * 1024;
+
+uint32_t checksum(unsigned char const* p, size_t len)
+{
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; ++i) {
+		h ^= p[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+uint64_t read_le(unsigned char const* p, size_t len)
+{
+	uint64_t ret{};
+	for (size_t i = 0; i < len; ++i) {
+		ret |= static_cast<uint64_t>(p[i]) << (8 * i);
+	}
+	return ret;
+}
+
+void append_le(std::string & out, uint64_t v, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		out += static_cast<char>((v >> (8 * i)) & 0xff);
+	}
+}
+
+int64_t record_size(std::string const& name, CSettingsStore::value const& v)
+{
+	return record_overhead + static_cast<int64_t>(name.size() + v.data_.size());
+}
+
+void append_header(std::string & out, uint64_t generation)
+{
+	out.append(magic, sizeof(magic));
+	append_le(out, version, 4);
+	append_le(out, generation, 8);
+}
+
+bool append_record(std::string & out, std::string const& name, CSettingsStore::value const& v)
+{
+	if (name.size() > 0xffff || v.data_.size() > 0x7fffffff) {
+		return false;
+	}
+
+	size_t const start = out.size();
+	out += static_cast<char>(v.kind_);
+	append_le(out, name.size(), 2);
+	append_le(out, v.data_.size(), 4);
+	out += name;
+	out += v.data_;
+	append_le(out, checksum(reinterpret_cast<unsigned char const*>(out.data() + start), out.size() - start), 4);
+	return true;
+}
+
+// Read-only mapping of a whole file
+class mapped_file final
+{
+public:
+	mapped_file() = default;
+	~mapped_file()
+	{
+		close();
+	}
+
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+
+	bool open(std::wstring const& file)
+	{
+		close();
+#ifdef FZ_WINDOWS
+		file_ = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file_ == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file_, &size)) {
+			close();
+			return false;
+		}
+		size_ = static_cast<int64_t>(size.QuadPart);
+		if (size_ > 0) {
+			mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping_) {
+				close();
+				return false;
+			}
+			data_ = static_cast<unsigned char const*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+		}
+#else
+		fd_ = ::open(fz::to_native(file).c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd_ == -1) {
+			return false;
+		}
+		struct stat buf;
+		if (fstat(fd_, &buf) != 0) {
+			close();
+			return false;
+		}
+		size_ = static_cast<int64_t>(buf.st_size);
+		if (size_ > 0) {
+			void* p = mmap(nullptr, static_cast<size_t>(size_), PROT_READ, MAP_PRIVATE, fd_, 0);
+			if (p != MAP_FAILED) {
+				data_ = static_cast<unsigned char const*>(p);
+			}
+		}
+#endif
+		if (size_ > 0 && !data_) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef FZ_WINDOWS
+		if (data_) {
+			UnmapViewOfFile(data_);
+		}
+		if (mapping_) {
+			CloseHandle(mapping_);
+			mapping_ = nullptr;
+		}
+		if (file_ != INVALID_HANDLE_VALUE) {
+			CloseHandle(file_);
+			file_ = INVALID_HANDLE_VALUE;
+		}
+#else
+		if (data_) {
+			munmap(const_cast<unsigned char*>(data_), static_cast<size_t>(size_));
+		}
+		if (fd_ != -1) {
+			::close(fd_);
+			fd_ = -1;
+		}
+#endif
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+	unsigned char const* data() const { return data_; }
+	int64_t size() const { return size_; }
+
+private:
+#ifdef FZ_WINDOWS
+	HANDLE file_{INVALID_HANDLE_VALUE};
+	HANDLE mapping_{};
+#else
+	int fd_{-1};
+#endif
+	unsigned char const* data_{};
+	int64_t size_{};
+};
+
+// Returns the generation, or 0 if the file is not a store
+uint64_t parse_header(mapped_file const& f)
+{
+	if (f.size() < header_size) {
+		return 0;
+	}
+	unsigned char const* p = f.data();
+	if (memcmp(p, magic, sizeof(magic)) || read_le(p + 4, 4) != version) {
+		return 0;
+	}
+	return read_le(p + 8, 8);
+}
+
+// Walks the records starting at offset, returns the end of the last valid one
+template<typename F>
+int64_t parse_records(mapped_file const& f, int64_t offset, F const& f_record)
+{
+	unsigned char const* const data = f.data();
+	int64_t const size = f.size();
+	while (size - offset >= record_overhead) {
+		unsigned char const* p = data + offset;
+		auto const k = static_cast<CSettingsStore::kind>(p[0]);
+		if (k != CSettingsStore::kind::text && k != CSettingsStore::kind::xml && k != CSettingsStore::kind::erase) {
+			break;
+		}
+		int64_t const nameLen = static_cast<int64_t>(read_le(p + 1, 2));
+		int64_t const valueLen = static_cast<int64_t>(read_le(p + 3, 4));
+		int64_t const len = record_overhead + nameLen + valueLen;
+		if (size - offset < len) {
+			break;
+		}
+		if (checksum(p, static_cast<size_t>(len - 4)) != read_le(p + len - 4, 4)) {
+			break;
+		}
+
+		f_record(k, std::string(reinterpret_cast<char const*>(p + 7), static_cast<size_t>(nameLen)),
+			std::string(reinterpret_cast<char const*>(p + 7 + nameLen), static_cast<size_t>(valueLen)));
+		offset += len;
+	}
+
+	return offset;
+}
+}
+
+CSettingsStore::CSettingsStore(std::wstring const& file)
+	: file_(file)
+{
+}
+
+bool CSettingsStore::Load()
+{
+	values_.clear();
+	liveSize_ = 0;
+	generation_ = 0;
+	validEnd_ = 0;
+
+	return Refresh();
+}
+
+bool CSettingsStore::Refresh()
+{
+	mapped_file f;
+	if (!f.open(file_)) {
+		return false;
+	}
+
+	uint64_t const fileGeneration = parse_header(f);
+	if (!fileGeneration) {
+		return false;
+	}
+
+	// Only the records after what has already been read need to be replayed,
+	// unless another process has replaced the file in the meantime.
+	int64_t offset = validEnd_;
+	if (fileGeneration != generation_ || f.size() < validEnd_ || validEnd_ < header_size) {
+		values_.clear();
+		liveSize_ = 0;
+		generation_ = fileGeneration;
+		offset = header_size;
+	}
+
+	validEnd_ = parse_records(f, offset, [this](kind k, std::string && name, std::string && data) {
+		Apply(name, value(k, std::move(data)));
+	});
+
+	return true;
+}
+
+void CSettingsStore::Apply(std::string const& name, value const& v)
+{
+	auto it = values_.find(name);
+	if (it != values_.end()) {
+		liveSize_ -= record_size(it->first, it->second);
+		if (v.kind_ == kind::erase) {
+			values_.erase(it);
+			return;
+		}
+		it->second = v;
+	}
+	else if (v.kind_ == kind::erase) {
+		return;
+	}
+	else {
+		it = values_.emplace(name, v).first;
+	}
+	liveSize_ += record_size(it->first, it->second);
+}
+
+bool CSettingsStore::Update(std::vector<std::pair<std::string, value>> const& changes)
+{
+	if (changes.empty()) {
+		return true;
+	}
+
+	std::string records;
+	for (auto const& change : changes) {
+		if (!append_record(records, change.first, change.second)) {
+			return false;
+		}
+	}
+
+	// Other processes might have appended records, those need to be kept
+	bool const valid = Refresh();
+
+	for (auto const& change : changes) {
+		Apply(change.first, change.second);
+	}
+
+	if (!valid) {
+		// File is gone or damaged, start over
+		return Replace(values_);
+	}
+
+	{
+		fz::file f(fz::to_native(file_), fz::file::writing, fz::file::existing);
+		if (!f.opened() || f.seek(validEnd_, fz::file::begin) != validEnd_) {
+			return false;
+		}
+
+		// Truncating afterwards gets rid of any damaged tail
+		int64_t const len = static_cast<int64_t>(records.size());
+		if (f.write(records.data(), len) != len || !f.truncate()) {
+			return false;
+		}
+		validEnd_ += len;
+	}
+
+	if (validEnd_ > compact_threshold && validEnd_ > 4 * (liveSize_ + header_size)) {
+		return Replace(values_);
+	}
+
+	return true;
+}
+
+bool CSettingsStore::Replace(std::map<std::string, value> const& values)
+{
+	uint64_t generation;
+	do {
+		generation = static_cast<uint64_t>(fz::random_number(1, std::numeric_limits<int64_t>::max()));
+	} while (generation == generation_);
+
+	std::string data;
+	append_header(data, generation);
+	for (auto const& v : values) {
+		if (v.second.kind_ == kind::erase) {
+			continue;
+		}
+		if (!append_record(data, v.first, v.second)) {
+			return false;
+		}
+	}
+
+	std::wstring const tmp = file_ + L".tmp";
+	{
+		fz::file f(fz::to_native(tmp), fz::file::writing, fz::file::empty);
+		int64_t const len = static_cast<int64_t>(data.size());
+		if (!f.opened() || f.write(data.data(), len) != len || !f.fsync()) {
+			f.close();
+			fz::remove_file(fz::to_native(tmp));
+			return false;
+		}
+	}
+
+	if (!wxRenameFile(tmp, file_, true)) {
+		fz::remove_file(fz::to_native(tmp));
+		return false;
+	}
+
+	// values might refer to values_
+	std::map<std::string, value> newValues;
+	int64_t liveSize{};
+	for (auto const& v : values) {
+		if (v.second.kind_ != kind::erase) {
+			newValues.insert(v);
+			liveSize += record_size(v.first, v.second);
+		}
+	}
+	values_ = std::move(newValues);
+	liveSize_ = liveSize;
+	generation_ = generation;
+	validEnd_ = static_cast<int64_t>(data.size());
+
+	return true;
+}
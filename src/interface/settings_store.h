@@ -0,0 +1,85 @@
+#ifndef FILEZILLA_INTERFACE_SETTINGS_STORE_HEADER
+#define FILEZILLA_INTERFACE_SETTINGS_STORE_HEADER
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Compact binary store for the settings.
+//
+// The file is a log of name/value records, later records override earlier
+// ones. Loading maps the file into memory and replays the log. Changes get
+// appended, so saving only costs as much as has changed. Once the file
+// consists mostly of overwritten records, it gets rewritten to contain just
+// the current values.
+//
+// A damaged record at the end, e.g. from a crash while writing, is ignored
+// and overwritten by the next update. Multiple processes may append to the
+// same file, but callers have to serialize access with MUTEX_OPTIONS.
+class CSettingsStore final
+{
+public:
+	enum class kind : unsigned char
+	{
+		// Value is UTF-8 text
+		text = 1,
+
+		// Value is a serialized XML fragment
+		xml,
+
+		// Removes the value
+		erase
+	};
+
+	struct value final
+	{
+		value() = default;
+		value(kind k, std::string const& data)
+			: kind_(k), data_(data)
+		{}
+
+		bool operator==(value const& op) const { return kind_ == op.kind_ && data_ == op.data_; }
+		bool operator!=(value const& op) const { return !(*this == op); }
+
+		kind kind_{kind::text};
+		std::string data_;
+	};
+
+	explicit CSettingsStore(std::wstring const& file);
+
+	std::wstring const& GetFile() const { return file_; }
+
+	// Returns false if the file does not exist or is not a valid store
+	bool Load();
+
+	// Replays the records other processes have appended since the file was
+	// last read or written. Reloads the file if it has been replaced.
+	bool Refresh();
+
+	std::map<std::string, value> const& Values() const { return values_; }
+
+	// Appends the changes to the file
+	bool Update(std::vector<std::pair<std::string, value>> const& changes);
+
+	// Rewrites the file to contain exactly the given values
+	bool Replace(std::map<std::string, value> const& values);
+
+private:
+	void Apply(std::string const& name, value const& v);
+
+	std::wstring const file_;
+
+	std::map<std::string, value> values_;
+
+	// Identifies the file as written by Replace. Detects the file having
+	// been replaced by another process.
+	uint64_t generation_{};
+
+	// Part of the file that has been read or written
+	int64_t validEnd_{};
+
+	// Size the records of the current values would take
+	int64_t liveSize_{};
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <filezilla.h>
+#include "site_store.h"
+
+#include <algorithm>
+#include <set>
+
+CSiteStore::CSiteStore(std::wstring const& file)
+	: file_(file)
+{
+}
+
+bool CSiteStore::Load()
+{
+	root_.children_.clear();
+	root_.index_.clear();
+	searchIndex_.clear();
+	siteCount_ = 0;
+
+	auto document = file_.Load();
+	if (!document) {
+		return false;
+	}
+
+	root_.folder_ = true;
+	root_.expanded_ = true;
+	root_.element_ = document.child("Servers");
+	if (root_.element_) {
+		Add(root_, root_.element_);
+	}
+
+	std::stable_sort(searchIndex_.begin(), searchIndex_.end(), [](auto const& lhs, auto const& rhs) {
+		return lhs.first < rhs.first;
+	});
+
+	return true;
+}
+
+void CSiteStore::Add(node & parent, pugi::xml_node element)
+{
+	for (auto child = element.first_child(); child; child = child.next_sibling()) {
+		bool const folder = !strcmp(child.name(), "Folder");
+		if (!folder && strcmp(child.name(), "Server")) {
+			continue;
+		}
+
+		// Same naming as used when resolving site paths
+		std::wstring name = GetTextElement_Trimmed(child, "Name");
+		if (name.empty()) {
+			name = GetTextElement_Trimmed(child);
+		}
+		if (name.empty()) {
+			continue;
+		}
+
+		auto n = std::make_unique<node>();
+		n->name_ = name;
+		n->element_ = child;
+		n->parent_ = &parent;
+		n->folder_ = folder;
+
+		if (folder) {
+			n->expanded_ = GetTextAttribute(child, "expanded") != L"0";
+			Add(*n, child);
+		}
+		else {
+			++siteCount_;
+			searchIndex_.emplace_back(fz::str_tolower(name), n.get());
+
+			std::wstring const host = GetTextElement_Trimmed(child, "Host");
+			if (!host.empty()) {
+				searchIndex_.emplace_back(fz::str_tolower(host), n.get());
+			}
+		}
+
+		parent.index_.emplace(name, n.get());
+		parent.children_.push_back(std::move(n));
+	}
+}
+
+CSiteStore::node const* CSiteStore::Find(std::vector<std::wstring> const& segments) const
+{
+	node const* n = &root_;
+	for (auto const& segment : segments) {
+		auto it = n->index_.find(segment);
+		if (it == n->index_.cend()) {
+			return nullptr;
+		}
+		n = it->second;
+	}
+
+	return n;
+}
+
+std::vector<std::wstring> CSiteStore::GetSegments(node const& n)
+{
+	std::vector<std::wstring> segments;
+	for (node const* p = &n; p->parent_; p = p->parent_) {
+		segments.push_back(p->name_);
+	}
+	std::reverse(segments.begin(), segments.end());
+
+	return segments;
+}
+
+std::vector<CSiteStore::node const*> CSiteStore::Search(std::wstring const& term) const
+{
+	std::vector<node const*> ret;
+
+	std::wstring const lower = fz::str_tolower(term);
+	if (lower.empty()) {
+		return ret;
+	}
+
+	auto it = std::lower_bound(searchIndex_.cbegin(), searchIndex_.cend(), lower, [](auto const& entry, std::wstring const& value) {
+		return entry.first < value;
+	});
+
+	// A site can match both by name and by host
+	std::set<node const*> seen;
+	for (; it != searchIndex_.cend() && !it->first.compare(0, lower.size(), lower); ++it) {
+		if (seen.insert(it->second).second) {
+			ret.push_back(it->second);
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,77 @@
+#ifndef FILEZILLA_INTERFACE_SITE_STORE_HEADER
+#define FILEZILLA_INTERFACE_SITE_STORE_HEADER
+
+#include "xmlfunctions.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+// Index over the entries of a Site Manager file.
+//
+// Loading only records the names and structure, the sites themselves get read
+// when needed. Each folder keeps its children in a map by name, so resolving
+// a site path takes O(depth * log(entries per folder)) instead of walking the
+// whole file. Names and hosts of all sites are kept in a sorted index for
+// searching.
+class CSiteStore final
+{
+public:
+	struct node final
+	{
+		// As used in site paths
+		std::wstring name_;
+
+		pugi::xml_node element_;
+		node const* parent_{};
+
+		bool folder_{};
+		bool expanded_{};
+
+		// In document order
+		std::vector<std::unique_ptr<node>> children_;
+
+		// First child of each name, later duplicates cannot be addressed by path
+		std::map<std::wstring, node const*> index_;
+	};
+
+	explicit CSiteStore(std::wstring const& file);
+
+	CSiteStore(CSiteStore const&) = delete;
+	CSiteStore& operator=(CSiteStore const&) = delete;
+
+	// Sets error description on failure
+	bool Load();
+
+	std::wstring GetError() const { return file_.GetError(); }
+	std::wstring GetFileName() const { return file_.GetFileName(); }
+
+	bool IsFromFutureVersion() const { return file_.IsFromFutureVersion(); }
+
+	// Whether the file has been changed since it was loaded
+	bool Modified() { return file_.Modified(); }
+
+	node const& Root() const { return root_; }
+
+	// Returns nullptr if there is no folder or site with the given path
+	node const* Find(std::vector<std::wstring> const& segments) const;
+
+	static std::vector<std::wstring> GetSegments(node const& n);
+
+	size_t SiteCount() const { return siteCount_; }
+
+	// Sites whose name or host starts with the given term, ignoring case
+	std::vector<node const*> Search(std::wstring const& term) const;
+
+private:
+	void Add(node & parent, pugi::xml_node element);
+
+	CXmlFile file_;
+	node root_;
+	size_t siteCount_{};
+
+	// Sorted by lowercase name and host
+	std::vector<std::pair<std::wstring, node const*>> searchIndex_;
+};
+
+#endif
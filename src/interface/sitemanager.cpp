@@ -6,10 +6,13 @@
 #include "ipcmutex.h"
 #include "loginmanager.h"
 #include "Options.h"
+#include "site_store.h"
 #include "xmlfunctions.h"
 
 #include <libfilezilla/translate.hpp>
 
+#include <algorithm>
+
 namespace {
 struct background_color {
 	wxColour const color;
@@ -29,55 +32,44 @@ background_color const background_colors[] = {
 };
 }
 
-std::map<int, std::unique_ptr<Site>> CSiteManager::m_idMap;
+std::map<int, std::wstring> CSiteManager::m_idMap;
+std::shared_ptr<CSiteStore> CSiteManager::m_store;
+std::shared_ptr<CSiteStore> CSiteManager::m_predefinedStore;
 
-bool CSiteManager::Load(CSiteManagerXmlHandler& handler)
+std::shared_ptr<CSiteStore> CSiteManager::GetStore(wxChar root, std::wstring & error)
 {
-	CXmlFile file(wxGetApp().GetSettingsFile(_T("sitemanager")));
-	auto document = file.Load();
-	if (!document) {
-		wxMessageBoxEx(file.GetError(), _("Error loading xml file"), wxICON_ERROR);
-		return false;
+	std::wstring file;
+	if (root == '0') {
+		file = wxGetApp().GetSettingsFile(_T("sitemanager"));
+	}
+	else {
+		CLocalPath const defaultsDir = wxGetApp().GetDefaultsDir();
+		if (defaultsDir.empty()) {
+			return nullptr;
+		}
+		file = defaultsDir.GetPath() + _T("fzdefaults.xml");
 	}
 
-	auto element = document.child("Servers");
-	if (!element) {
-		return false;
+	auto & store = (root == '0') ? m_store : m_predefinedStore;
+	if (store && store->GetFileName() == file && !store->Modified()) {
+		return store;
 	}
+	store.reset();
 
-	return Load(element, handler);
+	auto newStore = std::make_shared<CSiteStore>(file);
+	if (!newStore->Load()) {
+		error = newStore->GetError();
+		return nullptr;
+	}
+
+	store = newStore;
+	return store;
 }
 
-bool CSiteManager::Load(pugi::xml_node element, CSiteManagerXmlHandler& handler)
+void CSiteManager::InvalidateStore()
 {
-	wxASSERT(element);
-
-	for (auto child = element.first_child(); child; child = child.next_sibling()) {
-		if (!strcmp(child.name(), "Folder")) {
-			std::wstring name = GetTextElement_Trimmed(child);
-			if (name.empty()) {
-				continue;
-			}
-
-			const bool expand = GetTextAttribute(child, "expanded") != _T("0");
-			if (!handler.AddFolder(name.substr(0, 255), expand)) {
-				return false;
-			}
-			Load(child, handler);
-			if (!handler.LevelUp()) {
-				return false;
-			}
-		}
-		else if (!strcmp(child.name(), "Server")) {
-			std::unique_ptr<Site> data = ReadServerElement(child);
-
-			if (data) {
-				handler.AddSite(std::move(data));
-			}
-		}
-	}
-
-	return true;
+	// Modification times are not precise enough to detect changes made in quick succession
+	m_store.reset();
 }
 
 bool CSiteManager::ReadBookmarkElement(Bookmark & bookmark, pugi::xml_node element)
@@ -130,134 +122,44 @@ std::unique_ptr<Site> CSiteManager::ReadServerElement(pugi::xml_node element)
 	return data;
 }
 
-class CSiteManagerXmlHandler_Menu : public CSiteManagerXmlHandler
+namespace {
+// Use same sorting as site tree in site manager
+bool MenuOrder(CSiteStore::node const* lhs, CSiteStore::node const* rhs)
 {
-public:
-	CSiteManagerXmlHandler_Menu(wxMenu* pMenu, std::map<int, std::unique_ptr<Site>> *idMap, bool predefined)
-		: m_pMenu(pMenu), m_idMap(idMap)
-	{
-		if (predefined) {
-			path = _T("1");
-		}
-		else {
-			path = _T("0");
-		}
-	}
-
-	unsigned int GetInsertIndex(wxMenu* pMenu, const wxString& name)
-	{
-		unsigned int i;
-		for (i = 0; i < pMenu->GetMenuItemCount(); ++i) {
-			const wxMenuItem* const pItem = pMenu->FindItemByPosition(i);
-			if (!pItem) {
-				continue;
-			}
-
-			// Use same sorting as site tree in site manager
 #ifdef __WXMSW__
-			if (pItem->GetItemLabelText().CmpNoCase(name) > 0) {
-				break;
-			}
+	return wxString(lhs->name_).CmpNoCase(rhs->name_) < 0;
 #else
-			if (pItem->GetItemLabelText() > name) {
-				break;
-			}
+	return lhs->name_ < rhs->name_;
 #endif
-		}
-
-		return i;
-	}
-
-	virtual bool AddFolder(std::wstring const& name, bool)
-	{
-		m_parents.push_back(m_pMenu);
-		m_childNames.push_back(name);
-		m_paths.push_back(path);
-		path += _T("/") + CSiteManager::EscapeSegment(name);
-
-		m_pMenu = new wxMenu;
-
-		return true;
-	}
-
-	virtual bool AddSite(std::unique_ptr<Site> data)
-	{
-		std::wstring newName(data->server.GetName());
-		int i = GetInsertIndex(m_pMenu, newName);
-		newName = LabelEscape(newName);
-		wxMenuItem* pItem = m_pMenu->Insert(i, wxID_ANY, newName);
-
-		data->SetSitePath(path + _T("/") + CSiteManager::EscapeSegment(data->server.GetName()));
-
-		(*m_idMap)[pItem->GetId()] = std::move(data);
-
-		return true;
-	}
-
-	// Go up a level
-	virtual bool LevelUp()
-	{
-		if (m_parents.empty() || m_childNames.empty()) {
-			return false;
-		}
-
-		wxMenu* pChild = m_pMenu;
-		m_pMenu = m_parents.back();
-		if (pChild->GetMenuItemCount()) {
-			std::wstring name = m_childNames.back();
-			int i = GetInsertIndex(m_pMenu, name);
-			name = LabelEscape(name);
-
-			wxMenuItem* pItem = new wxMenuItem(m_pMenu, wxID_ANY, name, _T(""), wxITEM_NORMAL, pChild);
-			m_pMenu->Insert(i, pItem);
-		}
-		else {
-			delete pChild;
-		}
-		m_childNames.pop_back();
-		m_parents.pop_back();
-
-		path = m_paths.back();
-		m_paths.pop_back();
-
-		return true;
-	}
-
-protected:
-	wxMenu* m_pMenu;
-
-	std::map<int, std::unique_ptr<Site>> *m_idMap;
-
-	std::deque<wxMenu*> m_parents;
-	std::deque<std::wstring> m_childNames;
-
-	std::wstring path;
-	std::deque<std::wstring> m_paths;
-};
-
+}
 
-class CSiteManagerXmlHandler_Stats : public CSiteManagerXmlHandler
+void AddSitesToMenu(wxMenu & menu, CSiteStore::node const& folder, std::wstring const& path, std::map<int, std::wstring> & idMap)
 {
-public:
-	virtual bool AddFolder(std::wstring const&, bool)
-	{
-		++directories_;
-		return true;
-	}
-
-	virtual bool AddSite(std::unique_ptr<Site> site)
-	{
-		if (site) {
-			++sites_;
-			bookmarks_ += site->m_bookmarks.size();
+	std::vector<CSiteStore::node const*> children;
+	children.reserve(folder.children_.size());
+	for (auto const& child : folder.children_) {
+		children.push_back(child.get());
+	}
+	std::stable_sort(children.begin(), children.end(), &MenuOrder);
+
+	for (auto const* child : children) {
+		std::wstring const label = LabelEscape(child->name_.substr(0, 255));
+		std::wstring const childPath = path + _T("/") + CSiteManager::EscapeSegment(child->name_);
+		if (child->folder_) {
+			auto submenu = std::make_unique<wxMenu>();
+			AddSitesToMenu(*submenu, *child, childPath, idMap);
+			if (submenu->GetMenuItemCount()) {
+				menu.AppendSubMenu(submenu.release(), label);
+			}
+		}
+		else if (!GetTextElement_Trimmed(child->element_, "Host").empty()) {
+			// The site itself only gets read once selected
+			wxMenuItem* pItem = menu.Append(wxID_ANY, label);
+			idMap[pItem->GetId()] = childPath;
 		}
-		return true;
 	}
-
-	unsigned int sites_{};
-	unsigned int directories_{};
-	unsigned int bookmarks_{};
-};
+}
+}
 
 std::unique_ptr<wxMenu> CSiteManager::GetSitesMenu()
 {
@@ -270,10 +172,16 @@ std::unique_ptr<wxMenu> CSiteManager::GetSitesMenu()
 	auto predefinedSites = GetSitesMenu_Predefined(m_idMap);
 
 	auto pMenu = std::make_unique<wxMenu>();
-	CSiteManagerXmlHandler_Menu handler(pMenu.get(), &m_idMap, false);
 
-	bool res = Load(handler);
-	if (!res || !pMenu->GetMenuItemCount()) {
+	std::wstring error;
+	auto store = GetStore('0', error);
+	if (store) {
+		AddSitesToMenu(*pMenu, store->Root(), _T("0"), m_idMap);
+	}
+	else {
+		wxMessageBoxEx(error, _("Error loading xml file"), wxICON_ERROR);
+	}
+	if (!pMenu->GetMenuItemCount()) {
 		pMenu.reset();
 	}
 
@@ -304,42 +212,16 @@ void CSiteManager::ClearIdMap()
 	m_idMap.clear();
 }
 
-bool CSiteManager::LoadPredefined(CSiteManagerXmlHandler& handler)
+std::unique_ptr<wxMenu> CSiteManager::GetSitesMenu_Predefined(std::map<int, std::wstring> &idMap)
 {
-	CLocalPath const defaultsDir = wxGetApp().GetDefaultsDir();
-	if (defaultsDir.empty()) {
-		return false;
-	}
-
-	std::wstring const name(defaultsDir.GetPath() + _T("fzdefaults.xml"));
-	CXmlFile file(name);
-
-	auto document = file.Load();
-	if (!document) {
-		return false;
-	}
-
-	auto element = document.child("Servers");
-	if (!element) {
-		return false;
-	}
-
-	if (!Load(element, handler)) {
-		return false;
-	}
-
-	return true;
-}
-
-std::unique_ptr<wxMenu> CSiteManager::GetSitesMenu_Predefined(std::map<int, std::unique_ptr<Site>> &idMap)
-{
-	auto pMenu = std::make_unique<wxMenu>();
-	CSiteManagerXmlHandler_Menu handler(pMenu.get(), &idMap, true);
-
-	if (!LoadPredefined(handler)) {
+	std::wstring error;
+	auto store = GetStore('1', error);
+	if (!store) {
 		return 0;
 	}
 
+	auto pMenu = std::make_unique<wxMenu>();
+	AddSitesToMenu(*pMenu, store->Root(), _T("1"), idMap);
 	if (!pMenu->GetMenuItemCount()) {
 		return 0;
 	}
@@ -349,15 +231,19 @@ std::unique_ptr<wxMenu> CSiteManager::GetSitesMenu_Predefined(std::map<int, std:
 
 std::unique_ptr<Site> CSiteManager::GetSiteById(int id)
 {
-	auto iter = m_idMap.find(id);
+	std::wstring sitePath;
 
-	std::unique_ptr<Site> pData;
+	auto iter = m_idMap.find(id);
 	if (iter != m_idMap.end()) {
-		pData = std::move(iter->second);
+		sitePath = iter->second;
 	}
 	ClearIdMap();
 
-	return pData;
+	if (sitePath.empty()) {
+		return nullptr;
+	}
+
+	return GetSiteByPath(sitePath, false).first;
 }
 
 bool CSiteManager::UnescapeSitePath(std::wstring path, std::vector<std::wstring>& result)
@@ -452,28 +338,15 @@ std::pair<std::unique_ptr<Site>, Bookmark> CSiteManager::DoGetSiteByPath(std::ws
 	// to the same file or one is reading while the other one writes.
 	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
 
-	CXmlFile file;
-	if (c == '0') {
-		file.SetFileName(wxGetApp().GetSettingsFile(_T("sitemanager")));
-	}
-	else {
-		CLocalPath const defaultsDir = wxGetApp().GetDefaultsDir();
-		if (defaultsDir.empty()) {
+	std::wstring loadError;
+	auto store = GetStore(c, loadError);
+	if (!store) {
+		if (loadError.empty()) {
 			error = _("Site does not exist.");
-			return ret;
 		}
-		file.SetFileName(defaultsDir.GetPath() + _T("fzdefaults.xml"));
-	}
-
-	auto document = file.Load();
-	if (!document) {
-		wxMessageBoxEx(file.GetError(), _("Error loading xml file"), wxICON_ERROR);
-		return ret;
-	}
-
-	auto element = document.child("Servers");
-	if (!element) {
-		error = _("Site does not exist.");
+		else {
+			wxMessageBoxEx(loadError, _("Error loading xml file"), wxICON_ERROR);
+		}
 		return ret;
 	}
 
@@ -483,19 +356,31 @@ std::pair<std::unique_ptr<Site>, Bookmark> CSiteManager::DoGetSiteByPath(std::ws
 		return ret;
 	}
 
-	auto child = GetElementByPath(element, segments);
+	pugi::xml_node child;
+	pugi::xml_node bookmark;
+	if (auto const* node = store->Find(segments)) {
+		child = node->element_;
+	}
+	else if (segments.size() > 1) {
+		// Last segment may name a bookmark of the site
+		std::vector<std::wstring> const siteSegments(segments.cbegin(), segments.cend() - 1);
+		auto const* node = store->Find(siteSegments);
+		if (node && !node->folder_) {
+			for (auto element = node->element_.child("Bookmark"); element; element = element.next_sibling("Bookmark")) {
+				if (GetTextElement_Trimmed(element, "Name") == segments.back()) {
+					child = node->element_;
+					bookmark = element;
+					segments.pop_back();
+					break;
+				}
+			}
+		}
+	}
 	if (!child) {
 		error = _("Site does not exist.");
 		return ret;
 	}
 
-	pugi::xml_node bookmark;
-	if (!strcmp(child.name(), "Bookmark")) {
-		bookmark = child;
-		child = child.parent();
-		segments.pop_back();
-	}
-
 	ret.first = ReadServerElement(child);
 	if (!ret.first) {
 		error = _("Could not read server item.");
@@ -570,6 +455,7 @@ std::wstring CSiteManager::AddServer(Site site)
 	SetServer(xServer, site);
 	AddTextElement(xServer, name);
 
+	InvalidateStore();
 	if (!file.Save(false)) {
 		if (COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) == 2) {
 			return std::wstring();
@@ -695,6 +581,7 @@ bool CSiteManager::AddBookmark(std::wstring sitePath, const wxString& name, cons
 		AddTextElementUtf8(bookmark, "DirectoryComparison", "1");
 	}
 
+	InvalidateStore();
 	if (!file.Save(false)) {
 		if (COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) == 2) {
 			return true;
@@ -752,6 +639,7 @@ bool CSiteManager::ClearBookmarks(std::wstring sitePath)
 		bookmark = child.child("Bookmark");
 	}
 
+	InvalidateStore();
 	if (!file.Save(false)) {
 		if (COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) == 2) {
 			return true;
@@ -766,10 +654,16 @@ bool CSiteManager::ClearBookmarks(std::wstring sitePath)
 
 bool CSiteManager::HasSites()
 {
-	CSiteManagerXmlHandler_Stats handler;
-	Load(handler);
+	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
+
+	std::wstring error;
+	auto store = GetStore('0', error);
+	if (!store) {
+		wxMessageBoxEx(error, _("Error loading xml file"), wxICON_ERROR);
+		return false;
+	}
 
-	return handler.sites_ > 0;
+	return store->SiteCount() > 0;
 }
 
 wxColour CSiteManager::GetColourFromIndex(int i)
@@ -841,6 +735,7 @@ void CSiteManager::Rewrite(CLoginManager & loginManager, bool on_failure_set_to_
 
 	Rewrite(loginManager, element, on_failure_set_to_ask);
 
+	InvalidateStore();
 	file.Save(true);
 }
 
@@ -935,6 +830,7 @@ bool CSiteManager::ImportSites(pugi::xml_node sites)
 		return false;
 	}
 
+	InvalidateStore();
 	return file.Save(true);
 }
 
@@ -5,22 +5,11 @@
 
 #include "xmlfunctions.h"
 
-class CSiteManagerXmlHandler
-{
-public:
-	virtual ~CSiteManagerXmlHandler() {};
-
-	// Adds a folder and descents
-	virtual bool AddFolder(std::wstring const& name, bool expanded) = 0;
-	virtual bool AddSite(std::unique_ptr<Site> data) = 0;
-
-	// Go up a level
-	virtual bool LevelUp() { return true; } // *Ding*
-};
+#include <memory>
 
 class CLoginManager;
-class CSiteManagerXmlHandler;
 class CSiteManagerDialog;
+class CSiteStore;
 class CSiteManager
 {
 	friend class CSiteManagerDialog;
@@ -59,19 +48,24 @@ protected:
 
 	static std::pair<std::unique_ptr<Site>, Bookmark> DoGetSiteByPath(std::wstring sitePath, wxString& error);
 
-	static bool Load(CSiteManagerXmlHandler& pHandler);
-	static bool Load(pugi::xml_node element, CSiteManagerXmlHandler& pHandler);
 	static std::unique_ptr<Site> ReadServerElement(pugi::xml_node element);
 
 	static pugi::xml_node GetElementByPath(pugi::xml_node node, std::vector<std::wstring> const& segments);
 	static std::wstring BuildPath(wxChar root, std::vector<std::wstring> const& segments);
 
-	static std::map<int, std::unique_ptr<Site>> m_idMap;
+	// Returns the index of the own sites for root '0' or of the predefined
+	// sites for root '1'. The index is kept until the file changes.
+	// Needs to be called with MUTEX_SITEMANAGER held.
+	static std::shared_ptr<CSiteStore> GetStore(wxChar root, std::wstring & error);
+	static void InvalidateStore();
+
+	// Maps event id's to site paths
+	static std::map<int, std::wstring> m_idMap;
 
-	// The map maps event id's to sites
-	static std::unique_ptr<wxMenu> GetSitesMenu_Predefined(std::map<int, std::unique_ptr<Site>> &idMap);
+	static std::unique_ptr<wxMenu> GetSitesMenu_Predefined(std::map<int, std::wstring> &idMap);
 
-	static bool LoadPredefined(CSiteManagerXmlHandler& handler);
+	static std::shared_ptr<CSiteStore> m_store;
+	static std::shared_ptr<CSiteStore> m_predefinedStore;
 };
 
 #endif
@@ -42,6 +42,8 @@ EVT_TREE_ITEM_MENU(XRCID("ID_SITETREE"), CSiteManagerDialog::OnContextMenu)
 EVT_MENU(XRCID("ID_EXPORT"), CSiteManagerDialog::OnExportSelected)
 EVT_BUTTON(XRCID("ID_NEWBOOKMARK"), CSiteManagerDialog::OnNewBookmark)
 EVT_BUTTON(XRCID("ID_BOOKMARK_BROWSE"), CSiteManagerDialog::OnBookmarkBrowse)
+EVT_TREE_ITEM_EXPANDING(XRCID("ID_SITETREE"), CSiteManagerDialog::OnItemExpanding)
+EVT_TEXT_ENTER(XRCID("ID_SITESEARCH"), CSiteManagerDialog::OnSearch)
 END_EVENT_TABLE()
 
 class CSiteManagerItemData : public wxTreeItemData
@@ -418,22 +420,9 @@ void CSiteManagerDialog::MarkConnectedSite(int connected_site)
 		return;
 	}
 
-	wxTreeItemId current = m_ownSites;
-	for (auto const& segment : segments) {
-		wxTreeItemIdValue c;
-		wxTreeItemId child = pTree->GetFirstChild(current, c);
-		while (child) {
-			if (pTree->GetItemText(child) == segment) {
-				break;
-			}
-
-			child = pTree->GetNextChild(current, c);
-		}
-		if (!child) {
-			return;
-		}
-
-		current = child;
+	wxTreeItemId current = FindItem(m_ownSites, segments);
+	if (!current) {
+		return;
 	}
 
 	CSiteManagerItemData* data = static_cast<CSiteManagerItemData* >(pTree->GetItemData(current));
@@ -505,56 +494,112 @@ void CSiteManagerDialog::OnConnect(wxCommandEvent&)
 	EndModal(wxID_YES);
 }
 
-class CSiteManagerXmlHandler_Tree : public CSiteManagerXmlHandler
+bool CSiteManagerDialog::Load()
 {
-public:
-	CSiteManagerXmlHandler_Tree(wxTreeCtrlEx* pTree, wxTreeItemId root, std::wstring const& lastSelection, bool predefined)
-		: m_pTree(pTree), m_item(root), m_predefined(predefined)
-	{
-		if (!CSiteManager::UnescapeSitePath(lastSelection, m_lastSelection)) {
-			m_lastSelection.clear();
+	wxTreeCtrlEx *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrlEx);
+	if (!pTree) {
+		return false;
+	}
+
+	pTree->DeleteAllItems();
+	m_unloaded.clear();
+
+	// We have to synchronize access to sitemanager.xml so that multiple processed don't write
+	// to the same file or one is reading while the other one writes.
+	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
+
+	// Load default sites
+	bool hasDefaultSites = LoadDefaultSites();
+	if (hasDefaultSites) {
+		m_ownSites = pTree->AppendItem(pTree->GetRootItem(), _("My Sites"), 0, 0);
+	}
+	else {
+		m_ownSites = pTree->AddRoot(_("My Sites"), 0, 0);
+	}
+
+	wxTreeItemId treeId = m_ownSites;
+	pTree->SetItemImage(treeId, 1, wxTreeItemIcon_Expanded);
+	pTree->SetItemImage(treeId, 1, wxTreeItemIcon_SelectedExpanded);
+
+	std::wstring error;
+	m_store = CSiteManager::GetStore('0', error);
+	if (!m_store) {
+		wxString msg = error + _T("\n") + _("The Site Manager cannot be used unless the file gets repaired.");
+		wxMessageBoxEx(msg, _("Error loading xml file"), wxICON_ERROR);
+
+		return false;
+	}
+
+	if (m_store->IsFromFutureVersion()) {
+		wxString msg = wxString::Format(_("The file '%s' has been created by a more recent version of FileZilla.\nLoading files created by newer versions can result in loss of data.\nDo you want to continue?"), m_store->GetFileName());
+		if (wxMessageBoxEx(msg, _("Detected newer version of FileZilla"), wxICON_QUESTION | wxYES_NO) != wxYES) {
+			return false;
+		}
+	}
+
+	AddChildren(treeId, m_store->Root(), false);
+	pTree->Expand(treeId);
+
+	std::wstring const lastSelection = COptions::Get()->GetOption(OPTION_SITEMANAGER_LASTSELECTED);
+	if (!lastSelection.empty()) {
+		wxTreeItemId root;
+		if (lastSelection[0] == '0') {
+			root = m_ownSites;
+		}
+		else if (lastSelection[0] == '1') {
+			root = m_predefinedSites;
 		}
-		m_lastSelectionIt = m_lastSelection.cbegin();
 
-		m_kiosk = COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE);
+		std::vector<std::wstring> segments;
+		if (root && (lastSelection.size() == 1 || CSiteManager::UnescapeSitePath(lastSelection.substr(1), segments))) {
+			wxTreeItemId item = FindItem(root, segments);
+			if (item) {
+				pTree->SafeSelectItem(item);
+			}
+		}
 	}
 
-	virtual ~CSiteManagerXmlHandler_Tree()
-	{
-		m_pTree->SortChildren(m_item);
-		m_pTree->Expand(m_item);
+	if (!pTree->GetSelection()) {
+		pTree->SafeSelectItem(treeId);
 	}
 
-	virtual bool AddFolder(std::wstring const& name, bool expanded)
-	{
-		wxTreeItemId newItem = m_pTree->AppendItem(m_item, name, 0, 0);
-		m_pTree->SetItemImage(newItem, 1, wxTreeItemIcon_Expanded);
-		m_pTree->SetItemImage(newItem, 1, wxTreeItemIcon_SelectedExpanded);
-
-		m_item = newItem;
-		m_expand.push_back(expanded);
-
-		if (!m_wrong_sel_depth && m_lastSelectionIt != m_lastSelection.cend()) {
-			if (*m_lastSelectionIt == name) {
-				++m_lastSelectionIt;
-				if (m_lastSelectionIt == m_lastSelection.cend()) {
-					m_pTree->SafeSelectItem(newItem);
-				}
+	pTree->EnsureVisible(pTree->GetSelection());
+
+	return true;
+}
+
+void CSiteManagerDialog::AddChildren(wxTreeItemId parent, CSiteStore::node const& folder, bool predefined)
+{
+	wxTreeCtrlEx *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrlEx);
+	if (!pTree) {
+		return;
+	}
+
+	int const kiosk = COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE);
+
+	for (auto const& child : folder.children_) {
+		if (child->folder_) {
+			wxTreeItemId newItem = pTree->AppendItem(parent, child->name_.substr(0, 255), 0, 0);
+			pTree->SetItemImage(newItem, 1, wxTreeItemIcon_Expanded);
+			pTree->SetItemImage(newItem, 1, wxTreeItemIcon_SelectedExpanded);
+
+			if (child->expanded_) {
+				AddChildren(newItem, *child, predefined);
+				pTree->Expand(newItem);
 			}
-			else {
-				++m_wrong_sel_depth;
+			else if (!child->children_.empty()) {
+				m_unloaded[newItem.GetID()] = child.get();
+				pTree->SetItemHasChildren(newItem, true);
 			}
-		}
-		else {
-			++m_wrong_sel_depth;
+			continue;
 		}
 
-		return true;
-	}
+		std::unique_ptr<Site> data = CSiteManager::ReadServerElement(child->element_);
+		if (!data) {
+			continue;
+		}
 
-	virtual bool AddSite(std::unique_ptr<Site> data)
-	{
-		if (m_kiosk && !m_predefined &&
+		if (kiosk && !predefined &&
 			data->credentials.logonType_ == LogonType::normal)
 		{
 			// Clear saved password
@@ -566,157 +611,98 @@ public:
 		std::wstring const name = data->server.GetName();
 
 		CSiteManagerItemData* pData = new CSiteManagerItemData(std::move(data));
-		wxTreeItemId newItem = m_pTree->AppendItem(m_item, name, 2, 2, pData);
-
-		bool can_select = false;
-		if (!m_wrong_sel_depth && m_lastSelectionIt != m_lastSelection.cend()) {
-			if (*m_lastSelectionIt == name) {
-				++m_lastSelectionIt;
-				can_select = true;
-				if (m_lastSelectionIt == m_lastSelection.cend()) {
-					m_pTree->SafeSelectItem(newItem);
-				}
-			}
-		}
+		wxTreeItemId newItem = pTree->AppendItem(parent, name, 2, 2, pData);
 
 		for (auto const& bookmark : pData->m_site->m_bookmarks) {
-			AddBookmark(newItem, bookmark, can_select);
+			CSiteManagerItemData* pBookmarkData = new CSiteManagerItemData;
+			pBookmarkData->m_bookmark = std::make_unique<Bookmark>(bookmark);
+			pTree->AppendItem(newItem, bookmark.m_name, 3, 3, pBookmarkData);
 		}
 
-		m_pTree->SortChildren(newItem);
-		m_pTree->Expand(newItem);
-
-		return true;
+		pTree->SortChildren(newItem);
+		pTree->Expand(newItem);
 	}
 
-	bool AddBookmark(wxTreeItemId const& parent, Bookmark const& bookmark, bool can_select)
-	{
-		CSiteManagerItemData* pData = new CSiteManagerItemData;
-		pData->m_bookmark = std::make_unique<Bookmark>(bookmark);
-		wxTreeItemId newItem = m_pTree->AppendItem(parent, bookmark.m_name, 3, 3, pData);
-
-		if (can_select && m_lastSelectionIt != m_lastSelection.cend()) {
-			if (*m_lastSelectionIt == bookmark.m_name) {
-				++m_lastSelectionIt;
-				if (m_lastSelectionIt == m_lastSelection.cend()) {
-					m_pTree->SafeSelectItem(newItem);
-				}
-			}
-		}
+	pTree->SortChildren(parent);
+}
 
-		return true;
+void CSiteManagerDialog::LoadChildren(wxTreeItemId item)
+{
+	auto it = m_unloaded.find(item.GetID());
+	if (it == m_unloaded.end()) {
+		return;
 	}
 
-	virtual bool LevelUp()
-	{
-		if (m_wrong_sel_depth) {
-			m_wrong_sel_depth--;
-		}
+	CSiteStore::node const* folder = it->second;
+	m_unloaded.erase(it);
 
-		if (!m_expand.empty()) {
-			const bool expand = m_expand.back();
-			m_expand.pop_back();
-			if (expand) {
-				m_pTree->Expand(m_item);
-			}
-		}
-		m_pTree->SortChildren(m_item);
-
-		wxTreeItemId parent = m_pTree->GetItemParent(m_item);
-		if (!parent) {
-			return false;
-		}
+	AddChildren(item, *folder, IsPredefinedItem(item));
+}
 
-		m_item = parent;
-		return true;
+void CSiteManagerDialog::LoadSubtree(wxTreeItemId item)
+{
+	wxTreeCtrl *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrl);
+	if (!pTree || pTree->GetItemData(item)) {
+		return;
 	}
 
-protected:
-	wxTreeCtrlEx * const m_pTree;
-	wxTreeItemId m_item;
+	LoadChildren(item);
 
-	std::vector<std::wstring> m_lastSelection;
-	std::vector<std::wstring>::const_iterator m_lastSelectionIt;
-	int m_wrong_sel_depth{};
-
-	std::vector<bool> m_expand;
-
-	bool const m_predefined{};
-	int m_kiosk{};
-};
+	wxTreeItemIdValue cookie;
+	for (wxTreeItemId child = pTree->GetFirstChild(item, cookie); child.IsOk(); child = pTree->GetNextChild(item, cookie)) {
+		LoadSubtree(child);
+	}
+}
 
-bool CSiteManagerDialog::Load()
+void CSiteManagerDialog::ForgetUnloaded(wxTreeItemId item)
 {
-	wxTreeCtrlEx *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrlEx);
-	if (!pTree) {
-		return false;
+	// Item ids can get reused once the item is deleted
+	wxTreeCtrl *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrl);
+	if (!pTree || pTree->GetItemData(item)) {
+		return;
 	}
 
-	pTree->DeleteAllItems();
-
-	// We have to synchronize access to sitemanager.xml so that multiple processed don't write
-	// to the same file or one is reading while the other one writes.
-	CInterProcessMutex mutex(MUTEX_SITEMANAGER);
+	m_unloaded.erase(item.GetID());
 
-	// Load default sites
-	bool hasDefaultSites = LoadDefaultSites();
-	if (hasDefaultSites) {
-		m_ownSites = pTree->AppendItem(pTree->GetRootItem(), _("My Sites"), 0, 0);
-	}
-	else {
-		m_ownSites = pTree->AddRoot(_("My Sites"), 0, 0);
+	wxTreeItemIdValue cookie;
+	for (wxTreeItemId child = pTree->GetFirstChild(item, cookie); child.IsOk(); child = pTree->GetNextChild(item, cookie)) {
+		ForgetUnloaded(child);
 	}
+}
 
-	wxTreeItemId treeId = m_ownSites;
-	pTree->SetItemImage(treeId, 1, wxTreeItemIcon_Expanded);
-	pTree->SetItemImage(treeId, 1, wxTreeItemIcon_SelectedExpanded);
-
-	CXmlFile file(wxGetApp().GetSettingsFile(_T("sitemanager")));
-	auto document = file.Load();
-	if (!document) {
-		wxString msg = file.GetError() + _T("\n") + _("The Site Manager cannot be used unless the file gets repaired.");
-		wxMessageBoxEx(msg, _("Error loading xml file"), wxICON_ERROR);
-
-		return false;
+wxTreeItemId CSiteManagerDialog::FindItem(wxTreeItemId root, std::vector<std::wstring> const& segments)
+{
+	wxTreeCtrl *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrl);
+	if (!pTree) {
+		return wxTreeItemId();
 	}
 
-	if (file.IsFromFutureVersion()) {
-		wxString msg = wxString::Format(_("The file '%s' has been created by a more recent version of FileZilla.\nLoading files created by newer versions can result in loss of data.\nDo you want to continue?"), file.GetFileName());
-		if (wxMessageBoxEx(msg, _("Detected newer version of FileZilla"), wxICON_QUESTION | wxYES_NO) != wxYES) {
-			return false;
-		}
-	}
+	wxTreeItemId current = root;
+	for (auto const& segment : segments) {
+		LoadChildren(current);
 
-	auto element = document.child("Servers");
-	if (!element) {
-		return true;
-	}
+		wxTreeItemIdValue c;
+		wxTreeItemId child = pTree->GetFirstChild(current, c);
+		while (child) {
+			if (pTree->GetItemText(child) == segment) {
+				break;
+			}
 
-	std::wstring lastSelection = COptions::Get()->GetOption(OPTION_SITEMANAGER_LASTSELECTED);
-	if (!lastSelection.empty() && lastSelection[0] == '0') {
-		if (lastSelection == _T("0")) {
-			pTree->SafeSelectItem(treeId);
+			child = pTree->GetNextChild(current, c);
 		}
-		else {
-			lastSelection = lastSelection.substr(1);
+		if (!child) {
+			return wxTreeItemId();
 		}
-	}
-	else {
-		lastSelection.clear();
-	}
-	CSiteManagerXmlHandler_Tree handler(pTree, treeId, lastSelection, false);
 
-	bool res = CSiteManager::Load(element, handler);
-
-	pTree->SortChildren(treeId);
-	pTree->Expand(treeId);
-	if (!pTree->GetSelection()) {
-		pTree->SafeSelectItem(treeId);
+		current = child;
 	}
 
-	pTree->EnsureVisible(pTree->GetSelection());
+	return current;
+}
 
-	return res;
+void CSiteManagerDialog::OnItemExpanding(wxTreeEvent& event)
+{
+	LoadChildren(event.GetItem());
 }
 
 bool CSiteManagerDialog::Save(pugi::xml_node element, wxTreeItemId treeId)
@@ -758,6 +744,7 @@ bool CSiteManagerDialog::Save(pugi::xml_node element, wxTreeItemId treeId)
 
 		bool res = Save(element, m_ownSites);
 
+		CSiteManager::InvalidateStore();
 		if (!xml.Save(false)) {
 			if (COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE) == 2) {
 				return res;
@@ -796,7 +783,22 @@ bool CSiteManagerDialog::SaveChild(pugi::xml_node element, wxTreeItemId child)
 		const bool expanded = pTree->IsExpanded(child);
 		SetTextAttribute(node, "expanded", expanded ? _T("1") : _T("0"));
 		AddTextElement(node, name);
-		Save(node, child);
+
+		if (COptions::Get()->GetOptionVal(OPTION_DEFAULT_KIOSKMODE)) {
+			// Saved passwords need to get cleared
+			LoadChildren(child);
+		}
+
+		auto it = m_unloaded.find(child.GetID());
+		if (it != m_unloaded.end()) {
+			// Contents have never been shown, so they cannot have been changed
+			for (auto const& entry : it->second->children_) {
+				node.append_copy(entry->element_);
+			}
+		}
+		else {
+			Save(node, child);
+		}
 	}
 	else if (data->m_site) {
 		auto node = element.append_child("Server");
@@ -1042,6 +1044,7 @@ void CSiteManagerDialog::OnDelete(wxCommandEvent&)
 
 	m_is_deleting = true;
 
+	ForgetUnloaded(item);
 	pTree->Delete(item);
 	pTree->SafeSelectItem(parent);
 
@@ -1413,20 +1416,9 @@ void CSiteManagerDialog::OnCopySite(wxCommandEvent&)
 
 bool CSiteManagerDialog::LoadDefaultSites()
 {
-	CLocalPath const defaultsDir = wxGetApp().GetDefaultsDir();
-	if (defaultsDir.empty()) {
-		return false;
-	}
-
-	CXmlFile file(defaultsDir.GetPath() + _T("fzdefaults.xml"));
-
-	auto document = file.Load();
-	if (!document) {
-		return false;
-	}
-
-	auto element = document.child("Servers");
-	if (!element) {
+	std::wstring error;
+	m_predefinedStore = CSiteManager::GetStore('1', error);
+	if (!m_predefinedStore || !m_predefinedStore->Root().element_) {
 		return false;
 	}
 
@@ -1443,21 +1435,8 @@ bool CSiteManagerDialog::LoadDefaultSites()
 	pTree->SetItemImage(m_predefinedSites, 1, wxTreeItemIcon_Expanded);
 	pTree->SetItemImage(m_predefinedSites, 1, wxTreeItemIcon_SelectedExpanded);
 
-	std::wstring lastSelection = COptions::Get()->GetOption(OPTION_SITEMANAGER_LASTSELECTED);
-	if (!lastSelection.empty() && lastSelection[0] == '1') {
-		if (lastSelection == _T("1")) {
-			pTree->SafeSelectItem(m_predefinedSites);
-		}
-		else {
-			lastSelection = lastSelection.substr(1);
-		}
-	}
-	else {
-		lastSelection.clear();
-	}
-	CSiteManagerXmlHandler_Tree handler(pTree, m_predefinedSites, lastSelection, true);
-
-	CSiteManager::Load(element, handler);
+	AddChildren(m_predefinedSites, m_predefinedStore->Root(), true);
+	pTree->Expand(m_predefinedSites);
 
 	return true;
 }
@@ -1573,6 +1552,10 @@ bool CSiteManagerDialog::MoveItems(wxTreeItemId source, wxTreeItemId target, boo
 		return false;
 	}
 
+	// Everything that gets copied has to be in the tree
+	LoadChildren(target);
+	LoadSubtree(source);
+
 	wxString sourceName = pTree->GetItemText(source);
 
 
@@ -1679,6 +1662,9 @@ wxString CSiteManagerDialog::FindFirstFreeName(const wxTreeItemId &parent, const
 	wxTreeCtrl *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrl);
 	wxASSERT(pTree);
 
+	// New items get added to the parent, so its existing children need to be there
+	LoadChildren(parent);
+
 	wxString newName = name;
 	int index = 2;
 	for (;;) {
@@ -1889,3 +1875,45 @@ std::wstring CSiteManagerDialog::GetSitePath(wxTreeItemId item, bool stripBookma
 
 	return _T("0") + path;
 }
+
+void CSiteManagerDialog::OnSearch(wxCommandEvent&)
+{
+	wxTreeCtrlEx *pTree = XRCCTRL(*this, "ID_SITETREE", wxTreeCtrlEx);
+	if (!pTree) {
+		return;
+	}
+
+	std::wstring const term = xrc_call(*this, "ID_SITESEARCH", &wxTextCtrl::GetValue).ToStdWstring();
+	if (term != m_searchTerm) {
+		m_searchTerm = term;
+		m_searchResults.clear();
+		m_searchPos = 0;
+
+		if (m_predefinedStore && m_predefinedSites) {
+			for (auto const* node : m_predefinedStore->Search(term)) {
+				m_searchResults.emplace_back(m_predefinedSites, node);
+			}
+		}
+		if (m_store) {
+			for (auto const* node : m_store->Search(term)) {
+				m_searchResults.emplace_back(m_ownSites, node);
+			}
+		}
+	}
+
+	// Repeated searches cycle through the matches. The index reflects the file
+	// as loaded, matches that have since been renamed or removed are skipped.
+	for (size_t i = 0; i < m_searchResults.size(); ++i) {
+		auto const& result = m_searchResults[m_searchPos];
+		m_searchPos = (m_searchPos + 1) % m_searchResults.size();
+
+		wxTreeItemId item = FindItem(result.first, CSiteStore::GetSegments(*result.second));
+		if (item) {
+			pTree->EnsureVisible(item);
+			pTree->SafeSelectItem(item);
+			return;
+		}
+	}
+
+	wxBell();
+}
@@ -2,6 +2,7 @@
 #define FILEZILLA_INTERFACE_SITEMANAGER_DIALOG_HEADER
 
 #include "dialogex.h"
+#include "site_store.h"
 #include "sitemanager.h"
 
 class CInterProcessMutex;
@@ -46,6 +47,15 @@ protected:
 
 	bool IsPredefinedItem(wxTreeItemId item);
 
+	// Folders only get filled from the store once expanded or otherwise needed
+	void AddChildren(wxTreeItemId parent, CSiteStore::node const& folder, bool predefined);
+	void LoadChildren(wxTreeItemId item);
+	void LoadSubtree(wxTreeItemId item);
+	void ForgetUnloaded(wxTreeItemId item);
+
+	// Loads folders along the path as needed
+	wxTreeItemId FindItem(wxTreeItemId root, std::vector<std::wstring> const& segments);
+
 	wxString FindFirstFreeName(const wxTreeItemId &parent, const wxString& name);
 
 	void AddNewSite(wxTreeItemId parent, Site const& site, bool connected = false);
@@ -79,6 +89,8 @@ protected:
 	void OnExportSelected(wxCommandEvent&);
 	void OnNewBookmark(wxCommandEvent&);
 	void OnBookmarkBrowse(wxCommandEvent&);
+	void OnItemExpanding(wxTreeEvent& event);
+	void OnSearch(wxCommandEvent&);
 
 	CInterProcessMutex* m_pSiteManagerMutex{};
 
@@ -89,6 +101,16 @@ protected:
 
 	wxTreeItemId m_contextMenuItem;
 
+	std::shared_ptr<CSiteStore> m_store;
+	std::shared_ptr<CSiteStore> m_predefinedStore;
+
+	// Folder items not yet filled, by item id
+	std::map<void*, CSiteStore::node const*> m_unloaded;
+
+	std::wstring m_searchTerm;
+	std::vector<std::pair<wxTreeItemId, CSiteStore::node const*>> m_searchResults;
+	size_t m_searchPos{};
+
 	bool MoveItems(wxTreeItemId source, wxTreeItemId target, bool copy);
 
 protected:
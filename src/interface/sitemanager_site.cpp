@@ -365,8 +365,17 @@ void CSiteManagerSite::SetControlVisibility(ServerProtocol protocol, LogonType t
 		paramIt[i] = extraParameters_[i].begin();
 	}
 
+	bool tcpTuning{};
+
 	std::vector<ParameterTraits> const& parameterTraits = ExtraServerParameterTraits(protocol);
 	for (auto const& trait : parameterTraits) {
+		if (trait.section_ == ParameterSection::custom) {
+			if (trait.name_ == "tcp_congestion") {
+				tcpTuning = true;
+			}
+			continue;
+		}
+
 		auto & parameters = extraParameters_[trait.section_];
 		auto & it = paramIt[trait.section_];
 
@@ -444,6 +453,16 @@ void CSiteManagerSite::SetControlVisibility(ServerProtocol protocol, LogonType t
 		}
 	}
 
+	auto transferPageSizer = xrc_call(*this, "ID_LIMITMULTIPLE", &wxWindow::GetContainingSizer);
+	if (transferPageSizer) {
+		auto tcpSizerItem = transferPageSizer->GetItemById(XRCID("ID_TCP_SIZERITEM"));
+		if (tcpSizerItem) {
+			tcpSizerItem->Show(tcpTuning);
+			transferPageSizer->CalcMin();
+			transferPageSizer->Layout();
+		}
+	}
+
 	if (CServer::ProtocolHasFeature(protocol, ProtocolFeature::Charset)) {
 		if (GetPageCount() != m_totalPages) {
 			AddPage(m_pCharsetPage, m_charsetPageText);
@@ -669,6 +688,15 @@ bool CSiteManagerSite::Verify(bool predefined)
 
 	std::vector<ParameterTraits> const& parameterTraits = ExtraServerParameterTraits(protocol);
 	for (auto const& trait : parameterTraits) {
+		if (trait.section_ == ParameterSection::custom) {
+			if (trait.name_ == "tcp_bandwidth" && GetCustomParameter("tcp_buffers") == L"rtt" && GetCustomParameter(trait.name_).empty()) {
+				xrc_call(*this, "ID_TCP_BANDWIDTH", &wxWindow::SetFocus);
+				wxMessageBoxEx(_("You need to enter the bandwidth of the connection to size the socket buffers from the round-trip time."), _("Site Manager - Invalid data"), wxICON_EXCLAMATION, this);
+				return false;
+			}
+			continue;
+		}
+
 		if (!(trait.flags_ & ParameterTraits::optional)) {
 			auto & controls = *paramIt[trait.section_];
 			if (controls.second->GetValue().empty()) {
@@ -782,6 +810,8 @@ void CSiteManagerSite::UpdateSite(Site &site)
 
 void CSiteManagerSite::UpdateExtraParameters(CServer & server)
 {
+	// Only some custom parameters have controls, the others keep their value
+	auto const oldParameters = server.GetExtraParameters();
 	server.ClearExtraParameters();
 	
 	std::vector<std::pair<wxStaticText*, wxTextCtrl*>>::iterator paramIt[ParameterSection::section_count];
@@ -793,6 +823,18 @@ void CSiteManagerSite::UpdateExtraParameters(CServer & server)
 		if (trait.section_ == ParameterSection::credentials) {
 			continue;
 		}
+		if (trait.section_ == ParameterSection::custom) {
+			if (HasCustomControl(trait.name_)) {
+				server.SetExtraParameter(trait.name_, GetCustomParameter(trait.name_));
+			}
+			else {
+				auto const it = oldParameters.find(trait.name_);
+				if (it != oldParameters.cend()) {
+					server.SetExtraParameter(trait.name_, it->second);
+				}
+			}
+			continue;
+		}
 
 		server.SetExtraParameter(trait.name_, paramIt[trait.section_]->second->GetValue().ToStdWstring());
 		++paramIt[trait.section_];
@@ -821,6 +863,11 @@ void CSiteManagerSite::SetSite(Site const& site, bool predefined)
 	xrc_call(*this, "ID_TIMEZONE_HOURS", &wxWindow::Enable, !predefined);
 	xrc_call(*this, "ID_TIMEZONE_MINUTES", &wxWindow::Enable, !predefined);
 	xrc_call(*this, "ID_LIMITMULTIPLE", &wxWindow::Enable, !predefined);
+	xrc_call(*this, "ID_TCP_CONGESTION", &wxWindow::Enable, !predefined);
+	xrc_call(*this, "ID_TCP_BUFFERS", &wxWindow::Enable, !predefined);
+	xrc_call(*this, "ID_TCP_BANDWIDTH", &wxWindow::Enable, !predefined);
+	xrc_call(*this, "ID_TCP_NOTSENT_LOWAT", &wxWindow::Enable, !predefined);
+	xrc_call(*this, "ID_TCP_QUICKACK", &wxWindow::Enable, !predefined);
 	xrc_call(*this, "ID_CHARSET_AUTO", &wxWindow::Enable, !predefined);
 	xrc_call(*this, "ID_CHARSET_UTF8", &wxWindow::Enable, !predefined);
 	xrc_call(*this, "ID_CHARSET_CUSTOM", &wxWindow::Enable, !predefined);
@@ -858,6 +905,12 @@ void CSiteManagerSite::SetSite(Site const& site, bool predefined)
 		xrc_call(*this, "ID_MAXMULTIPLE", &wxSpinCtrl::Enable, false);
 		xrc_call<wxSpinCtrl, int>(*this, "ID_MAXMULTIPLE", &wxSpinCtrl::SetValue, 1);
 
+		xrc_call(*this, "ID_TCP_CONGESTION", &wxTextCtrl::ChangeValue, wxString());
+		xrc_call(*this, "ID_TCP_BUFFERS", &wxChoice::SetSelection, 0);
+		xrc_call(*this, "ID_TCP_BANDWIDTH", &wxTextCtrl::ChangeValue, wxString());
+		xrc_call(*this, "ID_TCP_NOTSENT_LOWAT", &wxTextCtrl::ChangeValue, wxString());
+		xrc_call(*this, "ID_TCP_QUICKACK", &wxCheckBox::SetValue, false);
+
 		xrc_call(*this, "ID_CHARSET_AUTO", &wxRadioButton::SetValue, true);
 		xrc_call(*this, "ID_ENCODING", &wxTextCtrl::ChangeValue, wxString());
 		xrc_call(*this, "ID_ENCODING", &wxTextCtrl::Enable, false);
@@ -992,11 +1045,86 @@ void CSiteManagerSite::SetExtraParameters(CServer const& server)
 		}
 
 		std::wstring value = server.GetExtraParameter(trait.name_);
-		paramIt[trait.section_]->second->ChangeValue(value.empty() ? trait.default_ : value);
+		if (value.empty()) {
+			value = trait.default_;
+		}
+		if (trait.section_ == ParameterSection::custom) {
+			SetCustomParameter(trait.name_, value);
+			continue;
+		}
+
+		paramIt[trait.section_]->second->ChangeValue(value);
 		++paramIt[trait.section_];
 	}
 }
 
+bool CSiteManagerSite::HasCustomControl(std::string const& name)
+{
+	return fz::starts_with(name, std::string("tcp_"));
+}
+
+std::wstring CSiteManagerSite::GetCustomParameter(std::string const& name)
+{
+	if (name == "tcp_congestion") {
+		return xrc_call(*this, "ID_TCP_CONGESTION", &wxTextCtrl::GetValue).Trim().Trim(false).ToStdWstring();
+	}
+	else if (name == "tcp_buffers") {
+		switch (xrc_call(*this, "ID_TCP_BUFFERS", &wxChoice::GetSelection)) {
+		case 1:
+			return L"auto";
+		case 2:
+			return L"rtt";
+		default:
+			return std::wstring();
+		}
+	}
+	else if (name == "tcp_bandwidth") {
+		unsigned long mbits{};
+		if (xrc_call(*this, "ID_TCP_BANDWIDTH", &wxTextCtrl::GetValue).ToULong(&mbits) && mbits) {
+			return fz::to_wstring(mbits);
+		}
+	}
+	else if (name == "tcp_notsent_lowat") {
+		unsigned long bytes{};
+		if (xrc_call(*this, "ID_TCP_NOTSENT_LOWAT", &wxTextCtrl::GetValue).ToULong(&bytes) && bytes && bytes <= 0x7fffffff) {
+			return fz::to_wstring(bytes);
+		}
+	}
+	else if (name == "tcp_quickack") {
+		if (xrc_call(*this, "ID_TCP_QUICKACK", &wxCheckBox::GetValue)) {
+			return L"1";
+		}
+	}
+
+	return std::wstring();
+}
+
+void CSiteManagerSite::SetCustomParameter(std::string const& name, std::wstring const& value)
+{
+	if (name == "tcp_congestion") {
+		xrc_call(*this, "ID_TCP_CONGESTION", &wxTextCtrl::ChangeValue, value);
+	}
+	else if (name == "tcp_buffers") {
+		int sel = 0;
+		if (value == L"auto") {
+			sel = 1;
+		}
+		else if (value == L"rtt") {
+			sel = 2;
+		}
+		xrc_call(*this, "ID_TCP_BUFFERS", &wxChoice::SetSelection, sel);
+	}
+	else if (name == "tcp_bandwidth") {
+		xrc_call(*this, "ID_TCP_BANDWIDTH", &wxTextCtrl::ChangeValue, value);
+	}
+	else if (name == "tcp_notsent_lowat") {
+		xrc_call(*this, "ID_TCP_NOTSENT_LOWAT", &wxTextCtrl::ChangeValue, value);
+	}
+	else if (name == "tcp_quickack") {
+		xrc_call(*this, "ID_TCP_QUICKACK", &wxCheckBox::SetValue, value == L"1");
+	}
+}
+
 void CSiteManagerSite::OnProtocolSelChanged(wxCommandEvent&)
 {
 	auto const protocol = GetProtocol();
@@ -32,6 +32,12 @@ private:
 	void SetExtraParameters(CServer const& server);
 	void UpdateExtraParameters(CServer & server);
 
+	// Some parameters in the custom section have dedicated controls, the
+	// TCP tuning parameters. Others, e.g. those for S3, have none.
+	static bool HasCustomControl(std::string const& name);
+	std::wstring GetCustomParameter(std::string const& name);
+	void SetCustomParameter(std::string const& name, std::wstring const& value);
+
 	DECLARE_EVENT_TABLE()
 	void OnProtocolSelChanged(wxCommandEvent& event);
 	void OnLogontypeSelChanged(wxCommandEvent& event);
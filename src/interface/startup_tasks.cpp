@@ -0,0 +1,125 @@
+#include <filezilla.h>
+#include "startup_tasks.h"
+
+#include <algorithm>
+
+CStartupTasks::CStartupTasks(fz::thread_pool & pool)
+	: pool_(pool)
+{
+}
+
+CStartupTasks::~CStartupTasks()
+{
+	size_t count;
+	{
+		fz::scoped_lock l(mtx_);
+		count = tasks_.size();
+	}
+	for (task_id id = 0; id < count; ++id) {
+		Wait(id);
+	}
+}
+
+CStartupTasks::task_id CStartupTasks::Add(std::string const& name, std::function<void()> const& f, std::vector<task_id> const& dependencies)
+{
+	fz::scoped_lock l(mtx_);
+
+	task_id const id = tasks_.size();
+	tasks_.emplace_back();
+	task & t = tasks_.back();
+	t.name_ = name;
+	t.f_ = f;
+
+	for (auto const& dep : dependencies) {
+		if (dep < id && !tasks_[dep].finished_) {
+			tasks_[dep].dependents_.push_back(id);
+			++t.pending_;
+		}
+	}
+
+	if (!t.pending_) {
+		Start(id);
+	}
+
+	return id;
+}
+
+void CStartupTasks::Start(task_id id)
+{
+	// Called with the mutex held
+	task & t = tasks_[id];
+	t.started_ = true;
+	t.async_ = pool_.spawn([this, id]() { Run(id); });
+	if (!t.async_) {
+		// Leave it to Wait
+		t.run_inline_ = true;
+	}
+}
+
+void CStartupTasks::Run(task_id id)
+{
+	std::function<void()> f;
+	{
+		fz::scoped_lock l(mtx_);
+		f = std::move(tasks_[id].f_);
+	}
+
+	auto const start = fz::monotonic_clock::now();
+	if (f) {
+		f();
+	}
+	auto const runtime = fz::monotonic_clock::now() - start;
+
+	fz::scoped_lock l(mtx_);
+	task & t = tasks_[id];
+	t.runtime_ = runtime;
+	t.finished_ = true;
+
+	for (auto const& dependent : t.dependents_) {
+		if (!--tasks_[dependent].pending_) {
+			Start(dependent);
+		}
+	}
+	cond_.signal(l);
+}
+
+void CStartupTasks::Wait(task_id id)
+{
+	fz::scoped_lock l(mtx_);
+	if (id >= tasks_.size()) {
+		return;
+	}
+
+	while (!tasks_[id].finished_) {
+		if (!tasks_[id].started_) {
+			// Its dependencies need to finish first, one of them might have to be run inline
+			task_id dep = 0;
+			for (; dep < id; ++dep) {
+				auto const& dependents = tasks_[dep].dependents_;
+				if (!tasks_[dep].finished_ && std::find(dependents.cbegin(), dependents.cend(), id) != dependents.cend()) {
+					break;
+				}
+			}
+			if (dep < id) {
+				l.unlock();
+				Wait(dep);
+				l.lock();
+				continue;
+			}
+		}
+		else if (tasks_[id].run_inline_) {
+			tasks_[id].run_inline_ = false;
+			l.unlock();
+			Run(id);
+			l.lock();
+			continue;
+		}
+		cond_.wait(l);
+	}
+
+	fz::async_task async = std::move(tasks_[id].async_);
+	l.unlock();
+	if (async) {
+		async.join();
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef FILEZILLA_INTERFACE_STARTUP_TASKS_HEADER
+#define FILEZILLA_INTERFACE_STARTUP_TASKS_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/thread_pool.hpp>
+#include <libfilezilla/time.hpp>
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs independent steps of the application startup concurrently.
+//
+// Each task can depend on previously added tasks, it only gets started once
+// all of them have finished. Tasks run on the thread pool, so they must not
+// touch any GUI objects or the options. The main thread calls Wait before
+// using the results of a task.
+class CStartupTasks final
+{
+public:
+	typedef size_t task_id;
+
+	explicit CStartupTasks(fz::thread_pool & pool);
+
+	// Waits for all tasks
+	~CStartupTasks();
+
+	CStartupTasks(CStartupTasks const&) = delete;
+	CStartupTasks& operator=(CStartupTasks const&) = delete;
+
+	task_id Add(std::string const& name, std::function<void()> const& f, std::vector<task_id> const& dependencies = std::vector<task_id>());
+
+	// Blocks until the task has finished. If it could not be started on the
+	// pool, it gets run on the calling thread.
+	void Wait(task_id id);
+
+	std::string const& GetName(task_id id) const { return tasks_[id].name_; }
+
+	// How long the task took to run, only valid after Wait
+	fz::duration GetRuntime(task_id id) const { return tasks_[id].runtime_; }
+
+private:
+	struct task final
+	{
+		std::string name_;
+		std::function<void()> f_;
+
+		std::vector<task_id> dependents_;
+		size_t pending_{};
+
+		bool started_{};
+		bool finished_{};
+		bool run_inline_{};
+
+		fz::async_task async_;
+		fz::duration runtime_;
+	};
+
+	void Start(task_id id);
+	void Run(task_id id);
+
+	fz::thread_pool & pool_;
+
+	// A deque so that references stay valid while tasks get added
+	std::deque<task> tasks_;
+
+	fz::mutex mtx_{false};
+	fz::condition cond_;
+};
+
+#endif
@@ -32,6 +32,16 @@ bool CStateFilterManager::FilenameFiltered(std::wstring const& name, std::wstrin
 	return CFilterManager::FilenameFiltered(name, path, dir, size, local, attributes, date);
 }
 
+bool CStateFilterManager::IsFilterActive(bool local) const
+{
+	if (local) {
+		return m_localFilter || HasActiveLocalFilters();
+	}
+	else {
+		return m_remoteFilter || HasActiveRemoteFilters();
+	}
+}
+
 CContextManager CContextManager::m_the_context_manager;
 
 CContextManager::CContextManager()
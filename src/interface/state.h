@@ -66,6 +66,9 @@ class CStateFilterManager final : public CFilterManager
 public:
 	virtual bool FilenameFiltered(std::wstring const& name, std::wstring const& path, bool dir, int64_t size, bool local, int attributes, fz::datetime const& date) const override;
 
+	// If this returns false, FilenameFiltered returns false for any file
+	bool IsFilterActive(bool local) const;
+
 	CFilter const& GetLocalFilter() const { return m_localFilter; }
 	void SetLocalFilter(CFilter const& filter) { m_localFilter = filter; }
 
@@ -22,35 +22,35 @@ public:
 		wxString timeFormat = COptions::Get()->GetOption(OPTION_TIME_FORMAT);
 
 		if (dateFormat == _T("1"))
-			m_dateFormat = _T("%Y-%m-%d");
+			m_dateFormat = L"%Y-%m-%d";
 		else if (!dateFormat.empty() && dateFormat[0] == '2') {
 			dateFormat = dateFormat.Mid(1);
 			if (fz::datetime::verify_format(dateFormat.ToStdWstring())) {
-				m_dateFormat = dateFormat;
+				m_dateFormat = dateFormat.ToStdWstring();
 			}
 			else {
-				m_dateFormat = _T("%x");
+				m_dateFormat = L"%x";
 			}
 		}
 		else
-			m_dateFormat = _T("%x");
+			m_dateFormat = L"%x";
 
 		m_dateTimeFormat = m_dateFormat;
 		m_dateTimeFormat += ' ';
 
 		if (timeFormat == _T("1"))
-			m_dateTimeFormat += _T("%H:%M");
+			m_dateTimeFormat += L"%H:%M";
 		else if (!timeFormat.empty() && timeFormat[0] == '2') {
 			timeFormat = timeFormat.Mid(1);
 			if (fz::datetime::verify_format(timeFormat.ToStdWstring())) {
-				m_dateTimeFormat += timeFormat;
+				m_dateTimeFormat += timeFormat.ToStdWstring();
 			}
 			else {
-				m_dateTimeFormat += _T("%X");
+				m_dateTimeFormat += L"%X";
 			}
 		}
 		else
-			m_dateTimeFormat += _T("%X");
+			m_dateTimeFormat += L"%X";
 	}
 
 	virtual void OnOptionsChanged(changed_options_t const&)
@@ -58,8 +58,9 @@ public:
 		InitFormat();
 	}
 
-	wxString m_dateFormat;
-	wxString m_dateTimeFormat;
+	// Kept as std::wstring, formatting happens for every visible list cell
+	std::wstring m_dateFormat;
+	std::wstring m_dateTimeFormat;
 };
 
 Impl& GetImpl()
@@ -87,12 +88,12 @@ wxString CTimeFormat::FormatDateTime(fz::datetime const& time)
 {
 	Impl& impl = GetImpl();
 
-	return time.format(impl.m_dateTimeFormat.ToStdWstring(), fz::datetime::local);
+	return time.format(impl.m_dateTimeFormat, fz::datetime::local);
 }
 
 wxString CTimeFormat::FormatDate(fz::datetime const& time)
 {
 	Impl& impl = GetImpl();
 
-	return time.format(impl.m_dateFormat.ToStdWstring(), fz::datetime::local);
+	return time.format(impl.m_dateFormat, fz::datetime::local);
 }
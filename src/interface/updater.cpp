@@ -3,17 +3,18 @@
 #if FZ_MANUALUPDATECHECK
 
 #include "buildinfo.h"
+#include "engine_context.h"
 #include "updater.h"
 #include "Options.h"
 #include "file_utils.h"
+#include "hash_service.h"
 #include <string>
 
 #ifdef __WXMSW__
 #include <wx/msw/registry.h>
 #endif
 
-#include <libfilezilla/file.hpp>
-#include <libfilezilla/hash.hpp>
+#include <libfilezilla/encode.hpp>
 #include <libfilezilla/local_filesys.hpp>
 #include <libfilezilla/translate.hpp>
 
@@ -788,26 +789,13 @@ bool CUpdater::VerifyChecksum(std::wstring const& file, int64_t size, std::wstri
 		return false;
 	}
 
-	fz::hash_accumulator acc(fz::hash_algorithm::sha512);
-
-	{
-		fz::file f(fz::to_native(file), fz::file::reading);
-		if (!f.opened()) {
-			log_ += fz::sprintf(_("Could not open '%s'"), file) + L"\n";
-			return false;
-		}
-		unsigned char buffer[65536];
-		int64_t read;
-		while ((read = f.read(buffer, sizeof(buffer))) > 0) {
-			acc.update(buffer, static_cast<size_t>(read));
-		}
-		if (read < 0) {
-			log_ += fz::sprintf(_("Could not read from '%s'"), file) + L"\n";
-			return false;
-		}
+	auto const hashed = engine_context_.GetHashService().Hash(file, hash_bit(file_hash::sha512));
+	if (!hashed.success) {
+		log_ += fz::sprintf(_("Could not read from '%s'"), file) + L"\n";
+		return false;
 	}
 
-	auto const digest = fz::hex_encode<std::wstring>(acc.digest());
+	auto const digest = fz::hex_encode<std::wstring>(hashed.digest(file_hash::sha512));
 
 	if (digest != checksum) {
 		log_ += fz::sprintf(_("Checksum mismatch on file %s\n"), file);
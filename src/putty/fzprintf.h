@@ -1,4 +1,4 @@
-#define FZSFTP_PROTOCOL_VERSION 8
+#define FZSFTP_PROTOCOL_VERSION 10
 
 typedef enum
 {
@@ -28,7 +28,9 @@ typedef enum
     sftpCipherServerToClient,
     sftpMacClientToServer,
     sftpMacServerToClient,
-    sftpHostkey
+    sftpHostkey,
+    sftpData, /* payload: length, then raw data of a download into the engine */
+    sftpDataRequest /* payload: maximum length of upload data the engine should send */
 } sftpEventTypes;
 
 int fznotify(sftpEventTypes type);
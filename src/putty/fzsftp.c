@@ -12,6 +12,7 @@ int limit[2] = { 0, 0 };
 char* input_pushback = 0;
 
 #ifndef _WINDOWS
+#include <errno.h>
 #include <unistd.h>
 
 char *input_buf = 0;
@@ -231,6 +232,111 @@ char* read_input_line(int force, int* error)
 }
 #endif
 
+/*
+ * Transfers from and to the engine instead of local files, used if the
+ * local filename is "-".
+ *
+ * Downloaded data is sent as sftpData, followed by its length, a linebreak
+ * and the raw data. Data to upload is requested with sftpDataRequest and
+ * the maximum length. The engine replies with a line consisting of '='
+ * and the length of the data, followed by the raw data. A length of 0
+ * marks the end of the data, '-' instead of the length an error.
+ */
+static int read_raw(char* buffer, int len)
+{
+#ifdef _WINDOWS
+    DWORD read;
+    if (!ReadFile(GetStdHandle(STD_INPUT_HANDLE), buffer, len, &read, 0))
+	return -1;
+    return read;
+#else
+    int ret;
+    do {
+	ret = read(0, buffer, len);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+#endif
+}
+
+static int write_raw(const char* buffer, int len)
+{
+#ifdef _WINDOWS
+    DWORD written;
+    if (!WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), buffer, len, &written, 0))
+	return -1;
+    return written;
+#else
+    int ret;
+    do {
+	ret = write(1, buffer, len);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+#endif
+}
+
+int read_input_data(char* buffer, int len)
+{
+    char line[64];
+    int pos, size;
+
+    fznotify1(sftpDataRequest, len);
+
+    while (1) {
+	pos = 0;
+	do {
+	    if (pos >= (int)sizeof(line) - 1 || read_raw(line + pos, 1) != 1)
+		fatalbox("read_input_data: Could not read reply");
+	} while (line[pos++] != '\n');
+	line[pos] = 0;
+
+	if (line[0] != '-')
+	    break;
+	ProcessQuotaCmd(line);
+    }
+
+    if (line[0] != '=')
+	fatalbox("Invalid data received in read_input_data");
+
+    if (line[1] == '-')
+	return -1;
+
+    size = 0;
+    for (pos = 1; line[pos] != '\r' && line[pos] != '\n'; ++pos) {
+	if (line[pos] < '0' || line[pos] > '9')
+	    fatalbox("Invalid data received in read_input_data: Length not a number");
+
+	size *= 10;
+	size += line[pos] - '0';
+	if (size > len)
+	    fatalbox("Invalid data received in read_input_data: Too much data");
+    }
+
+    for (pos = 0; pos < size;) {
+	int read = read_raw(buffer + pos, size - pos);
+	if (read <= 0)
+	    fatalbox("read_input_data: Could not read data");
+	pos += read;
+    }
+
+    return size;
+}
+
+int write_output_data(const char* buffer, int len)
+{
+    int pos;
+
+    fznotify1(sftpData, len);
+
+    for (pos = 0; pos < len;) {
+	int written = write_raw(buffer + pos, len - pos);
+	if (written <= 0)
+	    return -1;
+	pos += written;
+    }
+
+    return len;
+}
+
 void fz_timer_init(_fztimer *timer)
 {
 #ifdef _WINDOWS
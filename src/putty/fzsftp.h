@@ -12,6 +12,10 @@ char* read_input_line(int force, int* error);
 
 int CurrentSpeedLimit(int direction);
 
+// Transfers from and to the engine instead of local files
+int read_input_data(char* buffer, int len);
+int write_output_data(const char* buffer, int len);
+
 #ifdef _WINDOWS
 #include <windows.h>
 typedef FILETIME _fztimer;
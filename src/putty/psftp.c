@@ -42,6 +42,7 @@ static Backend *back;
 static void *backhandle;
 static Conf *conf;
 int sent_eof = FALSE;
+static int preallocate = FALSE;
 
 /* ----------------------------------------------------------------------
  * Manage sending requests and waiting for replies.
@@ -261,7 +262,7 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
     struct fxp_xfer *xfer;
     uint64 offset;
     WFile *file;
-    int ret, shown_err = FALSE;
+    int ret, shown_err = FALSE, stream;
     struct fxp_attrs attrs;
     _fztimer timer;
     int winterval;
@@ -430,6 +431,13 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
 	}
     }
 
+    /* FZ: "-" passes the data to the engine, see write_output_data */
+    stream = !strcmp(outfname, "-");
+    if (stream && restart) {
+	fzprintf(sftpError, "reget: cannot restart transfers to the engine");
+	return 0;
+    }
+
     req = fxp_stat_send(fname);
     pktin = sftp_wait_for_reply(req);
     if (!fxp_stat_recv(pktin, req, &attrs))
@@ -444,13 +452,15 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
 	return 0;
     }
 
-    if (restart) {
+    if (stream) {
+	file = NULL;
+    } else if (restart) {
 	file = open_existing_wfile(outfname, NULL);
     } else {
 	file = open_new_file(outfname, GET_PERMISSIONS(attrs));
     }
 
-    if (!file) {
+    if (!file && !stream) {
 	fzprintf(sftpError, "local: unable to open %s", outfname);
 
         req = fxp_close_send(fh);
@@ -480,6 +490,12 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
 	offset = uint64_make(0, 0);
     }
 
+    if (file && preallocate && (attrs.flags & SSH_FILEXFER_ATTR_SIZE) &&
+	uint64_compare(attrs.size, offset) > 0) {
+	/* Failure is harmless, the file just gets allocated as written */
+	preallocate_wfile(file, offset, uint64_subtract(attrs.size, offset));
+    }
+
     fzprintf(sftpInfo, "remote:%s => local:%s", fname, outfname);
 
     fz_timer_init(&timer);
@@ -513,11 +529,14 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
 	    unsigned char *buf = (unsigned char *)vbuf;
 
 	    wpos = 0;
-	    while (file && wpos < len) {
-		wlen = write_to_file(file, buf + wpos, len - wpos);
+	    while (wpos < len) {
+		if (file)
+		    wlen = write_to_file(file, buf + wpos, len - wpos);
+		else
+		    wlen = write_output_data(buf + wpos, len - wpos);
 		if (wlen <= 0) {
 		    if (!shown_err) {
-			fzprintf(sftpError, "error while writing local file");
+			fzprintf(sftpError, file ? "error while writing local file" : "error while writing data");
 			shown_err = TRUE;
 		    }
 		    ret = 0;
@@ -542,7 +561,8 @@ int sftp_get_file(char *fname, char *outfname, int recurse, int restart)
 
     xfer_cleanup(xfer);
 
-    close_wfile(file);
+    if (file)
+	close_wfile(file);
 
     req = fxp_close_send(fh);
     pktin = sftp_wait_for_reply(req);
@@ -561,7 +581,7 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
     struct sftp_request *req;
     uint64 offset;
     RFile *file;
-    int err = 0, eof;
+    int err = 0, eof, stream;
     struct fxp_attrs attrs;
     long permissions;
 
@@ -688,10 +708,21 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
 	return 1;
     }
 
-    file = open_existing_file(fname, NULL, NULL, NULL, &permissions);
-    if (!file) {
-	fzprintf(sftpError, "local: unable to open %s", fname);
-	return 2;
+    /* FZ: "-" requests the data from the engine, see read_input_data */
+    stream = !strcmp(fname, "-");
+    if (stream) {
+	if (restart) {
+	    fzprintf(sftpError, "reput: cannot restart transfers from the engine");
+	    return 0;
+	}
+	file = NULL;
+	permissions = -1;
+    } else {
+	file = open_existing_file(fname, NULL, NULL, NULL, &permissions);
+	if (!file) {
+	    fzprintf(sftpError, "local: unable to open %s", fname);
+	    return 2;
+	}
     }
     attrs.flags = 0;
     PUT_PERMISSIONS(attrs, permissions);
@@ -706,7 +737,8 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
     fh = fxp_open_recv(pktin, req);
 
     if (!fh) {
-	close_rfile(file);
+	if (file)
+	    close_rfile(file);
 	fzprintf(sftpError, "%s: open for write: %s", outfname, fxp_error());
 	return 0;
     }
@@ -752,9 +784,12 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
 	int len, ret;
 
 	while (xfer_upload_ready(xfer) && !err && !eof) {
-	    len = read_from_file(file, buffer, sizeof(buffer));
+	    if (file)
+		len = read_from_file(file, buffer, sizeof(buffer));
+	    else
+		len = read_input_data(buffer, sizeof(buffer));
 	    if (len == -1) {
-		fzprintf(sftpError, "error while reading local file");
+		fzprintf(sftpError, file ? "error while reading local file" : "error while reading data");
 		err = 1;
 	    } else if (len == 0) {
 		eof = 1;
@@ -791,7 +826,8 @@ int sftp_put_file(char *fname, char *outfname, int recurse, int restart)
 	}
     }
 
-    close_rfile(file);
+    if (file)
+	close_rfile(file);
 
     return (err == 0) ? 1 : 0;
 }
@@ -1459,7 +1495,7 @@ int sftp_general_put(struct sftp_command *cmd, int restart, int multiple)
     }
 
     i = 1;
-    while (i < cmd->nwords && cmd->words[i][0] == '-') {
+    while (i < cmd->nwords && cmd->words[i][0] == '-' && cmd->words[i][1]) {
 	if (!strcmp(cmd->words[i], "--")) {
 	    /* finish processing options */
 	    i++;
@@ -2125,6 +2161,177 @@ static int sftp_cmd_mtime(struct sftp_command *cmd)
     return 1;
 }
 
+static char *hex_digest(const unsigned char *digest, int len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char *out = snewn(len * 2 + 1, char);
+    int i;
+    for (i = 0; i < len; i++) {
+	out[i * 2] = hex[digest[i] >> 4];
+	out[i * 2 + 1] = hex[digest[i] & 0xf];
+    }
+    out[len * 2] = '\0';
+    return out;
+}
+
+static const struct ssh_hash *checksum_hash(const char *algorithm)
+{
+    if (!strcmp(algorithm, "sha1"))
+	return &ssh_sha1;
+    if (!strcmp(algorithm, "sha256"))
+	return &ssh_sha256;
+    if (!strcmp(algorithm, "sha512"))
+	return &ssh_sha512;
+    return NULL;
+}
+
+/*
+ * Hashes a local file, returns the hex digest or NULL on error.
+ */
+static char *hash_local_file(const char *fname, const char *algorithm)
+{
+    char buffer[4096];
+    unsigned char digest[SSH2_KEX_MAX_HASH_LEN];
+    struct MD5Context md5;
+    const struct ssh_hash *h = NULL;
+    void *ctx = NULL;
+    int len, hlen;
+    RFile *file;
+
+    if (strcmp(algorithm, "md5")) {
+	h = checksum_hash(algorithm);
+	if (!h)
+	    return NULL;
+    }
+
+    file = open_existing_file(fname, NULL, NULL, NULL, NULL);
+    if (!file)
+	return NULL;
+
+    if (h)
+	ctx = h->init();
+    else
+	MD5Init(&md5);
+
+    while ((len = read_from_file(file, buffer, sizeof(buffer))) > 0) {
+	if (h)
+	    h->bytes(ctx, buffer, len);
+	else
+	    MD5Update(&md5, (unsigned char const *)buffer, len);
+    }
+    close_rfile(file);
+
+    if (h) {
+	h->final(ctx, digest);
+	hlen = h->hlen;
+    }
+    else {
+	MD5Final(digest, &md5);
+	hlen = 16;
+    }
+    if (len < 0)
+	return NULL;
+
+    return hex_digest(digest, hlen);
+}
+
+/*
+ * Compares a remote file with a local one using the check-file-name
+ * or md5-hash extensions. Replies with the algorithm and both digests,
+ * or with "none" if the server cannot calculate checksums.
+ */
+static int sftp_cmd_checksum(struct sftp_command *cmd)
+{
+    char *unwcfname, *filename, *cname, *algorithm, *digest;
+    char *remote, *local, *output, *p, *q;
+    int is_wc, len;
+    struct sftp_packet *pktin;
+    struct sftp_request *req;
+
+    if (back == NULL) {
+	not_connected();
+	return 0;
+    }
+
+    if (cmd->nwords != 4) {
+	fzprintf(sftpError, "checksum: expects a list of algorithms, a remote and a local filename");
+	return 0;
+    }
+
+    // Only ask for what can also be calculated locally
+    p = cmd->words[1];
+    while (*p) {
+	q = p;
+	while (*q && *q != ',')
+	    q++;
+	len = q - p;
+	if (!((len == 3 && !strncmp(p, "md5", 3)) ||
+	      (len == 4 && !strncmp(p, "sha1", 4)) ||
+	      (len == 6 && (!strncmp(p, "sha256", 6) || !strncmp(p, "sha512", 6))))) {
+	    fzprintf(sftpError, "checksum: unsupported algorithm");
+	    return 0;
+	}
+	p = *q ? q + 1 : q;
+    }
+
+    filename = cmd->words[2];
+    unwcfname = snewn(strlen(filename) + 1, char);
+    is_wc = !wc_unescape(unwcfname, filename);
+    if (is_wc) {
+	fzprintf(sftpError, "checksum does not support wildcards");
+	sfree(unwcfname);
+	return 0;
+    }
+
+    cname = canonify(unwcfname, 0);
+    sfree(unwcfname);
+    if (!cname) {
+	fzprintf(sftpError, "%s: canonify: %s", filename, fxp_error());
+	return 0;
+    }
+
+    req = fxp_check_file_send(cname, cmd->words[1]);
+    pktin = sftp_wait_for_reply(req);
+    digest = fxp_check_file_recv(pktin, req, &algorithm, &len);
+    if (!digest && fxp_error_type() == SSH_FX_OP_UNSUPPORTED && strstr(cmd->words[1], "md5")) {
+	req = fxp_md5_hash_send(cname);
+	pktin = sftp_wait_for_reply(req);
+	digest = fxp_check_file_recv(pktin, req, &algorithm, &len);
+    }
+
+    if (!digest) {
+	if (fxp_error_type() == SSH_FX_OP_UNSUPPORTED) {
+	    fzprintf(sftpVerbose, "checksum: server does not support checksums");
+	    fzprintf(sftpReply, "none");
+	    sfree(cname);
+	    return 1;
+	}
+	fzprintf(sftpError, "checksum for %s: %s", cname, fxp_error());
+	sfree(cname);
+	return 0;
+    }
+    sfree(cname);
+
+    local = hash_local_file(cmd->words[3], algorithm);
+    if (!local) {
+	fzprintf(sftpError, "checksum: cannot hash local file %s using %s", cmd->words[3], algorithm);
+	sfree(algorithm);
+	sfree(digest);
+	return 0;
+    }
+
+    remote = hex_digest((unsigned char const *)digest, len);
+    output = dupprintf("%s %s %s", algorithm, remote, local);
+    fzprintf(sftpReply, "%s", output);
+
+    sfree(output);
+    sfree(remote);
+    sfree(local);
+    sfree(algorithm);
+    sfree(digest);
+    return 1;
+}
+
 static int sftp_cmd_open(struct sftp_command *cmd)
 {
     int portnumber;
@@ -2250,6 +2457,12 @@ static struct sftp_cmd_lookup {
 	    "  returned to your home directory.\n",
 	    sftp_cmd_cd
     },
+    {
+	"checksum", TRUE, "compare the checksums of a remote and a local file",
+	    " <algorithms> <remote-filename> <local-filename>\n"
+	    "  Comma-separated algorithms, in order of preference\n",
+	    sftp_cmd_checksum
+    },
     {
 	"chmod", TRUE, "change file permissions and modes",
 	    " <modes> <filename-or-wildcard> [ <filename-or-wildcard>... ]\n"
@@ -3007,6 +3220,7 @@ static void usage(void)
     printf("  -hostkey aa:bb:cc:...\n");
     printf("            manually specify a host key (may be repeated)\n");
     printf("  -batch    disable all interactive prompts\n");
+    printf("  -prealloc reserve disk space for downloads up front\n");
     printf("  -proxycmd command\n");
     printf("            use 'command' as local proxy\n");
     printf("  -sshlog file\n");
@@ -3437,6 +3651,8 @@ int psftp_main(int argc, char *argv[])
 	    modeflags = modeflags | 1;
 	} else if (strcmp(argv[i], "-be") == 0) {
 	    modeflags = modeflags | 2;
+	} else if (strcmp(argv[i], "-prealloc") == 0) {
+	    preallocate = TRUE;
 	} else if (strcmp(argv[i], "--") == 0) {
 	    i++;
 	    break;
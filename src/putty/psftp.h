@@ -112,6 +112,10 @@ enum { FROM_START, FROM_CURRENT, FROM_END };
 int seek_file(WFile *f, uint64 offset, int whence);
 /* Get file position */
 uint64 get_file_posn(WFile *f);
+/* Reserve space for len bytes from offset without changing the file
+ * size, and hint that the file gets written sequentially. Returns 0 if
+ * the space could not be reserved. */
+int preallocate_wfile(WFile *f, uint64 offset, uint64 len);
 /*
  * Determine the type of a file: nonexistent, file, directory or
  * weird. `weird' covers anything else - named pipes, Unix sockets,
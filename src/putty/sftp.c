@@ -838,6 +838,111 @@ int fxp_stat_recv(struct sftp_packet *pktin, struct sftp_request *req,
     }
 }
 
+/*
+ * Ask the server for the checksum of a whole file. check-file-name
+ * is described in draft-ietf-secsh-filexfer-extensions, md5-hash is
+ * its predecessor from earlier drafts of the protocol.
+ */
+struct sftp_request *fxp_check_file_send(const char *fname,
+					 const char *algorithms)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    sftp_pkt_adduint32(pktout, req->id);
+    sftp_pkt_addstring(pktout, "check-file-name");
+    sftp_pkt_addstring(pktout, fname);
+    sftp_pkt_addstring(pktout, algorithms);
+    sftp_pkt_adduint64(pktout, uint64_make(0, 0));
+    sftp_pkt_adduint64(pktout, uint64_make(0, 0));
+    sftp_pkt_adduint32(pktout, 0);
+    sftp_send(pktout);
+
+    return req;
+}
+
+struct sftp_request *fxp_md5_hash_send(const char *fname)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    sftp_pkt_adduint32(pktout, req->id);
+    sftp_pkt_addstring(pktout, "md5-hash");
+    sftp_pkt_addstring(pktout, fname);
+    sftp_pkt_adduint64(pktout, uint64_make(0, 0));
+    sftp_pkt_adduint64(pktout, uint64_make(0, 0));
+    sftp_pkt_addstring(pktout, "");
+    sftp_send(pktout);
+
+    return req;
+}
+
+/*
+ * Returns the digest, or NULL on error. For check-file replies the
+ * name of the algorithm the server picked is returned in *algorithm,
+ * md5-hash replies set it to "md5". Both need to be freed.
+ */
+char *fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+			  char **algorithm, int *len)
+{
+    char *name, *algo, *digest;
+    int namelen, algolen, digestlen;
+
+    *algorithm = NULL;
+    sfree(req);
+    if (pktin->type != SSH_FXP_EXTENDED_REPLY) {
+	fxp_got_status(pktin);
+	sftp_pkt_free(pktin);
+	return NULL;
+    }
+
+    /*
+     * Some servers omit the name of the reply, in which case the
+     * first string already is the algorithm.
+     */
+    if (!sftp_pkt_getstring(pktin, &name, &namelen)) {
+	fxp_internal_error("malformed SSH_FXP_EXTENDED_REPLY packet");
+	sftp_pkt_free(pktin);
+	return NULL;
+    }
+    if (namelen == 8 && !memcmp(name, "md5-hash", 8)) {
+	if (!sftp_pkt_getstring(pktin, &digest, &digestlen) || !digestlen) {
+	    fxp_internal_error("malformed md5-hash reply");
+	    sftp_pkt_free(pktin);
+	    return NULL;
+	}
+	*algorithm = dupstr("md5");
+    }
+    else {
+	if (namelen == 10 && !memcmp(name, "check-file", 10)) {
+	    if (!sftp_pkt_getstring(pktin, &algo, &algolen)) {
+		fxp_internal_error("malformed check-file reply");
+		sftp_pkt_free(pktin);
+		return NULL;
+	    }
+	}
+	else {
+	    algo = name;
+	    algolen = namelen;
+	}
+	digest = pktin->data + pktin->savedpos;
+	digestlen = pktin->length - pktin->savedpos;
+	if (!algolen || digestlen <= 0) {
+	    fxp_internal_error("malformed check-file reply");
+	    sftp_pkt_free(pktin);
+	    return NULL;
+	}
+	*algorithm = mkstr(algo, algolen);
+    }
+
+    *len = digestlen;
+    digest = mkstr(digest, digestlen);
+    sftp_pkt_free(pktin);
+    return digest;
+}
+
 struct sftp_request *fxp_fstat_send(struct fxp_handle *handle)
 {
     struct sftp_request *req = sftp_alloc_request();
@@ -189,6 +189,15 @@ struct sftp_request *fxp_fstat_send(struct fxp_handle *handle);
 int fxp_fstat_recv(struct sftp_packet *pktin, struct sftp_request *req,
 		   struct fxp_attrs *attrs);
 
+/*
+ * Return the checksum of a file.
+ */
+struct sftp_request *fxp_check_file_send(const char *fname,
+					 const char *algorithms);
+struct sftp_request *fxp_md5_hash_send(const char *fname);
+char *fxp_check_file_recv(struct sftp_packet *pktin, struct sftp_request *req,
+			  char **algorithm, int *len);
+
 /*
  * Set file attributes.
  */
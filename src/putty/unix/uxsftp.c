@@ -2,6 +2,10 @@
  * uxsftp.c: the Unix-specific parts of PSFTP and PSCP.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1 /* for fallocate */
+#endif
+
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -289,6 +293,47 @@ int seek_file(WFile *f, uint64 offset, int whence)
     return lseek(f->fd, fileofft, lseek_whence) >= 0 ? 0 : -1;
 }
 
+int preallocate_wfile(WFile *f, uint64 offset, uint64 len)
+{
+    off_t fileofft = (((off_t) offset.hi << 16) << 16) + offset.lo;
+    off_t lenofft = (((off_t) len.hi << 16) << 16) + len.lo;
+    int ret = 0;
+
+#ifdef HAVE_POSIX_FADVISE
+    posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+    {
+	int res;
+	do {
+	    res = fallocate(f->fd, FALLOC_FL_KEEP_SIZE, fileofft, lenofft);
+	} while (res < 0 && errno == EINTR);
+	ret = res == 0;
+    }
+#elif defined(F_PREALLOCATE)
+    {
+	/* Allocates past the physical end of the file */
+	fstore_t store;
+	memset(&store, 0, sizeof(store));
+	store.fst_flags = F_ALLOCATECONTIG;
+	store.fst_posmode = F_PEOFPOSMODE;
+	store.fst_length = lenofft;
+	ret = fcntl(f->fd, F_PREALLOCATE, &store) != -1;
+	if (!ret) {
+	    store.fst_flags = F_ALLOCATEALL;
+	    ret = fcntl(f->fd, F_PREALLOCATE, &store) != -1;
+	}
+	(void)fileofft;
+    }
+#else
+    (void)fileofft;
+    (void)lenofft;
+#endif
+
+    return ret;
+}
+
 uint64 get_file_posn(WFile *f)
 {
     off_t fileofft;
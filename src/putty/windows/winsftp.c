@@ -269,6 +269,18 @@ int seek_file(WFile *f, uint64 offset, int whence)
 	return 0;
 }
 
+int preallocate_wfile(WFile *f, uint64 offset, uint64 len)
+{
+    /* Space reserved beyond the end of file stays reserved as long as
+     * the handle is open, which is for the entire transfer. */
+    FILE_ALLOCATION_INFO info;
+    uint64 end = uint64_add(offset, len);
+    info.AllocationSize.LowPart = end.lo;
+    info.AllocationSize.HighPart = end.hi;
+    return SetFileInformationByHandle(f->h, FileAllocationInfo,
+				      &info, sizeof(info)) != 0;
+}
+
 uint64 get_file_posn(WFile *f)
 {
     uint64 ret;
@@ -16,11 +16,13 @@ enum class storjEvent {
 	Transfer,
 	UsedQuotaRecv,
 	UsedQuotaSend,
+	Data, // Downloaded data, followed by the raw bytes
+	DataRequest, // Asks for data to upload
 
 	count
 };
 
-#define FZSTORJ_PROTOCOL_VERSION 1
+#define FZSTORJ_PROTOCOL_VERSION 2
 
 #endif
 
@@ -9,6 +9,11 @@
 
 #include <map>
 
+#ifdef FZ_WINDOWS
+#include <io.h>
+#endif
+#include <fcntl.h>
+
 fz::mutex output_mutex;
 
 void fzprintf(storjEvent event)
@@ -94,6 +99,140 @@ std::string next_argument(std::string & line)
 	return ret;
 }
 
+// Reserves space for a file about to be downloaded without changing its
+// size. Failure is harmless, the file just gets allocated as written.
+void preallocate(FILE* fd, int64_t size)
+{
+#ifdef FZ_WINDOWS
+	// Stays reserved until the file gets closed
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = size;
+	SetFileInformationByHandle(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(fd))), FileAllocationInfo, &info, sizeof(info));
+#else
+	int const f = fileno(fd);
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(f, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#if defined(FALLOC_FL_KEEP_SIZE)
+	fallocate(f, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+#elif defined(F_PREALLOCATE)
+	fstore_t store{F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0};
+	if (fcntl(f, F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		fcntl(f, F_PREALLOCATE, &store);
+	}
+#else
+	(void)f;
+	(void)size;
+#endif
+#endif
+}
+
+// Opens an anonymous temporary file for reading and writing, it is gone
+// once closed.
+FILE* open_temp_file()
+{
+	FILE *fd{};
+#ifdef FZ_WINDOWS
+	char buf[MAX_PATH + 2];
+	int ret = GetTempPathA(MAX_PATH + 1, buf);
+	if (ret && ret <= MAX_PATH + 1) {
+		char buf2[MAX_PATH + 1];
+		ret = GetTempFileNameA(buf, "fzstorj", 0, buf2);
+		if (ret) {
+			fd = fopen(buf2, "w+bD");
+		}
+	}
+#else
+	std::string tmpname = P_tmpdir;
+	tmpname += "/fzstorjXXXXXX";
+	char* buf = &tmpname[0];
+	int f = mkstemp(buf);
+	if (f != -1) {
+		unlink(buf);
+		fd = fdopen(f, "w+");
+		if (!fd) {
+			close(f);
+		}
+	}
+#endif
+	return fd;
+}
+
+/*
+ * Instead of a local filename, "-" makes get and put exchange the data with
+ * the engine. libstorj needs a seekable file, so the data gets spooled
+ * through a temporary file.
+ *
+ * Downloaded data is sent as Data event with the length as argument,
+ * followed by the raw bytes.
+ *
+ * For uploads, a DataRequest event asks for at most the given number of
+ * bytes. The engine replies with "=<n>\n" followed by n raw bytes. "=0"
+ * ends the data, "=-" aborts the upload.
+ */
+
+// Fails if the engine could not provide the data
+bool receive_data(FILE* fd)
+{
+	char buffer[64 * 1024];
+	while (true) {
+		fzprintf(storjEvent::DataRequest, "%u", sizeof(buffer));
+
+		std::string line;
+		if (!getLine(line) || line.size() < 2 || line[0] != '=') {
+			fzprintf(storjEvent::Error, "Invalid data received");
+			exit(1);
+		}
+		if (line[1] == '-') {
+			return false;
+		}
+
+		size_t const size = fz::to_integral<size_t>(line.substr(1), static_cast<size_t>(-1));
+		if (size > sizeof(buffer)) {
+			fzprintf(storjEvent::Error, "Invalid data received");
+			exit(1);
+		}
+		if (!size) {
+			return true;
+		}
+
+		if (fread(buffer, size, 1, stdin) != 1) {
+			fzprintf(storjEvent::Error, "Invalid data received");
+			exit(1);
+		}
+		if (fwrite(buffer, size, 1, fd) != 1) {
+			return false;
+		}
+	}
+}
+
+bool send_data(FILE* fd)
+{
+	if (fseek(fd, 0, SEEK_SET)) {
+		return false;
+	}
+
+	char buffer[64 * 1024];
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), fd))) {
+		fz::scoped_lock l(output_mutex);
+		fzprintf(storjEvent::Data, "%u", size);
+		fwrite(buffer, size, 1, stdout);
+		fflush(stdout);
+	}
+
+	return !ferror(fd);
+}
+
+struct transfer_state
+{
+	uint64_t lastProgress{};
+
+	// Set if the downloaded data goes to the engine
+	bool stream{};
+};
+
 namespace {
 extern "C" void get_buckets_callback(uv_work_t *work_req, int status)
 {
@@ -264,18 +403,21 @@ extern "C" void download_file_progress(double progress,
 								   uint64_t total_bytes,
 								   void *handle)
 {
-	uint64_t & lastProgress = *static_cast<uint64_t*>(handle);
+	uint64_t & lastProgress = static_cast<transfer_state*>(handle)->lastProgress;
 	if (downloaded_bytes > lastProgress) {
 		fzprintf(storjEvent::Transfer, "%u", downloaded_bytes - lastProgress);
 		lastProgress = downloaded_bytes;
 	}
 }
 
-extern "C" void download_file_complete(int status, FILE *fd, void *)
+extern "C" void download_file_complete(int status, FILE *fd, void *handle)
 {
 	if (status) {
 		fzprintf(storjEvent::Error, "Download failed with error %s (%d)", storj_strerror(status), status);
 	}
+	else if (static_cast<transfer_state*>(handle)->stream && !send_data(fd)) {
+		fzprintf(storjEvent::Error, "Could not read from temporary file: %d", errno);
+	}
 	else {
 		fzprintf(storjEvent::Done);
 	}
@@ -372,6 +514,12 @@ extern "C" void delete_bucket_callback(uv_work_t *work_req, int status)
 
 int main()
 {
+#ifdef FZ_WINDOWS
+	// Transferred data must not get altered
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
 	fzprintf(storjEvent::Reply, "fzStorj started, protocol_version=%d", FZSTORJ_PROTOCOL_VERSION);
 
 	std::string host;
@@ -530,34 +678,43 @@ int main()
 			}
 		}
 		else if (command == "get") {
-			size_t pos = arg.find(' ');
-			if (pos == std::string::npos) {
-				fzprintf(storjEvent::Error, "Bad arguments");
-				continue;
+			std::string bucket = next_argument(arg);
+			std::string id = next_argument(arg);
+			std::string file = next_argument(arg);
+
+			// Optional, space for the file gets reserved if given
+			int64_t size = -1;
+			if (!arg.empty()) {
+				size = fz::to_integral<int64_t>(next_argument(arg), -1);
 			}
-			std::string bucket = arg.substr(0, pos);
-			size_t pos2 = arg.find(' ', pos + 1);
-			if (pos == std::string::npos) {
+
+			if (bucket.empty() || id.empty() || file.empty() || !arg.empty()) {
 				fzprintf(storjEvent::Error, "Bad arguments");
 				continue;
 			}
-			auto id = arg.substr(pos + 1, pos2 - pos - 1);
-			auto file = arg.substr(pos2 + 1);
-
-			if (file.size() >= 3 && file.front() == '"' && file.back() == '"') {
-				file = fz::replaced_substrings(file.substr(1, file.size() - 2), "\"\"", "\"");
-			}
 
 			init_env();
 
-			FILE *fd = fopen(file.c_str(), "w+");
+			transfer_state transfer;
+			transfer.stream = file == "-";
+
+			FILE *fd = transfer.stream ? open_temp_file() : fopen(file.c_str(), "w+");
 
 			if (fd == NULL) {
 				int err = errno;
-				fzprintf(storjEvent::Error, "Could not open local file %s for writing: %d", file, err);
+				if (transfer.stream) {
+					fzprintf(storjEvent::Error, "Could not create temporary file: %d", err);
+				}
+				else {
+					fzprintf(storjEvent::Error, "Could not open local file %s for writing: %d", file, err);
+				}
 				continue;
 			}
 
+			if (size > 0) {
+				preallocate(fd, size);
+			}
+
 			storj_download_state_t *state = static_cast<storj_download_state_t*>(malloc(sizeof(storj_download_state_t)));
 
 			/*uv_signal_t sig;
@@ -565,9 +722,8 @@ int main()
 			uv_signal_start(&sig, signal_handler, SIGINT);
 			sig.data = state;*/
 
-			uint64_t lastProgress{};
 			int status = storj_bridge_resolve_file(env, state, bucket.c_str(),
-												   id.c_str(), fd, &lastProgress,
+												   id.c_str(), fd, &transfer,
 												   download_file_progress,
 												   download_file_complete);
 			if (status) {
@@ -594,32 +750,24 @@ int main()
 
 			FILE *fd{};
 			if (file == "null") {
-#ifdef FZ_WINDOWS
-				char buf[MAX_PATH + 2];
-				int ret = GetTempPathA(MAX_PATH + 1, buf);
-				if (ret && ret <= MAX_PATH + 1) {
-					char buf2[MAX_PATH + 1];
-					ret = GetTempFileNameA(buf, "fzstorj", 0, buf2);
-					if (ret) {
-						fd = fopen(buf2, "r+D");
-						if (fd) {
-							fwrite(buf2, 1, 1, fd);
-							rewind(fd);
-						}
-					}
+				fd = open_temp_file();
+				if (fd) {
+					fputc(0, fd);
+					rewind(fd);
 				}
-#else
-				std::string tmpname = P_tmpdir;
-				tmpname += "/fzstorjXXXXXX";
-				char* buf = &tmpname[0];
-				int f = mkstemp(buf);
-				if (f != -1) {
-					unlink(buf);
-					write(f, buf, 1);
-					lseek(f, 0, SEEK_SET);
-					fd = fdopen(f, "r");
+			}
+			else if (file == "-") {
+				fd = open_temp_file();
+				if (fd == NULL) {
+					int err = errno;
+					fzprintf(storjEvent::Error, "Could not create temporary file: %d", err);
+					continue;
+				}
+				if (!receive_data(fd) || fseek(fd, 0, SEEK_SET)) {
+					fclose(fd);
+					fzprintf(storjEvent::Error, "Could not get the data to upload");
+					continue;
 				}
-#endif
 			}
 			else {
 				fd = fopen(file.c_str(), "r");
@@ -644,11 +792,11 @@ int main()
 
 			storj_upload_state_t *state = static_cast<storj_upload_state_t*>(malloc(sizeof(storj_upload_state_t)));
 
-			uint64_t lastProgress{};
+			transfer_state transfer;
 			int status = storj_bridge_store_file(env,
 												 state,
 												 &upload_opts,
-												 &lastProgress,
+												 &transfer,
 												 download_file_progress,
 												 upload_file_complete);
 
@@ -0,0 +1,240 @@
+#include <libfilezilla_engine.h>
+#include <directorylistingparser.h>
+
+#include "bench_dirparser.h"
+
+#include <libfilezilla/time.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Global allocation accounting. Replacing the global operators affects the
+// whole benchmark executable, which is fine as the parser benchmarks only
+// look at the difference between two snapshots taken on the same thread.
+namespace {
+std::atomic<int64_t> g_allocations{};
+std::atomic<int64_t> g_live_bytes{};
+std::atomic<int64_t> g_peak_bytes{};
+
+void* counted_alloc(size_t size)
+{
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	int64_t const live = g_live_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed) + malloc_usable_size(p);
+	int64_t peak = g_peak_bytes.load(std::memory_order_relaxed);
+	while (live > peak && !g_peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+	}
+	return p;
+}
+
+void counted_free(void* p)
+{
+	if (p) {
+		g_live_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+		free(p);
+	}
+}
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void* operator new(size_t size, std::nothrow_t const&) noexcept
+{
+	try {
+		return counted_alloc(size);
+	}
+	catch (std::bad_alloc const&) {
+		return nullptr;
+	}
+}
+void* operator new[](size_t size, std::nothrow_t const& nt) noexcept { return operator new(size, nt); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { counted_free(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { counted_free(p); }
+
+namespace {
+struct parser_format
+{
+	char const* name;
+	ServerType type;
+
+	// Returns the listing line(s) of the i-th entry, without trailing line break
+	std::function<std::string(size_t i)> line;
+};
+
+std::string num(size_t i) { return std::to_string(i); }
+std::string entry_size(size_t i) { return std::to_string(i * 7919 % 100000000); }
+
+// Templates follow the samples in dirparsertest.cpp, only names and sizes vary.
+// Every tenth entry is a directory where the format has them.
+std::vector<parser_format> const& formats()
+{
+	static std::vector<parser_format> const ret = {
+		{"unix", DEFAULT, [](size_t i) {
+			if (!(i % 10)) {
+				return "drwxr-xr-x   2 root     other        512 Apr  8  1994 dir_" + num(i);
+			}
+			return "-rw-r--r--   1 root     other   " + entry_size(i) + " Jan 25 00:17 file_" + num(i) + ".dat";
+		}},
+		{"unix_iso", DEFAULT, [](size_t i) {
+			return "-rw-r--r--   1 root     other   " + entry_size(i) + " 2005-06-07 21:22 file_" + num(i) + ".dat";
+		}},
+		{"unix_link", DEFAULT, [](size_t i) {
+			return "lrwxrwxrwx   1 root     other          7 Jan 25 00:17 link_" + num(i) + " -> usr/bin/target_" + num(i);
+		}},
+		{"dos", DEFAULT, [](size_t i) {
+			if (!(i % 10)) {
+				return "04-27-00  12:09PM       <DIR>          dir_" + num(i);
+			}
+			return "04-06-00  03:47PM                  " + entry_size(i) + " file_" + num(i) + ".dat";
+		}},
+		{"dos_longyear", DEFAULT, [](size_t i) {
+			return "2002-09-02  19:06                " + entry_size(i) + " file_" + num(i) + ".dat";
+		}},
+		{"mlsd", DEFAULT, [](size_t i) {
+			if (!(i % 10)) {
+				return "type=dir;modify=20081105165215;UNIX.mode=0755;UNIX.owner=1179;UNIX.group=1179; dir_" + num(i);
+			}
+			return "type=file;modify=20081105165215;size=" + entry_size(i) + ";UNIX.mode=0644;UNIX.owner=1179;UNIX.group=1179; file_" + num(i) + ".dat";
+		}},
+		{"eplf", DEFAULT, [](size_t i) {
+			return "+i8388621." + num(i) + ",m825718503,r,s" + entry_size(i) + ",up755\tfile_" + num(i) + ".dat";
+		}},
+		{"netware", DEFAULT, [](size_t i) {
+			return "- [R----F--] rhesus             " + entry_size(i) + "       Oct 20 15:27    file_" + num(i) + ".dat";
+		}},
+		{"netpresenz", DEFAULT, [](size_t i) {
+			return "-------r--         326  " + entry_size(i) + "  1392298 Nov 22  1995 file_" + num(i) + ".dat";
+		}},
+		{"os2", DEFAULT, [](size_t i) {
+			return "36611      A    04-23-103  10:57  file_" + num(i) + ".dat";
+		}},
+		{"vshell", DEFAULT, [](size_t i) {
+			return "-rwxr-xr-x    1 user group        " + entry_size(i) + " Oct 08, 2002 09:47 file_" + num(i) + ".dat";
+		}},
+		{"vms", DEFAULT, [](size_t i) {
+			return "FILE_" + num(i) + ".DAT;1       155   2-JUL-2003 10:30:13.64";
+		}},
+		{"vms_multiline", DEFAULT, [](size_t i) {
+			return "FILE_" + num(i) + ".DAT;1\r\n170774/170775     24-APR-2003 08:16:15  [FTP_CLIENT,SCOT]      (RWED,RWED,RE,)";
+		}},
+		{"as400", DEFAULT, [](size_t i) {
+			return "QSYS            " + entry_size(i) + " 23/02/00 15:09:55 *FILE FILE" + num(i) + ".DAT";
+		}},
+		{"wfftp", DEFAULT, [](size_t i) {
+			return "wfftp-file" + num(i) + "       " + entry_size(i) + "  06/03/04  Thur.   10:20:03";
+		}},
+		{"vxworks", DEFAULT, [](size_t i) {
+			return "2048    Feb-28-1998  05:23:30   vxworks_dir" + num(i) + " <DIR>";
+		}},
+		{"os9", DEFAULT, [](size_t i) {
+			return "20.20 07/03/29 1026 d-ewrewr 2650 85920 os9_dir" + num(i);
+		}},
+		{"mvs", DEFAULT, [](size_t i) {
+			return "WYOSPT 3420   2003/05/21  1  200  FB      80  8053  PS  BENCH.DATA" + num(i);
+		}},
+		{"mvs_pds", MVS, [](size_t i) {
+			return "MEMBER" + num(i) + " 01.01 2004/06/22 2004/06/22 16:32   128   128    0 BOBY12";
+		}},
+		{"zvm", ZVM, [](size_t i) {
+			return "ZVM" + num(i) + "  TRACE   V        65      107        2 2005-10-04 15:28:42 060191";
+		}},
+		{"hpnonstop", HPNONSTOP, [](size_t i) {
+			return "HP" + num(i) + " 101 " + entry_size(i) + " 6-Apr-07 14:21:18 255, 0 \"oooo\"";
+		}},
+	};
+	return ret;
+}
+}
+
+std::vector<std::string> parser_benchmark_formats()
+{
+	std::vector<std::string> ret;
+	for (auto const& f : formats()) {
+		ret.emplace_back(f.name);
+	}
+	return ret;
+}
+
+void run_parser_benchmark(std::string const& format, size_t entries)
+{
+	parser_format const* f{};
+	for (auto const& candidate : formats()) {
+		if (format == candidate.name) {
+			f = &candidate;
+		}
+	}
+	if (!f) {
+		return;
+	}
+
+	std::string const name = "parser_" + format;
+
+	std::string listing;
+	size_t lines{};
+	for (size_t i = 0; i < entries; ++i) {
+		std::string const line = f->line(i);
+		listing += line;
+		listing += "\r\n";
+		lines += 1 + std::count(line.cbegin(), line.cend(), '\n');
+	}
+
+	// Split into chunks the size of typical socket reads up front, the
+	// parser takes ownership of them.
+	size_t const chunk_size = 65536;
+	std::vector<std::pair<char*, int>> chunks;
+	for (size_t pos = 0; pos < listing.size(); pos += chunk_size) {
+		size_t const len = std::min(chunk_size, listing.size() - pos);
+		char* data = new char[len];
+		memcpy(data, listing.c_str() + pos, len);
+		chunks.emplace_back(data, static_cast<int>(len));
+	}
+
+	CServer server;
+	server.SetType(f->type);
+
+	int64_t const allocations_start = g_allocations.load();
+	int64_t const live_start = g_live_bytes.load();
+	g_peak_bytes.store(live_start);
+
+	auto const start = fz::monotonic_clock::now();
+	size_t parsed{};
+	{
+		CDirectoryListingParser parser(nullptr, server);
+		for (auto const& chunk : chunks) {
+			parser.AddData(chunk.first, chunk.second);
+		}
+		CDirectoryListing const result = parser.Parse(CServerPath(L"/"));
+		parsed = result.size();
+	}
+	double const seconds = (fz::monotonic_clock::now() - start).get_microseconds() / 1000000.0;
+
+	int64_t const allocations = g_allocations.load() - allocations_start;
+	int64_t const peak = g_peak_bytes.load() - live_start;
+
+	if (parsed != entries) {
+		std::cerr << name << ": parsed " << parsed << " of " << entries << " entries" << std::endl;
+	}
+
+	char buf[1024];
+	snprintf(buf, sizeof(buf), "{\"benchmark\":\"%s\",\"lines\":%zu,\"entries\":%zu,\"bytes\":%zu,\"seconds\":%.6f,\"lines_per_second\":%.1f,"
+		"\"allocations\":%lld,\"allocations_per_entry\":%.2f,\"peak_bytes\":%lld,\"peak_bytes_per_entry\":%.1f}",
+		name.c_str(), lines, parsed, listing.size(), seconds, seconds > 0 ? lines / seconds : 0.,
+		static_cast<long long>(allocations), parsed ? static_cast<double>(allocations) / parsed : 0.,
+		static_cast<long long>(peak), parsed ? static_cast<double>(peak) / parsed : 0.);
+	std::cout << buf << std::endl;
+}
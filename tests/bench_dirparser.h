@@ -0,0 +1,19 @@
+#ifndef FILEZILLA_TESTS_BENCH_DIRPARSER_HEADER
+#define FILEZILLA_TESTS_BENCH_DIRPARSER_HEADER
+
+// Microbenchmarks for CDirectoryListingParser.
+//
+// For each listing format a large synthetic listing is generated from line
+// templates modelled after the samples in dirparsertest.cpp and fed to the
+// parser in network-sized chunks. Besides lines per second, the number of
+// heap allocations per entry and the peak heap usage are reported.
+
+#include <string>
+#include <vector>
+
+// Names of the listing formats, benchmarks are named parser_<format>
+std::vector<std::string> parser_benchmark_formats();
+
+void run_parser_benchmark(std::string const& format, size_t entries);
+
+#endif
@@ -0,0 +1,600 @@
+#include "bench_servers.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+int listen_loopback(int & port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) {
+		return -1;
+	}
+
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) || listen(fd, 64)) {
+		close(fd);
+		return -1;
+	}
+
+	socklen_t len = sizeof(addr);
+	if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len)) {
+		close(fd);
+		return -1;
+	}
+	port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+bool send_all(int fd, char const* data, size_t len)
+{
+	while (len) {
+		ssize_t written = send(fd, data, len, MSG_NOSIGNAL);
+		if (written <= 0) {
+			return false;
+		}
+		data += written;
+		len -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+bool send_all(int fd, std::string const& s)
+{
+	return send_all(fd, s.c_str(), s.size());
+}
+
+// Sends size bytes of a fixed pattern
+bool send_pattern(int fd, int64_t size)
+{
+	static char const* const pattern = [] {
+		static char buf[65536];
+		for (size_t i = 0; i < sizeof(buf); ++i) {
+			buf[i] = static_cast<char>('a' + i % 26);
+		}
+		return buf;
+	}();
+
+	while (size > 0) {
+		size_t chunk = static_cast<size_t>(std::min<int64_t>(size, 65536));
+		if (!send_all(fd, pattern, chunk)) {
+			return false;
+		}
+		size -= static_cast<int64_t>(chunk);
+	}
+	return true;
+}
+
+int64_t receive_all(int fd)
+{
+	char buf[65536];
+	int64_t total{};
+	for (;;) {
+		ssize_t r = recv(fd, buf, sizeof(buf), 0);
+		if (r <= 0) {
+			break;
+		}
+		total += r;
+	}
+	return total;
+}
+
+// Line reader for the control connections
+class line_reader final
+{
+public:
+	explicit line_reader(int fd)
+		: fd_(fd)
+	{}
+
+	// Returns false on EOF or error
+	bool get(std::string & line)
+	{
+		for (;;) {
+			size_t pos = buffer_.find('\n');
+			if (pos != std::string::npos) {
+				line = buffer_.substr(0, pos);
+				buffer_.erase(0, pos + 1);
+				if (!line.empty() && line.back() == '\r') {
+					line.pop_back();
+				}
+				return true;
+			}
+
+			char buf[4096];
+			ssize_t r = recv(fd_, buf, sizeof(buf), 0);
+			if (r <= 0) {
+				return false;
+			}
+			buffer_.append(buf, static_cast<size_t>(r));
+		}
+	}
+
+private:
+	int const fd_;
+	std::string buffer_;
+};
+
+std::string parent_of(std::string const& path)
+{
+	size_t pos = path.rfind('/');
+	if (!pos || pos == std::string::npos) {
+		return "/";
+	}
+	return path.substr(0, pos);
+}
+
+std::string name_of(std::string const& path)
+{
+	size_t pos = path.rfind('/');
+	return path.substr(pos + 1);
+}
+}
+
+bench_vfs::bench_vfs()
+{
+	dirs_["/"];
+}
+
+void bench_vfs::add_file(std::string const& dir, std::string const& name, int64_t size)
+{
+	std::lock_guard<std::mutex> l(mutex_);
+	std::string const path = (dir == "/") ? dir + name : dir + "/" + name;
+	auto & entries = dirs_[dir];
+	if (files_.find(path) == files_.end()) {
+		entries.push_back(bench_entry{name, size, false});
+	}
+	else {
+		for (auto & entry : entries) {
+			if (entry.name == name) {
+				entry.size = size;
+			}
+		}
+	}
+	files_[path] = size;
+}
+
+void bench_vfs::add_dir(std::string const& parent, std::string const& name)
+{
+	std::lock_guard<std::mutex> l(mutex_);
+	std::string const path = (parent == "/") ? parent + name : parent + "/" + name;
+	if (dirs_.find(path) == dirs_.end()) {
+		dirs_[parent].push_back(bench_entry{name, 0, true});
+		dirs_[path];
+	}
+}
+
+bool bench_vfs::has_dir(std::string const& path) const
+{
+	std::lock_guard<std::mutex> l(mutex_);
+	return dirs_.find(path) != dirs_.end();
+}
+
+int64_t bench_vfs::file_size(std::string const& path) const
+{
+	std::lock_guard<std::mutex> l(mutex_);
+	auto it = files_.find(path);
+	return (it != files_.end()) ? it->second : -1;
+}
+
+std::vector<bench_entry> bench_vfs::list(std::string const& path) const
+{
+	std::lock_guard<std::mutex> l(mutex_);
+	auto it = dirs_.find(path);
+	if (it != dirs_.end()) {
+		return it->second;
+	}
+	return std::vector<bench_entry>();
+}
+
+std::string bench_vfs::resolve(std::string const& cwd, std::string const& path)
+{
+	std::vector<std::string> segments;
+
+	auto split = [&segments](std::string const& p) {
+		size_t start = 0;
+		while (start <= p.size()) {
+			size_t end = p.find('/', start);
+			if (end == std::string::npos) {
+				end = p.size();
+			}
+			std::string const segment = p.substr(start, end - start);
+			if (segment == "..") {
+				if (!segments.empty()) {
+					segments.pop_back();
+				}
+			}
+			else if (!segment.empty() && segment != ".") {
+				segments.push_back(segment);
+			}
+			start = end + 1;
+		}
+	};
+
+	if (path.empty() || path[0] != '/') {
+		split(cwd);
+	}
+	split(path);
+
+	std::string ret;
+	for (auto const& segment : segments) {
+		ret += '/';
+		ret += segment;
+	}
+	if (ret.empty()) {
+		ret = "/";
+	}
+	return ret;
+}
+
+bench_server::bench_server(bench_vfs & vfs)
+	: vfs_(vfs)
+{
+}
+
+bench_server::~bench_server()
+{
+	stop();
+}
+
+bool bench_server::start()
+{
+	listen_fd_ = listen_loopback(port_);
+	if (listen_fd_ == -1) {
+		return false;
+	}
+
+	accept_thread_ = std::thread([this]() { accept_loop(); });
+	return true;
+}
+
+void bench_server::stop()
+{
+	if (stopping_.exchange(true)) {
+		return;
+	}
+
+	if (listen_fd_ != -1) {
+		shutdown(listen_fd_, SHUT_RDWR);
+		close(listen_fd_);
+	}
+	if (accept_thread_.joinable()) {
+		accept_thread_.join();
+	}
+
+	std::vector<std::thread> connections;
+	{
+		std::lock_guard<std::mutex> l(mutex_);
+		for (int fd : fds_) {
+			shutdown(fd, SHUT_RDWR);
+		}
+		connections.swap(connections_);
+	}
+	for (auto & t : connections) {
+		t.join();
+	}
+}
+
+void bench_server::accept_loop()
+{
+	while (!stopping_) {
+		int fd = accept(listen_fd_, nullptr, nullptr);
+		if (fd == -1) {
+			if (stopping_) {
+				break;
+			}
+			continue;
+		}
+
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		std::lock_guard<std::mutex> l(mutex_);
+		fds_.push_back(fd);
+		connections_.emplace_back([this, fd]() {
+			handle(fd);
+			{
+				std::lock_guard<std::mutex> l(mutex_);
+				fds_.erase(std::find(fds_.begin(), fds_.end(), fd));
+			}
+			close(fd);
+		});
+	}
+}
+
+ftp_standin_server::ftp_standin_server(bench_vfs & vfs, listing_format format)
+	: bench_server(vfs)
+	, format_(format)
+{
+}
+
+ftp_standin_server::~ftp_standin_server()
+{
+	stop();
+}
+
+std::string ftp_standin_server::format_listing(std::vector<bench_entry> const& entries, bool mlsd) const
+{
+	std::string ret;
+	ret.reserve(entries.size() * 64);
+
+	char line[512];
+	for (auto const& entry : entries) {
+		if (mlsd) {
+			if (entry.dir) {
+				snprintf(line, sizeof(line), "type=dir;modify=20190101120000; %s\r\n", entry.name.c_str());
+			}
+			else {
+				snprintf(line, sizeof(line), "type=file;size=%lld;modify=20190101120000; %s\r\n", static_cast<long long>(entry.size), entry.name.c_str());
+			}
+		}
+		else if (format_ == listing_format::dos) {
+			if (entry.dir) {
+				snprintf(line, sizeof(line), "01-01-19  12:00PM       <DIR>          %s\r\n", entry.name.c_str());
+			}
+			else {
+				snprintf(line, sizeof(line), "01-01-19  12:00PM %20lld %s\r\n", static_cast<long long>(entry.size), entry.name.c_str());
+			}
+		}
+		else {
+			snprintf(line, sizeof(line), "%s 1 owner group %lld Jan 01  2019 %s\r\n", entry.dir ? "drwxr-xr-x" : "-rw-r--r--", static_cast<long long>(entry.dir ? 4096 : entry.size), entry.name.c_str());
+		}
+		ret += line;
+	}
+
+	return ret;
+}
+
+void ftp_standin_server::handle(int fd)
+{
+	line_reader reader(fd);
+
+	std::string cwd = "/";
+	int pasv_fd = -1;
+	int64_t rest{};
+
+	auto reply = [fd](std::string const& r) {
+		return send_all(fd, r + "\r\n");
+	};
+
+	// Accepts the data connection, closes the passive listener
+	auto data_connection = [&pasv_fd]() {
+		if (pasv_fd == -1) {
+			return -1;
+		}
+		int data_fd = accept(pasv_fd, nullptr, nullptr);
+		close(pasv_fd);
+		pasv_fd = -1;
+		return data_fd;
+	};
+
+	if (!reply("220 FileZilla benchmark stand-in")) {
+		return;
+	}
+
+	std::string line;
+	while (reader.get(line)) {
+		size_t pos = line.find(' ');
+		std::string cmd = line.substr(0, pos);
+		std::string const arg = (pos != std::string::npos) ? line.substr(pos + 1) : std::string();
+		std::transform(cmd.begin(), cmd.end(), cmd.begin(), [](char c) { return static_cast<char>(toupper(static_cast<unsigned char>(c))); });
+
+		bool ok = true;
+		if (cmd == "USER") {
+			ok = reply("331 Password required");
+		}
+		else if (cmd == "PASS") {
+			ok = reply("230 Logged on");
+		}
+		else if (cmd == "SYST") {
+			ok = reply("215 UNIX emulated by FileZilla benchmark");
+		}
+		else if (cmd == "FEAT") {
+			std::string feat = "211-Features:\r\n MDTM\r\n REST STREAM\r\n SIZE\r\n EPSV\r\n UTF8\r\n";
+			if (format_ == listing_format::mlsd) {
+				feat += " MLST type*;size*;modify*;\r\n";
+			}
+			feat += "211 End";
+			ok = reply(feat);
+		}
+		else if (cmd == "OPTS" || cmd == "TYPE" || cmd == "MODE" || cmd == "STRU" || cmd == "NOOP" || cmd == "CLNT") {
+			ok = reply("200 OK");
+		}
+		else if (cmd == "PWD" || cmd == "XPWD") {
+			ok = reply("257 \"" + cwd + "\" is current directory.");
+		}
+		else if (cmd == "CWD" || cmd == "CDUP") {
+			std::string const target = bench_vfs::resolve(cwd, (cmd == "CDUP") ? std::string("..") : arg);
+			if (vfs_.has_dir(target)) {
+				cwd = target;
+				ok = reply("250 CWD successful");
+			}
+			else {
+				ok = reply("550 No such directory");
+			}
+		}
+		else if (cmd == "MKD") {
+			std::string const target = bench_vfs::resolve(cwd, arg);
+			vfs_.add_dir(parent_of(target), name_of(target));
+			ok = reply("257 \"" + target + "\" created");
+		}
+		else if (cmd == "PASV" || cmd == "EPSV") {
+			if (pasv_fd != -1) {
+				close(pasv_fd);
+			}
+			int port{};
+			pasv_fd = listen_loopback(port);
+			if (pasv_fd == -1) {
+				ok = reply("425 Cannot open passive connection");
+			}
+			else if (cmd == "PASV") {
+				ok = reply("227 Entering Passive Mode (127,0,0,1," + std::to_string(port / 256) + "," + std::to_string(port % 256) + ")");
+			}
+			else {
+				ok = reply("229 Entering Extended Passive Mode (|||" + std::to_string(port) + "|)");
+			}
+		}
+		else if (cmd == "REST") {
+			rest = std::atoll(arg.c_str());
+			ok = reply("350 Restarting");
+		}
+		else if (cmd == "SIZE" || cmd == "MDTM") {
+			int64_t const size = vfs_.file_size(bench_vfs::resolve(cwd, arg));
+			if (size < 0) {
+				ok = reply("550 File not found");
+			}
+			else if (cmd == "SIZE") {
+				ok = reply("213 " + std::to_string(size));
+			}
+			else {
+				ok = reply("213 20190101120000");
+			}
+		}
+		else if (cmd == "LIST" || cmd == "NLST" || cmd == "MLSD") {
+			std::string path = cwd;
+			if (!arg.empty() && arg[0] != '-') {
+				path = bench_vfs::resolve(cwd, arg);
+			}
+			std::string const listing = format_listing(vfs_.list(path), cmd == "MLSD");
+
+			int data_fd = data_connection();
+			if (data_fd == -1) {
+				ok = reply("425 Use PASV first");
+			}
+			else {
+				ok = reply("150 Opening data connection");
+				bool sent = send_all(data_fd, listing);
+				close(data_fd);
+				ok = ok && reply(sent ? "226 Transfer complete" : "426 Transfer aborted");
+			}
+		}
+		else if (cmd == "RETR") {
+			int64_t const size = vfs_.file_size(bench_vfs::resolve(cwd, arg));
+			if (size < 0) {
+				ok = reply("550 File not found");
+			}
+			else {
+				int data_fd = data_connection();
+				if (data_fd == -1) {
+					ok = reply("425 Use PASV first");
+				}
+				else {
+					ok = reply("150 Opening data connection");
+					bool sent = send_pattern(data_fd, std::max<int64_t>(0, size - rest));
+					close(data_fd);
+					ok = ok && reply(sent ? "226 Transfer complete" : "426 Transfer aborted");
+				}
+			}
+			rest = 0;
+		}
+		else if (cmd == "STOR" || cmd == "APPE") {
+			int data_fd = data_connection();
+			if (data_fd == -1) {
+				ok = reply("425 Use PASV first");
+			}
+			else {
+				ok = reply("150 Opening data connection");
+				int64_t const received = receive_all(data_fd);
+				close(data_fd);
+
+				std::string const target = bench_vfs::resolve(cwd, arg);
+				vfs_.add_file(parent_of(target), name_of(target), rest + received);
+				ok = ok && reply("226 Transfer complete");
+			}
+			rest = 0;
+		}
+		else if (cmd == "DELE" || cmd == "RMD") {
+			ok = reply("250 OK");
+		}
+		else if (cmd == "QUIT") {
+			reply("221 Goodbye");
+			break;
+		}
+		else {
+			ok = reply("502 Command not implemented");
+		}
+
+		if (!ok) {
+			break;
+		}
+	}
+
+	if (pasv_fd != -1) {
+		close(pasv_fd);
+	}
+}
+
+http_standin_server::http_standin_server(bench_vfs & vfs)
+	: bench_server(vfs)
+{
+}
+
+http_standin_server::~http_standin_server()
+{
+	stop();
+}
+
+void http_standin_server::handle(int fd)
+{
+	line_reader reader(fd);
+
+	std::string line;
+	while (reader.get(line)) {
+		if (line.empty()) {
+			continue;
+		}
+
+		// Request line, e.g. GET /path HTTP/1.1
+		size_t const first = line.find(' ');
+		size_t const second = line.find(' ', first + 1);
+		if (first == std::string::npos || second == std::string::npos) {
+			break;
+		}
+		std::string const verb = line.substr(0, first);
+		std::string const path = line.substr(first + 1, second - first - 1);
+
+		int64_t offset{};
+		bool close_connection{};
+		while (reader.get(line) && !line.empty()) {
+			std::string lower = line;
+			std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+			if (!lower.compare(0, 13, "range: bytes=")) {
+				offset = std::atoll(lower.c_str() + 13);
+			}
+			else if (lower == "connection: close") {
+				close_connection = true;
+			}
+		}
+
+		int64_t const size = vfs_.file_size(path);
+		bool ok;
+		if (size < 0) {
+			ok = send_all(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+		}
+		else if (offset > 0 && offset < size) {
+			ok = send_all(fd, "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\nContent-Range: bytes " + std::to_string(offset) + "-" + std::to_string(size - 1) + "/" + std::to_string(size) + "\r\nContent-Length: " + std::to_string(size - offset) + "\r\n\r\n");
+			ok = ok && (verb == "HEAD" || send_pattern(fd, size - offset));
+		}
+		else {
+			ok = send_all(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n");
+			ok = ok && (verb == "HEAD" || send_pattern(fd, size));
+		}
+
+		if (!ok || close_connection) {
+			break;
+		}
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef FILEZILLA_TESTS_BENCH_SERVERS_HEADER
+#define FILEZILLA_TESTS_BENCH_SERVERS_HEADER
+
+// Minimal in-process stand-in servers for the benchmark suite.
+//
+// They only implement as much of the protocols as the engine needs to
+// drive its transfer and listing code paths, against a synthetic file tree.
+// File contents are never stored, downloads produce a fixed pattern and
+// uploads are discarded after counting.
+//
+// The servers use blocking sockets with one thread per connection and only
+// listen on the loopback interface.
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct bench_entry
+{
+	std::string name;
+	int64_t size{};
+	bool dir{};
+};
+
+// Synthetic directory tree, paths are absolute and use / as separator
+class bench_vfs final
+{
+public:
+	bench_vfs();
+
+	void add_file(std::string const& dir, std::string const& name, int64_t size);
+	void add_dir(std::string const& parent, std::string const& name);
+
+	bool has_dir(std::string const& path) const;
+
+	// Returns -1 if no such file
+	int64_t file_size(std::string const& path) const;
+
+	std::vector<bench_entry> list(std::string const& path) const;
+
+	// Resolves path relative to cwd, handles . and ..
+	static std::string resolve(std::string const& cwd, std::string const& path);
+
+private:
+	mutable std::mutex mutex_;
+	std::map<std::string, std::vector<bench_entry>> dirs_;
+	std::map<std::string, int64_t> files_;
+};
+
+class bench_server
+{
+public:
+	explicit bench_server(bench_vfs & vfs);
+	virtual ~bench_server();
+
+	bench_server(bench_server const&) = delete;
+	bench_server& operator=(bench_server const&) = delete;
+
+	// Listens on an ephemeral loopback port
+	bool start();
+	void stop();
+
+	int port() const { return port_; }
+
+protected:
+	virtual void handle(int fd) = 0;
+
+	bench_vfs & vfs_;
+
+private:
+	void accept_loop();
+
+	int listen_fd_{-1};
+	int port_{};
+
+	std::atomic<bool> stopping_{};
+	std::thread accept_thread_;
+
+	std::mutex mutex_;
+	std::vector<std::thread> connections_;
+	std::vector<int> fds_;
+};
+
+class ftp_standin_server final : public bench_server
+{
+public:
+	enum class listing_format
+	{
+		unix_ls,
+		dos,
+		mlsd
+	};
+
+	ftp_standin_server(bench_vfs & vfs, listing_format format);
+	virtual ~ftp_standin_server();
+
+protected:
+	virtual void handle(int fd) override;
+
+private:
+	std::string format_listing(std::vector<bench_entry> const& entries, bool mlsd) const;
+
+	listing_format const format_;
+};
+
+class http_standin_server final : public bench_server
+{
+public:
+	explicit http_standin_server(bench_vfs & vfs);
+	virtual ~http_standin_server();
+
+protected:
+	virtual void handle(int fd) override;
+};
+
+#endif
@@ -0,0 +1,577 @@
+// Benchmark suite driving the engine against in-process stand-in servers.
+//
+// Run through `make bench`. Each benchmark prints one JSON object per line
+// to stdout, progress and errors go to stderr.
+//
+// Usage: benchmark [name...]
+//   Without arguments all benchmarks are run, otherwise only those whose
+//   name starts with one of the given arguments.
+//
+// SFTP is handled by the external fzsftp executable which needs a real SSH
+// server. Set FZ_BENCH_SFTP to user:password@host:port and FZ_BENCH_FZSFTP
+// to the path of fzsftp to include the SFTP benchmarks. They upload their
+// own test data into FZ_BENCH_SFTP_DIR, /tmp/fzbench by default.
+//
+// The parser_* benchmarks do not use the network at all, they feed synthetic
+// listings straight to CDirectoryListingParser, see bench_dirparser.h.
+//
+// Note that CPU times are those of the whole process, they include the
+// stand-in servers.
+
+#include <libfilezilla_engine.h>
+#include <engine_context.h>
+#include <xmlutils.h>
+
+#include "bench_dirparser.h"
+#include "bench_servers.h"
+
+#include <libfilezilla/format.hpp>
+
+#include <algorithm>
+#include <clocale>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+class bench_options final : public COptionsBase
+{
+public:
+	bench_options()
+	{
+		numbers_[OPTION_USEPASV] = 1;
+		numbers_[OPTION_TIMEOUT] = 20;
+		numbers_[OPTION_ALLOW_TRANSFERMODEFALLBACK] = 1;
+		numbers_[OPTION_RECONNECTDELAY] = 5;
+		numbers_[OPTION_SOCKET_BUFFERSIZE_RECV] = 4194304;
+		numbers_[OPTION_SOCKET_BUFFERSIZE_SEND] = 262144;
+		numbers_[OPTION_SIZE_USETHOUSANDSEP] = 1;
+		numbers_[OPTION_SIZE_DECIMALPLACES] = 1;
+		numbers_[OPTION_TCP_KEEPALIVE_INTERVAL] = 15;
+		numbers_[OPTION_CACHE_TTL] = 600;
+
+		if (char const* fzsftp = getenv("FZ_BENCH_FZSFTP")) {
+			strings_[OPTION_FZSFTP_EXECUTABLE] = fz::to_wstring(std::string(fzsftp));
+		}
+		if (char const* metrics = getenv("FZ_BENCH_METRICS")) {
+			strings_[OPTION_METRICS_FILE] = fz::to_wstring(std::string(metrics));
+		}
+		if (char const* trace = getenv("FZ_BENCH_TRACE")) {
+			strings_[OPTION_TRACE_FILE] = fz::to_wstring(std::string(trace));
+		}
+	}
+
+	virtual int GetOptionVal(unsigned int id) override
+	{
+		auto it = numbers_.find(id);
+		return (it != numbers_.end()) ? it->second : 0;
+	}
+
+	virtual std::wstring GetOption(unsigned int id) override
+	{
+		auto it = strings_.find(id);
+		return (it != strings_.end()) ? it->second : std::wstring();
+	}
+
+	virtual std::unique_ptr<pugi::xml_document> GetOptionXml(unsigned int) override
+	{
+		return std::make_unique<pugi::xml_document>();
+	}
+
+	virtual bool SetOption(unsigned int id, int value) override
+	{
+		numbers_[id] = value;
+		return true;
+	}
+
+	virtual bool SetOption(unsigned int id, std::wstring const& value) override
+	{
+		strings_[id] = value;
+		return true;
+	}
+
+	virtual bool SetOptionXml(unsigned int, pugi::xml_node const&) override { return false; }
+	virtual bool SetOptionXml(unsigned int, pugi::xml_document const&) override { return false; }
+
+private:
+	// Only modified before the engine gets created
+	std::map<unsigned int, int> numbers_;
+	std::map<unsigned int, std::wstring> strings_;
+};
+
+class bench_encoding_converter final : public CustomEncodingConverterBase
+{
+public:
+	virtual std::wstring toLocal(std::wstring const&, char const* buffer, size_t len) const override
+	{
+		return fz::to_wstring(std::string(buffer, len));
+	}
+
+	virtual std::string toServer(std::wstring const&, wchar_t const* buffer, size_t len) const override
+	{
+		return fz::to_string(std::wstring(buffer, len));
+	}
+};
+
+// Executes commands synchronously and answers all async requests
+// in the most permissive way.
+class bench_engine final : public EngineNotificationHandler
+{
+public:
+	explicit bench_engine(CFileZillaEngineContext & context)
+		: engine_(std::make_unique<CFileZillaEngine>(context, *this))
+	{
+	}
+
+	virtual ~bench_engine()
+	{
+		engine_.reset();
+	}
+
+	int run(CCommand const& command)
+	{
+		int res = engine_->Execute(command);
+		if (res != FZ_REPLY_WOULDBLOCK) {
+			return res;
+		}
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> l(mutex_);
+				cond_.wait(l, [this] { return signalled_; });
+				signalled_ = false;
+			}
+
+			while (auto notification = engine_->GetNextNotification()) {
+				switch (notification->GetID()) {
+				case nId_operation:
+					return static_cast<COperationNotification const&>(*notification).nReplyCode;
+				case nId_asyncrequest:
+					reply(std::unique_ptr<CAsyncRequestNotification>(static_cast<CAsyncRequestNotification*>(notification.release())));
+					break;
+				case nId_logmsg:
+					if (verbose_) {
+						std::wcerr << static_cast<CLogmsgNotification const&>(*notification).msg << std::endl;
+					}
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	}
+
+	int cache_lookup(CServerPath const& path, CDirectoryListing & listing)
+	{
+		return engine_->CacheLookup(path, listing);
+	}
+
+	bool verbose_{};
+
+private:
+	virtual void OnEngineEvent(CFileZillaEngine*) override
+	{
+		std::lock_guard<std::mutex> l(mutex_);
+		signalled_ = true;
+		cond_.notify_one();
+	}
+
+	void reply(std::unique_ptr<CAsyncRequestNotification> && request)
+	{
+		switch (request->GetRequestID()) {
+		case reqId_fileexists:
+			static_cast<CFileExistsNotification&>(*request).overwriteAction = CFileExistsNotification::overwrite;
+			break;
+		case reqId_hostkey:
+		case reqId_hostkeyChanged:
+			static_cast<CHostKeyNotification&>(*request).m_trust = true;
+			break;
+		case reqId_certificate:
+			static_cast<CCertificateNotification&>(*request).trusted_ = true;
+			break;
+		case reqId_insecure_ftp:
+			static_cast<CInsecureFTPNotification&>(*request).allow_ = true;
+			break;
+		default:
+			break;
+		}
+		engine_->SetAsyncRequestReply(std::move(request));
+	}
+
+	std::unique_ptr<CFileZillaEngine> engine_;
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	bool signalled_{};
+};
+
+double cpu_seconds()
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+// Collects timings of a single benchmark run and reports them
+class bench_result final
+{
+public:
+	explicit bench_result(std::string const& name)
+		: name_(name)
+		, cpu_start_(cpu_seconds())
+		, start_(fz::monotonic_clock::now())
+	{
+	}
+
+	// Runs a single operation and records its latency
+	bool time(std::function<int()> const& f)
+	{
+		auto const start = fz::monotonic_clock::now();
+		int res = f();
+		latencies_.push_back((fz::monotonic_clock::now() - start).get_microseconds());
+		if (res != FZ_REPLY_OK) {
+			++failures_;
+		}
+		return res == FZ_REPLY_OK;
+	}
+
+	void add_bytes(int64_t bytes) { bytes_ += bytes; }
+	void add_entries(int64_t entries) { entries_ += entries; }
+
+	void report()
+	{
+		double const seconds = (fz::monotonic_clock::now() - start_).get_microseconds() / 1000000.0;
+		double const cpu = cpu_seconds() - cpu_start_;
+
+		std::sort(latencies_.begin(), latencies_.end());
+		int64_t const total = std::accumulate(latencies_.begin(), latencies_.end(), int64_t{});
+		double const mean = latencies_.empty() ? 0 : static_cast<double>(total) / latencies_.size() / 1000.0;
+		double const p95 = latencies_.empty() ? 0 : latencies_[std::min(latencies_.size() - 1, latencies_.size() * 95 / 100)] / 1000.0;
+
+		char buf[1024];
+		snprintf(buf, sizeof(buf), "{\"benchmark\":\"%s\",\"operations\":%zu,\"failures\":%d,\"bytes\":%lld,\"entries\":%lld,\"seconds\":%.6f,"
+			"\"bytes_per_second\":%.1f,\"entries_per_second\":%.1f,\"latency_mean_ms\":%.3f,\"latency_p95_ms\":%.3f,\"cpu_seconds\":%.6f,\"cpu_ns_per_byte\":%.3f}",
+			name_.c_str(), latencies_.size(), failures_, static_cast<long long>(bytes_), static_cast<long long>(entries_), seconds,
+			seconds > 0 ? bytes_ / seconds : 0., seconds > 0 ? entries_ / seconds : 0.,
+			mean, p95, cpu, bytes_ ? cpu * 1e9 / bytes_ : 0.);
+		std::cout << buf << std::endl;
+	}
+
+private:
+	std::string const name_;
+	double const cpu_start_;
+	fz::monotonic_clock const start_;
+
+	std::vector<int64_t> latencies_;
+	int64_t bytes_{};
+	int64_t entries_{};
+	int failures_{};
+};
+
+struct bench_target
+{
+	CServer server;
+	Credentials credentials;
+	CServerPath root;
+};
+
+std::wstring g_local_dir;
+
+std::wstring local_file(std::wstring const& name)
+{
+	return g_local_dir + L"/" + name;
+}
+
+bool create_local_file(std::wstring const& path, int64_t size)
+{
+	FILE* f = fopen(fz::to_string(path).c_str(), "wb");
+	if (!f) {
+		return false;
+	}
+	char buf[65536] = {};
+	while (size > 0) {
+		size_t chunk = static_cast<size_t>(std::min<int64_t>(size, sizeof(buf)));
+		if (fwrite(buf, 1, chunk, f) != chunk) {
+			fclose(f);
+			return false;
+		}
+		size -= chunk;
+	}
+	return fclose(f) == 0;
+}
+
+void remove_local_file(std::wstring const& path)
+{
+	unlink(fz::to_string(path).c_str());
+}
+
+bool connect(bench_engine & engine, bench_target const& target)
+{
+	return engine.run(CConnectCommand(target.server, ServerHandle(), target.credentials, false)) == FZ_REPLY_OK;
+}
+
+void download_files(std::string const& name, CFileZillaEngineContext & context, bench_target const& target, CServerPath const& path, std::vector<std::pair<std::wstring, int64_t>> const& files)
+{
+	bench_engine engine(context);
+	if (!connect(engine, target)) {
+		std::cerr << name << ": could not connect" << std::endl;
+		return;
+	}
+
+	bench_result result(name);
+	for (auto const& file : files) {
+		std::wstring const local = local_file(file.first);
+		if (result.time([&] { return engine.run(CFileTransferCommand(local, path, file.first, true, CFileTransferCommand::t_transferSettings())); })) {
+			result.add_bytes(file.second);
+		}
+		remove_local_file(local);
+	}
+	result.report();
+}
+
+void upload_files(std::string const& name, CFileZillaEngineContext & context, bench_target const& target, CServerPath const& path, int64_t size, size_t count)
+{
+	std::wstring const source = local_file(L"upload_source");
+	if (!create_local_file(source, size)) {
+		std::cerr << name << ": could not create local file" << std::endl;
+		return;
+	}
+
+	bench_engine engine(context);
+	if (!connect(engine, target) || engine.run(CMkdirCommand(path)) != FZ_REPLY_OK) {
+		std::cerr << name << ": could not connect" << std::endl;
+		remove_local_file(source);
+		return;
+	}
+
+	bench_result result(name);
+	for (size_t i = 0; i < count; ++i) {
+		std::wstring const remote = fz::sprintf(L"upload%d", i);
+		if (result.time([&] { return engine.run(CFileTransferCommand(source, path, remote, false, CFileTransferCommand::t_transferSettings())); })) {
+			result.add_bytes(size);
+		}
+	}
+	result.report();
+
+	remove_local_file(source);
+}
+
+// Recursively lists everything below the given path, like a recursive operation would
+void list_tree(std::string const& name, CFileZillaEngineContext & context, bench_target const& target, CServerPath const& root)
+{
+	bench_engine engine(context);
+	if (!connect(engine, target)) {
+		std::cerr << name << ": could not connect" << std::endl;
+		return;
+	}
+
+	bench_result result(name);
+
+	std::deque<CServerPath> pending{root};
+	while (!pending.empty()) {
+		CServerPath const path = pending.front();
+		pending.pop_front();
+
+		if (!result.time([&] { return engine.run(CListCommand(path, std::wstring(), LIST_FLAG_REFRESH)); })) {
+			continue;
+		}
+
+		CDirectoryListing listing;
+		if (engine.cache_lookup(path, listing) != FZ_REPLY_OK) {
+			continue;
+		}
+		result.add_entries(listing.size());
+		for (size_t i = 0; i < listing.size(); ++i) {
+			if (listing[i].is_dir()) {
+				pending.emplace_back(CServerPath(path, listing[i].name));
+			}
+		}
+	}
+	result.report();
+}
+
+struct benchmark
+{
+	std::string name;
+	std::function<void()> run;
+};
+
+bool selected(std::vector<std::string> const& filters, std::string const& name)
+{
+	if (filters.empty()) {
+		return true;
+	}
+	for (auto const& filter : filters) {
+		if (!name.compare(0, filter.size(), filter)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int64_t env_number(char const* name, int64_t def)
+{
+	char const* v = getenv(name);
+	return v ? std::atoll(v) : def;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	setlocale(LC_ALL, "");
+
+	std::vector<std::string> filters(argv + 1, argv + argc);
+
+	char tmpl[] = "/tmp/fzbenchXXXXXX";
+	if (!mkdtemp(tmpl)) {
+		std::cerr << "Could not create temporary directory" << std::endl;
+		return 1;
+	}
+	g_local_dir = fz::to_wstring(std::string(tmpl));
+
+	// Workload sizes, can be overridden to get quicker or more stable runs
+	size_t const small_count = static_cast<size_t>(env_number("FZ_BENCH_SMALL_FILES", 500));
+	int64_t const small_size = env_number("FZ_BENCH_SMALL_SIZE", 4096);
+	size_t const huge_count = static_cast<size_t>(env_number("FZ_BENCH_HUGE_FILES", 2));
+	int64_t const huge_size = env_number("FZ_BENCH_HUGE_SIZE", 512ll * 1024 * 1024);
+	int const tree_depth = static_cast<int>(env_number("FZ_BENCH_TREE_DEPTH", 6));
+	int const tree_fanout = static_cast<int>(env_number("FZ_BENCH_TREE_FANOUT", 3));
+	size_t const giant_entries = static_cast<size_t>(env_number("FZ_BENCH_GIANT_LISTING", 200000));
+	size_t const parser_entries = static_cast<size_t>(env_number("FZ_BENCH_PARSER_ENTRIES", 500000));
+
+	// Build the synthetic tree shared by all stand-in servers
+	bench_vfs vfs;
+	std::vector<std::pair<std::wstring, int64_t>> small_files, huge_files;
+	vfs.add_dir("/", "small");
+	for (size_t i = 0; i < small_count; ++i) {
+		std::string const file = "file" + std::to_string(i);
+		vfs.add_file("/small", file, small_size);
+		small_files.emplace_back(fz::to_wstring(file), small_size);
+	}
+	vfs.add_dir("/", "huge");
+	for (size_t i = 0; i < huge_count; ++i) {
+		std::string const file = "huge" + std::to_string(i);
+		vfs.add_file("/huge", file, huge_size);
+		huge_files.emplace_back(fz::to_wstring(file), huge_size);
+	}
+	vfs.add_dir("/", "giant");
+	for (size_t i = 0; i < giant_entries; ++i) {
+		vfs.add_file("/giant", "entry_with_a_somewhat_longer_name_" + std::to_string(i) + ".dat", static_cast<int64_t>(i) * 37);
+	}
+	vfs.add_dir("/", "tree");
+	std::function<void(std::string const&, int)> build_tree = [&](std::string const& path, int depth) {
+		for (int i = 0; i < tree_fanout; ++i) {
+			vfs.add_file(path, "file" + std::to_string(i), 1024);
+			if (depth < tree_depth) {
+				std::string const dir = "dir" + std::to_string(i);
+				vfs.add_dir(path, dir);
+				build_tree(path + "/" + dir, depth + 1);
+			}
+		}
+	};
+	build_tree("/tree", 1);
+
+	bench_options options;
+	bench_encoding_converter converter;
+	CFileZillaEngineContext context(options, converter);
+
+	std::vector<std::unique_ptr<bench_server>> servers;
+	std::vector<benchmark> benchmarks;
+
+	for (auto const& format : parser_benchmark_formats()) {
+		benchmarks.push_back({"parser_" + format, [format, parser_entries] { run_parser_benchmark(format, parser_entries); }});
+	}
+
+	auto add_ftp = [&](std::string const& prefix, ftp_standin_server::listing_format format) {
+		auto server = std::make_unique<ftp_standin_server>(vfs, format);
+		if (!server->start()) {
+			std::cerr << "Could not start FTP stand-in server" << std::endl;
+			return;
+		}
+		bench_target target;
+		target.server = CServer(INSECURE_FTP, DEFAULT, L"127.0.0.1", server->port());
+		target.server.SetUser(L"bench");
+		target.credentials.logonType_ = LogonType::normal;
+		target.credentials.SetPass(L"bench");
+		servers.emplace_back(std::move(server));
+
+		benchmarks.push_back({prefix + "_small_files_download", [&, target, prefix] { download_files(prefix + "_small_files_download", context, target, CServerPath(L"/small"), small_files); }});
+		benchmarks.push_back({prefix + "_huge_files_download", [&, target, prefix] { download_files(prefix + "_huge_files_download", context, target, CServerPath(L"/huge"), huge_files); }});
+		benchmarks.push_back({prefix + "_small_files_upload", [&, target, prefix] { upload_files(prefix + "_small_files_upload", context, target, CServerPath(L"/upload"), small_size, small_count); }});
+		benchmarks.push_back({prefix + "_huge_files_upload", [&, target, prefix] { upload_files(prefix + "_huge_files_upload", context, target, CServerPath(L"/upload"), huge_size, huge_count); }});
+		benchmarks.push_back({prefix + "_deep_tree_list", [&, target, prefix] { list_tree(prefix + "_deep_tree_list", context, target, CServerPath(L"/tree")); }});
+		benchmarks.push_back({prefix + "_giant_listing", [&, target, prefix] { list_tree(prefix + "_giant_listing", context, target, CServerPath(L"/giant")); }});
+	};
+	add_ftp("ftp_unix", ftp_standin_server::listing_format::unix_ls);
+	add_ftp("ftp_dos", ftp_standin_server::listing_format::dos);
+	add_ftp("ftp_mlsd", ftp_standin_server::listing_format::mlsd);
+
+	{
+		auto server = std::make_unique<http_standin_server>(vfs);
+		if (server->start()) {
+			bench_target target;
+			target.server = CServer(HTTP, DEFAULT, L"127.0.0.1", server->port());
+			servers.emplace_back(std::move(server));
+
+			benchmarks.push_back({"http_small_files_download", [&, target] { download_files("http_small_files_download", context, target, CServerPath(L"/small"), small_files); }});
+			benchmarks.push_back({"http_huge_files_download", [&, target] { download_files("http_huge_files_download", context, target, CServerPath(L"/huge"), huge_files); }});
+		}
+		else {
+			std::cerr << "Could not start HTTP stand-in server" << std::endl;
+		}
+	}
+
+	if (char const* sftp = getenv("FZ_BENCH_SFTP")) {
+		// user:password@host:port
+		std::string const spec = sftp;
+		size_t const at = spec.rfind('@');
+		size_t const colon = spec.find(':');
+		size_t const port_colon = spec.rfind(':');
+		if (at == std::string::npos || colon > at || port_colon < at) {
+			std::cerr << "FZ_BENCH_SFTP has to be of the form user:password@host:port" << std::endl;
+		}
+		else {
+			bench_target target;
+			target.server = CServer(SFTP, DEFAULT, fz::to_wstring(spec.substr(at + 1, port_colon - at - 1)), static_cast<unsigned int>(std::atoi(spec.c_str() + port_colon + 1)));
+			target.server.SetUser(fz::to_wstring(spec.substr(0, colon)));
+			target.credentials.logonType_ = LogonType::normal;
+			target.credentials.SetPass(fz::to_wstring(spec.substr(colon + 1, at - colon - 1)));
+
+			char const* dir = getenv("FZ_BENCH_SFTP_DIR");
+			CServerPath const path(fz::to_wstring(std::string(dir ? dir : "/tmp/fzbench")));
+
+			benchmarks.push_back({"sftp_small_files_upload", [&, target, path] { upload_files("sftp_small_files_upload", context, target, path, small_size, small_count); }});
+			benchmarks.push_back({"sftp_small_files_download", [&, target, path] {
+				std::vector<std::pair<std::wstring, int64_t>> files;
+				for (size_t i = 0; i < small_count; ++i) {
+					files.emplace_back(fz::sprintf(L"upload%d", i), small_size);
+				}
+				download_files("sftp_small_files_download", context, target, path, files);
+			}});
+		}
+	}
+
+	for (auto const& b : benchmarks) {
+		if (selected(filters, b.name)) {
+			std::cerr << "Running " << b.name << "..." << std::endl;
+			b.run();
+		}
+	}
+
+	for (auto & server : servers) {
+		server->stop();
+	}
+
+	rmdir(tmpl);
+
+	return 0;
+}
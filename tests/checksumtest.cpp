@@ -0,0 +1,65 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "checksum.h"
+
+#include <libfilezilla/encode.hpp>
+
+/*
+ * This testsuite asserts the correctness of the helpers used to
+ * verify transfers against checksums reported by servers.
+ */
+
+class CChecksumTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CChecksumTest);
+	CPPUNIT_TEST(testParseAlgorithm);
+	CPPUNIT_TEST(testFindDigest);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testParseAlgorithm();
+	void testFindDigest();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CChecksumTest);
+
+void CChecksumTest::testParseAlgorithm()
+{
+	fz::hash_algorithm algorithm{};
+	CPPUNIT_ASSERT(ParseHashAlgorithm(L"SHA-256", algorithm) && algorithm == fz::hash_algorithm::sha256);
+	CPPUNIT_ASSERT(ParseHashAlgorithm(L"sha512", algorithm) && algorithm == fz::hash_algorithm::sha512);
+	CPPUNIT_ASSERT(ParseHashAlgorithm(L"SHA", algorithm) && algorithm == fz::hash_algorithm::sha1);
+	CPPUNIT_ASSERT(ParseHashAlgorithm(L"md5", algorithm) && algorithm == fz::hash_algorithm::md5);
+	CPPUNIT_ASSERT(!ParseHashAlgorithm(L"CRC32", algorithm));
+	CPPUNIT_ASSERT(!ParseHashAlgorithm(L"", algorithm));
+
+	CPPUNIT_ASSERT(GetHashStrength(fz::hash_algorithm::sha512) > GetHashStrength(fz::hash_algorithm::sha256));
+	CPPUNIT_ASSERT(GetHashStrength(fz::hash_algorithm::sha1) > GetHashStrength(fz::hash_algorithm::md5));
+}
+
+void CChecksumTest::testFindDigest()
+{
+	std::wstring const empty_md5 = L"d41d8cd98f00b204e9800998ecf8427e";
+	auto const expected = fz::md5(std::string());
+
+	// HASH reply: algorithm, byte range, digest, filename
+	CPPUNIT_ASSERT(FindHexDigest(L"MD5 0-0 " + empty_md5 + L" my file.txt", fz::hash_algorithm::md5) == expected);
+
+	// XMD5 reply, some servers use uppercase
+	CPPUNIT_ASSERT(FindHexDigest(fz::str_toupper_ascii(empty_md5), fz::hash_algorithm::md5) == expected);
+
+	// Wrong length for the algorithm
+	CPPUNIT_ASSERT(FindHexDigest(empty_md5, fz::hash_algorithm::sha256).empty());
+
+	// Not hex
+	CPPUNIT_ASSERT(FindHexDigest(L"File not found: d41d8cd98f00b204e9800998ecf8427x", fz::hash_algorithm::md5).empty());
+
+	// XCRC reply
+	std::vector<uint8_t> const crc{0xcb, 0xf4, 0x39, 0x26};
+	CPPUNIT_ASSERT(FindHexDigest(L"CBF43926", GetDigestSize(file_hash::crc32)) == crc);
+	CPPUNIT_ASSERT(FindHexDigest(L"CBF43926", 0).empty());
+	CPPUNIT_ASSERT(GetDigestSize(ToFileHash(fz::hash_algorithm::sha256)) == GetDigestSize(fz::hash_algorithm::sha256));
+}
@@ -23,6 +23,8 @@ class CNaturalSortTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testSeq);
 	CPPUNIT_TEST(testPair);
 	CPPUNIT_TEST(testFractional);
+	CPPUNIT_TEST(testLeadingZeros);
+	CPPUNIT_TEST(testSortKey);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -37,6 +39,8 @@ public:
 	void testSeq();
 	void testPair();
 	void testFractional();
+	void testLeadingZeros();
+	void testSortKey();
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(CNaturalSortTest);
@@ -140,3 +144,44 @@ void CNaturalSortTest::testFractional()
 	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("1.1"), _T("1.3")) < 0);
 	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("1.3"), _T("1.15")) < 0);
 }
+
+void CNaturalSortTest::testLeadingZeros()
+{
+	// Leading zeros only matter if the names are equal otherwise
+	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("01b"), _T("1c")) < 0);
+	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("1c"), _T("01b")) > 0);
+	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("01"), _T("1a")) < 0);
+	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("01a2"), _T("1a02")) > 0);
+	CPPUNIT_ASSERT(CFileListCtrlSortBase::CmpNatural(_T("00-"), _T("0a")) < 0);
+}
+
+namespace {
+int sign(int v)
+{
+	return (v > 0) - (v < 0);
+}
+}
+
+void CNaturalSortTest::testSortKey()
+{
+	std::wstring const names[] = {
+		L"", L"x", L"a", L"A", L"ab", L"B", L"0", L"00", L"1", L"01", L"02", L"2", L"10", L"010",
+		L"2100", L"02005", L"1a", L"01a", L"1abc", L"10abc", L"10abc3", L"a0", L"a1a", L"a10",
+		L"x2-y7", L"x2-y08", L"1.001", L"1.010", L"1.3", L"1.15", L"-2", L"a-02.b"
+	};
+
+	for (auto const& a : names) {
+		for (auto const& b : names) {
+			auto const natural1 = CFileListCtrlSortBase::GetSortKey(a, CFileListCtrlSortBase::namesort_natural);
+			auto const natural2 = CFileListCtrlSortBase::GetSortKey(b, CFileListCtrlSortBase::namesort_natural);
+			CPPUNIT_ASSERT_EQUAL(sign(CFileListCtrlSortBase::CmpNatural(a, b)), sign(natural1.compare(natural2)));
+
+			auto const nocase1 = CFileListCtrlSortBase::GetSortKey(a, CFileListCtrlSortBase::namesort_caseinsensitive);
+			auto const nocase2 = CFileListCtrlSortBase::GetSortKey(b, CFileListCtrlSortBase::namesort_caseinsensitive);
+			int const res = nocase1.compare(nocase2);
+			if (res) {
+				CPPUNIT_ASSERT_EQUAL(sign(CFileListCtrlSortBase::CmpNoCase(a, b)), sign(res));
+			}
+		}
+	}
+}
@@ -0,0 +1,247 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts the correctness of the name index used by
+ * CDirectoryListing to find files.
+ */
+
+class CDirectoryListingTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryListingTest);
+	CPPUNIT_TEST(testInsert);
+	CPPUNIT_TEST(testCollisions);
+	CPPUNIT_TEST(testWrapAround);
+	CPPUNIT_TEST(testRemove);
+	CPPUNIT_TEST(testRemoveMany);
+	CPPUNIT_TEST(testFindFile);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testInsert();
+	void testCollisions();
+	void testWrapAround();
+	void testRemove();
+	void testRemoveMany();
+	void testFindFile();
+
+protected:
+	typedef CDirectoryListing::name_index name_index;
+
+	static size_t find(name_index const& index, uint32_t hash, size_t expected)
+	{
+		return index.find(hash, [expected](size_t i) { return i == expected; });
+	}
+
+	static size_t find_first(name_index const& index, uint32_t hash)
+	{
+		return index.find(hash, [](size_t) { return true; });
+	}
+
+	static uint32_t hash(size_t i)
+	{
+		return static_cast<uint32_t>(i * 2654435761u);
+	}
+
+	static CDirectoryListing make_listing(std::vector<std::wstring> const& names)
+	{
+		std::vector<CDirentry> entries;
+		for (auto const& name : names) {
+			CDirentry entry;
+			entry.name = name;
+			entry.size = 0;
+			entry.flags = 0;
+			entries.push_back(std::move(entry));
+		}
+		CDirectoryListing listing;
+		listing.Assign(std::move(entries));
+		return listing;
+	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryListingTest);
+
+void CDirectoryListingTest::testInsert()
+{
+	name_index index;
+	CPPUNIT_ASSERT(find_first(index, 1) == std::string::npos);
+
+	// Enough entries to grow the table a few times
+	for (size_t i = 0; i < 1000; ++i) {
+		index.insert(hash(i), i);
+	}
+	CPPUNIT_ASSERT_EQUAL(size_t(1000), index.count());
+
+	for (size_t i = 0; i < 1000; ++i) {
+		CPPUNIT_ASSERT_EQUAL(i, find(index, hash(i), i));
+	}
+	CPPUNIT_ASSERT(find_first(index, hash(1000)) == std::string::npos);
+	CPPUNIT_ASSERT(find(index, hash(5), 6) == std::string::npos);
+}
+
+void CDirectoryListingTest::testCollisions()
+{
+	// Entries with the same hash form a chain of consecutive slots
+	name_index index;
+	for (size_t i = 0; i < 6; ++i) {
+		index.insert(7, i);
+	}
+	// Its home slot is taken by the chain
+	index.insert(8, 6);
+
+	CPPUNIT_ASSERT_EQUAL(size_t(3), find(index, 7, 3));
+	CPPUNIT_ASSERT_EQUAL(size_t(6), find(index, 8, 6));
+
+	// Names need not be unique, the first matching entry is returned
+	CPPUNIT_ASSERT_EQUAL(size_t(0), find_first(index, 7));
+
+	index.erase(7, 0);
+	CPPUNIT_ASSERT_EQUAL(size_t(1), find_first(index, 7));
+
+	index.erase(7, 3);
+	CPPUNIT_ASSERT(find(index, 7, 3) == std::string::npos);
+	CPPUNIT_ASSERT_EQUAL(size_t(5), find(index, 7, 5));
+	CPPUNIT_ASSERT_EQUAL(size_t(6), find(index, 8, 6));
+	CPPUNIT_ASSERT_EQUAL(size_t(5), index.count());
+
+	// Erasing unknown entries does nothing
+	index.erase(7, 3);
+	index.erase(9, 1);
+	CPPUNIT_ASSERT_EQUAL(size_t(5), index.count());
+	CPPUNIT_ASSERT_EQUAL(size_t(1), find(index, 7, 1));
+}
+
+void CDirectoryListingTest::testWrapAround()
+{
+	// The initial table has 16 slots. Entries with hash 15 start in the
+	// last slot and wrap around to the front of the table.
+	name_index index;
+	index.insert(15, 0);
+	index.insert(15, 1);
+	index.insert(15, 2);
+	index.insert(0, 3);
+	index.insert(1, 4);
+
+	for (size_t i = 0; i < 3; ++i) {
+		CPPUNIT_ASSERT_EQUAL(i, find(index, 15, i));
+	}
+	CPPUNIT_ASSERT_EQUAL(size_t(3), find(index, 0, 3));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), find(index, 1, 4));
+
+	// Deleting from the last slot has to shift the wrapped entries back
+	index.erase(15, 0);
+	CPPUNIT_ASSERT(find(index, 15, 0) == std::string::npos);
+	CPPUNIT_ASSERT_EQUAL(size_t(1), find(index, 15, 1));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), find(index, 15, 2));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), find(index, 0, 3));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), find(index, 1, 4));
+
+	index.erase(15, 1);
+	index.erase(15, 2);
+	CPPUNIT_ASSERT(find_first(index, 15) == std::string::npos);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), find(index, 0, 3));
+	CPPUNIT_ASSERT_EQUAL(size_t(4), find(index, 1, 4));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), index.count());
+}
+
+void CDirectoryListingTest::testRemove()
+{
+	name_index index;
+	for (size_t i = 0; i < 20; ++i) {
+		index.insert(hash(i), i);
+	}
+
+	// Following entries move up by one
+	index.remove(hash(5), 5);
+	CPPUNIT_ASSERT_EQUAL(size_t(19), index.count());
+	CPPUNIT_ASSERT(find_first(index, hash(5)) == std::string::npos);
+	for (size_t i = 0; i < 20; ++i) {
+		if (i != 5) {
+			size_t const expected = i < 5 ? i : i - 1;
+			CPPUNIT_ASSERT_EQUAL(expected, find(index, hash(i), expected));
+		}
+	}
+}
+
+void CDirectoryListingTest::testRemoveMany()
+{
+	// Enough removals for the slots to get rewritten several times, mixed
+	// with lookups, insertions and erasures in between.
+	name_index index;
+	std::vector<size_t> names;
+	for (size_t i = 0; i < 2000; ++i) {
+		index.insert(hash(i), i);
+		names.push_back(i);
+	}
+
+	auto check = [&]() {
+		CPPUNIT_ASSERT_EQUAL(names.size(), index.count());
+		for (size_t i = 0; i < names.size(); ++i) {
+			CPPUNIT_ASSERT_EQUAL(i, find(index, hash(names[i]), i));
+		}
+	};
+
+	size_t next = 2000;
+	for (size_t round = 0; names.size() > 10; ++round) {
+		size_t const i = (round * 7919) % names.size();
+		index.remove(hash(names[i]), i);
+		CPPUNIT_ASSERT(find_first(index, hash(names[i])) == std::string::npos);
+		names.erase(names.begin() + i);
+
+		if (round % 50 == 0) {
+			check();
+		}
+		if (round % 97 == 0) {
+			// Renaming the last entry
+			size_t const last = names.size() - 1;
+			index.erase(hash(names[last]), last);
+			names[last] = next++;
+			index.insert(hash(names[last]), last);
+		}
+		if (round % 131 == 0) {
+			// Entries indexed on demand
+			index.insert(hash(next), names.size());
+			names.push_back(next++);
+		}
+	}
+	check();
+}
+
+void CDirectoryListingTest::testFindFile()
+{
+	CDirectoryListing listing = make_listing({L"README", L"readme.txt", L"Makefile", L"makefile", L"src"});
+
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listing.FindFile_CmpNoCase(L"MAKEFILE"));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), listing.FindFile_CmpCase(L"makefile"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpNoCase(L"readme"));
+	CPPUNIT_ASSERT(listing.FindFile_CmpCase(L"readme") == std::string::npos);
+
+	listing.RemoveEntry(2);
+	CPPUNIT_ASSERT_EQUAL(size_t(2), listing.FindFile_CmpNoCase(L"MAKEFILE"));
+	CPPUNIT_ASSERT(listing.FindFile_CmpCase(L"Makefile") == std::string::npos);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), listing.FindFile_CmpCase(L"src"));
+
+	listing.RenameEntry(0, L"Other");
+	CPPUNIT_ASSERT(listing.FindFile_CmpNoCase(L"readme") == std::string::npos);
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpNoCase(L"OTHER"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.FindFile_CmpCase(L"Other"));
+
+	// The index only covers the entries looked at so far
+	std::vector<std::wstring> names;
+	for (size_t i = 0; i < 3000; ++i) {
+		names.push_back(L"File" + std::to_wstring(i));
+	}
+	listing = make_listing(names);
+	CPPUNIT_ASSERT_EQUAL(size_t(10), listing.FindFile_CmpNoCase(L"file10"));
+	listing.RemoveEntry(5);
+	// File2001
+	listing.RemoveEntry(2000);
+	CPPUNIT_ASSERT_EQUAL(size_t(9), listing.FindFile_CmpNoCase(L"FILE10"));
+	CPPUNIT_ASSERT_EQUAL(size_t(2498), listing.FindFile_CmpNoCase(L"file2500"));
+	CPPUNIT_ASSERT_EQUAL(size_t(1999), listing.FindFile_CmpNoCase(L"file2000"));
+	CPPUNIT_ASSERT(listing.FindFile_CmpNoCase(L"file2001") == std::string::npos);
+	CPPUNIT_ASSERT(listing.FindFile_CmpCase(L"File5") == std::string::npos);
+}
@@ -0,0 +1,104 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "hash_service.h"
+
+#include <libfilezilla/encode.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * This testsuite asserts the correctness of the CHashService class.
+ */
+
+class CHashServiceTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CHashServiceTest);
+	CPPUNIT_TEST(testDigests);
+	CPPUNIT_TEST(testMultiple);
+	CPPUNIT_TEST(testCancel);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testDigests();
+	void testMultiple();
+	void testCancel();
+
+protected:
+	std::string dir_;
+	std::wstring file_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CHashServiceTest);
+
+void CHashServiceTest::setUp()
+{
+	// Keep the test file out of the working directory
+	char const* tmp = std::getenv("TMPDIR");
+	std::string tmpl = std::string((tmp && *tmp) ? tmp : "/tmp") + "/fzhashtestXXXXXX";
+	CPPUNIT_ASSERT(mkdtemp(&tmpl[0]));
+	dir_ = tmpl;
+	file_ = fz::to_wstring(dir_) + L"/hashservicetest.tmp";
+
+	fz::file f(fz::to_native(file_), fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+	CPPUNIT_ASSERT(f.write("123456789", 9) == 9);
+}
+
+void CHashServiceTest::tearDown()
+{
+	std::remove(fz::to_string(file_).c_str());
+	std::remove(dir_.c_str());
+}
+
+void CHashServiceTest::testDigests()
+{
+	fz::thread_pool pool;
+	CHashService service(pool);
+
+	auto const all = hash_bit(file_hash::md5) | hash_bit(file_hash::sha1) | hash_bit(file_hash::sha256) | hash_bit(file_hash::crc32);
+	auto const res = service.Hash(file_, all);
+	CPPUNIT_ASSERT(res.success);
+	CPPUNIT_ASSERT(res.size == 9);
+
+	CPPUNIT_ASSERT(fz::hex_encode<std::string>(res.digest(file_hash::md5)) == "25f9e794323b453885f5181f1b624d0b");
+	CPPUNIT_ASSERT(fz::hex_encode<std::string>(res.digest(file_hash::sha1)) == "f7c3bc1d808e04732adf679965ccc34ca7ae3441");
+	CPPUNIT_ASSERT(fz::hex_encode<std::string>(res.digest(file_hash::sha256)) == "15e2b0d3c33891ebb0f1ef609ec419420c20e320ce94c65fbc8c3312448eb225");
+	CPPUNIT_ASSERT(fz::hex_encode<std::string>(res.digest(file_hash::crc32)) == "cbf43926");
+
+	// Not requested
+	CPPUNIT_ASSERT(res.digest(file_hash::sha512).empty());
+}
+
+void CHashServiceTest::testMultiple()
+{
+	fz::thread_pool pool;
+	CHashService service(pool);
+
+	std::wstring const missing = fz::to_wstring(dir_) + L"/hashservicetest.missing";
+	auto const res = service.Hash({file_, missing, file_}, hash_bit(file_hash::crc32));
+	CPPUNIT_ASSERT(res.size() == 3);
+	CPPUNIT_ASSERT(res[0].success && res[2].success);
+	CPPUNIT_ASSERT(!res[1].success);
+	CPPUNIT_ASSERT(res[1].file == missing);
+	CPPUNIT_ASSERT(res[0].digest(file_hash::crc32) == res[2].digest(file_hash::crc32));
+}
+
+void CHashServiceTest::testCancel()
+{
+	fz::thread_pool pool;
+	CHashService service(pool);
+
+	std::atomic<bool> cancel{};
+	CPPUNIT_ASSERT(service.Hash(file_, hash_bit(file_hash::sha1), &cancel).success);
+
+	cancel = true;
+	auto const res = service.Hash(file_, hash_bit(file_hash::sha1), &cancel);
+	CPPUNIT_ASSERT(!res.success);
+	CPPUNIT_ASSERT(res.digest(file_hash::sha1).empty());
+}
@@ -0,0 +1,308 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "iothread.h"
+#include "transfer_io.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <string.h>
+#include <thread>
+
+/*
+ * This testsuite asserts the correctness of the CIOThread class when writing
+ * downloads, in particular how it finishes or aborts them.
+ */
+
+class CIOThreadTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CIOThreadTest);
+	CPPUNIT_TEST(testFinalize);
+	CPPUNIT_TEST(testFinalizeQueued);
+	CPPUNIT_TEST(testFinalizeError);
+	CPPUNIT_TEST(testDestroyFinalizing);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void testFinalize();
+	void testFinalizeQueued();
+	void testFinalizeError();
+	void testDestroyFinalizing();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CIOThreadTest);
+
+namespace {
+// Gets told by the thread that it may continue
+class waiter final : public fz::event_handler
+{
+public:
+	explicit waiter(fz::event_loop & loop)
+		: fz::event_handler(loop)
+	{}
+
+	virtual ~waiter()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		if (ev.derived_type() == CIOThreadEvent::type()) {
+			fz::scoped_lock l(mtx_);
+			++events_;
+			cond_.signal(l);
+		}
+	}
+
+	bool wait()
+	{
+		fz::scoped_lock l(mtx_);
+		while (!events_) {
+			if (!cond_.wait(l, fz::duration::from_seconds(10))) {
+				return false;
+			}
+		}
+		--events_;
+		return true;
+	}
+
+private:
+	fz::mutex mtx_;
+	fz::condition cond_;
+	int events_{};
+};
+
+// Hands count full buffers to the thread and fills the next one with len
+// bytes. Buffer n is filled with the character 'a' + n.
+std::string fill(CIOThread & thread, int count, int len)
+{
+	std::string expected;
+
+	char* buffer{};
+	for (int i = 0; i <= count; ++i) {
+		CPPUNIT_ASSERT(thread.GetNextWriteBuffer(&buffer) == IO_Success);
+		int const size = (i == count) ? len : BUFFERSIZE;
+		memset(buffer, 'a' + i, size);
+		expected.append(size, 'a' + i);
+	}
+
+	return expected;
+}
+
+// Reads from the pipe until it ends, returns the final result of read
+int64_t drain(std::shared_ptr<transfer_reader> const& reader, std::string & data)
+{
+	char buf[4096];
+	int64_t r;
+	while ((r = reader->read(buf, sizeof(buf))) > 0) {
+		data.append(buf, static_cast<size_t>(r));
+	}
+	return r;
+}
+}
+
+void CIOThreadTest::testFinalize()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop;
+	waiter w(loop);
+
+	auto writer = std::make_shared<memory_writer>();
+	std::string expected;
+	{
+		CIOThread thread;
+		CPPUNIT_ASSERT(thread.Create(pool, writer, true));
+		thread.SetEventHandler(&w);
+
+		expected = fill(thread, 3, 100);
+
+		int res;
+		while ((res = thread.Finalize(100)) == IO_Again) {
+			CPPUNIT_ASSERT(w.wait());
+		}
+		CPPUNIT_ASSERT(res == IO_Success);
+	}
+
+	CPPUNIT_ASSERT(writer->data() == expected);
+
+	// Nothing but the empty final buffer
+	auto empty = std::make_shared<memory_writer>();
+	{
+		CIOThread thread;
+		CPPUNIT_ASSERT(thread.Create(pool, empty, true));
+		thread.SetEventHandler(&w);
+
+		int res;
+		while ((res = thread.Finalize(0)) == IO_Again) {
+			CPPUNIT_ASSERT(w.wait());
+		}
+		CPPUNIT_ASSERT(res == IO_Success);
+	}
+	CPPUNIT_ASSERT(empty->data().empty());
+}
+
+void CIOThreadTest::testFinalizeQueued()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop;
+	waiter w(loop);
+
+	// The pipe holds less than a buffer, the thread blocks on the first write
+	transfer_pipe pipe(-1, 1024);
+	auto reader = pipe.reader();
+
+	std::string expected;
+	std::string received;
+	int64_t read = -1;
+	{
+		CIOThread thread;
+		CPPUNIT_ASSERT(thread.Create(pool, pipe.writer(), true));
+		thread.SetEventHandler(&w);
+
+		expected = fill(thread, 2, 100);
+
+		// Must not wait for the queued buffers
+		CPPUNIT_ASSERT(thread.Finalize(100) == IO_Again);
+
+		std::thread t([&]() {
+			read = drain(reader, received);
+		});
+
+		CPPUNIT_ASSERT(w.wait());
+		CPPUNIT_ASSERT(thread.Finalize(100) == IO_Success);
+
+		// Finalizing again is harmless
+		CPPUNIT_ASSERT(thread.Finalize(100) == IO_Success);
+
+		t.join();
+	}
+
+	CPPUNIT_ASSERT(read == 0);
+	CPPUNIT_ASSERT(received == expected);
+}
+
+void CIOThreadTest::testFinalizeError()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop;
+	waiter w(loop);
+
+	{
+		// The final buffer does not fit anymore
+		auto writer = std::make_shared<memory_writer>(BUFFERSIZE + 50);
+
+		CIOThread thread;
+		CPPUNIT_ASSERT(thread.Create(pool, writer, true));
+		thread.SetEventHandler(&w);
+
+		fill(thread, 1, 100);
+
+		int res;
+		while ((res = thread.Finalize(100)) == IO_Again) {
+			CPPUNIT_ASSERT(w.wait());
+		}
+		CPPUNIT_ASSERT(res == IO_Error);
+		CPPUNIT_ASSERT(!thread.GetError().empty());
+		CPPUNIT_ASSERT(thread.Finalize(100) == IO_Error);
+	}
+
+	{
+		// The queued buffer does not fit
+		auto writer = std::make_shared<memory_writer>(10);
+
+		CIOThread thread;
+		CPPUNIT_ASSERT(thread.Create(pool, writer, true));
+		thread.SetEventHandler(&w);
+
+		fill(thread, 1, 100);
+
+		int res;
+		while ((res = thread.Finalize(100)) == IO_Again) {
+			CPPUNIT_ASSERT(w.wait());
+		}
+		CPPUNIT_ASSERT(res == IO_Error);
+		CPPUNIT_ASSERT(!thread.GetError().empty());
+
+		char* buffer{};
+		CPPUNIT_ASSERT(thread.GetNextWriteBuffer(&buffer) == IO_Error);
+	}
+}
+
+void CIOThreadTest::testDestroyFinalizing()
+{
+	fz::thread_pool pool;
+	fz::event_loop loop;
+	waiter w(loop);
+
+	{
+		// Blocked writing a queued buffer, nobody reads from the pipe
+		transfer_pipe pipe(-1, 1024);
+		auto reader = pipe.reader();
+
+		CIOThread thread;
+		CPPUNIT_ASSERT(thread.Create(pool, pipe.writer(), true));
+		thread.SetEventHandler(&w);
+
+		fill(thread, 2, 100);
+		CPPUNIT_ASSERT(thread.Finalize(100) == IO_Again);
+
+		thread.Destroy();
+		CPPUNIT_ASSERT(thread.Finalize(100) == IO_Error);
+
+		std::string received;
+		CPPUNIT_ASSERT(drain(reader, received) == -1);
+	}
+
+	{
+		// Blocked writing the final buffer
+		transfer_pipe pipe(-1, 1024);
+		auto reader = pipe.reader();
+
+		CIOThread thread;
+		CPPUNIT_ASSERT(thread.Create(pool, pipe.writer(), true));
+		thread.SetEventHandler(&w);
+
+		fill(thread, 0, BUFFERSIZE);
+		CPPUNIT_ASSERT(thread.Finalize(BUFFERSIZE) == IO_Again);
+
+		thread.Destroy();
+		CPPUNIT_ASSERT(thread.Finalize(BUFFERSIZE) == IO_Error);
+
+		std::string received;
+		CPPUNIT_ASSERT(drain(reader, received) == -1);
+	}
+
+	{
+		// Aborted transfers get written out, but are not complete
+		transfer_pipe pipe(-1, 1024);
+		auto reader = pipe.reader();
+
+		std::string expected;
+		std::string received;
+		int64_t read = 0;
+		std::thread t([&]() {
+			read = drain(reader, received);
+		});
+
+		{
+			CIOThread thread;
+			CPPUNIT_ASSERT(thread.Create(pool, pipe.writer(), true));
+			thread.SetEventHandler(&w);
+
+			expected = fill(thread, 1, 100);
+
+			int res;
+			while ((res = thread.Finalize(100, false)) == IO_Again) {
+				CPPUNIT_ASSERT(w.wait());
+			}
+			CPPUNIT_ASSERT(res == IO_Success);
+		}
+
+		// The reader may miss whatever was still in the pipe when it failed
+		t.join();
+		CPPUNIT_ASSERT(read == -1);
+		CPPUNIT_ASSERT(!expected.compare(0, received.size(), received));
+	}
+}
@@ -0,0 +1,163 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "metrics.h"
+
+#include <thread>
+#include <vector>
+
+/*
+ * This testsuite asserts the correctness of the CMetrics class.
+ */
+
+class CMetricsTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CMetricsTest);
+	CPPUNIT_TEST(testCounters);
+	CPPUNIT_TEST(testHistogram);
+	CPPUNIT_TEST(testPrometheus);
+	CPPUNIT_TEST(testTracing);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testCounters();
+	void testHistogram();
+	void testPrometheus();
+	void testTracing();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CMetricsTest);
+
+namespace {
+bool contains(std::string const& haystack, std::string const& needle)
+{
+	return haystack.find(needle) != std::string::npos;
+}
+}
+
+void CMetricsTest::testCounters()
+{
+	CMetrics metrics;
+
+	// The same series always yields the same counter
+	auto & a = metrics.GetCounter("fz_test_total", "x=\"1\"");
+	CPPUNIT_ASSERT(&a == &metrics.GetCounter("fz_test_total", "x=\"1\""));
+	CPPUNIT_ASSERT(&a != &metrics.GetCounter("fz_test_total", "x=\"2\""));
+	CPPUNIT_ASSERT(&a != &metrics.GetCounter("fz_test_total"));
+	CPPUNIT_ASSERT(a.get() == 0);
+
+	// Updates from several threads all get counted
+	std::vector<std::thread> threads;
+	for (int i = 0; i < 4; ++i) {
+		threads.emplace_back([&metrics]() {
+			auto & c = metrics.GetCounter("fz_test_total", "x=\"1\"");
+			for (int j = 0; j < 10000; ++j) {
+				c.add();
+			}
+			c.add(5);
+		});
+	}
+	for (auto & t : threads) {
+		t.join();
+	}
+
+	CPPUNIT_ASSERT(a.get() == 40020);
+	CPPUNIT_ASSERT(metrics.GetCounter("fz_test_total", "x=\"2\"").get() == 0);
+
+	// References stay valid while other series get added
+	for (int i = 0; i < 100; ++i) {
+		metrics.GetCounter("fz_other_total", "n=\"" + std::to_string(i) + "\"").add(i);
+	}
+	a.add();
+	CPPUNIT_ASSERT(metrics.GetCounter("fz_test_total", "x=\"1\"").get() == 40021);
+}
+
+void CMetricsTest::testHistogram()
+{
+	CPPUNIT_ASSERT(CMetrics::histogram::bucket_bound(0) == 1);
+	CPPUNIT_ASSERT(CMetrics::histogram::bucket_bound(1) == 4);
+	CPPUNIT_ASSERT(CMetrics::histogram::bucket_bound(2) == 16);
+
+	CMetrics metrics;
+	auto & h = metrics.GetHistogram("fz_test_duration");
+	CPPUNIT_ASSERT(&h == &metrics.GetHistogram("fz_test_duration"));
+
+	// Bounds are inclusive, huge values end up in the +Inf bucket
+	h.observe(0);
+	h.observe(1);
+	h.observe(2);
+	h.observe(4);
+	h.observe(5);
+	h.observe(int64_t(1) << 40);
+
+	std::string const out = metrics.FormatPrometheus();
+	CPPUNIT_ASSERT(contains(out, "# TYPE fz_test_duration histogram\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_test_duration_bucket{le=\"1\"} 2\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_test_duration_bucket{le=\"4\"} 4\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_test_duration_bucket{le=\"16\"} 5\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_test_duration_bucket{le=\"1073741824\"} 5\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_test_duration_bucket{le=\"+Inf\"} 6\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_test_duration_sum " + std::to_string(12 + (int64_t(1) << 40)) + "\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_test_duration_count 6\n"));
+}
+
+void CMetricsTest::testPrometheus()
+{
+	CMetrics metrics;
+	CPPUNIT_ASSERT(metrics.FormatPrometheus().empty());
+
+	metrics.GetCounter("fz_b_total", "op=\"list\"").add(2);
+	metrics.GetCounter("fz_a_total").add(3);
+	metrics.GetCounter("fz_b_total", "op=\"cwd\"").add(7);
+
+	// Families sorted by name, all series of a family adjacent
+	CPPUNIT_ASSERT(metrics.FormatPrometheus() ==
+		"# TYPE fz_a_total counter\n"
+		"fz_a_total 3\n"
+		"# TYPE fz_b_total counter\n"
+		"fz_b_total{op=\"cwd\"} 7\n"
+		"fz_b_total{op=\"list\"} 2\n");
+
+	// Labels get combined with the bucket bound
+	metrics.GetHistogram("fz_c", "op=\"list\"").observe(3);
+	std::string const out = metrics.FormatPrometheus();
+	CPPUNIT_ASSERT(contains(out, "fz_c_bucket{op=\"list\",le=\"4\"} 1\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_c_sum{op=\"list\"} 3\n"));
+	CPPUNIT_ASSERT(contains(out, "fz_c_count{op=\"list\"} 1\n"));
+	CPPUNIT_ASSERT(!contains(out, "dropped"));
+}
+
+void CMetricsTest::testTracing()
+{
+	CMetrics metrics;
+
+	auto const start = fz::monotonic_clock::now();
+	auto const end = start + fz::duration::from_milliseconds(5);
+
+	// Nothing gets recorded unless enabled
+	CPPUNIT_ASSERT(!metrics.Tracing());
+	metrics.AddSpan("operation", "ignored", 1, start, end);
+	CPPUNIT_ASSERT(!contains(metrics.FormatChromeTrace(), "ignored"));
+
+	metrics.EnableTracing(2);
+	CPPUNIT_ASSERT(metrics.Tracing());
+	metrics.AddSpan("operation", "first \"quoted\"", 1, start, end, 0);
+	metrics.AddSpan("io", "second", 2, start, end, 3);
+	metrics.AddSpan("io", "third", 3, start, end);
+
+	// Spans without valid times are ignored
+	metrics.AddSpan("io", "invalid", 4, fz::monotonic_clock(), end);
+
+	std::string const trace = metrics.FormatChromeTrace();
+	CPPUNIT_ASSERT(trace.substr(0, 15) == "{\"traceEvents\":");
+	CPPUNIT_ASSERT(contains(trace, "\"name\":\"first \\\"quoted\\\"\",\"cat\":\"operation\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"));
+	CPPUNIT_ASSERT(contains(trace, "\"name\":\"second\",\"cat\":\"io\""));
+	CPPUNIT_ASSERT(contains(trace, "\"dur\":5000,\"args\":{\"result\":3}}"));
+	CPPUNIT_ASSERT(!contains(trace, "third"));
+	CPPUNIT_ASSERT(!contains(trace, "invalid"));
+
+	// The limit got reached, the dropped span is accounted for
+	CPPUNIT_ASSERT(contains(metrics.FormatPrometheus(), "fz_trace_dropped_spans_total 1\n"));
+}
@@ -0,0 +1,287 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "oplock_manager.h"
+
+#include <libfilezilla/event_loop.hpp>
+
+/*
+ * This testsuite asserts the correctness of the OpLockManager class.
+ */
+
+class COpLockManagerTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(COpLockManagerTest);
+	CPPUNIT_TEST(testConflicts);
+	CPPUNIT_TEST(testNested);
+	CPPUNIT_TEST(testRelease);
+	CPPUNIT_TEST(testWakeOrder);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testConflicts();
+	void testNested();
+	void testRelease();
+	void testWakeOrder();
+
+protected:
+	CServer const server_{FTP, UNIX, L"ftp.example.com", 21};
+	CServer const server2_{FTP, UNIX, L"ftp2.example.com", 21};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(COpLockManagerTest);
+
+namespace {
+struct sync_event_type;
+typedef fz::simple_event<sync_event_type> sync_event;
+
+// Records the order in which the handlers get told to obtain their locks
+class recorder final
+{
+public:
+	void add(fz::event_handler * handler)
+	{
+		fz::scoped_lock l(mtx_);
+		order_.push_back(handler);
+	}
+
+	// All events sent so far have been handled once the sync event arrives,
+	// the loop handles them in order.
+	std::vector<fz::event_handler*> get(fz::event_handler & sync)
+	{
+		fz::scoped_lock l(mtx_);
+		synced_ = false;
+		sync.send_event<sync_event>();
+		while (!synced_) {
+			CPPUNIT_ASSERT(cond_.wait(l, fz::duration::from_seconds(10)));
+		}
+
+		auto ret = std::move(order_);
+		order_.clear();
+		return ret;
+	}
+
+	void synced()
+	{
+		fz::scoped_lock l(mtx_);
+		synced_ = true;
+		cond_.signal(l);
+	}
+
+private:
+	fz::mutex mtx_;
+	fz::condition cond_;
+	std::vector<fz::event_handler*> order_;
+	bool synced_{};
+};
+
+class handler final : public fz::event_handler
+{
+public:
+	handler(fz::event_loop & loop, recorder & r)
+		: fz::event_handler(loop)
+		, recorder_(r)
+	{}
+
+	virtual ~handler()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		if (ev.derived_type() == CObtainLockEvent::type()) {
+			recorder_.add(this);
+		}
+		else if (ev.derived_type() == sync_event::type()) {
+			recorder_.synced();
+		}
+	}
+
+private:
+	recorder & recorder_;
+};
+}
+
+void COpLockManagerTest::testConflicts()
+{
+	fz::event_loop loop;
+	recorder r;
+	handler h1(loop, r);
+	handler h2(loop, r);
+	handler h3(loop, r);
+
+	OpLockManager mgr;
+
+	CServerPath const path(L"/a/b");
+	OpLock l1 = mgr.Lock(&h1, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(l1 && !l1.waiting());
+
+	// Same path and reason by another handler
+	OpLock l2 = mgr.Lock(&h2, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(l2 && l2.waiting());
+	CPPUNIT_ASSERT(mgr.Waiting(&h2, server_));
+	CPPUNIT_ASSERT(!mgr.Waiting(&h1, server_));
+
+	// The same handler never conflicts with itself
+	OpLock l3 = mgr.Lock(&h1, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(!l3.waiting());
+
+	// Different reason, different server, different path
+	OpLock l4 = mgr.Lock(&h3, server_, locking_reason::mkdir, path);
+	CPPUNIT_ASSERT(!l4.waiting());
+	OpLock l5 = mgr.Lock(&h3, server2_, locking_reason::list, path);
+	CPPUNIT_ASSERT(!l5.waiting());
+	OpLock l6 = mgr.Lock(&h3, server_, locking_reason::list, CServerPath(L"/a/c"));
+	CPPUNIT_ASSERT(!l6.waiting());
+	CPPUNIT_ASSERT(!mgr.Waiting(&h3, server_));
+
+	// Nothing got released, nobody may obtain their lock
+	CPPUNIT_ASSERT(r.get(h1).empty());
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&h2, server_));
+	CPPUNIT_ASSERT(l2.waiting());
+}
+
+void COpLockManagerTest::testNested()
+{
+	fz::event_loop loop;
+	recorder r;
+	handler h1(loop, r);
+	handler h2(loop, r);
+
+	OpLockManager mgr;
+
+	{
+		// Exclusive locks only cover the path itself
+		OpLock parent = mgr.Lock(&h1, server_, locking_reason::list, CServerPath(L"/a"));
+		OpLock child = mgr.Lock(&h2, server_, locking_reason::list, CServerPath(L"/a/b"));
+		CPPUNIT_ASSERT(!parent.waiting() && !child.waiting());
+	}
+
+	{
+		// Inclusive locks also cover all subdirectories
+		OpLock parent = mgr.Lock(&h1, server_, locking_reason::list, CServerPath(L"/a"), true);
+		OpLock child = mgr.Lock(&h2, server_, locking_reason::list, CServerPath(L"/a/b/c"));
+		OpLock other = mgr.Lock(&h2, server_, locking_reason::list, CServerPath(L"/b"));
+		OpLock root = mgr.Lock(&h2, server_, locking_reason::list, CServerPath(L"/"));
+		CPPUNIT_ASSERT(!parent.waiting());
+		CPPUNIT_ASSERT(child.waiting());
+		CPPUNIT_ASSERT(!other.waiting());
+		CPPUNIT_ASSERT(!root.waiting());
+	}
+
+	{
+		// An inclusive lock conflicts with locks held in its subtree
+		OpLock child = mgr.Lock(&h1, server_, locking_reason::list, CServerPath(L"/a/b/c"));
+		OpLock parent = mgr.Lock(&h2, server_, locking_reason::list, CServerPath(L"/a"), true);
+		OpLock sibling = mgr.Lock(&h2, server_, locking_reason::list, CServerPath(L"/b"), true);
+		CPPUNIT_ASSERT(!child.waiting());
+		CPPUNIT_ASSERT(parent.waiting());
+		CPPUNIT_ASSERT(!sibling.waiting());
+
+		// Releasing the child lets the parent be obtained
+		child = OpLock();
+		CPPUNIT_ASSERT(r.get(h1) == std::vector<fz::event_handler*>{&h2});
+		CPPUNIT_ASSERT(mgr.ObtainWaiting(&h2, server_));
+		CPPUNIT_ASSERT(!parent.waiting());
+		CPPUNIT_ASSERT(!mgr.Waiting(&h2, server_));
+	}
+}
+
+void COpLockManagerTest::testRelease()
+{
+	fz::event_loop loop;
+	recorder r;
+	handler h1(loop, r);
+	handler h2(loop, r);
+	handler h3(loop, r);
+
+	OpLockManager mgr;
+
+	CServerPath const path(L"/a");
+	OpLock l1 = mgr.Lock(&h1, server_, locking_reason::list, path);
+	OpLock l2 = mgr.Lock(&h2, server_, locking_reason::list, path);
+	OpLock l3 = mgr.Lock(&h3, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(l2.waiting() && l3.waiting());
+
+	// Releasing a waiting lock does not wake anybody
+	l3 = OpLock();
+	CPPUNIT_ASSERT(!l3);
+	CPPUNIT_ASSERT(!mgr.Waiting(&h3, server_));
+	CPPUNIT_ASSERT(r.get(h1).empty());
+
+	// Neither does releasing an unrelated lock
+	{
+		OpLock unrelated = mgr.Lock(&h3, server_, locking_reason::list, CServerPath(L"/b"));
+	}
+	CPPUNIT_ASSERT(r.get(h1).empty());
+
+	// Moving a lock keeps it held
+	OpLock moved = std::move(l1);
+	CPPUNIT_ASSERT(!l1 && moved);
+	CPPUNIT_ASSERT(r.get(h1).empty());
+
+	moved = OpLock();
+	CPPUNIT_ASSERT(r.get(h1) == std::vector<fz::event_handler*>{&h2});
+	CPPUNIT_ASSERT(l2.waiting());
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&h2, server_));
+	CPPUNIT_ASSERT(!l2.waiting());
+
+	// Obtaining twice does nothing
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&h2, server_));
+
+	// Everything released, the server is unknown again
+	l2 = OpLock();
+	CPPUNIT_ASSERT(!mgr.Waiting(&h2, server_));
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&h2, server_));
+	CPPUNIT_ASSERT(r.get(h1).empty());
+
+	// And can be locked again
+	OpLock l4 = mgr.Lock(&h3, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(l4 && !l4.waiting());
+}
+
+void COpLockManagerTest::testWakeOrder()
+{
+	fz::event_loop loop;
+	recorder r;
+	handler h1(loop, r);
+	handler h2(loop, r);
+	handler h3(loop, r);
+	handler h4(loop, r);
+	handler h5(loop, r);
+	handler h6(loop, r);
+
+	OpLockManager mgr;
+
+	OpLock held = mgr.Lock(&h1, server_, locking_reason::list, CServerPath(L"/a"), true);
+	OpLock unrelated = mgr.Lock(&h6, server_, locking_reason::list, CServerPath(L"/x"));
+
+	OpLock inSubtree = mgr.Lock(&h2, server_, locking_reason::list, CServerPath(L"/a/b"));
+	OpLock sameFirst = mgr.Lock(&h3, server_, locking_reason::list, CServerPath(L"/a"));
+	OpLock parent = mgr.Lock(&h4, server_, locking_reason::list, CServerPath(L"/"), true);
+	OpLock sameSecond = mgr.Lock(&h5, server_, locking_reason::list, CServerPath(L"/a"));
+	OpLock other = mgr.Lock(&h5, server_, locking_reason::list, CServerPath(L"/x"));
+	CPPUNIT_ASSERT(inSubtree.waiting() && sameFirst.waiting() && parent.waiting() && sameSecond.waiting() && other.waiting());
+
+	// Waiters on the same path in the order they started waiting, then on
+	// the parents, then in the subtree. Each handler is only told once.
+	held = OpLock();
+	CPPUNIT_ASSERT(r.get(h1) == (std::vector<fz::event_handler*>{&h3, &h5, &h4, &h2}));
+
+	// The first to act gets the lock, the others keep waiting
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&h3, server_));
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&h5, server_));
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&h4, server_));
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&h2, server_));
+	CPPUNIT_ASSERT(!sameFirst.waiting() && !inSubtree.waiting());
+	CPPUNIT_ASSERT(sameSecond.waiting() && parent.waiting() && other.waiting());
+
+	sameFirst = OpLock();
+	CPPUNIT_ASSERT(r.get(h1) == (std::vector<fz::event_handler*>{&h5, &h4}));
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&h5, server_));
+	CPPUNIT_ASSERT(!sameSecond.waiting());
+	CPPUNIT_ASSERT(other.waiting());
+}
@@ -0,0 +1,124 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "pathcache.h"
+
+/*
+ * This testsuite asserts the correctness of the CPathCache class.
+ */
+
+class CPathCacheTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CPathCacheTest);
+	CPPUNIT_TEST(testLookup);
+	CPPUNIT_TEST(testEviction);
+	CPPUNIT_TEST(testInvalidate);
+	CPPUNIT_TEST(testFailures);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testLookup();
+	void testEviction();
+	void testInvalidate();
+	void testFailures();
+
+protected:
+	CServer const server_{FTP, UNIX, L"ftp.example.com", 21};
+	CServer const server2_{FTP, UNIX, L"ftp2.example.com", 21};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CPathCacheTest);
+
+void CPathCacheTest::testLookup()
+{
+	CMetrics metrics;
+	CPathCache cache(&metrics);
+
+	CServerPath const source(L"/foo");
+	CServerPath const target(L"/srv/foo");
+	cache.Store(server_, target, source);
+	cache.Store(server_, CServerPath(L"/srv/foo/bar"), target, L"bar");
+
+	CPPUNIT_ASSERT(cache.Lookup(server_, source) == target);
+	CPPUNIT_ASSERT(cache.Lookup(server_, target, L"bar") == CServerPath(L"/srv/foo/bar"));
+	CPPUNIT_ASSERT(cache.Lookup(server_, target).empty());
+	CPPUNIT_ASSERT(cache.Lookup(server2_, source).empty());
+
+	auto const stats = cache.GetStatistics();
+	CPPUNIT_ASSERT(stats.hits == 2 && stats.misses == 2 && stats.entries == 2);
+	CPPUNIT_ASSERT(metrics.GetCounter("fz_path_cache_lookups_total", "result=\"hit\"").get() == 2);
+}
+
+void CPathCacheTest::testEviction()
+{
+	CPathCache cache(nullptr, 3);
+
+	CServerPath const a(L"/a");
+	CServerPath const b(L"/b");
+	CServerPath const c(L"/c");
+	CServerPath const d(L"/d");
+	cache.Store(server_, a, a);
+	cache.Store(server_, b, b);
+	cache.Store(server2_, c, c);
+
+	// Using a makes b the least recently used entry
+	CPPUNIT_ASSERT(cache.Lookup(server_, a) == a);
+	cache.Store(server_, d, d);
+
+	CPPUNIT_ASSERT(cache.Lookup(server_, b).empty());
+	CPPUNIT_ASSERT(cache.Lookup(server_, a) == a);
+	CPPUNIT_ASSERT(cache.Lookup(server2_, c) == c);
+	CPPUNIT_ASSERT(cache.Lookup(server_, d) == d);
+
+	auto const stats = cache.GetStatistics();
+	CPPUNIT_ASSERT(stats.evictions == 1 && stats.entries == 3);
+}
+
+void CPathCacheTest::testInvalidate()
+{
+	CPathCache cache;
+
+	CServerPath const foo(L"/foo");
+	CServerPath const bar(L"/foo/bar");
+	CServerPath const baz(L"/baz");
+	cache.Store(server_, foo, foo);
+	cache.Store(server_, bar, foo, L"bar");
+	cache.Store(server_, baz, baz);
+	cache.Store(server2_, foo, foo);
+
+	cache.InvalidatePath(server_, foo);
+	CPPUNIT_ASSERT(cache.Lookup(server_, foo).empty());
+	CPPUNIT_ASSERT(cache.Lookup(server_, foo, L"bar").empty());
+	CPPUNIT_ASSERT(cache.Lookup(server_, baz) == baz);
+	CPPUNIT_ASSERT(cache.Lookup(server2_, foo) == foo);
+
+	cache.InvalidateServer(server_);
+	CPPUNIT_ASSERT(cache.Lookup(server_, baz).empty());
+	CPPUNIT_ASSERT(cache.GetStatistics().entries == 1);
+}
+
+void CPathCacheTest::testFailures()
+{
+	CPathCache cache;
+
+	CServerPath const foo(L"/foo");
+	cache.StoreFailure(server_, foo, L"missing");
+	CPPUNIT_ASSERT(cache.LookupFailure(server_, foo, L"missing"));
+	CPPUNIT_ASSERT(!cache.LookupFailure(server_, foo));
+	CPPUNIT_ASSERT(!cache.LookupFailure(server2_, foo, L"missing"));
+	CPPUNIT_ASSERT(cache.Lookup(server_, foo, L"missing").empty());
+
+	// Creating a directory forgets the failures
+	cache.InvalidateFailures(server_);
+	CPPUNIT_ASSERT(!cache.LookupFailure(server_, foo, L"missing"));
+
+	// Success replaces failure
+	cache.StoreFailure(server_, foo);
+	cache.Store(server_, foo, foo);
+	CPPUNIT_ASSERT(!cache.LookupFailure(server_, foo));
+	CPPUNIT_ASSERT(cache.Lookup(server_, foo) == foo);
+
+	CPPUNIT_ASSERT(cache.GetStatistics().failure_hits == 1);
+}
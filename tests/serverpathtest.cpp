@@ -2,6 +2,7 @@
 #include "directorylistingparser.h"
 #include <cppunit/extensions/HelperMacros.h>
 #include <list>
+#include <unordered_set>
 
 /*
  * This testsuite asserts the correctness of the CServerPath class.
@@ -17,6 +18,8 @@ class CServerPathTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testGetCommonParent);
 	CPPUNIT_TEST(testFormatFilename);
 	CPPUNIT_TEST(testChangePath);
+	CPPUNIT_TEST(testCompare);
+	CPPUNIT_TEST(testDeepPath);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -30,6 +33,8 @@ public:
 	void testGetCommonParent();
 	void testFormatFilename();
 	void testChangePath();
+	void testCompare();
+	void testDeepPath();
 
 protected:
 };
@@ -687,3 +692,68 @@ void CServerPathTest::testChangePath()
 	}
 
 }
+
+void CServerPathTest::testCompare()
+{
+	// Same paths built in different ways, sharing segments or not
+	CServerPath const unix1(L"/foo/bar/baz");
+	CServerPath unix2(L"/foo");
+	CPPUNIT_ASSERT(unix2.AddSegment(L"bar") && unix2.ChangePath(L"baz"));
+	CServerPath const unix3(L"/foo/bar/./baz/../baz");
+	CServerPath const unix4 = unix2.GetParent();
+	CServerPath const unix5(L"/foo/bar/Baz");
+
+	CPPUNIT_ASSERT(unix1 == unix2 && unix2 == unix3);
+	CPPUNIT_ASSERT(unix1.hash() == unix2.hash() && unix2.hash() == unix3.hash());
+	CPPUNIT_ASSERT(unix4 == CServerPath(L"/foo/bar"));
+	CPPUNIT_ASSERT(unix1 != unix4 && unix1 != unix5);
+	CPPUNIT_ASSERT(!unix1.CmpNoCase(unix5) && unix1.CmpNoCase(unix4) > 0);
+
+	CPPUNIT_ASSERT(unix4 < unix1 && !(unix1 < unix4));
+	CPPUNIT_ASSERT(unix5 < unix1 && !(unix1 < unix2) && !(unix2 < unix1));
+	CPPUNIT_ASSERT(CServerPath(L"/foo/a/z") < CServerPath(L"/foo/b"));
+
+	CPPUNIT_ASSERT(unix1.IsSubdirOf(unix4, false) && unix4.IsParentOf(unix3, false));
+	CPPUNIT_ASSERT(!unix4.IsSubdirOf(unix1, false) && !unix1.IsSubdirOf(unix1, false));
+	CPPUNIT_ASSERT(CServerPath(L"/Foo/Bar/x").IsSubdirOf(unix4, true) && !CServerPath(L"/Foo/Bar/x").IsSubdirOf(unix4, false));
+
+	CPPUNIT_ASSERT(unix1.GetCommonParent(unix5) == unix4);
+
+	CServerPath const vms1(L"FOO:[BAR.BAZ]");
+	CServerPath const unix6(L"/BAR/BAZ");
+	CPPUNIT_ASSERT(vms1 != unix6);
+
+	std::unordered_set<CServerPath> set{unix1, unix4, unix5, vms1};
+	CPPUNIT_ASSERT(set.size() == 4);
+	CPPUNIT_ASSERT(set.count(unix2) && set.count(unix3) && !set.count(unix6));
+}
+
+void CServerPathTest::testDeepPath()
+{
+	// Neither building, comparing, formatting nor destroying a path may
+	// recurse per segment
+	size_t const depth = 500000;
+
+	CServerPath deep(L"/");
+	for (size_t i = 0; i < depth; ++i) {
+		CPPUNIT_ASSERT(deep.AddSegment(L"d"));
+	}
+	CServerPath const other = deep;
+	CServerPath deep2(L"/");
+	for (size_t i = 0; i < depth; ++i) {
+		CPPUNIT_ASSERT(deep2.AddSegment(i ? L"d" : L"e"));
+	}
+
+	CPPUNIT_ASSERT(deep == other && deep != deep2);
+	CPPUNIT_ASSERT(deep < deep2 && deep.CmpNoCase(deep2) < 0);
+	CPPUNIT_ASSERT(deep.GetPath().size() == depth * 2);
+	CPPUNIT_ASSERT(deep2.GetPath().substr(0, 4) == L"/e/d");
+
+	// The difference closest to the root decides
+	CPPUNIT_ASSERT(CServerPath(L"/a/z/z") < CServerPath(L"/b/a/a"));
+	CPPUNIT_ASSERT(CServerPath(L"/b/a/a").CmpNoCase(CServerPath(L"/A/Z/Z")) > 0);
+
+	deep2 = CServerPath();
+	deep = CServerPath();
+	CPPUNIT_ASSERT(other.GetPath().size() == depth * 2);
+}
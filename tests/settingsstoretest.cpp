@@ -0,0 +1,285 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <../interface/settings_store.h>
+
+#include <libfilezilla/file.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * This testsuite asserts the correctness of the CSettingsStore class.
+ */
+
+class CSettingsStoreTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSettingsStoreTest);
+	CPPUNIT_TEST(testFormat);
+	CPPUNIT_TEST(testRoundtrip);
+	CPPUNIT_TEST(testChecksum);
+	CPPUNIT_TEST(testDamagedTail);
+	CPPUNIT_TEST(testOtherWriters);
+	CPPUNIT_TEST(testReplaced);
+	CPPUNIT_TEST(testCompact);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testFormat();
+	void testRoundtrip();
+	void testChecksum();
+	void testDamagedTail();
+	void testOtherWriters();
+	void testReplaced();
+	void testCompact();
+
+protected:
+	std::string ReadFile();
+	void WriteFile(std::string const& data);
+
+	std::string dir_;
+	std::wstring file_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSettingsStoreTest);
+
+namespace {
+typedef CSettingsStore::value value;
+typedef CSettingsStore::kind kind;
+
+std::string le(uint64_t v, size_t len)
+{
+	std::string ret;
+	for (size_t i = 0; i < len; ++i) {
+		ret += static_cast<char>((v >> (8 * i)) & 0xff);
+	}
+	return ret;
+}
+
+std::string record(kind k, std::string const& name, std::string const& data)
+{
+	std::string ret;
+	ret += static_cast<char>(k);
+	ret += le(name.size(), 2);
+	ret += le(data.size(), 4);
+	ret += name;
+	ret += data;
+
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (char c : ret) {
+		h ^= static_cast<unsigned char>(c);
+		h *= 16777619u;
+	}
+	return ret + le(h, 4);
+}
+
+std::string header(uint64_t generation)
+{
+	return std::string("FZST") + le(1, 4) + le(generation, 8);
+}
+}
+
+void CSettingsStoreTest::setUp()
+{
+	char const* tmp = std::getenv("TMPDIR");
+	std::string tmpl = std::string((tmp && *tmp) ? tmp : "/tmp") + "/fzsettingstestXXXXXX";
+	CPPUNIT_ASSERT(mkdtemp(&tmpl[0]));
+	dir_ = tmpl;
+	file_ = fz::to_wstring(dir_) + L"/filezilla.settings";
+}
+
+void CSettingsStoreTest::tearDown()
+{
+	std::remove(fz::to_string(file_).c_str());
+	std::remove(fz::to_string(file_ + L".tmp").c_str());
+	std::remove(dir_.c_str());
+}
+
+std::string CSettingsStoreTest::ReadFile()
+{
+	std::string ret;
+
+	fz::file f(fz::to_native(file_), fz::file::reading);
+	CPPUNIT_ASSERT(f.opened());
+	char buf[4096];
+	int64_t r;
+	while ((r = f.read(buf, sizeof(buf))) > 0) {
+		ret.append(buf, static_cast<size_t>(r));
+	}
+	return ret;
+}
+
+void CSettingsStoreTest::WriteFile(std::string const& data)
+{
+	fz::file f(fz::to_native(file_), fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+	CPPUNIT_ASSERT(f.write(data.data(), data.size()) == static_cast<int64_t>(data.size()));
+}
+
+void CSettingsStoreTest::testFormat()
+{
+	WriteFile(header(42) + record(kind::text, "a", "1") + record(kind::xml, "b", "<x/>") + record(kind::text, "a", "2") + record(kind::erase, "b", std::string()));
+
+	CSettingsStore store(file_);
+	CPPUNIT_ASSERT(store.Load());
+	CPPUNIT_ASSERT(store.Values().size() == 1);
+	CPPUNIT_ASSERT(store.Values().at("a") == value(kind::text, "2"));
+
+	// Appended records use the same format
+	CPPUNIT_ASSERT(store.Update({{"c", value(kind::xml, "<y/>")}}));
+	std::string const data = ReadFile();
+	std::string const expected = record(kind::xml, "c", "<y/>");
+	CPPUNIT_ASSERT(data.size() > expected.size());
+	CPPUNIT_ASSERT(data.substr(data.size() - expected.size()) == expected);
+
+	// Not a store
+	WriteFile("<?xml version=\"1.0\"?>\n<FileZilla3/>\n");
+	CPPUNIT_ASSERT(!store.Load());
+	CPPUNIT_ASSERT(store.Values().empty());
+
+	// Unknown version
+	WriteFile(std::string("FZST") + le(2, 4) + le(42, 8));
+	CPPUNIT_ASSERT(!store.Load());
+}
+
+void CSettingsStoreTest::testRoundtrip()
+{
+	{
+		CSettingsStore store(file_);
+		CPPUNIT_ASSERT(!store.Load());
+		CPPUNIT_ASSERT(store.Replace({{"a", value(kind::text, "1")}, {"x", value(kind::xml, "<T/>")}}));
+		CPPUNIT_ASSERT(store.Update({{"a", value(kind::text, "2")}, {"b", value(kind::text, "b")}}));
+		CPPUNIT_ASSERT(store.Update({{"x", value(kind::erase, std::string())}}));
+		CPPUNIT_ASSERT(store.Values().size() == 2);
+	}
+
+	CSettingsStore store(file_);
+	CPPUNIT_ASSERT(store.Load());
+	CPPUNIT_ASSERT(store.Values().size() == 2);
+	CPPUNIT_ASSERT(store.Values().at("a") == value(kind::text, "2"));
+	CPPUNIT_ASSERT(store.Values().at("b") == value(kind::text, "b"));
+}
+
+void CSettingsStoreTest::testChecksum()
+{
+	std::string const first = record(kind::text, "a", "1");
+	std::string second = record(kind::text, "b", "2");
+	std::string const third = record(kind::text, "c", "3");
+
+	// Flip a bit in the value of the second record
+	second[second.size() - 5] ^= 1;
+	WriteFile(header(1) + first + second + third);
+
+	// Parsing stops at the damaged record
+	CSettingsStore store(file_);
+	CPPUNIT_ASSERT(store.Load());
+	CPPUNIT_ASSERT(store.Values().size() == 1);
+	CPPUNIT_ASSERT(store.Values().at("a") == value(kind::text, "1"));
+}
+
+void CSettingsStoreTest::testDamagedTail()
+{
+	std::string const valid = header(1) + record(kind::text, "a", "1");
+	std::string const full = record(kind::text, "b", "2");
+
+	// Interrupted while writing the second record
+	WriteFile(valid + full.substr(0, full.size() - 3));
+
+	CSettingsStore store(file_);
+	CPPUNIT_ASSERT(store.Load());
+	CPPUNIT_ASSERT(store.Values().size() == 1);
+
+	// The next update overwrites the damaged tail
+	CPPUNIT_ASSERT(store.Update({{"c", value(kind::text, "3")}}));
+	CPPUNIT_ASSERT(ReadFile() == valid + record(kind::text, "c", "3"));
+
+	CSettingsStore other(file_);
+	CPPUNIT_ASSERT(other.Load());
+	CPPUNIT_ASSERT(other.Values().size() == 2);
+	CPPUNIT_ASSERT(other.Values().at("c") == value(kind::text, "3"));
+}
+
+void CSettingsStoreTest::testOtherWriters()
+{
+	CSettingsStore a(file_);
+	CPPUNIT_ASSERT(a.Replace({{"a", value(kind::text, "1")}}));
+
+	CSettingsStore b(file_);
+	CPPUNIT_ASSERT(b.Load());
+
+	CPPUNIT_ASSERT(a.Update({{"a", value(kind::text, "fromA")}, {"onlyA", value(kind::text, "1")}}));
+	CPPUNIT_ASSERT(b.Values().at("a") == value(kind::text, "1"));
+
+	// Updating replays what the other one has appended first
+	CPPUNIT_ASSERT(b.Update({{"onlyB", value(kind::text, "2")}}));
+	CPPUNIT_ASSERT(b.Values().size() == 3);
+	CPPUNIT_ASSERT(b.Values().at("a") == value(kind::text, "fromA"));
+
+	CPPUNIT_ASSERT(a.Update({{"onlyA", value(kind::erase, std::string())}}));
+	CPPUNIT_ASSERT(b.Refresh());
+	CPPUNIT_ASSERT(b.Values().size() == 2);
+	CPPUNIT_ASSERT(b.Values().find("onlyA") == b.Values().cend());
+	CPPUNIT_ASSERT(b.Values().at("onlyB") == value(kind::text, "2"));
+
+	CSettingsStore r(file_);
+	CPPUNIT_ASSERT(r.Load());
+	CPPUNIT_ASSERT(r.Values() == b.Values());
+}
+
+void CSettingsStoreTest::testReplaced()
+{
+	CSettingsStore a(file_);
+	CPPUNIT_ASSERT(a.Replace({{"a", value(kind::text, "1")}, {"b", value(kind::text, "2")}}));
+
+	CSettingsStore b(file_);
+	CPPUNIT_ASSERT(b.Load());
+
+	// A new generation gets read from the start
+	CPPUNIT_ASSERT(a.Replace({{"c", value(kind::text, "3")}}));
+	CPPUNIT_ASSERT(b.Refresh());
+	CPPUNIT_ASSERT(b.Values().size() == 1);
+	CPPUNIT_ASSERT(b.Values().at("c") == value(kind::text, "3"));
+
+	// Once the file is gone, updating writes a new one
+	std::remove(fz::to_string(file_).c_str());
+	CPPUNIT_ASSERT(!b.Refresh());
+	CPPUNIT_ASSERT(b.Update({{"d", value(kind::text, "4")}}));
+
+	CSettingsStore r(file_);
+	CPPUNIT_ASSERT(r.Load());
+	CPPUNIT_ASSERT(r.Values().size() == 2);
+	CPPUNIT_ASSERT(r.Values().at("d") == value(kind::text, "4"));
+}
+
+void CSettingsStoreTest::testCompact()
+{
+	CSettingsStore a(file_);
+	CPPUNIT_ASSERT(a.Replace({{"a", value(kind::text, "1")}}));
+
+	CSettingsStore b(file_);
+	CPPUNIT_ASSERT(b.Load());
+	CPPUNIT_ASSERT(b.Update({{"onlyB", value(kind::text, "yes")}}));
+
+	std::string const big(1000, 'x');
+	for (int i = 0; i < 300; ++i) {
+		CPPUNIT_ASSERT(a.Update({{"big", value(kind::text, big + std::to_string(i))}}));
+	}
+
+	// Mostly obsolete records got dropped, other writers' values kept
+	CPPUNIT_ASSERT(ReadFile().size() < 100 * big.size());
+	CSettingsStore r(file_);
+	CPPUNIT_ASSERT(r.Load());
+	CPPUNIT_ASSERT(r.Values().size() == 3);
+	CPPUNIT_ASSERT(r.Values().at("onlyB") == value(kind::text, "yes"));
+	CPPUNIT_ASSERT(r.Values().at("big") == value(kind::text, big + "299"));
+
+	// Appending after the other one has compacted
+	CPPUNIT_ASSERT(b.Update({{"after", value(kind::text, "1")}}));
+	CPPUNIT_ASSERT(b.Values().at("big") == value(kind::text, big + "299"));
+	CPPUNIT_ASSERT(r.Load());
+	CPPUNIT_ASSERT(r.Values().size() == 4);
+	CPPUNIT_ASSERT(r.Values().at("after") == value(kind::text, "1"));
+}
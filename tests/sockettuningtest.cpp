@@ -0,0 +1,150 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "socket_tuning.h"
+
+#include <xmlutils.h>
+
+#include <limits>
+#include <map>
+
+/*
+ * This testsuite asserts the correctness of the CTcpTuning class.
+ */
+
+class CTcpTuningTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CTcpTuningTest);
+	CPPUNIT_TEST(testDefaults);
+	CPPUNIT_TEST(testParse);
+	CPPUNIT_TEST(testInvalid);
+	CPPUNIT_TEST(testBufferSize);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testDefaults();
+	void testParse();
+	void testInvalid();
+	void testBufferSize();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CTcpTuningTest);
+
+namespace {
+class test_options final : public COptionsBase
+{
+public:
+	virtual int GetOptionVal(unsigned int) override { return 0; }
+	virtual std::wstring GetOption(unsigned int) override { return std::wstring(); }
+	virtual std::unique_ptr<pugi::xml_document> GetOptionXml(unsigned int) override { return nullptr; }
+
+	virtual bool SetOption(unsigned int, int) override { return false; }
+	virtual bool SetOption(unsigned int, std::wstring const&) override { return false; }
+	virtual bool SetOptionXml(unsigned int, pugi::xml_node const&) override { return false; }
+	virtual bool SetOptionXml(unsigned int, pugi::xml_document const&) override { return false; }
+};
+
+CServer make_server(std::map<std::string, std::wstring> const& parameters)
+{
+	CServer server(FTP, DEFAULT, L"ftp.example.com", 21);
+	for (auto const& p : parameters) {
+		server.SetExtraParameter(p.first, p.second);
+	}
+	return server;
+}
+}
+
+void CTcpTuningTest::testDefaults()
+{
+	test_options options;
+	CTcpTuning const tuning(make_server({}), options);
+
+	CPPUNIT_ASSERT(tuning.GetCongestion().empty());
+	CPPUNIT_ASSERT(tuning.GetBuffers() == CTcpTuning::buffers::options);
+	CPPUNIT_ASSERT(tuning.GetBandwidth() == 0);
+	CPPUNIT_ASSERT(tuning.GetNotsentLowat() == -1);
+	CPPUNIT_ASSERT(!tuning.GetQuickack());
+	CPPUNIT_ASSERT(tuning.GetBufferSize(20) == -1);
+}
+
+void CTcpTuningTest::testParse()
+{
+	test_options options;
+	CTcpTuning const tuning(make_server({
+		{"tcp_congestion", L"bbr"},
+		{"tcp_buffers", L"rtt"},
+		{"tcp_bandwidth", L"100"},
+		{"tcp_notsent_lowat", L"16384"},
+		{"tcp_quickack", L"1"}
+	}), options);
+
+	CPPUNIT_ASSERT(tuning.GetCongestion() == "bbr");
+	CPPUNIT_ASSERT(tuning.GetBuffers() == CTcpTuning::buffers::rtt);
+	CPPUNIT_ASSERT(tuning.GetBandwidth() == 12500000);
+	CPPUNIT_ASSERT(tuning.GetNotsentLowat() == 16384);
+	CPPUNIT_ASSERT(tuning.GetQuickack());
+
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_buffers", L"auto"}}), options).GetBuffers() == CTcpTuning::buffers::automatic);
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_notsent_lowat", L"0"}}), options).GetNotsentLowat() == 0);
+	CPPUNIT_ASSERT(!CTcpTuning(make_server({{"tcp_quickack", L"0"}}), options).GetQuickack());
+
+	// Largest accepted bandwidth, 1 Tbit/s
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_bandwidth", L"1000000"}}), options).GetBandwidth() == 125000000000ll);
+}
+
+void CTcpTuningTest::testInvalid()
+{
+	test_options options;
+
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_buffers", L"RTT"}}), options).GetBuffers() == CTcpTuning::buffers::options);
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_buffers", L"fast"}}), options).GetBuffers() == CTcpTuning::buffers::options);
+
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_bandwidth", L"0"}}), options).GetBandwidth() == 0);
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_bandwidth", L"-100"}}), options).GetBandwidth() == 0);
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_bandwidth", L"1000001"}}), options).GetBandwidth() == 0);
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_bandwidth", L"fast"}}), options).GetBandwidth() == 0);
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_bandwidth", L"10M"}}), options).GetBandwidth() == 0);
+
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_notsent_lowat", L"16k"}}), options).GetNotsentLowat() == -1);
+	CPPUNIT_ASSERT(CTcpTuning(make_server({{"tcp_notsent_lowat", L"-5"}}), options).GetNotsentLowat() < 0);
+
+	CPPUNIT_ASSERT(!CTcpTuning(make_server({{"tcp_quickack", L"yes"}}), options).GetQuickack());
+
+	// Parameters are only known to protocols using TCP tuning
+	CServer sftp(SFTP, DEFAULT, L"sftp.example.com", 22);
+	sftp.SetExtraParameter("tcp_buffers", L"rtt");
+	sftp.SetExtraParameter("tcp_bandwidth", L"100");
+	CTcpTuning const tuning(sftp, options);
+	CPPUNIT_ASSERT(tuning.GetBuffers() == CTcpTuning::buffers::options);
+	CPPUNIT_ASSERT(tuning.GetBandwidth() == 0);
+}
+
+void CTcpTuningTest::testBufferSize()
+{
+	test_options options;
+
+	// 100 Mbit/s
+	CTcpTuning const tuning(make_server({{"tcp_buffers", L"rtt"}, {"tcp_bandwidth", L"100"}}), options);
+
+	// Twice the bandwidth-delay product
+	CPPUNIT_ASSERT(tuning.GetBufferSize(20) == 500000);
+	CPPUNIT_ASSERT(tuning.GetBufferSize(100) == 2500000);
+
+	// Unknown round-trip time
+	CPPUNIT_ASSERT(tuning.GetBufferSize(0) == -1);
+	CPPUNIT_ASSERT(tuning.GetBufferSize(-1) == -1);
+
+	// Clamped to 64 KiB..64 MiB
+	CPPUNIT_ASSERT(tuning.GetBufferSize(1) == 64 * 1024);
+	CPPUNIT_ASSERT(tuning.GetBufferSize(10000) == 64 * 1024 * 1024);
+
+	CTcpTuning const fast(make_server({{"tcp_buffers", L"rtt"}, {"tcp_bandwidth", L"1000000"}}), options);
+	CPPUNIT_ASSERT(fast.GetBufferSize(1) == 64 * 1024 * 1024);
+	CPPUNIT_ASSERT(fast.GetBufferSize(std::numeric_limits<int>::max()) == 64 * 1024 * 1024);
+
+	CTcpTuning const slow(make_server({{"tcp_buffers", L"rtt"}, {"tcp_bandwidth", L"1"}}), options);
+	CPPUNIT_ASSERT(slow.GetBufferSize(20) == 64 * 1024);
+	CPPUNIT_ASSERT(slow.GetBufferSize(1000) == 250000);
+}
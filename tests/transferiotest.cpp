@@ -0,0 +1,117 @@
+#include <filezilla.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "transfer_io.h"
+
+#include <algorithm>
+#include <thread>
+
+/*
+ * This testsuite asserts the correctness of the readers and writers used
+ * for transfers that do not involve local files.
+ */
+
+class CTransferIOTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CTransferIOTest);
+	CPPUNIT_TEST(testMemory);
+	CPPUNIT_TEST(testPipe);
+	CPPUNIT_TEST(testPipeAbort);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void testMemory();
+	void testPipe();
+	void testPipeAbort();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CTransferIOTest);
+
+void CTransferIOTest::testMemory()
+{
+	memory_reader reader("0123456789");
+	CPPUNIT_ASSERT(reader.size() == 10);
+
+	char buf[4];
+	CPPUNIT_ASSERT(reader.read(buf, 4) == 4);
+	CPPUNIT_ASSERT(std::string(buf, 4) == "0123");
+
+	CPPUNIT_ASSERT(reader.seek(8));
+	CPPUNIT_ASSERT(reader.read(buf, 4) == 2);
+	CPPUNIT_ASSERT(std::string(buf, 2) == "89");
+	CPPUNIT_ASSERT(reader.read(buf, 4) == 0);
+	CPPUNIT_ASSERT(!reader.seek(11));
+
+	memory_writer writer(6);
+	CPPUNIT_ASSERT(writer.write("abc", 3));
+	CPPUNIT_ASSERT(writer.write("def", 3));
+	CPPUNIT_ASSERT(writer.data() == "abcdef");
+
+	// Over the limit
+	CPPUNIT_ASSERT(!writer.write("g", 1));
+}
+
+void CTransferIOTest::testPipe()
+{
+	std::string data;
+	for (int i = 0; i < 100000; ++i) {
+		data += static_cast<char>(i % 251);
+	}
+
+	// Smaller than the data, so that the writer has to wait for the reader
+	transfer_pipe pipe(data.size(), 1000);
+	auto writer = pipe.writer();
+	auto reader = pipe.reader();
+	CPPUNIT_ASSERT(reader->size() == static_cast<int64_t>(data.size()));
+
+	bool written = true;
+	std::thread t([&]() {
+		for (size_t i = 0; i < data.size(); i += 3000) {
+			written &= writer->write(data.c_str() + i, std::min(size_t(3000), data.size() - i));
+		}
+		written &= writer->finish();
+	});
+
+	std::string received;
+	char buf[777];
+	int64_t read;
+	while ((read = reader->read(buf, sizeof(buf))) > 0) {
+		received.append(buf, static_cast<size_t>(read));
+	}
+	t.join();
+
+	CPPUNIT_ASSERT(written);
+	CPPUNIT_ASSERT(read == 0);
+	CPPUNIT_ASSERT(received == data);
+}
+
+void CTransferIOTest::testPipeAbort()
+{
+	{
+		// Download got aborted, the upload must not see a complete file
+		transfer_pipe pipe;
+		auto reader = pipe.reader();
+		{
+			auto writer = pipe.writer();
+			CPPUNIT_ASSERT(writer->write("abc", 3));
+		}
+
+		char buf[10];
+		CPPUNIT_ASSERT(reader->read(buf, sizeof(buf)) == -1);
+	}
+
+	{
+		// Upload got aborted while the download waits for room in the pipe
+		transfer_pipe pipe(-1, 2);
+		auto writer = pipe.writer();
+		auto reader = pipe.reader();
+
+		bool written = true;
+		std::thread t([&]() {
+			written = writer->write("abcdef", 6);
+		});
+		reader->cancel();
+		t.join();
+
+		CPPUNIT_ASSERT(!written);
+	}
+}